@@ -24,7 +24,7 @@ void FileManager::setup(ConfigBase& config, const char* pConfigPath) {
     // Init
     _spiffsIsOk = false;
     _sdIsOk = false;
-    _cachedFileListValid = false;
+    invalidateFileCaches();
 
     // Get config
     String pathStr = "fileManager";
@@ -195,7 +195,9 @@ void FileManager::reformat(const String& fileSystemStr, String& respStr) {
     // Reformat - need to disable Watchdog timer while formatting
     // Watchdog is not enabled on core 1 in Arduino according to this
     // https://www.bountysource.com/issues/44690700-watchdog-with-system-reset
-    _cachedFileListValid = false;
+    xSemaphoreTake(_fileSysMutex, portMAX_DELAY);
+    invalidateFileCaches();
+    xSemaphoreGive(_fileSysMutex);
     disableCore0WDT();
     esp_err_t ret = esp_spiffs_format(NULL);
     enableCore0WDT();
@@ -212,23 +214,131 @@ bool FileManager::getFileInfo(const String& fileSystemStr, const String& filenam
     // Take mutex
     xSemaphoreTake(_fileSysMutex, portMAX_DELAY);
 
+    // Check cache
+    String rootFilename = getFilePath(nameOfFS, filename);
+    FileInfoCacheEntry* pEntry = NULL;
+    for (int i = 0; i < FILE_INFO_CACHE_ENTRIES; i++) {
+        if (_fileInfoCache[i]._rootFilename.equals(rootFilename)) {
+            pEntry = &_fileInfoCache[i];
+            break;
+        }
+    }
+    if (pEntry) {
+        _fileInfoCacheHits++;
+        pEntry->_lastUsedMs = millis();
+        bool exists = pEntry->_exists;
+        if (exists)
+            fileLength = pEntry->_fileLength;
+        xSemaphoreGive(_fileSysMutex);
+        return exists;
+    }
+
     // Check file exists
+    _fileInfoCacheMisses++;
     struct stat st;
-    String rootFilename = getFilePath(nameOfFS, filename);
+    bool exists = (stat(rootFilename.c_str(), &st) == 0) && S_ISREG(st.st_mode);
+
+    // Replace the least recently used (or an empty) cache entry
+    pEntry = &_fileInfoCache[0];
+    for (int i = 0; i < FILE_INFO_CACHE_ENTRIES; i++) {
+        if (_fileInfoCache[i]._rootFilename.length() == 0) {
+            pEntry = &_fileInfoCache[i];
+            break;
+        }
+        if (millis() - _fileInfoCache[i]._lastUsedMs > millis() - pEntry->_lastUsedMs)
+            pEntry = &_fileInfoCache[i];
+    }
+    pEntry->_rootFilename = rootFilename;
+    pEntry->_exists = exists;
+    pEntry->_fileLength = exists ? st.st_size : 0;
+    pEntry->_lastUsedMs = millis();
+    xSemaphoreGive(_fileSysMutex);
+    if (exists)
+        fileLength = st.st_size;
+    return exists;
+}
 
-    if (stat(rootFilename.c_str(), &st) != 0) {
-        xSemaphoreGive(_fileSysMutex);
+bool FileManager::getFileStatus(const String& fileSystemStr, const String& filename, String& rootFilename,
+                                int& fileLength, time_t& modTime) {
+    String nameOfFS;
+    if (!checkFileSystem(fileSystemStr, nameOfFS)) {
         return false;
     }
-    if (!S_ISREG(st.st_mode)) {
+
+    // Take mutex
+    xSemaphoreTake(_fileSysMutex, portMAX_DELAY);
+
+    // Check file exists
+    struct stat st;
+    rootFilename = getFilePath(nameOfFS, filename);
+    if ((stat(rootFilename.c_str(), &st) != 0) || !S_ISREG(st.st_mode)) {
         xSemaphoreGive(_fileSysMutex);
         return false;
     }
     xSemaphoreGive(_fileSysMutex);
     fileLength = st.st_size;
+    modTime = st.st_mtime;
     return true;
 }
 
+int FileManager::readFileBlock(const String& rootFilename, int filePos, uint8_t* pBuf, int maxLen) {
+    // Take mutex
+    xSemaphoreTake(_fileSysMutex, portMAX_DELAY);
+
+    // Open file and seek
+    FILE* pFile = fopen(rootFilename.c_str(), "rb");
+    if (!pFile) {
+        xSemaphoreGive(_fileSysMutex);
+        return -1;
+    }
+    if ((filePos != 0) && (fseek(pFile, filePos, SEEK_SET) != 0)) {
+        fclose(pFile);
+        xSemaphoreGive(_fileSysMutex);
+        return -1;
+    }
+
+    // Read
+    int readLen = fread((char*)pBuf, 1, maxLen, pFile);
+    fclose(pFile);
+    xSemaphoreGive(_fileSysMutex);
+    return readLen;
+}
+
+FILE* FileManager::writeFileOpen(const String& fileSystemStr, const String& filename) {
+    // Check file system supported
+    String nameOfFS;
+    if (!checkFileSystem(fileSystemStr, nameOfFS))
+        return NULL;
+
+    // Take mutex
+    xSemaphoreTake(_fileSysMutex, portMAX_DELAY);
+
+    // Open (truncating any existing file)
+    String rootFilename = getFilePath(nameOfFS, filename);
+    FILE* pFile = fopen(rootFilename.c_str(), "wb");
+    invalidateFileCaches();
+    xSemaphoreGive(_fileSysMutex);
+    return pFile;
+}
+
+bool FileManager::writeFileBlock(FILE* pFile, const uint8_t* pBuf, int len) {
+    if (!pFile)
+        return false;
+    xSemaphoreTake(_fileSysMutex, portMAX_DELAY);
+    size_t bytesWritten = fwrite(pBuf, 1, len, pFile);
+    xSemaphoreGive(_fileSysMutex);
+    return bytesWritten == size_t(len);
+}
+
+void FileManager::writeFileClose(FILE* pFile) {
+    if (!pFile)
+        return;
+    xSemaphoreTake(_fileSysMutex, portMAX_DELAY);
+    fclose(pFile);
+    invalidateFileCaches();
+    xSemaphoreGive(_fileSysMutex);
+}
+
 bool FileManager::getFilesJSON(const String& fileSystemStr, const String& folderStr, String& respStr) {
     // Check file system supported
     String nameOfFS;
@@ -426,14 +536,16 @@ bool FileManager::setFileContents(const String& fileSystemStr, const String& fil
     fclose(pFile);
 
     // Clean up
-    _cachedFileListValid = false;
+    invalidateFileCaches();
     xSemaphoreGive(_fileSysMutex);
     return bytesWritten == fileContents.length();
 }
 
 void FileManager::uploadAPIBlocksComplete() {
-    // Cached file list now invalid
-    _cachedFileListValid = false;
+    // Cached file list and info now invalid
+    xSemaphoreTake(_fileSysMutex, portMAX_DELAY);
+    invalidateFileCaches();
+    xSemaphoreGive(_fileSysMutex);
 }
 
 void FileManager::uploadAPIBlockHandler(const char* fileSystem, const String& req, const String& filename, int fileLength, size_t index,
@@ -475,6 +587,7 @@ void FileManager::uploadAPIBlockHandler(const char* fileSystem, const String& re
 
         // Rename
         rename(tmpRootFilename.c_str(), rootFilename.c_str());
+        invalidateFileCaches();
     }
 
     // Restore semaphore
@@ -498,7 +611,7 @@ bool FileManager::deleteFile(const String& fileSystemStr, const String& filename
         unlink(rootFilename.c_str());
     }
 
-    _cachedFileListValid = false;
+    invalidateFileCaches();
     xSemaphoreGive(_fileSysMutex);
     return true;
 }
@@ -628,6 +741,16 @@ String FileManager::getFileExtension(String& fileName) {
     return fileName.substring(dotPos + 1);
 }
 
+// Check file name extension (case insensitive) without allocating
+bool FileManager::hasFileExtension(const char* pFileName, unsigned int nameLen, const char* pExtn) {
+    // Find last .
+    unsigned int dotPos = nameLen;
+    while ((dotPos > 0) && (pFileName[dotPos - 1] != '.')) dotPos--;
+    if (dotPos == 0) return false;
+    unsigned int extnLen = nameLen - dotPos;
+    return (extnLen == strlen(pExtn)) && (strncasecmp(pFileName + dotPos, pExtn, extnLen) == 0);
+}
+
 // Get file system and check ok
 bool FileManager::checkFileSystem(const String& fileSystemStr, String& fsName) {
     // Check file system
@@ -656,6 +779,13 @@ bool FileManager::checkFileSystem(const String& fileSystemStr, String& fsName) {
     return false;
 }
 
+// Called when files are changed - must be called with the file system mutex held (or during setup)
+void FileManager::invalidateFileCaches() {
+    _cachedFileListValid = false;
+    for (int i = 0; i < FILE_INFO_CACHE_ENTRIES; i++)
+        _fileInfoCache[i]._rootFilename = "";
+}
+
 String FileManager::getFilePath(const String& nameOfFS, const String& filename) {
     // Check if filename already contains file system
     if ((filename.indexOf("spiffs/") >= 0) || (filename.indexOf("sd/") >= 0)) return (filename.startsWith("/") ? filename : ("/" + filename));
@@ -33,6 +33,20 @@ private:
     // Cached file list response
     String _cachedFileListResponse;
 
+    // Cached results of file info lookups (including files not found) so that repeated checks
+    // on the same names (e.g. when classifying work items) don't need to stat the file system
+    static const int FILE_INFO_CACHE_ENTRIES = 8;
+    struct FileInfoCacheEntry
+    {
+        String _rootFilename;
+        bool _exists;
+        int _fileLength;
+        uint32_t _lastUsedMs;
+    };
+    FileInfoCacheEntry _fileInfoCache[FILE_INFO_CACHE_ENTRIES];
+    int _fileInfoCacheHits;
+    int _fileInfoCacheMisses;
+
     // Mutex controlling access to file system
     SemaphoreHandle_t _fileSysMutex;
 
@@ -49,6 +63,8 @@ public:
         _chunkedFilePos = 0;
         _chunkedFileInProgress = false;
         _pSDCard = NULL;
+        _fileInfoCacheHits = 0;
+        _fileInfoCacheMisses = 0;
         _fileSysMutex = xSemaphoreCreateMutex();
     }
 
@@ -75,9 +91,30 @@ public:
     // Delete file on file system
     bool deleteFile(const String& fileSystemStr, const String& filename);
     
-    // Test file exists and get info
+    // Test file exists and get info - results are cached until files are changed
     bool getFileInfo(const String& fileSystemStr, const String& filename, int& fileLength);
 
+    // File info cache stats
+    void getFileInfoCacheStats(int& hits, int& misses)
+    {
+        hits = _fileInfoCacheHits;
+        misses = _fileInfoCacheMisses;
+    }
+
+    // Get the full path, length and modification time of a file - the path can be used with
+    // readFileBlock for access which is independent of the chunked file access
+    bool getFileStatus(const String& fileSystemStr, const String& filename, String& rootFilename,
+                int& fileLength, time_t& modTime);
+
+    // Read a block from a file at a position - returns bytes read (-1 on failure)
+    int readFileBlock(const String& rootFilename, int filePos, uint8_t* pBuf, int maxLen);
+
+    // Write a file incrementally (e.g. from another task) - each call takes the file system mutex
+    // and the cached file list and info are invalidated when the file is opened and closed
+    FILE* writeFileOpen(const String& fileSystemStr, const String& filename);
+    bool writeFileBlock(FILE* pFile, const uint8_t* pBuf, int len);
+    void writeFileClose(FILE* pFile);
+
     // Start access to a file in chunks
     bool chunkedFileStart(const String& fileSystemStr, const String& filename, bool readByLine);
 
@@ -87,11 +124,15 @@ public:
     // Get file name extension
     static String getFileExtension(String& filename);
 
+    // Check file name extension (case insensitive) without allocating
+    static bool hasFileExtension(const char* pFileName, unsigned int nameLen, const char* pExtn);
+
     // Read line from file
     char* readLineFromFile(char* pBuf, int maxLen, FILE* pFile);
 
 private:
     bool checkFileSystem(const String& fileSystemStr, String& fsName);
     String getFilePath(const String& nameOfFS, const String& filename);
+    void invalidateFileCaches();
 
 };
@@ -0,0 +1,92 @@
+// RBotFirmware
+// Rob Dobson 2016-18
+
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+
+// Single precision polynomial approximations for kinematics
+// These avoid the double precision libm paths which are slow on the ESP32 (no double FPU)
+// Maximum absolute errors (measured against double precision libm over the full input range):
+//    atan2       2.0e-6 radians (0.00012 degrees)
+//    sin, cos    5.0e-7 for |angle| <= 2*PI - for larger angles the error is dominated by the
+//                float representation of the angle itself (3e-5 at 100*PI)
+// For reference a single microstep of the theta axis is 1.6e-4 radians (38400 steps per rotation)
+class FastTrig
+{
+public:
+    static constexpr float PI_F = 3.14159265358979f;
+    static constexpr float HALF_PI_F = 1.57079632679490f;
+    static constexpr float TWO_PI_F = 6.28318530717959f;
+    static constexpr float TWO_OVER_PI_F = 0.636619772367581f;
+    static constexpr float RAD_TO_DEG_F = 57.2957795130823f;
+    static constexpr float DEG_TO_RAD_F = 0.0174532925199433f;
+
+    // Result in the range -PI to PI
+    static inline float atan2(float y, float x)
+    {
+        float absX = fabsf(x);
+        float absY = fabsf(y);
+        float maxXY = absX > absY ? absX : absY;
+        float minXY = absX > absY ? absY : absX;
+        if (maxXY == 0)
+            return 0;
+
+        // Minimax polynomial for atan on 0..1
+        float a = minXY / maxXY;
+        float s = a * a;
+        float r = (((((-0.01172120f * s + 0.05265332f) * s - 0.11643287f) * s
+                        + 0.19354346f) * s - 0.33262347f) * s + 0.99997726f) * a;
+
+        // Octant and quadrant
+        if (absY > absX)
+            r = HALF_PI_F - r;
+        if (x < 0)
+            r = PI_F - r;
+        return (y < 0) ? -r : r;
+    }
+
+    static inline void sinCos(float angleRad, float &sinOut, float &cosOut)
+    {
+        // Reduce to -PI/4..PI/4 and quadrant (two-part PI/2 for accuracy)
+        float quadF = angleRad * TWO_OVER_PI_F;
+        int32_t quad = int32_t(quadF + (quadF >= 0 ? 0.5f : -0.5f));
+        float r = (angleRad - float(quad) * 1.57079637050628662f) + float(quad) * 4.37113900018624e-8f;
+
+        // Polynomials
+        float r2 = r * r;
+        float sinR = r + r * r2 * (-1.66666667e-1f + r2 * (8.33333333e-3f + r2 * -1.98412698e-4f));
+        float cosR = 1.0f + r2 * (-0.5f + r2 * (4.16666667e-2f + r2 * (-1.38888889e-3f + r2 * 2.48015873e-5f)));
+
+        // Quadrant
+        switch (quad & 3)
+        {
+            case 0: sinOut = sinR; cosOut = cosR; break;
+            case 1: sinOut = cosR; cosOut = -sinR; break;
+            case 2: sinOut = -sinR; cosOut = -cosR; break;
+            default: sinOut = -cosR; cosOut = sinR; break;
+        }
+    }
+
+    static inline float sin(float angleRad)
+    {
+        float s, c;
+        sinCos(angleRad, s, c);
+        return s;
+    }
+
+    static inline float cos(float angleRad)
+    {
+        float s, c;
+        sinCos(angleRad, s, c);
+        return c;
+    }
+
+    // Wrap to 0 <= angle < 360
+    static inline float wrapDegrees(float angleDegrees)
+    {
+        float wrapped = angleDegrees - 360.0f * floorf(angleDegrees * (1.0f / 360.0f));
+        return (wrapped >= 360.0f) ? wrapped - 360.0f : wrapped;
+    }
+};
@@ -0,0 +1,154 @@
+// RBotFirmware
+// Rob Dobson 2016-18
+
+#pragma once
+
+#include "AxisValues.h"
+#include "RobotCommandArgs.h"
+
+// Compact move command used on the motion path from the evaluators through block splitting
+// and planning - plain data so copying is a small fixed size block
+// RobotCommandArgs remains the form used for status reporting, homing and the API
+struct MoveCmd
+{
+    // Flags
+    static constexpr uint8_t FLAG_STEPWISE = 0x01;
+    static constexpr uint8_t FLAG_FEEDRATE_VALID = 0x02;
+    static constexpr uint8_t FLAG_DONT_SPLIT = 0x04;
+    static constexpr uint8_t FLAG_ALLOW_OUT_OF_BOUNDS = 0x08;
+    static constexpr uint8_t FLAG_MORE_MOVES_COMING = 0x10;
+    // Arc (G2/G3) - clockwise if FLAG_ARC_CW
+    static constexpr uint8_t FLAG_ARC = 0x20;
+    static constexpr uint8_t FLAG_ARC_CW = 0x40;
+    // Set on split-up arc blocks whose start is within the arc (not the first block)
+    static constexpr uint8_t FLAG_ARC_JUNCTION = 0x80;
+    // Flags which vary between the blocks of a split-up move
+    static constexpr uint8_t BLOCK_FLAGS = FLAG_MORE_MOVES_COMING | FLAG_ARC_JUNCTION;
+
+    // Target in MM (or coordinate units before conversion) or in steps if stepwise
+    union
+    {
+        float _ptMM[RobotConsts::MAX_AXES];
+        int32_t _ptSteps[RobotConsts::MAX_AXES];
+    };
+    float _feedrate;
+    int32_t _numberedCommandIndex;
+    // Arc in the XY plane - centre as an offset from the start point (I, J) or, if non-zero,
+    // the radius (R - negative for arcs of more than 180 degrees)
+    // On split-up arc blocks the radius is always set (positive)
+    float _arcCentreOffset[2];
+    float _arcRadius;
+    // Endstop checks (AxisMinMaxBools value)
+    uint32_t _endstops;
+    // Axis validity bits (as AxisFloats)
+    uint8_t _validityFlags;
+    uint8_t _flags;
+    // RobotMoveTypeArg
+    uint8_t _moveType;
+
+    void clear()
+    {
+        for (int axisIdx = 0; axisIdx < RobotConsts::MAX_AXES; axisIdx++)
+            _ptSteps[axisIdx] = 0;
+        _feedrate = 0;
+        _arcCentreOffset[0] = 0;
+        _arcCentreOffset[1] = 0;
+        _arcRadius = 0;
+        _numberedCommandIndex = RobotConsts::NUMBERED_COMMAND_NONE;
+        _endstops = 0;
+        _validityFlags = 0;
+        _flags = 0;
+        _moveType = RobotMoveTypeArg_None;
+    }
+
+    // Flags
+    inline bool getFlag(uint8_t flag) const
+    {
+        return (_flags & flag) != 0;
+    }
+    inline void setFlag(uint8_t flag, bool val)
+    {
+        _flags = val ? (_flags | flag) : (_flags & ~flag);
+    }
+    inline bool isStepwise() const
+    {
+        return getFlag(FLAG_STEPWISE);
+    }
+    inline void setBlockFlags(uint8_t blockFlags)
+    {
+        _flags = (_flags & ~BLOCK_FLAGS) | (blockFlags & BLOCK_FLAGS);
+    }
+
+    // Axis values
+    inline bool isValid(int axisIdx) const
+    {
+        return (_validityFlags & (0x01 << axisIdx)) != 0;
+    }
+    void setAxisValMM(int axisIdx, float value)
+    {
+        if (axisIdx >= 0 && axisIdx < RobotConsts::MAX_AXES)
+        {
+            _ptMM[axisIdx] = value;
+            _validityFlags |= 0x01 << axisIdx;
+            setFlag(FLAG_STEPWISE, false);
+        }
+    }
+    void setAxisSteps(int axisIdx, int32_t value)
+    {
+        if (axisIdx >= 0 && axisIdx < RobotConsts::MAX_AXES)
+        {
+            _ptSteps[axisIdx] = value;
+            _validityFlags |= 0x01 << axisIdx;
+            setFlag(FLAG_STEPWISE, true);
+        }
+    }
+    void setPointMM(const AxisFloats &pt)
+    {
+        for (int axisIdx = 0; axisIdx < RobotConsts::MAX_AXES; axisIdx++)
+            _ptMM[axisIdx] = pt._pt[axisIdx];
+        _validityFlags = pt._validityFlags;
+    }
+    void getPointMM(AxisFloats &pt) const
+    {
+        for (int axisIdx = 0; axisIdx < RobotConsts::MAX_AXES; axisIdx++)
+            pt._pt[axisIdx] = _ptMM[axisIdx];
+        pt._validityFlags = _validityFlags;
+    }
+    void setFeedrate(float feedrate)
+    {
+        _feedrate = feedrate;
+        setFlag(FLAG_FEEDRATE_VALID, true);
+    }
+    AxisMinMaxBools getEndstopCheck() const
+    {
+        AxisMinMaxBools endstops;
+        endstops._uint = _endstops;
+        return endstops;
+    }
+
+    // Conversion from the general command form (used for homing moves)
+    void setFromArgs(RobotCommandArgs &args)
+    {
+        clear();
+        if (args.isStepwise())
+        {
+            for (int axisIdx = 0; axisIdx < RobotConsts::MAX_AXES; axisIdx++)
+                _ptSteps[axisIdx] = args.getPointSteps().vals[axisIdx];
+            _flags |= FLAG_STEPWISE;
+        }
+        else
+        {
+            for (int axisIdx = 0; axisIdx < RobotConsts::MAX_AXES; axisIdx++)
+                _ptMM[axisIdx] = args.getPointMM()._pt[axisIdx];
+        }
+        _validityFlags = args.getPointMM()._validityFlags;
+        if (args.isFeedrateValid())
+            setFeedrate(args.getFeedrate());
+        _numberedCommandIndex = args.getNumberedCommandIndex();
+        _endstops = args.getEndstopCheck().uintVal();
+        _moveType = args.getMoveType();
+        setFlag(FLAG_DONT_SPLIT, args.getDontSplitMove());
+        setFlag(FLAG_ALLOW_OUT_OF_BOUNDS, args.getAllowOutOfBounds());
+        setFlag(FLAG_MORE_MOVES_COMING, args.getMoreMovesComing());
+    }
+};
@@ -86,15 +86,36 @@ void RestAPIRobot::apiPostLEDConfigBody(String& reqStr, uint8_t *pData, size_t l
 void RestAPIRobot::apiExec(String &reqStr, String &respStr)
 {
     Log.notice("%sExec %s\n", MODULE_PREFIX, reqStr.c_str());
-    WorkItem workItem(RestAPIEndpoints::removeFirstArgStr(reqStr.c_str()).c_str());
-    _workManager.addWorkItem(workItem, respStr);
+    // Handled by the work manager's service loop
+    _workManager.postCommand(RestAPIEndpoints::removeFirstArgStr(reqStr.c_str()).c_str(), respStr);
 }
 
 void RestAPIRobot::apiPlayFile(String &reqStr, String &respStr)
 {
     Log.notice("%splayFile %s\n", MODULE_PREFIX, reqStr.c_str());
-    WorkItem workItem(RestAPIEndpoints::removeFirstArgStr(reqStr.c_str()).c_str());
-    _workManager.addWorkItem(workItem, respStr);
+    _workManager.postCommand(RestAPIEndpoints::removeFirstArgStr(reqStr.c_str()).c_str(), respStr);
+}
+
+void RestAPIRobot::apiIsrStats(String &reqStr, String &respStr)
+{
+    // motion/isrstats/reset returns the stats then clears them - handled by the work manager's
+    // service loop
+    String argStr = RestAPIEndpoints::getNthArgStr(reqStr.c_str(), 2);
+    String cmdStr = "motion_isrstats";
+    if (argStr.length() > 0)
+        cmdStr += "/" + argStr;
+    _workManager.postCommand(cmdStr.c_str(), respStr);
+}
+
+void RestAPIRobot::apiPipeline(String &reqStr, String &respStr)
+{
+    // motion/pipeline/N limits the snapshot to the first N blocks - handled by the work
+    // manager's service loop as the planner changes the pipeline there
+    String argStr = RestAPIEndpoints::getNthArgStr(reqStr.c_str(), 2);
+    String cmdStr = "motion_pipeline";
+    if (argStr.length() > 0)
+        cmdStr += "/" + argStr;
+    _workManager.postCommand(cmdStr.c_str(), respStr);
 }
 
 void RestAPIRobot::setup(RestAPIEndpoints &endpoints)
@@ -137,6 +158,16 @@ void RestAPIRobot::setup(RestAPIEndpoints &endpoints)
     endpoints.addEndpoint("status", RestAPIEndpointDef::ENDPOINT_CALLBACK, RestAPIEndpointDef::ENDPOINT_GET,
                             std::bind(&RestAPIRobot::apiQueryStatus, this, std::placeholders::_1, std::placeholders::_2),
                             "Query status");
+
+    // Motion ISR execution time stats
+    endpoints.addEndpoint("motion/isrstats", RestAPIEndpointDef::ENDPOINT_CALLBACK, RestAPIEndpointDef::ENDPOINT_GET,
+                            std::bind(&RestAPIRobot::apiIsrStats, this, std::placeholders::_1, std::placeholders::_2),
+                            "Motion ISR execution time histogram ... /reset to clear after reading");
+
+    // Motion pipeline snapshot
+    endpoints.addEndpoint("motion/pipeline", RestAPIEndpointDef::ENDPOINT_CALLBACK, RestAPIEndpointDef::ENDPOINT_GET,
+                            std::bind(&RestAPIRobot::apiPipeline, this, std::placeholders::_1, std::placeholders::_2),
+                            "Motion pipeline snapshot ... /N for first N blocks only");
                             
     //LED Strip
     endpoints.addEndpoint("settings/led", RestAPIEndpointDef::ENDPOINT_CALLBACK, RestAPIEndpointDef::ENDPOINT_GET,
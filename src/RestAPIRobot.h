@@ -34,5 +34,7 @@ class RestAPIRobot
     void apiPattern(String &reqStr, String &respStr);
     void apiSequence(String &reqStr, String &respStr);
     void apiPlayFile(String &reqStr, String &respStr);
+    void apiIsrStats(String &reqStr, String &respStr);
+    void apiPipeline(String &reqStr, String &respStr);
     void setup(RestAPIEndpoints &endpoints);
 };
@@ -21,6 +21,8 @@ void MotionBlock::clear()
     _entrySpeedMMps = 0;
     _exitSpeedMMps = 0;
     _debugStepDistMM = 0;
+    _distUM = 0;
+    _nominalTimeUS = 0;
     _isExecuting = false;
     _canExecute = false;
     _blockIsFollowed = false;
@@ -31,6 +33,7 @@ void MotionBlock::clear()
     _initialStepRatePerTTicks = 0;
     _maxStepRatePerTTicks = 0;
     _stepsBeforeDecel = 0;
+    _microstepShift = 0;
     _numberedCommandIndex = 0;
     _endStopsToCheck.none();
     for (int axisIdx = 0; axisIdx < RobotConsts::MAX_AXES; axisIdx++)
@@ -106,8 +109,9 @@ bool MotionBlock::prepareForStepping(AxesParams &axesParams, bool isStepwise)
     if (_isExecuting)
         return false;
 
-    // Find the max number of steps for any axis
-    uint32_t absMaxStepsForAnyAxis = abs(_stepsTotalMaybeNeg[_axisIdxWithMaxSteps]);
+    // Find the max number of steps (pulses in the block's microstep mode) for any axis
+    uint32_t absMaxStepsForAnyAxis = uint32_t(abs(_stepsTotalMaybeNeg[_axisIdxWithMaxSteps])) >> _microstepShift;
+    float maxStepRatePerSec = axesParams.getMaxStepRatePerSec(_axisIdxWithMaxSteps) / (1 << _microstepShift);
 
     // Check if stepwise movement
     float initialStepRatePerSec = 0;
@@ -120,8 +124,8 @@ bool MotionBlock::prepareForStepping(AxesParams &axesParams, bool isStepwise)
     {
         // Feedrate is in steps per second in this case
         float stepRatePerSec = _feedrate;
-        if (stepRatePerSec > axesParams.getMaxStepRatePerSec(_axisIdxWithMaxSteps))
-            stepRatePerSec = axesParams.getMaxStepRatePerSec(_axisIdxWithMaxSteps);
+        if (stepRatePerSec > maxStepRatePerSec)
+            stepRatePerSec = maxStepRatePerSec;
         initialStepRatePerSec = stepRatePerSec;
         finalStepRatePerSec = stepRatePerSec;
         maxAccStepsPerSec2 = stepRatePerSec;
@@ -131,13 +135,13 @@ bool MotionBlock::prepareForStepping(AxesParams &axesParams, bool isStepwise)
     else
     {
         // Get the initial step rate, final step rate and max acceleration for the axis with max steps
-        stepDistMM = fabsf(_moveDistPrimaryAxesMM / _stepsTotalMaybeNeg[_axisIdxWithMaxSteps]);
+        stepDistMM = fabsf(_moveDistPrimaryAxesMM / absMaxStepsForAnyAxis);
         initialStepRatePerSec = fabsf(_entrySpeedMMps / stepDistMM);
-        if (initialStepRatePerSec > axesParams.getMaxStepRatePerSec(_axisIdxWithMaxSteps))
-            initialStepRatePerSec = axesParams.getMaxStepRatePerSec(_axisIdxWithMaxSteps);
+        if (initialStepRatePerSec > maxStepRatePerSec)
+            initialStepRatePerSec = maxStepRatePerSec;
         finalStepRatePerSec = fabsf(_exitSpeedMMps / stepDistMM);
-        if (finalStepRatePerSec > axesParams.getMaxStepRatePerSec(_axisIdxWithMaxSteps))
-            finalStepRatePerSec = axesParams.getMaxStepRatePerSec(_axisIdxWithMaxSteps);
+        if (finalStepRatePerSec > maxStepRatePerSec)
+            finalStepRatePerSec = maxStepRatePerSec;
         maxAccStepsPerSec2 = fabsf(axesParams.getMaxAccel(_axisIdxWithMaxSteps) / stepDistMM);
 
         // Calculate the distance decelerating and ensure within bounds
@@ -163,8 +167,8 @@ bool MotionBlock::prepareForStepping(AxesParams &axesParams, bool isStepwise)
 
         // Find max possible rate for axis with max steps
         axisMaxStepRatePerSec = fabsf(_feedrate / stepDistMM);
-        if (axisMaxStepRatePerSec > axesParams.getMaxStepRatePerSec(_axisIdxWithMaxSteps))
-            axisMaxStepRatePerSec = axesParams.getMaxStepRatePerSec(_axisIdxWithMaxSteps);
+        if (axisMaxStepRatePerSec > maxStepRatePerSec)
+            axisMaxStepRatePerSec = maxStepRatePerSec;
 
         // See if max speed will be reached
         uint32_t stepsToMaxSpeed =
@@ -207,6 +211,26 @@ void MotionBlock::debugShowBlkHead()
     Log.notice("#i EntMMps ExtMMps StTot0 StTot1 StTot2 St>Dec    Init     (perTT)      Pk     (perTT)     Fin     (perTT)     Acc     (perTT) UnitVecMax   FeedRtMMps StepDistMM  MaxStepRate\n");
 }
 
+const char *MotionBlock::getSnapshotFields()
+{
+    return "[\"entry\",\"exit\",\"maxEntry\",\"feedrate\",\"distMM\",\"steps0\",\"steps1\",\"steps2\","
+           "\"stepsBeforeDecel\",\"initRate\",\"maxRate\",\"finalRate\",\"accRate\",\"stepDistMM\",\"usStepShift\",\"flags\"]";
+}
+
+String MotionBlock::getSnapshotJSON()
+{
+    // Flags: 1 executing, 2 can execute, 4 followed
+    int flags = (_isExecuting ? 1 : 0) | (_canExecute ? 2 : 0) | (_blockIsFollowed ? 4 : 0);
+    char tmpBuf[200];
+    snprintf(tmpBuf, sizeof(tmpBuf), "[%.2f,%.2f,%.2f,%.2f,%.3f,%d,%d,%d,%u,%u,%u,%u,%u,%.6f,%d,%d]",
+                _entrySpeedMMps, _exitSpeedMMps, _maxEntrySpeedMMps, _feedrate, _moveDistPrimaryAxesMM,
+                getStepsToTarget(0), getStepsToTarget(1), getStepsToTarget(2),
+                _stepsBeforeDecel, _initialStepRatePerTTicks, _maxStepRatePerTTicks,
+                _finalStepRatePerTTicks, _accStepsPerTTicksPerMS, _debugStepDistMM,
+                _microstepShift, flags);
+    return tmpBuf;
+}
+
 void MotionBlock::debugShowBlock(int elemIdx, AxesParams &axesParams)
 {
     char tmpBuf[200];
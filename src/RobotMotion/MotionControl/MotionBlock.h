@@ -40,6 +40,10 @@ public:
     float _exitSpeedMMps;
     // Step distance in MM
     double _debugStepDistMM;
+    // Distance and time at the requested feedrate for motion stats (integers as the stats
+    // are accumulated in the ISR)
+    uint32_t _distUM;
+    uint32_t _nominalTimeUS;
     // End-stops to test
     AxisMinMaxBools _endStopsToCheck;
     // Numbered command index - to help keep track of block execution from other processes
@@ -62,6 +66,10 @@ public:
     int _axisIdxWithMaxSteps;
     uint32_t _stepsBeforeDecel;
 
+    // Microstep mode for the block - step counts above are in configured microsteps and
+    // each step pulse moves (1 << _microstepShift) of them
+    uint8_t _microstepShift;
+
     // Stepping acceleration/deceleration profile
     uint32_t _initialStepRatePerTTicks;
     uint32_t _maxStepRatePerTTicks;
@@ -86,6 +94,10 @@ public:
     // We now compute the stepping parameters to make motion happen
     bool prepareForStepping(AxesParams &axesParams, bool isStepwise);
 
+    // Compact JSON array of the block's planning and stepping values (see getSnapshotFields)
+    String getSnapshotJSON();
+    static const char *getSnapshotFields();
+
     // Debug
     void debugShowBlkHead();
     void debugShowBlock(int elemIdx, AxesParams &axesParams);
@@ -19,9 +19,14 @@ MotionHelper::MotionHelper() :
 {
     // Init
     _isPaused = false;
+    _stopRequested = false;
+    _stopRequestTimeMs = 0;
     _moveRelative = false;
     _blockDistanceMM = 0;
     _allowAllOutOfBounds = false;
+    _statsMinFreeHeap = 0xffffffff;
+    _statsHeapCheckMs = 0;
+    _isDryRun = false;
     // Clear axis current location
     _lastCommandedAxisPos.clear();
     _rampGenerator.resetTotalStepPosition();
@@ -31,6 +36,12 @@ MotionHelper::MotionHelper() :
     _correctStepOverflowFn = NULL;
     // Handling of splitting-up of motion into smaller blocks
     _blocksToAddTotal = 0;    
+    _blocksToAddMoveCmd.clear();
+    _blocksToAddIsArc = false;
+    _arcChordToleranceMM = arcChordToleranceMM_default;
+    // Microstep switching
+    _fullStepPhaseValid = false;
+    _fullStepPhaseCheckMs = 0;
     // Init callbacks
     _ptToActuatorFn = nullptr;
     _actuatorToPtFn = nullptr;
@@ -75,8 +86,11 @@ void MotionHelper::configure(const char *robotConfigJSON)
     _blockDistanceMM = float(RdJson::getDouble("blockDistanceMM", blockDistanceMM_default, robotGeom.c_str()));
     _allowAllOutOfBounds = bool(RdJson::getLong("allowOutOfBounds", false, robotGeom.c_str()));
     float junctionDeviation = float(RdJson::getDouble("junctionDeviation", junctionDeviation_default, robotGeom.c_str()));
-    Log.notice("%sconfigMotionPipeline len %d, blockDistMM %F (0=no-max), allowOoB %s, jnDev %F\n", MODULE_PREFIX,
-               pipelineLen, _blockDistanceMM, _allowAllOutOfBounds ? "Y" : "N", junctionDeviation);
+    _arcChordToleranceMM = float(RdJson::getDouble("arcChordTolMM", arcChordToleranceMM_default, robotGeom.c_str()));
+    if (_arcChordToleranceMM <= 0)
+        _arcChordToleranceMM = arcChordToleranceMM_default;
+    Log.notice("%sconfigMotionPipeline len %d, blockDistMM %F (0=no-max), allowOoB %s, jnDev %F, arcTolMM %F\n", MODULE_PREFIX,
+               pipelineLen, _blockDistanceMM, _allowAllOutOfBounds ? "Y" : "N", junctionDeviation, _arcChordToleranceMM);
 
     // Pipeline length and block size
     _motionPipeline.init(pipelineLen);
@@ -97,20 +111,42 @@ void MotionHelper::configure(const char *robotConfigJSON)
         if (_axesParams.configureAxis(robotGeom.c_str(), axisIdx, axisJSON))
         {
             // Configure ramp generator - motors and end-stops
-            _rampGenerator.configureAxis(axisIdx, axisJSON.c_str());
+            if (!_isDryRun)
+                _rampGenerator.configureAxis(axisIdx, axisJSON.c_str());
         }
     }
 
+    axesConfigured();
+
     // Set the robot attributes
     if (_setRobotAttributes)
         _setRobotAttributes(_axesParams, _robotAttributes);
 
+    // A dry-run instance only plans - the hardware is left as configured by the live instance
+    if (_isDryRun)
+    {
+        _motionPlanner.configureMicrostepSwitch(0, 0, 0, 0);
+        _rampGenerator.configure(false);
+        _lastCommandedAxisPos.clear();
+        return;
+    }
+
     // Homing
     _motionHoming.configure(robotGeom.c_str());    
 
     // Trinamic controller
     _trinamicsController.configure(robotGeom.c_str());
 
+    // Speed-dependent microstep switching
+    if (_trinamicsController.isMicrostepSwitchEnabled())
+        _motionPlanner.configureMicrostepSwitch(_trinamicsController.getHighSpeedMicrostepShift(),
+                    _trinamicsController.getHighSpeedStepRatePerSec(),
+                    _trinamicsController.getMicrosteps(),
+                    _trinamicsController.getNumMicrostepSwitchAxes());
+    else
+        _motionPlanner.configureMicrostepSwitch(0, 0, 0, 0);
+    _fullStepPhaseValid = false;
+
     // Motor enabler
     _motorEnabler.configure(robotGeom.c_str());
 
@@ -155,6 +191,7 @@ void MotionHelper::stop()
     _rampGenerator.stop();
     _trinamicsController.stop();
     _motionPipeline.clear();
+    _motionPlanner.setCurMicrostepShift(_rampGenerator.getAppliedMicrostepShift());
     //pause(false);
     setCurPosActualPosition();
  }
@@ -173,8 +210,7 @@ void MotionHelper::setCurPosActualPosition()
     AxisInt32s actuatorPos;
     _rampGenerator.getTotalStepPosition(actuatorPos);
     AxisFloats curPosMM;
-    if (_actuatorToPtFn)
-        _actuatorToPtFn(actuatorPos, curPosMM, _lastCommandedAxisPos, _axesParams);
+    actuatorToPt(actuatorPos, curPosMM);
     _lastCommandedAxisPos._axisPositionMM = curPosMM;
     _lastCommandedAxisPos._stepsFromHome = actuatorPos;
 }
@@ -196,8 +232,7 @@ void MotionHelper::getCurStatus(RobotCommandArgs &args)
     args.setPointSteps(curActuatorPos);
     // Use reverse kinematics to get location
     AxisFloats curMMPos;
-    if (_actuatorToPtFn)
-        _actuatorToPtFn(curActuatorPos, curMMPos, _lastCommandedAxisPos, _axesParams);
+    actuatorToPt(curActuatorPos, curMMPos);
     args.setPointMM(curMMPos);
     // Get end-stop values
     AxisMinMaxBools endstops;
@@ -225,25 +260,34 @@ void MotionHelper::goHome(RobotCommandArgs &args)
     _motionHoming.homingStart(args);
 }
 
-// Command the robot to move (adding a command to the pipeline of motion)
+// Command the robot to move using the general command form (e.g. homing)
 bool MotionHelper::moveTo(RobotCommandArgs &args)
+{
+    MoveCmd moveCmd;
+    moveCmd.setFromArgs(args);
+    return moveTo(moveCmd);
+}
+
+// Command the robot to move (adding a command to the pipeline of motion)
+bool MotionHelper::moveTo(MoveCmd &moveCmd)
 {
     // Handle stepwise motion
-    if (args.isStepwise())
+    if (moveCmd.isStepwise())
     {
-        return _motionPlanner.moveToStepwise(args, _lastCommandedAxisPos, _axesParams, _motionPipeline);
+        return _motionPlanner.moveToStepwise(moveCmd, _lastCommandedAxisPos, _axesParams, _motionPipeline);
     }
     // Convert coordinates if required
     // Convert coords to MM (in-place conversion)
     if (_convertCoordsFn)
-        _convertCoordsFn(args, _axesParams);
+        _convertCoordsFn(moveCmd, _axesParams);
     // Fill in the destPos for axes for which values not specified
     // Handle relative motion override if present
-    AxisFloats destPos = args.getPointMM();
+    AxisFloats destPos;
+    moveCmd.getPointMM(destPos);
     bool includeDist[RobotConsts::MAX_AXES];
     for (int i = 0; i < RobotConsts::MAX_AXES; i++)
     {
-        if (!args.isValid(i))
+        if (!moveCmd.isValid(i))
         {
             destPos.setVal(i, _lastCommandedAxisPos._axisPositionMM.getVal(i));
 #ifdef DEBUG_MOTION_HELPER
@@ -257,10 +301,10 @@ bool MotionHelper::moveTo(RobotCommandArgs &args)
             // Check relative motion - override current options if this command
             // explicitly states a moveType
             bool moveRelative = _moveRelative;
-            if (args.getMoveType() != RobotMoveTypeArg_None)
-                moveRelative = (args.getMoveType() == RobotMoveTypeArg_Relative);
+            if (moveCmd._moveType != RobotMoveTypeArg_None)
+                moveRelative = (moveCmd._moveType == RobotMoveTypeArg_Relative);
             if (moveRelative)
-                destPos.setVal(i, _lastCommandedAxisPos._axisPositionMM.getVal(i) + args.getValMM(i));
+                destPos.setVal(i, _lastCommandedAxisPos._axisPositionMM.getVal(i) + moveCmd._ptMM[i]);
 #ifdef DEBUG_MOTION_HELPER
             Log.notice("%smoveTo ax %d, pos %F relative %s\n", MODULE_PREFIX, 
                     i, 
@@ -276,13 +320,18 @@ bool MotionHelper::moveTo(RobotCommandArgs &args)
 
     // Ensure at least one block
     int numBlocks = 1;
-    if (_blockDistanceMM > 0.01f && !args.getDontSplitMove())
+    if (_blockDistanceMM > 0.01f && !moveCmd.getFlag(MoveCmd::FLAG_DONT_SPLIT))
         numBlocks = int(ceil(lineLen / _blockDistanceMM));
     if (numBlocks == 0)
         numBlocks = 1;
 
+    // Arcs
+    _blocksToAddIsArc = false;
+    if (moveCmd.getFlag(MoveCmd::FLAG_ARC) && !setupArc(moveCmd, destPos, numBlocks))
+        return false;
+
     // Setup for adding blocks to the pipe
-    _blocksToAddCommandArgs = args;
+    _blocksToAddMoveCmd = moveCmd;
     _blocksToAddStartPos = _lastCommandedAxisPos._axisPositionMM;
     _blocksToAddDelta = (destPos - _lastCommandedAxisPos._axisPositionMM) / float(numBlocks);
     _blocksToAddEndPos = destPos;
@@ -294,6 +343,85 @@ bool MotionHelper::moveTo(RobotCommandArgs &args)
     return true;
 }
 
+// Setup generation of blocks along an arc in the XY plane from the last commanded position to destPos
+// The number of blocks is increased if needed to keep each within the chord tolerance of the arc
+bool MotionHelper::setupArc(MoveCmd &moveCmd, AxisFloats &destPos, int &numBlocks)
+{
+    float startX = _lastCommandedAxisPos._axisPositionMM._pt[0];
+    float startY = _lastCommandedAxisPos._axisPositionMM._pt[1];
+    float deltaX = destPos._pt[0] - startX;
+    float deltaY = destPos._pt[1] - startY;
+    bool isClockwise = moveCmd.getFlag(MoveCmd::FLAG_ARC_CW);
+
+    // Centre offset from the start
+    float centreOffsetX = moveCmd._arcCentreOffset[0];
+    float centreOffsetY = moveCmd._arcCentreOffset[1];
+    if (moveCmd._arcRadius != 0)
+    {
+        // Radius form - the centre is on the perpendicular bisector of the chord
+        float radius = moveCmd._arcRadius;
+        float chordLenSq = deltaX * deltaX + deltaY * deltaY;
+        float hSq = 4 * radius * radius - chordLenSq;
+        if (chordLenSq == 0 || hSq < -_arcChordToleranceMM)
+        {
+            Log.warning("%sarc radius %F too small for chord\n", MODULE_PREFIX, radius);
+            return false;
+        }
+        float hDivChord = -sqrtf(fmaxf(hSq, 0)) / sqrtf(chordLenSq);
+        if (!isClockwise)
+            hDivChord = -hDivChord;
+        if (radius < 0)
+            hDivChord = -hDivChord;
+        centreOffsetX = 0.5f * (deltaX - deltaY * hDivChord);
+        centreOffsetY = 0.5f * (deltaY + deltaX * hDivChord);
+    }
+
+    // Radius vectors from the centre to the start and end
+    float startVecX = -centreOffsetX;
+    float startVecY = -centreOffsetY;
+    float endVecX = deltaX - centreOffsetX;
+    float endVecY = deltaY - centreOffsetY;
+    float radius = sqrtf(startVecX * startVecX + startVecY * startVecY);
+    if (radius < MotionBlock::MINIMUM_MOVE_DIST_MM)
+        return false;
+
+    // Angle swept (a full circle if the start and end coincide)
+    float sweepAngle = FastTrig::atan2(startVecX * endVecY - startVecY * endVecX, startVecX * endVecX + startVecY * endVecY);
+    if (isClockwise && sweepAngle >= -1e-6f)
+        sweepAngle -= FastTrig::TWO_PI_F;
+    else if (!isClockwise && sweepAngle <= 1e-6f)
+        sweepAngle += FastTrig::TWO_PI_F;
+
+    // Blocks needed for the chord tolerance (chord half-length from the sagitta)
+    float arcLen = fabsf(sweepAngle) * radius;
+    float tolerance = fminf(_arcChordToleranceMM, radius);
+    float maxChordLen = 2 * sqrtf(tolerance * (2 * radius - tolerance));
+    int arcBlocks = int(ceilf(arcLen / maxChordLen));
+    if (_blockDistanceMM > 0.01f && !moveCmd.getFlag(MoveCmd::FLAG_DONT_SPLIT))
+        arcBlocks = max(arcBlocks, int(ceilf(arcLen / _blockDistanceMM)));
+    numBlocks = max(arcBlocks, 1);
+
+    // Setup the rotation
+    _blocksToAddIsArc = true;
+    _blocksToAddArcCentre[0] = startX + centreOffsetX;
+    _blocksToAddArcCentre[1] = startY + centreOffsetY;
+    _blocksToAddArcRadiusVec[0] = startVecX;
+    _blocksToAddArcRadiusVec[1] = startVecY;
+    _blocksToAddArcRadius = radius;
+    _blocksToAddArcStartAngle = FastTrig::atan2(startVecY, startVecX);
+    _blocksToAddArcAnglePerBlock = sweepAngle / numBlocks;
+    FastTrig::sinCos(_blocksToAddArcAnglePerBlock, _blocksToAddArcSinPerBlock, _blocksToAddArcCosPerBlock);
+
+    // Blocks carry the radius for the planner
+    moveCmd._arcRadius = radius;
+
+#ifdef DEBUG_MOTION_HELPER
+    Log.notice("%sarc centre %F,%F radius %F sweep %F blocks %d\n", MODULE_PREFIX,
+               _blocksToAddArcCentre[0], _blocksToAddArcCentre[1], radius, sweepAngle, numBlocks);
+#endif
+    return true;
+}
+
 // A single moveTo command can be split into blocks - this function checks if such
 // splitting is in progress and adds the split-up motion blocks accordingly
 void MotionHelper::blocksToAddProcess()
@@ -301,31 +429,18 @@ void MotionHelper::blocksToAddProcess()
     // Check if we can add anything to the pipeline
     while (_motionPipeline.canAccept())
     {
-        // Check if any blocks remain to be expanded out
-        if (_blocksToAddTotal <= 0)
-            return;
-
         // Add to pipeline any blocks that are waiting to be expanded out
-        AxisFloats nextBlockDest = _blocksToAddStartPos + _blocksToAddDelta * float(_blocksToAddCurBlock + 1);
-
-        // If last block then just use end point coords
-        if (_blocksToAddCurBlock + 1 >= _blocksToAddTotal)
-            nextBlockDest = _blocksToAddEndPos;
-
-        // Bump position
-        _blocksToAddCurBlock++;
-
-        // Check if done
-        if (_blocksToAddCurBlock >= _blocksToAddTotal)
-            _blocksToAddTotal = 0;
+        AxisFloats nextBlockDest;
+        uint8_t blockFlags = 0;
+        if (!blocksToAddNext<RobotConsts::MAX_AXES>(nextBlockDest, blockFlags))
+            return;
 
         // Prepare add to planner
-        _blocksToAddCommandArgs.setPointMM(nextBlockDest);
-        _blocksToAddCommandArgs.setMoreMovesComing(_blocksToAddTotal != 0);
-
+        _blocksToAddMoveCmd.setPointMM(nextBlockDest);
+        _blocksToAddMoveCmd.setBlockFlags(blockFlags);
 
         // Add to planner
-        addToPlanner(_blocksToAddCommandArgs);
+        addToPlanner(_blocksToAddMoveCmd);
 
         // Enable motors
          if (!_isPaused) {
@@ -335,38 +450,55 @@ void MotionHelper::blocksToAddProcess()
 }
 
 // Add a movement to the pipeline using the planner which computes suitable motion
-bool MotionHelper::addToPlanner(RobotCommandArgs &args)
+bool MotionHelper::addToPlanner(MoveCmd &moveCmd)
 {
     // Check we are not stopping
     if (_stopRequested)
         return false;
             
     // Convert the move to actuator coordinates
+    AxisFloats targetPt;
+    moveCmd.getPointMM(targetPt);
     AxisFloats actuatorCoords;
-    bool moveOk = false;
-    if (_ptToActuatorFn)
-        moveOk = _ptToActuatorFn(args.getPointMM(), actuatorCoords, _lastCommandedAxisPos, _axesParams,
-                    args.getAllowOutOfBounds() || _allowAllOutOfBounds);
+    bool moveOk = ptToActuator(targetPt, actuatorCoords,
+                    moveCmd.getFlag(MoveCmd::FLAG_ALLOW_OUT_OF_BOUNDS) || _allowAllOutOfBounds);
 
     // Plan the move
     if (moveOk)
     {
-        moveOk = _motionPlanner.moveTo(args, actuatorCoords, _lastCommandedAxisPos, _axesParams, _motionPipeline);
+        moveOk = _motionPlanner.moveTo(moveCmd, actuatorCoords, _lastCommandedAxisPos, _axesParams, _motionPipeline);
     }
     if (moveOk)
     {
         // Update axisMotion
-        _lastCommandedAxisPos._axisPositionMM = args.getPointMM();
+        _lastCommandedAxisPos._axisPositionMM = targetPt;
 
         // Correct overflows
-        if (_correctStepOverflowFn)
-        {
-            _correctStepOverflowFn(_lastCommandedAxisPos, _axesParams);
-        }            
+        correctStepOverflow();
     }
     return moveOk;
 }
 
+// Coordinate transforms through the function pointers
+bool MotionHelper::ptToActuator(AxisFloats &targetPt, AxisFloats &outActuator, bool allowOutOfBounds)
+{
+    if (!_ptToActuatorFn)
+        return false;
+    return _ptToActuatorFn(targetPt, outActuator, _lastCommandedAxisPos, _axesParams, allowOutOfBounds);
+}
+
+void MotionHelper::actuatorToPt(AxisInt32s &actuatorPos, AxisFloats &outPt)
+{
+    if (_actuatorToPtFn)
+        _actuatorToPtFn(actuatorPos, outPt, _lastCommandedAxisPos, _axesParams);
+}
+
+void MotionHelper::correctStepOverflow()
+{
+    if (_correctStepOverflowFn)
+        _correctStepOverflowFn(_lastCommandedAxisPos, _axesParams);
+}
+
 // Called regularly to allow the MotionHelper to do background work such as
 // adding split-up blocks to the pipeline and checking if motors should be
 // disabled after a period of no motion
@@ -381,12 +513,16 @@ void MotionHelper::service()
             _rampGenerator.stop();
             _trinamicsController.stop();
             _motionPipeline.clear();
+            _motionPlanner.setCurMicrostepShift(_rampGenerator.getAppliedMicrostepShift());
             pause(false);
             setCurPosActualPosition();
             _stopRequested = false;
         }
     }
 
+    // Microstep mode changes and full-step phase calibration
+    microstepSwitchService();
+
     // Call process on motion actuator - only really used for testing as
     // motion is handled by ISR
     _rampGenerator.process();
@@ -394,6 +530,15 @@ void MotionHelper::service()
     // Process any split-up blocks to be added to the pipeline
     blocksToAddProcess();
 
+    // Pattern stats heap check
+    if (Utils::isTimeout(millis(), _statsHeapCheckMs, STATS_HEAP_CHECK_MS))
+    {
+        _statsHeapCheckMs = millis();
+        uint32_t freeHeap = ESP.getFreeHeap();
+        if (_statsMinFreeHeap > freeHeap)
+            _statsMinFreeHeap = freeHeap;
+    }
+
     // Service homing
     _motionHoming.service(_axesParams);
 
@@ -413,6 +558,52 @@ void MotionHelper::setCurPositionAsHome(int axisIdx)
     _lastCommandedAxisPos._axisPositionMM.setVal(axisIdx, _axesParams.getHomeOffsetVal(axisIdx));
     _lastCommandedAxisPos._stepsFromHome.setVal(axisIdx, _axesParams.gethomeOffSteps(axisIdx));
     _rampGenerator.setTotalStepPosition(axisIdx, _axesParams.gethomeOffSteps(axisIdx));
+    invalidateFullStepPhase();
+}
+
+// Apply microstep mode changes requested by the ramp generator at block boundaries and, when idle,
+// find the step positions at which the drivers are on a full step
+void MotionHelper::microstepSwitchService()
+{
+    int requestedMicrostepShift = _rampGenerator.getRequestedMicrostepShift();
+    if (requestedMicrostepShift >= 0)
+    {
+        if (!_trinamicsController.setMicrostepShift(requestedMicrostepShift))
+            Log.warning("%smicrostep mode %d could not be set\n", MODULE_PREFIX, requestedMicrostepShift);
+        _rampGenerator.setAppliedMicrostepShift(requestedMicrostepShift);
+    }
+
+    // Full-step phase is measured with the motors stationary - once known it is checked again
+    // whenever motion has stopped at a new position
+    if (!_trinamicsController.isMicrostepSwitchEnabled())
+        return;
+    if (!isIdle() || (_blocksToAddTotal != 0) || _motionHoming.isHomingInProgress())
+        return;
+    if (!Utils::isTimeout(millis(), _fullStepPhaseCheckMs, FULL_STEP_PHASE_CHECK_MS))
+        return;
+    AxisInt32s actuatorPos;
+    _rampGenerator.getTotalStepPosition(actuatorPos);
+    if (_fullStepPhaseValid && (actuatorPos == _fullStepPhaseSamplePos))
+        return;
+    _fullStepPhaseCheckMs = millis();
+    _fullStepPhaseSamplePos = actuatorPos;
+    _trinamicsController.calibrateFullStepPhase(actuatorPos);
+    _fullStepPhaseValid = true;
+    for (int axisIdx = 0; axisIdx < _trinamicsController.getNumMicrostepSwitchAxes(); axisIdx++)
+    {
+        int32_t phase = -1;
+        if (!_trinamicsController.getFullStepPhase(axisIdx, phase))
+            _fullStepPhaseValid = false;
+        _motionPlanner.setFullStepPhase(axisIdx, phase);
+    }
+}
+
+void MotionHelper::invalidateFullStepPhase()
+{
+    _fullStepPhaseValid = false;
+    _trinamicsController.invalidateFullStepPhase();
+    for (int axisIdx = 0; axisIdx < RobotConsts::MAX_AXES; axisIdx++)
+        _motionPlanner.setFullStepPhase(axisIdx, -1);
 }
 
 // Debug helper methods
@@ -431,6 +622,61 @@ String MotionHelper::getDebugStr()
     return _rampGenerator.getDebugStr();
 }
 
+// Dry-run - add split-up blocks to the pipeline and execute blocks (see RampGenerator::dryRunExecute)
+// returning the time taken by the executed blocks
+float MotionHelper::dryRunService(bool flush)
+{
+    // Blocks of a split move still to be added are planned into the pipeline before flushing (so
+    // the move doesn't stop where the pipeline happened to end)
+    blocksToAddProcess();
+    return _rampGenerator.dryRunExecute(flush && (_blocksToAddTotal == 0));
+}
+
+// Pattern stats - motion (ISR), planning time and heap
+void MotionHelper::resetPatternStats(int cmdIdxFirst, int cmdIdxLast)
+{
+    if (cmdIdxFirst == RobotConsts::NUMBERED_COMMAND_NONE)
+        _rampGenerator.getMotionStats().reset();
+    else
+        _rampGenerator.getMotionStats().resetAtCmdIdx(cmdIdxFirst, cmdIdxLast);
+    _motionPlanner.resetStats();
+    _statsMinFreeHeap = ESP.getFreeHeap();
+}
+
+String MotionHelper::getPlannerStatsJSON()
+{
+    return "{\"blocks\":" + String(_motionPlanner.getStatsBlocks()) +
+                ",\"avgUs\":" + String(_motionPlanner.getStatsAvgTimeUs(), 1) +
+                ",\"maxUs\":" + String(_motionPlanner.getStatsMaxTimeUs()) +
+                ",\"minFreeHeap\":" + String(_statsMinFreeHeap) +
+                ",\"pipelineLen\":" + String(_motionPipeline.size()) +
+                ",\"blockDistMM\":" + String(_blockDistanceMM, 3) +
+                ",\"jnDev\":" + String(_motionPlanner.getJunctionDeviation(), 4) + "}";
+}
+
+// Snapshot of the pipeline for tuning - rates are in steps per TTICKS_VALUE ticks
+// (accRate per ms) and the fields of each block are listed in "fields"
+String MotionHelper::getPipelineSnapshotJSON(unsigned int maxBlocks)
+{
+    std::vector<MotionBlock> blocks;
+    _motionPipeline.snapshot(blocks, maxBlocks);
+    String jsonStr = "{\"pipelineLen\":" + String(_motionPipeline.size()) +
+                ",\"blockDistMM\":" + String(_blockDistanceMM, 3) +
+                ",\"jnDev\":" + String(_motionPlanner.getJunctionDeviation(), 4) +
+                ",\"ticksPerSec\":" + String(uint32_t(MotionBlock::TICKS_PER_SEC)) +
+                ",\"tticks\":" + String(MotionBlock::TTICKS_VALUE) +
+                ",\"fields\":" + MotionBlock::getSnapshotFields() + ",\"blocks\":[";
+    jsonStr.reserve(jsonStr.length() + blocks.size() * 100);
+    for (unsigned int i = 0; i < blocks.size(); i++)
+    {
+        if (i != 0)
+            jsonStr += ",";
+        jsonStr += blocks[i].getSnapshotJSON();
+    }
+    jsonStr += "]}";
+    return jsonStr;
+}
+
 int MotionHelper::testGetPipelineCount()
 {
     return _motionPipeline.count();
@@ -6,26 +6,37 @@
 #include "../AxesParams.h"
 #include "../AxisPosition.h"
 #include "RobotCommandArgs.h"
+#include "MoveCmd.h"
 #include "MotionPlanner.h"
 #include "RampGenerator/RampGenerator.h"
 #include "MotionHoming.h"
 #include "Trinamics/TrinamicsController.h"
 #include "MotorEnabler.h"
+#include "FastTrig.h"
 
 class MotionHelper
 {
 public:
     static constexpr float blockDistanceMM_default = 0.0f;
+    static constexpr float arcChordToleranceMM_default = 0.02f;
     static constexpr float junctionDeviation_default = 0.05f;
     static constexpr float distToTravelMM_ignoreBelow = 0.01f;
     static constexpr int pipelineLen_default = 100;
     static constexpr uint32_t MAX_TIME_BEFORE_STOP_COMPLETE_MS = 500;
+    static constexpr uint32_t FULL_STEP_PHASE_CHECK_MS = 1000;
+    // Arc blocks are positioned exactly (rather than by incremental rotation) every N blocks
+    static constexpr int ARC_EXACT_POSITION_BLOCKS = 16;
+    static constexpr uint32_t STATS_HEAP_CHECK_MS = 100;
 
-private:
+protected:
     // Pause
     bool _isPaused;
+    // Dry-run instance (planning only)
+    bool _isDryRun;
     // Block distance
     float _blockDistanceMM;
+    // Max distance between an arc and the straight blocks approximating it
+    float _arcChordToleranceMM;
     // Allow all out of bounds movement
     bool _allowAllOutOfBounds;
     // Axes parameters
@@ -66,19 +77,38 @@ private:
     AxisFloats _blocksToAddEndPos;
     // Deltas for each axis for block generation
     AxisFloats _blocksToAddDelta;
-    // Command args for block generation
-    RobotCommandArgs _blocksToAddCommandArgs;
+    // Move command for block generation
+    MoveCmd _blocksToAddMoveCmd;
+    // Arc block generation - the vector from the centre to the current block end is rotated
+    // by a fixed angle for each block
+    bool _blocksToAddIsArc;
+    float _blocksToAddArcCentre[2];
+    float _blocksToAddArcRadiusVec[2];
+    float _blocksToAddArcRadius;
+    float _blocksToAddArcStartAngle;
+    float _blocksToAddArcAnglePerBlock;
+    float _blocksToAddArcCosPerBlock;
+    float _blocksToAddArcSinPerBlock;
 
     // Handling of stop
     bool _stopRequested;
-    bool _stopRequestTimeMs;
+    unsigned long _stopRequestTimeMs;
+
+    // Microstep switching full-step phase calibration (and the step position last checked)
+    bool _fullStepPhaseValid;
+    unsigned long _fullStepPhaseCheckMs;
+    AxisInt32s _fullStepPhaseSamplePos;
+
+    // Pattern stats - min free heap since reset
+    uint32_t _statsMinFreeHeap;
+    unsigned long _statsHeapCheckMs;
 
     // Debug
     unsigned long _debugLastPosDispMs;
 
 public:
     MotionHelper();
-    ~MotionHelper();
+    virtual ~MotionHelper();
 
     void setTransforms(ptToActuatorFnType ptToActuatorFn, actuatorToPtFnType actuatorToPtFn,
                        correctStepOverflowFnType correctStepOverflowFn,
@@ -86,6 +116,14 @@ public:
 
     void configure(const char *robotConfigJSON);
 
+    // Dry-run (must be set before configure) - plans without hardware or the ISR so that
+    // durations can be estimated - dryRunService must be called in place of service
+    void setDryRun()
+    {
+        _isDryRun = true;
+    }
+    float dryRunService(bool flush);
+
     // Can accept
     bool canAccept();
     // Pause (or un-pause) all motion
@@ -96,6 +134,16 @@ public:
     void stop();
     // Check if idle
     bool isIdle();
+    // Enable or disable motors (disabled motors are enabled again by the next move)
+    void enableMotors(bool en)
+    {
+        _motorEnabler.enableMotors(en, false);
+    }
+    // Speed factor applied to subsequent moves
+    void setSpeedFactor(float speedFactor)
+    {
+        _motionPlanner.setSpeedFactor(speedFactor);
+    }
 
     double getStepsPerUnit(int axisIdx)
     {
@@ -124,6 +172,7 @@ public:
 
     void setCurPositionAsHome(int axisIdx);
 
+    bool moveTo(MoveCmd &moveCmd);
     bool moveTo(RobotCommandArgs &args);
     void setMotionParams(RobotCommandArgs &args);
     void getCurStatus(RobotCommandArgs &args);
@@ -145,12 +194,29 @@ public:
     void debugShowTopBlock();
     void debugShowTiming();
     String getDebugStr();
+    String getPipelineSnapshotJSON(unsigned int maxBlocks);
     int testGetPipelineCount();
     bool testGetPipelineBlock(int elIdx, MotionBlock &elem);
     void setIntrumentationMode(const char *testModeStr)
     {
         _rampGenerator.setInstrumentationMode(testModeStr);
     }
+    StepTrace &getStepTrace()
+    {
+        return _rampGenerator.getStepTrace();
+    }
+    IsrStats &getIsrStats()
+    {
+        return _rampGenerator.getIsrStats();
+    }
+    MotionStats &getMotionStats()
+    {
+        return _rampGenerator.getMotionStats();
+    }
+    // Motion stats are reset when a block numbered in the range given starts (immediately if
+    // the range is NUMBERED_COMMAND_NONE) - planner stats and heap are reset now
+    void resetPatternStats(int cmdIdxFirst, int cmdIdxLast);
+    String getPlannerStatsJSON();
 
 #ifdef UNIT_TEST
     MotionHoming* testGetMotionHoming()
@@ -159,12 +225,81 @@ public:
     }
 #endif
 
-private:
+protected:
     bool isInBounds(double v, double b1, double b2)
     {
         return (v > fmin(b1, b2) && v < fmax(b1, b2));
     }
     void setCurPosActualPosition();
-    bool addToPlanner(RobotCommandArgs &args);
-    void blocksToAddProcess();
+    virtual bool addToPlanner(MoveCmd &moveCmd);
+    virtual void blocksToAddProcess();
+    // Coordinate transforms (through the functions set by setTransforms - the compile-time form
+    // uses its cached kinematics constants instead)
+    virtual bool ptToActuator(AxisFloats &targetPt, AxisFloats &outActuator, bool allowOutOfBounds);
+    virtual void actuatorToPt(AxisInt32s &actuatorPos, AxisFloats &outPt);
+    virtual void correctStepOverflow();
+    // Axis parameters have been (re)configured
+    virtual void axesConfigured()
+    {
+    }
+    bool setupArc(MoveCmd &moveCmd, AxisFloats &destPos, int &numBlocks);
+
+    // Split-up block generation - templated on the number of axes so that the compile-time
+    // form (see MotionHelperT) has fixed-length loops
+    // Returns false if there are no more blocks to add - blockFlags are MoveCmd::BLOCK_FLAGS
+    template <int NumAxes>
+    bool blocksToAddNext(AxisFloats &nextBlockDest, uint8_t &blockFlags)
+    {
+        // Check if any blocks remain to be expanded out
+        if (_blocksToAddTotal <= 0)
+            return false;
+
+        // Position at end of next block
+        float blockMult = float(_blocksToAddCurBlock + 1);
+        for (int axisIdx = 0; axisIdx < NumAxes; axisIdx++)
+            nextBlockDest._pt[axisIdx] = _blocksToAddStartPos._pt[axisIdx] + _blocksToAddDelta._pt[axisIdx] * blockMult;
+
+        // Arcs replace X and Y (other axes move linearly to give a helix)
+        blockFlags = 0;
+        if (_blocksToAddIsArc)
+        {
+            if ((_blocksToAddCurBlock + 1) % ARC_EXACT_POSITION_BLOCKS == 0)
+            {
+                // Exact position to stop rounding errors accumulating
+                float sinAngle, cosAngle;
+                FastTrig::sinCos(_blocksToAddArcStartAngle + _blocksToAddArcAnglePerBlock * blockMult, sinAngle, cosAngle);
+                _blocksToAddArcRadiusVec[0] = cosAngle * _blocksToAddArcRadius;
+                _blocksToAddArcRadiusVec[1] = sinAngle * _blocksToAddArcRadius;
+            }
+            else
+            {
+                // Rotate by the angle per block
+                float vecX = _blocksToAddArcRadiusVec[0];
+                _blocksToAddArcRadiusVec[0] = vecX * _blocksToAddArcCosPerBlock - _blocksToAddArcRadiusVec[1] * _blocksToAddArcSinPerBlock;
+                _blocksToAddArcRadiusVec[1] = vecX * _blocksToAddArcSinPerBlock + _blocksToAddArcRadiusVec[1] * _blocksToAddArcCosPerBlock;
+            }
+            nextBlockDest._pt[0] = _blocksToAddArcCentre[0] + _blocksToAddArcRadiusVec[0];
+            nextBlockDest._pt[1] = _blocksToAddArcCentre[1] + _blocksToAddArcRadiusVec[1];
+            if (_blocksToAddCurBlock != 0)
+                blockFlags |= MoveCmd::FLAG_ARC_JUNCTION;
+        }
+
+        // If last block then just use end point coords
+        if (_blocksToAddCurBlock + 1 >= _blocksToAddTotal)
+            nextBlockDest = _blocksToAddEndPos;
+
+        // Bump position
+        _blocksToAddCurBlock++;
+
+        // Check if done
+        if (_blocksToAddCurBlock >= _blocksToAddTotal)
+            _blocksToAddTotal = 0;
+        if (_blocksToAddTotal != 0)
+            blockFlags |= MoveCmd::FLAG_MORE_MOVES_COMING;
+        return true;
+    }
+
+private:
+    void microstepSwitchService();
+    void invalidateFullStepPhase();
 };
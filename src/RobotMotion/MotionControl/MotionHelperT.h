@@ -0,0 +1,145 @@
+// RBotFirmware
+// Rob Dobson 2016-18
+
+#pragma once
+
+#include "MotionHelper.h"
+
+// MotionHelper with the robot kinematics and number of axes fixed at compile time
+// The Kinematics class provides static ptToActuator, actuatorToPt, correctStepOverflow,
+// convertCoords and setRobotAttributes functions matching the MotionPlanner.h typedefs and
+// a KinematicsConsts type (filled in by computeKinematicsConsts from the axis parameters) which
+// is held per instance and passed to the direct forms of ptToActuator, actuatorToPt,
+// correctStepOverflow and ptsToActuatorBatch (which converts several points in one call)
+// Calls on the block splitting path are made directly (so they can be inlined) rather than
+// through function pointers and per-axis loops (including the planner's) are bounded by NumAxes
+// Instantiate explicitly in the translation unit that defines the kinematics functions
+template <typename Kinematics, int NumAxes>
+class MotionHelperT : public MotionHelper
+{
+    static_assert(NumAxes > 0 && NumAxes <= RobotConsts::MAX_AXES, "NumAxes out of range");
+
+public:
+    MotionHelperT()
+    {
+        // The runtime form is only used for coordinate conversion and robot attributes (the
+        // other transforms are overridden to use the kinematics constants)
+        setTransforms(Kinematics::ptToActuator, Kinematics::actuatorToPt, Kinematics::correctStepOverflow,
+                      Kinematics::convertCoords, Kinematics::setRobotAttributes);
+        Kinematics::computeKinematicsConsts(_axesParams, _kinematicsConsts);
+    }
+
+protected:
+    // Max number of split-up blocks converted to actuator coordinates in one call
+    static constexpr int KINEMATICS_BATCH_MAX = 16;
+
+    virtual void axesConfigured() override
+    {
+        Kinematics::computeKinematicsConsts(_axesParams, _kinematicsConsts);
+    }
+    virtual void blocksToAddProcess() override;
+    virtual bool addToPlanner(MoveCmd &moveCmd) override;
+    virtual bool ptToActuator(AxisFloats &targetPt, AxisFloats &outActuator, bool allowOutOfBounds) override
+    {
+        return Kinematics::ptToActuator(_kinematicsConsts, targetPt, outActuator, _lastCommandedAxisPos, allowOutOfBounds);
+    }
+    virtual void actuatorToPt(AxisInt32s &actuatorPos, AxisFloats &outPt) override
+    {
+        Kinematics::actuatorToPt(_kinematicsConsts, actuatorPos, outPt);
+    }
+    virtual void correctStepOverflow() override
+    {
+        Kinematics::correctStepOverflow(_kinematicsConsts, _lastCommandedAxisPos);
+    }
+    void ptsToActuatorBatch(const AxisFloats* pTargetPts, AxisFloats* pOutActuator, bool* pOutValid, int numPts,
+                AxisPosition &curPos, bool allowOutOfBounds)
+    {
+        Kinematics::ptsToActuatorBatch(_kinematicsConsts, pTargetPts, pOutActuator, pOutValid, numPts, curPos, allowOutOfBounds);
+    }
+
+private:
+    typename Kinematics::KinematicsConsts _kinematicsConsts;
+
+    bool addActuatorMoveToPlanner(MoveCmd &moveCmd, AxisFloats &targetPt, AxisFloats &actuatorCoords, AxisInt32s &overflowCorrection);
+};
+
+// Split-up blocks are generated and converted to actuator coordinates in batches
+template <typename Kinematics, int NumAxes>
+void MotionHelperT<Kinematics, NumAxes>::blocksToAddProcess()
+{
+    AxisFloats batchPts[KINEMATICS_BATCH_MAX];
+    AxisFloats batchActuator[KINEMATICS_BATCH_MAX];
+    uint8_t batchBlockFlags[KINEMATICS_BATCH_MAX];
+    bool batchValid[KINEMATICS_BATCH_MAX];
+    while (!_stopRequested)
+    {
+        // Batch size is limited by space in the pipeline
+        int batchMax = std::min(int(_motionPipeline.freeCount()), KINEMATICS_BATCH_MAX);
+        int numPts = 0;
+        while ((numPts < batchMax) && this->template blocksToAddNext<NumAxes>(batchPts[numPts], batchBlockFlags[numPts]))
+            numPts++;
+        if (numPts == 0)
+            return;
+
+        // Convert all points
+        ptsToActuatorBatch(batchPts, batchActuator, batchValid, numPts, _lastCommandedAxisPos,
+                    _blocksToAddMoveCmd.getFlag(MoveCmd::FLAG_ALLOW_OUT_OF_BOUNDS) || _allowAllOutOfBounds);
+
+        // Plan - actuator coords are relative to the position at the start of the batch so
+        // overflow corrections made since then are applied
+        AxisInt32s overflowCorrection;
+        for (int ptIdx = 0; ptIdx < numPts; ptIdx++)
+        {
+            if (!batchValid[ptIdx])
+                continue;
+            for (int axisIdx = 0; axisIdx < NumAxes; axisIdx++)
+                batchActuator[ptIdx]._pt[axisIdx] += overflowCorrection.vals[axisIdx];
+            _blocksToAddMoveCmd.setPointMM(batchPts[ptIdx]);
+            _blocksToAddMoveCmd.setBlockFlags(batchBlockFlags[ptIdx]);
+            addActuatorMoveToPlanner(_blocksToAddMoveCmd, batchPts[ptIdx], batchActuator[ptIdx], overflowCorrection);
+        }
+
+        // Enable motors
+        if (!_isPaused) {
+            _motorEnabler.enableMotors(true, false);
+        }
+    }
+}
+
+// Add a movement to the pipeline using the planner which computes suitable motion
+template <typename Kinematics, int NumAxes>
+bool MotionHelperT<Kinematics, NumAxes>::addToPlanner(MoveCmd &moveCmd)
+{
+    // Check we are not stopping
+    if (_stopRequested)
+        return false;
+
+    // Convert the move to actuator coordinates
+    AxisFloats targetPt;
+    moveCmd.getPointMM(targetPt);
+    AxisFloats actuatorCoords;
+    if (!ptToActuator(targetPt, actuatorCoords, moveCmd.getFlag(MoveCmd::FLAG_ALLOW_OUT_OF_BOUNDS) || _allowAllOutOfBounds))
+        return false;
+    AxisInt32s overflowCorrection;
+    return addActuatorMoveToPlanner(moveCmd, targetPt, actuatorCoords, overflowCorrection);
+}
+
+// Plan a move which has been converted to actuator coordinates and accumulate any step overflow correction
+template <typename Kinematics, int NumAxes>
+bool MotionHelperT<Kinematics, NumAxes>::addActuatorMoveToPlanner(MoveCmd &moveCmd, AxisFloats &targetPt,
+            AxisFloats &actuatorCoords, AxisInt32s &overflowCorrection)
+{
+    // Plan the move
+    if (!_motionPlanner.moveTo<NumAxes>(moveCmd, actuatorCoords, _lastCommandedAxisPos, _axesParams, _motionPipeline))
+        return false;
+
+    // Update axisMotion
+    _lastCommandedAxisPos._axisPositionMM = targetPt;
+
+    // Correct overflows
+    AxisInt32s stepsBefore = _lastCommandedAxisPos._stepsFromHome;
+    Kinematics::correctStepOverflow(_kinematicsConsts, _lastCommandedAxisPos);
+    for (int axisIdx = 0; axisIdx < NumAxes; axisIdx++)
+        overflowCorrection.vals[axisIdx] += _lastCommandedAxisPos._stepsFromHome.vals[axisIdx] - stepsBefore.vals[axisIdx];
+    return true;
+}
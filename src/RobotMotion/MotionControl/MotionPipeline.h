@@ -6,6 +6,7 @@
 #include "MotionRingBuffer.h"
 #include "MotionBlock.h"
 #include <vector>
+#include <algorithm>
 
 class MotionPipeline
 {
@@ -30,17 +31,30 @@ class MotionPipeline
         _pipelinePosn.clear();
     }
 
-    unsigned int count()
+    unsigned int IRAM_ATTR count()
     {
         return _pipelinePosn.count();
     }
 
+    unsigned int size()
+    {
+        return _pipeline.size();
+    }
+
     // Check if ready to accept data
     bool canAccept()
     {
         return _pipelinePosn.canPut();
     }
 
+    // Number of blocks that can currently be added (one slot is always kept empty)
+    unsigned int freeCount()
+    {
+        if (_pipeline.size() == 0)
+            return 0;
+        return _pipeline.size() - 1 - count();
+    }
+
     // Add to pipeline
     bool add(MotionBlock &block)
     {
@@ -121,6 +135,25 @@ class MotionPipeline
         return &(_pipeline[nthPos]);
     }
 
+    // Copy the blocks (from the next to be executed) without stopping motion - blocks
+    // which are completed by the ISR while copying are dropped as their slots may be reused
+    void snapshot(std::vector<MotionBlock> &blocks, unsigned int maxBlocks)
+    {
+        blocks.clear();
+        unsigned int bufLen = _pipeline.size();
+        if (bufLen == 0)
+            return;
+        unsigned int getPosAtStart = _pipelinePosn._getPos;
+        unsigned int cnt = count();
+        if (cnt > maxBlocks)
+            cnt = maxBlocks;
+        blocks.reserve(cnt);
+        for (unsigned int i = 0; i < cnt; i++)
+            blocks.push_back(_pipeline[(getPosAtStart + i) % bufLen]);
+        unsigned int numGot = (_pipelinePosn._getPos + bufLen - getPosAtStart) % bufLen;
+        blocks.erase(blocks.begin(), blocks.begin() + std::min(numGot, (unsigned int)blocks.size()));
+    }
+
     // Debug
     void debugShowBlocks(AxesParams &axesParams)
     {
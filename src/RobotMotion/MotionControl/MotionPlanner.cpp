@@ -8,13 +8,98 @@ void MotionPlanner::configure(float junctionDeviation)
     _junctionDeviation = junctionDeviation;
 }
 
+// Microstep switching - a shift of 0 disables it
+void MotionPlanner::configureMicrostepSwitch(uint8_t highSpeedMicrostepShift, float highSpeedStepRatePerSec,
+                                int32_t microstepsPerFullStep, int numSwitchingAxes)
+{
+    _highSpeedMicrostepShift = highSpeedMicrostepShift;
+    _highSpeedStepRatePerSec = highSpeedStepRatePerSec;
+    _microstepsPerFullStep = microstepsPerFullStep;
+    _lastMicrostepShift = 0;
+    for (int axisIdx = 0; axisIdx < RobotConsts::MAX_AXES; axisIdx++)
+    {
+        _microstepSwitchAxis[axisIdx] = axisIdx < numSwitchingAxes;
+        _fullStepPhase[axisIdx] = -1;
+    }
+}
+
+void MotionPlanner::setFullStepPhase(int axisIdx, int32_t phase)
+{
+    if (axisIdx >= 0 && axisIdx < RobotConsts::MAX_AXES)
+        _fullStepPhase[axisIdx] = phase;
+}
+
+// Choose the microstep mode for a block and adjust its step targets so that every block in the
+// reduced mode starts on a full step and moves a whole number of reduced-mode steps
+// Returning to the configured microsteps is possible from any position as every reduced-mode
+// position is also a valid position at the finer resolution
+// Note that step overflow correction removes whole rotations so doesn't change full-step phase
+template <int NumAxes>
+uint8_t MotionPlanner::planMicrostepShift(int32_t *pStepsToTarget, AxisPosition &curAxisPositions,
+                                float cruiseStepRatePerSec)
+{
+    if (_highSpeedMicrostepShift == 0)
+        return 0;
+
+    // Hysteresis avoids switching back and forth on blocks close to the threshold
+    float thresholdStepRatePerSec = _highSpeedStepRatePerSec;
+    if (_lastMicrostepShift != 0)
+        thresholdStepRatePerSec *= MICROSTEP_SWITCH_DOWN_RATIO;
+    uint8_t microstepShift = (cruiseStepRatePerSec > thresholdStepRatePerSec) ? _highSpeedMicrostepShift : 0;
+
+    // All switching drivers must have a known full-step phase and other axes must not move
+    for (int axisIdx = 0; axisIdx < NumAxes; axisIdx++)
+    {
+        if (_microstepSwitchAxis[axisIdx] ? (_fullStepPhase[axisIdx] < 0) : (pStepsToTarget[axisIdx] != 0))
+            microstepShift = 0;
+    }
+    if (microstepShift == 0)
+        return 0;
+
+    // Check if every driver is on a full step - if not then stay in the current mode for this
+    // block but end it on a full step so the next block can switch
+    int32_t alignSteps = 1 << microstepShift;
+    if (_lastMicrostepShift != microstepShift)
+    {
+        for (int axisIdx = 0; axisIdx < NumAxes; axisIdx++)
+        {
+            if (!_microstepSwitchAxis[axisIdx])
+                continue;
+            int32_t offset = (curAxisPositions._stepsFromHome.vals[axisIdx] - _fullStepPhase[axisIdx]) % _microstepsPerFullStep;
+            if (offset != 0)
+            {
+                microstepShift = _lastMicrostepShift;
+                alignSteps = _microstepsPerFullStep;
+                break;
+            }
+        }
+    }
+
+    // Round the targets to the nearest aligned position
+    for (int axisIdx = 0; axisIdx < NumAxes; axisIdx++)
+    {
+        if (!_microstepSwitchAxis[axisIdx])
+            continue;
+        int32_t target = curAxisPositions._stepsFromHome.vals[axisIdx] + pStepsToTarget[axisIdx];
+        int32_t offset = ((target - _fullStepPhase[axisIdx]) % alignSteps + alignSteps) % alignSteps;
+        target += (offset * 2 >= alignSteps) ? alignSteps - offset : -offset;
+        pStepsToTarget[axisIdx] = target - curAxisPositions._stepsFromHome.vals[axisIdx];
+    }
+    return microstepShift;
+}
+
 // Entry point for adding a motion block
-bool MotionPlanner::moveTo(RobotCommandArgs &args,
+template <int NumAxes>
+bool MotionPlanner::moveTo(MoveCmd &moveCmd,
             AxisFloats &destActuatorCoords,
             AxisPosition &curAxisPositions,
             AxesParams &axesParams, MotionPipeline &motionPipeline)
 {
-    // Find first primary axis
+    // Planning time stats
+    uint32_t planStartUs = micros();
+
+    // Find first primary axis - over all axes as unconfigured axes are primary and the speed
+    // limit is taken from the last one found
     int firstPrimaryAxis = -1;
     for (int axisIdx = 0; axisIdx < RobotConsts::MAX_AXES; axisIdx++)
         if (axesParams.isPrimaryAxis(axisIdx))
@@ -23,14 +108,14 @@ bool MotionPlanner::moveTo(RobotCommandArgs &args,
         firstPrimaryAxis = 0;
 
     // Find axis deltas and sum of squares of motion on primary axes
-    float deltas[RobotConsts::MAX_AXES];
+    float deltas[NumAxes];
     bool isAMove = false;
     bool isAPrimaryMove = false;
     int axisWithMaxMoveDist = 0;
     float squareSum = 0;
-    for (int axisIdx = 0; axisIdx < RobotConsts::MAX_AXES; axisIdx++)
+    for (int axisIdx = 0; axisIdx < NumAxes; axisIdx++)
     {
-        deltas[axisIdx] = args.getValNoCkMM(axisIdx) - curAxisPositions._axisPositionMM._pt[axisIdx];
+        deltas[axisIdx] = moveCmd._ptMM[axisIdx] - curAxisPositions._axisPositionMM._pt[axisIdx];
         if (deltas[axisIdx] != 0)
         {
             isAMove = true;
@@ -55,18 +140,20 @@ bool MotionPlanner::moveTo(RobotCommandArgs &args,
     MotionBlock block;
 
     // Set flag to indicate if more moves coming
-    block._blockIsFollowed = args.getMoreMovesComing();
+    block._blockIsFollowed = moveCmd.getFlag(MoveCmd::FLAG_MORE_MOVES_COMING);
 
     // set end-stop check requirements
-    block.setEndStopsToCheck(args.getEndstopCheck());
+    AxisMinMaxBools endstops = moveCmd.getEndstopCheck();
+    block.setEndStopsToCheck(endstops);
 
     // Set numbered command index if present
-    block.setNumberedCommandIndex(args.getNumberedCommandIndex());
+    block.setNumberedCommandIndex(moveCmd._numberedCommandIndex);
 
-    // Max speed (may be overridden downwards by feedrate)
-    float validFeedrateMMps = 1e8;
-    if (args.isFeedrateValid())
-        validFeedrateMMps = args.getFeedrate();
+    // Max speed (may be overridden downwards by feedrate) - both are scaled by the speed factor
+    float validFeedrateMMps = axesParams.getMaxSpeed(firstPrimaryAxis);
+    if (moveCmd.getFlag(MoveCmd::FLAG_FEEDRATE_VALID))
+        validFeedrateMMps = moveCmd._feedrate;
+    validFeedrateMMps *= _speedFactor;
 
     // Check the feedrate against the first primary axis
     if (validFeedrateMMps > axesParams.getMaxSpeed(firstPrimaryAxis))
@@ -74,7 +161,7 @@ bool MotionPlanner::moveTo(RobotCommandArgs &args,
 
     // Find the unit vectors for the primary axes and check the feedrate
     AxisFloats unitVectors;
-    for (int axisIdx = 0; axisIdx < RobotConsts::MAX_AXES; axisIdx++)
+    for (int axisIdx = 0; axisIdx < NumAxes; axisIdx++)
     {
         if (axesParams.isPrimaryAxis(axisIdx))
         {
@@ -86,14 +173,32 @@ bool MotionPlanner::moveTo(RobotCommandArgs &args,
     // Store values in the block
     block._feedrate = validFeedrateMMps;
     block._moveDistPrimaryAxesMM = moveDist;
+    block._distUM = uint32_t(moveDist * 1000);
+    if (validFeedrateMMps > 0)
+        block._nominalTimeUS = uint32_t(moveDist * 1e6f / validFeedrateMMps);
+
+    // Steps on each axis
+    int32_t stepsToTarget[NumAxes];
+    float cruiseStepRatePerSec = 0;
+    for (int axisIdx = 0; axisIdx < NumAxes; axisIdx++)
+    {
+        float stepsFloat = destActuatorCoords._pt[axisIdx] - curAxisPositions._stepsFromHome.vals[axisIdx];
+        stepsToTarget[axisIdx] = int32_t(ceilf(stepsFloat));
+        float axisStepRatePerSec = fminf(fabsf(stepsToTarget[axisIdx]) * validFeedrateMMps / moveDist,
+                                        axesParams.getMaxStepRatePerSec(axisIdx));
+        if (cruiseStepRatePerSec < axisStepRatePerSec)
+            cruiseStepRatePerSec = axisStepRatePerSec;
+    }
+
+    // Microstep mode (may adjust the steps to maintain full-step alignment)
+    block._microstepShift = planMicrostepShift<NumAxes>(stepsToTarget, curAxisPositions, cruiseStepRatePerSec);
 
     // Find if there are any steps
     bool hasSteps = false;
-    for (int axisIdx = 0; axisIdx < RobotConsts::MAX_AXES; axisIdx++)
+    for (int axisIdx = 0; axisIdx < NumAxes; axisIdx++)
     {
         // Check if any steps to perform
-        float stepsFloat = destActuatorCoords._pt[axisIdx] - curAxisPositions._stepsFromHome.vals[axisIdx];
-        int32_t steps = int32_t(ceilf(stepsFloat));
+        int32_t steps = stepsToTarget[axisIdx];
         if (steps != 0)
             hasSteps = true;
         // Value (and direction)
@@ -125,14 +230,23 @@ bool MotionPlanner::moveTo(RobotCommandArgs &args,
         _prevMotionBlockValid = false;
 
     // Calculate the maximum speed for the junction between two blocks
-    if (isAPrimaryMove && _prevMotionBlockValid)
+    if (isAPrimaryMove && _prevMotionBlockValid && moveCmd.getFlag(MoveCmd::FLAG_ARC_JUNCTION))
+    {
+        // Junction within an arc - limit by the centripetal acceleration of the arc itself
+        // rather than the angle between blocks (which depends on how finely the arc is split)
+        vmaxJunction = fminf(fminf(_prevMotionBlock._maxParamSpeedMMps, block._feedrate),
+                    sqrtf(axesParams._masterAxisMaxAccMMps2 * moveCmd._arcRadius));
+    }
+    else if (isAPrimaryMove && _prevMotionBlockValid)
     {
         float prevParamSpeed = isAPrimaryMove ? _prevMotionBlock._maxParamSpeedMMps : 0;
         if (junctionDeviation > 0.0f && prevParamSpeed > 0.0f)
         {
             // Compute cosine of angle between previous and current path. (prev_unit_vec is negative)
             // NOTE: Max junction velocity is computed without sin() or acos() by trig half angle identity.
-            float cosTheta = -_prevMotionBlock._unitVectors.X() * unitVectors.X() - _prevMotionBlock._unitVectors.Y() * unitVectors.Y() - _prevMotionBlock._unitVectors.Z() * unitVectors.Z();
+            float cosTheta = 0;
+            for (int axisIdx = 0; axisIdx < NumAxes; axisIdx++)
+                cosTheta -= _prevMotionBlock._unitVectors._pt[axisIdx] * unitVectors._pt[axisIdx];
 
             // Skip and use default max junction speed for 0 degree acute junction.
             if (cosTheta < 0.95F)
@@ -151,6 +265,10 @@ bool MotionPlanner::moveTo(RobotCommandArgs &args,
             }
         }
     }
+
+    // Motion pauses between blocks while the microstep mode is changed so plan to stop there
+    if (block._microstepShift != _lastMicrostepShift)
+        vmaxJunction = _minimumPlannerSpeedMMps;
     block._maxEntrySpeedMMps = vmaxJunction;
 
 #ifdef DEBUG_MOTIONPLANNER_DETAILED_INFO
@@ -165,15 +283,21 @@ bool MotionPlanner::moveTo(RobotCommandArgs &args,
     prevBlockInfo._unitVectors = unitVectors;
     _prevMotionBlock = prevBlockInfo;
     _prevMotionBlockValid = true;
+    _lastMicrostepShift = block._microstepShift;
 
     // Recalculate the whole queue
     recalculatePipeline(motionPipeline, axesParams);
 
     // Return the change in actuator position
-    for (int axisIdx = 0; axisIdx < RobotConsts::MAX_AXES; axisIdx++)
-        curAxisPositions._stepsFromHome.setVal(axisIdx,
-                    curAxisPositions._stepsFromHome.getVal(axisIdx) + block.getStepsToTarget(axisIdx));
-
+    for (int axisIdx = 0; axisIdx < NumAxes; axisIdx++)
+        curAxisPositions._stepsFromHome.vals[axisIdx] += stepsToTarget[axisIdx];
+
+    // Planning time stats
+    uint32_t planTimeUs = micros() - planStartUs;
+    _statsBlocks++;
+    _statsTimeUs += planTimeUs;
+    if (_statsMaxTimeUs < planTimeUs)
+        _statsMaxTimeUs = planTimeUs;
     return true;
 }
 
@@ -323,7 +447,7 @@ void MotionPlanner::recalculatePipeline(MotionPipeline &motionPipeline, AxesPara
 }
 
 // Entry point for adding a motion block for stepwise motion
-bool MotionPlanner::moveToStepwise(RobotCommandArgs &args,
+bool MotionPlanner::moveToStepwise(MoveCmd &moveCmd,
                     AxisPosition &curAxisPositions,
                     AxesParams &axesParams, MotionPipeline &motionPipeline)
 {
@@ -339,13 +463,13 @@ bool MotionPlanner::moveToStepwise(RobotCommandArgs &args,
     {
         // Check if any steps to perform
         int32_t steps = 0;
-        if (args.isValid(axisIdx))
+        if (moveCmd.isValid(axisIdx))
         {
             // See if absolute or relative motion
-            if (args.getMoveType() == RobotMoveTypeArg_Relative)
-                steps = args.getPointSteps().getVal(axisIdx);
+            if (moveCmd._moveType == RobotMoveTypeArg_Relative)
+                steps = moveCmd._ptSteps[axisIdx];
             else
-                steps = args.getPointSteps().getVal(axisIdx) - curAxisPositions._stepsFromHome.vals[axisIdx];
+                steps = moveCmd._ptSteps[axisIdx] - curAxisPositions._stepsFromHome.vals[axisIdx];
         }
         // Set steps to target
         if (steps != 0)
@@ -366,14 +490,15 @@ bool MotionPlanner::moveToStepwise(RobotCommandArgs &args,
     block._unitVecAxisWithMaxDist = 1.0;
 
     // set end-stop check requirements
-    block.setEndStopsToCheck(args.getEndstopCheck());
+    AxisMinMaxBools endstops = moveCmd.getEndstopCheck();
+    block.setEndStopsToCheck(endstops);
 
     // Set numbered command index if present
-    block.setNumberedCommandIndex(args.getNumberedCommandIndex());
+    block.setNumberedCommandIndex(moveCmd._numberedCommandIndex);
 
     // feedrate override?
-    if (args.isFeedrateValid())
-        minFeedrateStepsPerSec = args.getFeedrate();
+    if (moveCmd.getFlag(MoveCmd::FLAG_FEEDRATE_VALID))
+        minFeedrateStepsPerSec = moveCmd._feedrate;
     block._feedrate = minFeedrateStepsPerSec;
 
     // Prepare for stepping
@@ -383,9 +508,10 @@ bool MotionPlanner::moveToStepwise(RobotCommandArgs &args,
         block._canExecute = true;
     }
 
-    // Add the block
+    // Add the block - stepwise motion always uses the configured microsteps
     motionPipeline.add(block);
     _prevMotionBlockValid = true;
+    _lastMicrostepShift = 0;
 
     // Return the change in actuator position
     for (int axisIdx = 0; axisIdx < RobotConsts::MAX_AXES; axisIdx++)
@@ -399,3 +525,12 @@ bool MotionPlanner::moveToStepwise(RobotCommandArgs &args,
 
     return true;
 }
+
+// Forms for each number of axes
+static_assert(RobotConsts::MAX_AXES == 3, "Instantiate moveTo for each number of axes");
+template bool MotionPlanner::moveTo<1>(MoveCmd &moveCmd, AxisFloats &destActuatorCoords, AxisPosition &curAxisPositions,
+            AxesParams &axesParams, MotionPipeline &motionPipeline);
+template bool MotionPlanner::moveTo<2>(MoveCmd &moveCmd, AxisFloats &destActuatorCoords, AxisPosition &curAxisPositions,
+            AxesParams &axesParams, MotionPipeline &motionPipeline);
+template bool MotionPlanner::moveTo<3>(MoveCmd &moveCmd, AxisFloats &destActuatorCoords, AxisPosition &curAxisPositions,
+            AxesParams &axesParams, MotionPipeline &motionPipeline);
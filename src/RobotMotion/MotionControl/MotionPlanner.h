@@ -10,13 +10,13 @@
 #endif
 
 #include "../AxisPosition.h"
-#include "../../RobotCommandArgs.h"
+#include "../../MoveCmd.h"
 #include "MotionPipeline.h"
 
 typedef bool (*ptToActuatorFnType)(AxisFloats &targetPt, AxisFloats &outActuator, AxisPosition &curPos, AxesParams &axesParams, bool allowOutOfBounds);
 typedef void (*actuatorToPtFnType)(AxisInt32s &targetActuator, AxisFloats &outPt, AxisPosition &curPos, AxesParams &axesParams);
 typedef void (*correctStepOverflowFnType)(AxisPosition &curPos, AxesParams &axesParams);
-typedef void (*convertCoordsFnType)(RobotCommandArgs& cmdArgs, AxesParams &axesParams);
+typedef void (*convertCoordsFnType)(MoveCmd& moveCmd, AxesParams &axesParams);
 typedef void (*setRobotAttributesFnType)(AxesParams& axesParams, String& robotAttributes);
 
 class MotionPlanner
@@ -26,6 +26,8 @@ class MotionPlanner
     float _minimumPlannerSpeedMMps;
     // Junction deviation
     float _junctionDeviation;
+    // Speed factor (M220) - applied to the feedrate (or max speed if none) of subsequent moves
+    float _speedFactor;
 
     // Structure to store details on last processed block
     struct MotionBlockSequentialData
@@ -37,19 +39,95 @@ class MotionPlanner
     bool _prevMotionBlockValid;
     MotionBlockSequentialData _prevMotionBlock;
 
+    // Speed-dependent microstep switching - the high speed mode is a power-of-two reduction
+    // (shift) of the configured microsteps used when the cruise step rate exceeds a threshold
+    static constexpr float MICROSTEP_SWITCH_DOWN_RATIO = 0.8f;
+    uint8_t _highSpeedMicrostepShift;
+    float _highSpeedStepRatePerSec;
+    int32_t _microstepsPerFullStep;
+    // Axes whose drivers switch and the step count (modulo a full step) at which each is on
+    // a full step (-1 if unknown)
+    bool _microstepSwitchAxis[RobotConsts::MAX_AXES];
+    int32_t _fullStepPhase[RobotConsts::MAX_AXES];
+    // Microstep mode of the most recently planned block
+    uint8_t _lastMicrostepShift;
+
+    // Planning time stats (blocks added by moveTo including pipeline recalculation)
+    uint32_t _statsBlocks;
+    uint32_t _statsTimeUs;
+    uint32_t _statsMaxTimeUs;
+
   public:
     MotionPlanner()
     {
         _prevMotionBlockValid = false;
         _minimumPlannerSpeedMMps = 0;
+        resetStats();
         // Configure the motion pipeline - these values will be changed in config
         _junctionDeviation = 0;
+        _speedFactor = 1.0f;
+        // Microstep switching disabled until configured
+        configureMicrostepSwitch(0, 0, 0, 0);
     }
 
     void configure(float junctionDeviation);
+    float getJunctionDeviation()
+    {
+        return _junctionDeviation;
+    }
+
+    void setSpeedFactor(float speedFactor)
+    {
+        if (speedFactor > 0)
+            _speedFactor = speedFactor;
+    }
+    float getSpeedFactor()
+    {
+        return _speedFactor;
+    }
+
+    // Planning time stats
+    void resetStats()
+    {
+        _statsBlocks = 0;
+        _statsTimeUs = 0;
+        _statsMaxTimeUs = 0;
+    }
+    uint32_t getStatsBlocks()
+    {
+        return _statsBlocks;
+    }
+    float getStatsAvgTimeUs()
+    {
+        return (_statsBlocks > 0) ? float(_statsTimeUs) / _statsBlocks : 0;
+    }
+    uint32_t getStatsMaxTimeUs()
+    {
+        return _statsMaxTimeUs;
+    }
+
+    // Microstep switching
+    void configureMicrostepSwitch(uint8_t highSpeedMicrostepShift, float highSpeedStepRatePerSec,
+                                  int32_t microstepsPerFullStep, int numSwitchingAxes);
+    void setFullStepPhase(int axisIdx, int32_t phase);
+    void setCurMicrostepShift(uint8_t microstepShift)
+    {
+        _lastMicrostepShift = microstepShift;
+    }
 
     // Entry point for adding a motion block
-    bool moveTo(RobotCommandArgs &args,
+    bool moveTo(MoveCmd &moveCmd,
+                AxisFloats &destActuatorCoords,
+                AxisPosition &curAxisPositions,
+                AxesParams &axesParams, MotionPipeline &motionPipeline)
+    {
+        return moveTo<RobotConsts::MAX_AXES>(moveCmd, destActuatorCoords, curAxisPositions, axesParams, motionPipeline);
+    }
+
+    // Form with per-axis loops bounded by the robot's number of axes (used by MotionHelperT) -
+    // axes from NumAxes up don't move - instantiated in MotionPlanner.cpp for 1 to MAX_AXES
+    template <int NumAxes>
+    bool moveTo(MoveCmd &moveCmd,
                 AxisFloats &destActuatorCoords,
                 AxisPosition &curAxisPositions,
                 AxesParams &axesParams, MotionPipeline &motionPipeline);
@@ -59,7 +137,11 @@ class MotionPlanner
     void recalculatePipeline(MotionPipeline &motionPipeline, AxesParams &axesParams);
 
     // Entry point for adding a motion block
-    bool moveToStepwise(RobotCommandArgs &args,
+    bool moveToStepwise(MoveCmd &moveCmd,
                         AxisPosition &curAxisPositions,
                         AxesParams &axesParams, MotionPipeline &motionPipeline);
+
+  private:
+    template <int NumAxes>
+    uint8_t planMicrostepShift(int32_t *pStepsToTarget, AxisPosition &curAxisPositions, float cruiseStepRatePerSec);
 };
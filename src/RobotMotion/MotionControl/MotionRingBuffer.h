@@ -64,7 +64,7 @@ class MotionRingBufferPosn
             _getPos = 0;
     }
 
-    unsigned int count()
+    unsigned int IRAM_ATTR count()
     {
         unsigned int getPos = _getPos;
         if (getPos <= _putPos)
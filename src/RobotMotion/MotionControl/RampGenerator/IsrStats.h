@@ -0,0 +1,121 @@
+// RBotFirmware
+// Rob Dobson 2016-2018
+
+#pragma once
+
+#include <Arduino.h>
+#include "xtensa/core-macros.h"
+
+// ISR execution time statistics - durations (in CPU cycles) are binned into a log2 histogram
+// separately for each path through the ISR
+// Bin 0 holds durations below 2^MIN_BIN_BITS cycles, bin N (N > 0) holds durations with
+// (MIN_BIN_BITS + N) significant bits and the last bin holds everything longer
+class IsrStats
+{
+public:
+    enum IsrPath
+    {
+        PATH_IDLE,
+        PATH_NEW_BLOCK,
+        PATH_STEP,
+        NUM_PATHS
+    };
+    static constexpr int NUM_BINS = 12;
+    static constexpr int MIN_BIN_BITS = 6;
+
+private:
+    volatile uint32_t _binCounts[NUM_PATHS][NUM_BINS];
+    volatile uint32_t _maxCycles[NUM_PATHS];
+    volatile uint32_t _overrunCount[NUM_PATHS];
+    // Reset is carried out in the ISR so counts remain consistent
+    volatile bool _resetRequested;
+    uint32_t _budgetCycles;
+    uint32_t _cyclesPerUs;
+
+public:
+    IsrStats()
+    {
+        _cyclesPerUs = 1;
+        _budgetCycles = 0xffffffff;
+        clear();
+    }
+
+    // Budget is the ISR interval
+    void setBudget(uint32_t budgetUs, uint32_t cyclesPerUs)
+    {
+        _cyclesPerUs = cyclesPerUs;
+        _budgetCycles = budgetUs * cyclesPerUs;
+    }
+
+    void reset()
+    {
+        _resetRequested = true;
+    }
+
+    static inline int binIndex(uint32_t cycles)
+    {
+        int bin = (32 - __builtin_clz(cycles | 1)) - MIN_BIN_BITS;
+        if (bin < 0)
+            return 0;
+        return (bin >= NUM_BINS) ? NUM_BINS - 1 : bin;
+    }
+
+    // Lowest duration (cycles) in a bin
+    static uint32_t binLowerCycles(int binIdx)
+    {
+        return (binIdx == 0) ? 0 : (1u << (MIN_BIN_BITS + binIdx - 1));
+    }
+
+    // Called at ISR exit with the cycle count read at ISR entry
+    inline void IRAM_ATTR record(IsrPath path, uint32_t startCycles)
+    {
+        uint32_t cycles = XTHAL_GET_CCOUNT() - startCycles;
+        if (_resetRequested)
+            clear();
+        _binCounts[path][binIndex(cycles)]++;
+        if (cycles > _maxCycles[path])
+            _maxCycles[path] = cycles;
+        if (cycles > _budgetCycles)
+            _overrunCount[path]++;
+    }
+
+    String getJSON()
+    {
+        static const char *pathNames[NUM_PATHS] = {"idle", "newBlock", "step"};
+        String jsonStr = "{\"budgetUs\":" + String(_budgetCycles / _cyclesPerUs) +
+                    ",\"cyclesPerUs\":" + String(_cyclesPerUs) + ",\"binLowerCycles\":[";
+        for (int binIdx = 0; binIdx < NUM_BINS; binIdx++)
+            jsonStr += String(binIdx == 0 ? "" : ",") + String(binLowerCycles(binIdx));
+        jsonStr += "]";
+        for (int pathIdx = 0; pathIdx < NUM_PATHS; pathIdx++)
+        {
+            uint32_t count = 0;
+            String binsStr;
+            for (int binIdx = 0; binIdx < NUM_BINS; binIdx++)
+            {
+                count += _binCounts[pathIdx][binIdx];
+                binsStr += String(binIdx == 0 ? "" : ",") + String(_binCounts[pathIdx][binIdx]);
+            }
+            jsonStr += ",\"" + String(pathNames[pathIdx]) + "\":{\"count\":" + String(count) +
+                    ",\"maxCycles\":" + String(_maxCycles[pathIdx]) +
+                    ",\"maxUs\":" + String(float(_maxCycles[pathIdx]) / _cyclesPerUs, 2) +
+                    ",\"overruns\":" + String(_overrunCount[pathIdx]) +
+                    ",\"bins\":[" + binsStr + "]}";
+        }
+        jsonStr += "}";
+        return jsonStr;
+    }
+
+private:
+    inline void IRAM_ATTR clear()
+    {
+        for (int pathIdx = 0; pathIdx < NUM_PATHS; pathIdx++)
+        {
+            for (int binIdx = 0; binIdx < NUM_BINS; binIdx++)
+                _binCounts[pathIdx][binIdx] = 0;
+            _maxCycles[pathIdx] = 0;
+            _overrunCount[pathIdx] = 0;
+        }
+        _resetRequested = false;
+    }
+};
@@ -0,0 +1,167 @@
+// RBotFirmware
+// Rob Dobson 2016-2018
+
+#pragma once
+
+#include <Arduino.h>
+#include "../MotionBlock.h"
+
+// Motion statistics for a pattern - updated by the ramp generator ISR (integer arithmetic
+// only as the FPU can't be used in the ISR) and reset when the first numbered move of each
+// pattern starts (the previous pattern's moves may still be running when the next one begins)
+// Underrun counts are only made while work is pending (as flagged by the main loop) so
+// that they indicate motion starved by file reading, parsing or planning:
+//    pipeline empty - no blocks have been planned (reading / parsing / the main loop is slow)
+//    not ready      - blocks are in the pipeline but planning has not released them
+class MotionStats
+{
+private:
+    // Set by the main loop
+    volatile bool _workPending;
+    volatile bool _resetRequested;
+    volatile bool _resetOnCmdIdx;
+    volatile int _resetCmdIdxFirst;
+    volatile int _resetCmdIdxLast;
+
+    // ISR tick counts
+    volatile uint32_t _ticksEmpty;
+    volatile uint32_t _ticksNotReady;
+    volatile uint32_t _ticksMoving;
+    volatile uint32_t _ticksBelowNominal;
+    volatile uint32_t _underrunEvents;
+    volatile bool _inUnderrun;
+
+    // Blocks executed and their total distance and time at nominal speed - the time is kept in
+    // ms (with the remainder in uS) so that it doesn't wrap during long patterns
+    volatile uint32_t _blocksExecuted;
+    volatile uint32_t _distUM;
+    volatile uint32_t _nominalTimeMs;
+    volatile uint32_t _nominalTimeRemUS;
+
+    // Min pipeline occupancy seen when starting a block
+    volatile uint32_t _minPipelineCount;
+
+public:
+    MotionStats()
+    {
+        _workPending = false;
+        _resetCmdIdxFirst = 0;
+        _resetCmdIdxLast = 0;
+        clear();
+    }
+
+    void setWorkPending(bool workPending)
+    {
+        _workPending = workPending;
+    }
+
+    void reset()
+    {
+        _resetOnCmdIdx = false;
+        _resetRequested = true;
+    }
+
+    // Reset when a block numbered in the range given starts
+    void resetAtCmdIdx(int cmdIdxFirst, int cmdIdxLast)
+    {
+        _resetRequested = false;
+        _resetCmdIdxFirst = cmdIdxFirst;
+        _resetCmdIdxLast = cmdIdxLast;
+        _resetOnCmdIdx = true;
+    }
+
+    // Called from the ISR when the pipeline is empty
+    inline void IRAM_ATTR tickEmpty()
+    {
+        if (_resetRequested)
+            clear();
+        if (!_workPending)
+            return;
+        _ticksEmpty++;
+        startUnderrun();
+    }
+
+    // Called from the ISR when the next block cannot yet be executed
+    inline void IRAM_ATTR tickNotReady()
+    {
+        if (_resetRequested)
+            clear();
+        if (!_workPending)
+            return;
+        _ticksNotReady++;
+        startUnderrun();
+    }
+
+    // Called from the ISR when a block starts
+    inline void IRAM_ATTR blockStarted(MotionBlock *pBlock, uint32_t pipelineCount)
+    {
+        if (_resetOnCmdIdx && (pBlock->_numberedCommandIndex >= _resetCmdIdxFirst) &&
+                    (pBlock->_numberedCommandIndex <= _resetCmdIdxLast))
+            clear();
+        if (_resetRequested)
+            clear();
+        _inUnderrun = false;
+        _blocksExecuted++;
+        _distUM += pBlock->_distUM;
+        uint32_t nominalTimeUS = _nominalTimeRemUS + pBlock->_nominalTimeUS;
+        _nominalTimeMs += nominalTimeUS / 1000;
+        _nominalTimeRemUS = nominalTimeUS % 1000;
+        if (pipelineCount < _minPipelineCount)
+            _minPipelineCount = pipelineCount;
+    }
+
+    // Called from the ISR on each tick of block execution
+    inline void IRAM_ATTR tickMoving(bool belowNominal)
+    {
+        _ticksMoving++;
+        if (belowNominal)
+            _ticksBelowNominal++;
+    }
+
+    String getJSON()
+    {
+        // Achieved speed includes time lost to underruns
+        uint32_t ticksActive = _ticksMoving + _ticksEmpty + _ticksNotReady;
+        float activeTimeS = ticksActive * (MotionBlock::TICK_INTERVAL_NS / 1e9f);
+        float distMM = _distUM / 1000.0f;
+        float nominalTimeS = _nominalTimeMs / 1000.0f + _nominalTimeRemUS / 1e6f;
+        float plannedMMps = (nominalTimeS > 0) ? distMM / nominalTimeS : 0;
+        float achievedMMps = (activeTimeS > 0) ? distMM / activeTimeS : 0;
+        uint32_t tickMs = MotionBlock::NS_IN_A_MS / MotionBlock::TICK_INTERVAL_NS;
+        return "{\"blocks\":" + String(_blocksExecuted) +
+                ",\"distMM\":" + String(distMM, 1) +
+                ",\"plannedMMps\":" + String(plannedMMps, 2) +
+                ",\"achievedMMps\":" + String(achievedMMps, 2) +
+                ",\"belowNominalMs\":" + String((_ticksBelowNominal + _ticksEmpty + _ticksNotReady) / tickMs) +
+                ",\"emptyMs\":" + String(_ticksEmpty / tickMs) +
+                ",\"notReadyMs\":" + String(_ticksNotReady / tickMs) +
+                ",\"underruns\":" + String(_underrunEvents) +
+                ",\"minPipeline\":" + String(_blocksExecuted > 0 ? _minPipelineCount : 0) + "}";
+    }
+
+private:
+    inline void IRAM_ATTR startUnderrun()
+    {
+        // Only count underruns which interrupt a pattern in progress
+        if (!_inUnderrun && (_blocksExecuted > 0))
+            _underrunEvents++;
+        _inUnderrun = true;
+    }
+
+    inline void IRAM_ATTR clear()
+    {
+        _ticksEmpty = 0;
+        _ticksNotReady = 0;
+        _ticksMoving = 0;
+        _ticksBelowNominal = 0;
+        _underrunEvents = 0;
+        _inUnderrun = false;
+        _blocksExecuted = 0;
+        _distUM = 0;
+        _nominalTimeMs = 0;
+        _nominalTimeRemUS = 0;
+        _minPipelineCount = 0xffffffff;
+        _resetRequested = false;
+        _resetOnCmdIdx = false;
+    }
+};
@@ -42,9 +42,6 @@ RampGenerator* RampGenerator::_pThis = NULL;
 
 RampGenerator::RampGenerator(MotionPipeline* pMotionPipeline)
 {
-    // Static refrerence to a single RampGenerator instance
-    _pThis = this;
-
     // Init
     _pMotionPipeline = pMotionPipeline;
     _isPaused = true;
@@ -57,6 +54,10 @@ RampGenerator::RampGenerator(MotionPipeline* pMotionPipeline)
     _endStopCheckNum = 0;
     _isrTimerStarted = false;
     _rampGenEnabled = false;
+    _appliedMicrostepShift = 0;
+    _requestedMicrostepShift = -1;
+    _blockIdx = 0;
+    _dirnBits = 0;
 
 #ifdef TEST_MOTION_ACTUATOR_ENABLE
     _pMotionInstrumentation = NULL;
@@ -84,6 +85,8 @@ void RampGenerator::deinit()
     {
         timerAlarmDisable(_isrMotionTimer);
         _isrTimerStarted = false;
+        if (_pThis == this)
+            _pThis = NULL;
     }
 #endif
 }
@@ -104,11 +107,20 @@ void RampGenerator::configure(bool rampGenEnabled)
 
 
     _rampGenEnabled = rampGenEnabled;
+
+    // ISR execution time budget is the ISR interval
+    _isrStats.setBudget(DIRECT_STEP_ISR_TIMER_PERIOD_US, getCpuFrequencyMhz());
+
+    // Drivers are configured with full microstepping
+    _appliedMicrostepShift = 0;
+    _requestedMicrostepShift = -1;
+
     // If we are using the ISR then create the Spark Interval Timer and start it
 #ifdef USE_ESP32_TIMER_ISR
     if (_rampGenEnabled)
     {
         Log.notice("RampGenerator: Starting ISR timer for direct stepping\n");
+        _pThis = this;
         _isrMotionTimer = timerBegin(0, CLOCK_RATE_MHZ, true);
         timerAttachInterrupt(_isrMotionTimer, _staticISRStepperMotion, true);
         timerAlarmWrite(_isrMotionTimer, DIRECT_STEP_ISR_TIMER_PERIOD_US, true);
@@ -122,6 +134,7 @@ void RampGenerator::stop()
 {
     _isPaused = true;
     _endStopReached = false;
+    _requestedMicrostepShift = -1;
 }
 
 void RampGenerator::pause(bool pauseIt)
@@ -168,6 +181,12 @@ int RampGenerator::getLastCompletedNumberedCmdIdx()
     return _lastDoneNumberedCmdIdx;
 }
 
+void RampGenerator::setAppliedMicrostepShift(uint8_t microstepShift)
+{
+    _appliedMicrostepShift = microstepShift;
+    _requestedMicrostepShift = -1;
+}
+
 // Handle the end of a step for any axis
 bool IRAM_ATTR RampGenerator::handleStepEnd()
 {
@@ -188,17 +207,23 @@ bool IRAM_ATTR RampGenerator::handleStepEnd()
 void IRAM_ATTR RampGenerator::setupNewBlock(MotionBlock *pBlock)
 {
     // Setup step counts, direction and endstops for each axis
+    // In a reduced microstep mode each step moves (1 << shift) configured microsteps
     _endStopCheckNum = 0;
+    _blockIdx++;
+    _dirnBits = 0;
+    int32_t stepInc = 1 << pBlock->_microstepShift;
     for (int axisIdx = 0; axisIdx < RobotConsts::MAX_AXES; axisIdx++)
     {
         // Total steps
         int32_t stepsTotal = pBlock->_stepsTotalMaybeNeg[axisIdx];
-        _stepsTotalAbs[axisIdx] = abs(stepsTotal);
+        _stepsTotalAbs[axisIdx] = uint32_t(abs(stepsTotal)) >> pBlock->_microstepShift;
         _curStepCount[axisIdx] = 0;
         _curAccumulatorRelative[axisIdx] = 0;
         // Set direction for the axis
         _rampGenIO.setDirection(axisIdx, stepsTotal >= 0);
-        _totalStepsInc[axisIdx] = (stepsTotal >= 0) ? 1 : -1;
+        _totalStepsInc[axisIdx] = (stepsTotal >= 0) ? stepInc : -stepInc;
+        if (stepsTotal >= 0)
+            _dirnBits |= 1 << axisIdx;
 
         // Instrumentation
         INSTRUMENT_MOTION_ACTUATOR_STEP_DIRN
@@ -287,6 +312,7 @@ bool IRAM_ATTR RampGenerator::handleStepMotion(MotionBlock *pBlock)
 {
     // Complete Flag
     bool anyAxisMoving = false;
+    uint8_t stepBits = 0;
 
     // Axis with most steps
     int axisIdxMaxSteps = pBlock->_axisIdxWithMaxSteps;
@@ -300,6 +326,7 @@ bool IRAM_ATTR RampGenerator::handleStepMotion(MotionBlock *pBlock)
         // Step this axis
         _rampGenIO.stepStart(axisIdxMaxSteps);
         _curStepCount[axisIdxMaxSteps]++;
+        stepBits |= 1 << axisIdxMaxSteps;
         if (_curStepCount[axisIdxMaxSteps] < _stepsTotalAbs[axisIdxMaxSteps])
             anyAxisMoving = true;
 
@@ -323,6 +350,7 @@ bool IRAM_ATTR RampGenerator::handleStepMotion(MotionBlock *pBlock)
             // Step the axis
             _rampGenIO.stepStart(axisIdx);
             _curStepCount[axisIdx]++;
+            stepBits |= 1 << axisIdx;
             if (_curStepCount[axisIdx] < _stepsTotalAbs[axisIdx])
                 anyAxisMoving = true;
 
@@ -331,6 +359,10 @@ bool IRAM_ATTR RampGenerator::handleStepMotion(MotionBlock *pBlock)
         }
     }
 
+    // Step trace
+    if (stepBits)
+        _stepTrace.record(stepBits, _dirnBits, _blockIdx);
+
     // Return indicator of block complete
     return anyAxisMoving;
 }
@@ -359,30 +391,51 @@ volatile int maxStepRt = -1;
 void IRAM_ATTR RampGenerator::_staticISRStepperMotion()
 {
     if (_pThis)
-        _pThis->isrStepperMotion();
+    {
+        uint32_t startCycles = XTHAL_GET_CCOUNT();
+        IsrStats::IsrPath path = _pThis->isrStepperMotion();
+        _pThis->_isrStats.record(path, startCycles);
+    }
 }
 
-void IRAM_ATTR RampGenerator::isrStepperMotion()
+// Returns the path taken through the ISR (for execution time stats)
+IsrStats::IsrPath IRAM_ATTR RampGenerator::isrStepperMotion()
 {    
     // Instrumentation code to time ISR execution (if enabled - see MotionInstrumentation.h)
     INSTRUMENT_MOTION_ACTUATOR_TIME_START
 
+    // Step trace cycle counter tracking
+    _stepTrace.tick();
+
     // Do a step-end for any motor which needs one - return here to avoid too short a pulse
     if (handleStepEnd())
-        return;
+        return IsrStats::PATH_STEP;
 
     // Check if paused
     if (_isPaused)
-        return;
+        return IsrStats::PATH_IDLE;
 
     // Peek a MotionPipelineElem from the queue
     MotionBlock *pBlock = _pMotionPipeline->peekGet();
     if (!pBlock)
-        return;
+    {
+        _motionStats.tickEmpty();
+        return IsrStats::PATH_IDLE;
+    }
 
     // Check if the element can be executed
     if (!pBlock->_canExecute)
-        return;
+    {
+        _motionStats.tickNotReady();
+        return IsrStats::PATH_IDLE;
+    }
+
+    // A new block in a different microstep mode waits until the drivers have been switched
+    if (!pBlock->_isExecuting && (pBlock->_microstepShift != _appliedMicrostepShift))
+    {
+        _requestedMicrostepShift = pBlock->_microstepShift;
+        return IsrStats::PATH_IDLE;
+    }
 
     // See if the block was already executing and set isExecuting if not
     bool newBlock = !pBlock->_isExecuting;
@@ -393,11 +446,12 @@ void IRAM_ATTR RampGenerator::isrStepperMotion()
     {
         // Setup new block
         setupNewBlock(pBlock);
+        _motionStats.blockStarted(pBlock, _pMotionPipeline->count());
 
         // Return here to reduce the maximum time this function takes
         // Assuming this function is called frequently (<50uS intervals say)
         // then it will make little difference if we return now and pick up on the next tick
-        return;
+        return IsrStats::PATH_NEW_BLOCK;
     }
 
     // Check endstops        
@@ -420,6 +474,7 @@ void IRAM_ATTR RampGenerator::isrStepperMotion()
     // Update the millisec accumulator - this handles the process of changing speed incrementally to
     // implement acceleration and deceleration
     updateMSAccumulator(pBlock);
+    _motionStats.tickMoving(_curStepRatePerTTicks < pBlock->_maxStepRatePerTTicks);
 
     // Bump the step accumulator
     _curAccumulatorStep += std::max(_curStepRatePerTTicks, MIN_STEP_RATE_PER_TTICKS);
@@ -454,6 +509,63 @@ void IRAM_ATTR RampGenerator::isrStepperMotion()
 
     // Time execution
     INSTRUMENT_MOTION_ACTUATOR_TIME_END
+    return IsrStats::PATH_STEP;
+}
+
+// Dry-run execution - the block at the head of the pipeline is treated as executing (as the ISR
+// would have started it) so the planner doesn't replan it and blocks are only completed when
+// the pipeline is full to keep the planner's lookahead as it would be when running
+float RampGenerator::dryRunExecute(bool flush)
+{
+    float durationS = 0;
+    while (true)
+    {
+        MotionBlock *pBlock = _pMotionPipeline->peekGet();
+        if (!pBlock || !pBlock->_canExecute)
+            break;
+        pBlock->_isExecuting = true;
+        if (!flush && _pMotionPipeline->canAccept())
+            break;
+        durationS += getBlockDurationS(*pBlock);
+        endMotion(pBlock);
+    }
+    return durationS;
+}
+
+// Duration of a block - the ISR accelerates from the initial step rate until the max step rate is
+// reached or _stepsBeforeDecel steps have been made and then decelerates to (and holds) the final
+// step rate - rates are steps per TTICKS_VALUE ticks and acceleration is per ms
+float RampGenerator::getBlockDurationS(const MotionBlock &block)
+{
+    const float rateToStepsPerSec = MotionBlock::TICKS_PER_SEC / MotionBlock::TTICKS_VALUE;
+    float numSteps = float(uint32_t(abs(block._stepsTotalMaybeNeg[block._axisIdxWithMaxSteps])) >> block._microstepShift);
+    float stepsBeforeDecel = std::min(float(block._stepsBeforeDecel), numSteps);
+    float minRate = MIN_STEP_RATE_PER_SEC;
+    float initialRate = std::max(block._initialStepRatePerTTicks * rateToStepsPerSec, minRate);
+    float maxRate = std::max(block._maxStepRatePerTTicks * rateToStepsPerSec, initialRate);
+    float finalRate = std::max(block._finalStepRatePerTTicks * rateToStepsPerSec, minRate);
+    float acc = block._accStepsPerTTicksPerMS * rateToStepsPerSec * 1000;
+    if (acc <= 0)
+        return numSteps / maxRate;
+
+    // Accelerate (possibly not reaching the max rate) then cruise
+    float stepsAccelerating = (maxRate * maxRate - initialRate * initialRate) / 2 / acc;
+    float peakRate = maxRate;
+    if (stepsAccelerating > stepsBeforeDecel)
+    {
+        stepsAccelerating = stepsBeforeDecel;
+        peakRate = sqrtf(initialRate * initialRate + 2 * acc * stepsBeforeDecel);
+    }
+    float durationS = (peakRate - initialRate) / acc + (stepsBeforeDecel - stepsAccelerating) / peakRate;
+
+    // Decelerate to the final rate and hold it for any remaining steps
+    float stepsDecelerating = numSteps - stepsBeforeDecel;
+    float stepsToFinalRate = (peakRate * peakRate - finalRate * finalRate) / 2 / acc;
+    if (stepsToFinalRate >= stepsDecelerating)
+        durationS += (peakRate - sqrtf(peakRate * peakRate - 2 * acc * stepsDecelerating)) / acc;
+    else
+        durationS += std::max(peakRate - finalRate, 0.0f) / acc + (stepsDecelerating - std::max(stepsToFinalRate, 0.0f)) / std::min(peakRate, finalRate);
+    return durationS;
 }
 
 // Process method called by main program loop
@@ -11,13 +11,17 @@
 #include "MotionInstrumentation.h"
 #include "../MotionBlock.h"
 #include "RampGenIO.h"
+#include "StepTrace.h"
+#include "IsrStats.h"
+#include "MotionStats.h"
 
 class MotionPipeline;
 
 class RampGenerator
 {
 private:
-    // This singleton
+    // Instance driven by the ISR timer (only one instance can own the timer - other
+    // instances, such as those used for dry-run estimates, execute blocks without it)
     static RampGenerator* _pThis;
 
     // If this is true nothing will move
@@ -27,9 +31,25 @@ private:
     volatile int32_t _axisTotalSteps[RobotConsts::MAX_AXES];
     volatile int32_t _totalStepsInc[RobotConsts::MAX_AXES];
 
+    // Microstep mode currently applied to the drivers and mode requested by the next block (-1 if none)
+    volatile uint8_t _appliedMicrostepShift;
+    volatile int8_t _requestedMicrostepShift;
+
     // Pipeline of blocks to be processed
     MotionPipeline* _pMotionPipeline;
 
+    // Step trace recording
+    StepTrace _stepTrace;
+    // Count of blocks started and direction bits (per axis) of the current block
+    uint16_t _blockIdx;
+    uint8_t _dirnBits;
+
+    // ISR execution time stats
+    IsrStats _isrStats;
+
+    // Pattern motion stats (underruns and achieved speed)
+    MotionStats _motionStats;
+
     // Motors and endstops
     RampGenIO _rampGenIO;
 
@@ -87,6 +107,12 @@ public:
     void setInstrumentationMode(const char *testModeStr);
     void deinit();
     void configure(bool rampGenEnabled);
+
+    // Dry-run execution (no ISR) - blocks are executed instantly once the pipeline is full
+    // (or all blocks if flushing) and the total of their durations returned
+    float dryRunExecute(bool flush);
+    // Duration of a block as executed by the ISR (analytic from the block's step profile)
+    static float getBlockDurationS(const MotionBlock &block);
     bool configureAxis(int axisIdx, const char *axisJSON)
     {
         return _rampGenIO.configureAxis(axisIdx, axisJSON);
@@ -104,13 +130,35 @@ public:
     }
     bool isEndStopReached();
     int getLastCompletedNumberedCmdIdx();
+    // Microstep mode changes are requested by the ISR and applied outside it
+    int getRequestedMicrostepShift()
+    {
+        return _requestedMicrostepShift;
+    }
+    uint8_t getAppliedMicrostepShift()
+    {
+        return _appliedMicrostepShift;
+    }
+    void setAppliedMicrostepShift(uint8_t microstepShift);
+    StepTrace& getStepTrace()
+    {
+        return _stepTrace;
+    }
+    IsrStats& getIsrStats()
+    {
+        return _isrStats;
+    }
+    MotionStats& getMotionStats()
+    {
+        return _motionStats;
+    }
     void process();
     String getDebugStr();
     void showDebug();
 
 private:
     static void _staticISRStepperMotion();
-    void isrStepperMotion();
+    IsrStats::IsrPath isrStepperMotion();
     bool handleStepEnd();
     void setupNewBlock(MotionBlock *pBlock);
     void updateMSAccumulator(MotionBlock *pBlock);
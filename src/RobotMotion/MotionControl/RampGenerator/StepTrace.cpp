@@ -0,0 +1,149 @@
+// RBotFirmware
+// Rob Dobson 2016-2018
+
+#include "StepTrace.h"
+#include <ArduinoLog.h>
+#include "FileManager.h"
+
+static const char* MODULE_PREFIX = "StepTrace: ";
+
+StepTrace::StepTrace()
+{
+    _pBuf = NULL;
+    _putPos = 0;
+    _getPos = 0;
+    _isActive = false;
+    _stopRequested = false;
+    _droppedCount = 0;
+    _lastCycleCount = 0;
+    _cycleCountWraps = 0;
+    _pFileManager = NULL;
+    _pFile = NULL;
+    _drainTask = NULL;
+    _recordsWritten = 0;
+}
+
+StepTrace::~StepTrace()
+{
+    _isActive = false;
+    if (_drainTask)
+        vTaskDelete(_drainTask);
+    cleanUp();
+}
+
+bool StepTrace::start(FileManager &fileManager, const char *pFileSystem, const char *pFilename)
+{
+    // Check not already tracing
+    if (_drainTask)
+    {
+        Log.warning("%salready tracing\n", MODULE_PREFIX);
+        return false;
+    }
+
+    // Buffer
+    _pBuf = new StepTraceRecord[TRACE_BUF_RECORDS];
+    if (!_pBuf)
+    {
+        Log.warning("%sfailed to allocate buffer\n", MODULE_PREFIX);
+        return false;
+    }
+
+    // File and header
+    _pFileManager = &fileManager;
+    _pFile = fileManager.writeFileOpen(pFileSystem, pFilename);
+    if (!_pFile)
+    {
+        Log.warning("%sfailed to open %s/%s\n", MODULE_PREFIX, pFileSystem, pFilename);
+        cleanUp();
+        return false;
+    }
+    StepTraceFileHeader header;
+    memset(&header, 0, sizeof(header));
+    header._magic = FILE_MAGIC;
+    header._version = FILE_VERSION;
+    header._recordSize = sizeof(StepTraceRecord);
+    header._cycleCountHz = getCpuFrequencyMhz() * 1000000;
+    header._numAxes = RobotConsts::MAX_AXES;
+    fileManager.writeFileBlock(_pFile, (const uint8_t *)&header, sizeof(header));
+
+    // Reset and start the drain task (lower priority than the main loop)
+    _putPos = 0;
+    _getPos = 0;
+    _droppedCount = 0;
+    _recordsWritten = 0;
+    _cycleCountWraps = 0;
+    _lastCycleCount = XTHAL_GET_CCOUNT();
+    _stopRequested = false;
+    if (xTaskCreate(drainTaskFn, "StepTrace", 3000, this, tskIDLE_PRIORITY, &_drainTask) != pdPASS)
+    {
+        Log.warning("%sfailed to start task\n", MODULE_PREFIX);
+        _drainTask = NULL;
+        cleanUp();
+        return false;
+    }
+    _isActive = true;
+    Log.notice("%sstarted %s/%s\n", MODULE_PREFIX, pFileSystem, pFilename);
+    return true;
+}
+
+void StepTrace::stop()
+{
+    _stopRequested = true;
+}
+
+String StepTrace::getStatusJSON()
+{
+    return "{\"active\":" + String(_isActive ? 1 : 0) +
+                ",\"written\":" + String(_recordsWritten) +
+                ",\"dropped\":" + String(_droppedCount) + "}";
+}
+
+void StepTrace::drainTaskFn(void *pParam)
+{
+    StepTrace *pThis = (StepTrace *)pParam;
+    while (true)
+    {
+        // Stop recording before the final drain
+        bool stopping = pThis->_stopRequested;
+        if (stopping)
+        {
+            // Allow any ISR record in progress to complete
+            pThis->_isActive = false;
+            vTaskDelay(1);
+        }
+        pThis->drain();
+        if (stopping)
+            break;
+        vTaskDelay(DRAIN_INTERVAL_MS / portTICK_PERIOD_MS);
+    }
+    Log.notice("%sstopped written %d dropped %d\n", MODULE_PREFIX, pThis->_recordsWritten, pThis->_droppedCount);
+    pThis->cleanUp();
+    pThis->_drainTask = NULL;
+    vTaskDelete(NULL);
+}
+
+void StepTrace::drain()
+{
+    // Write contiguous runs of records
+    while (_getPos != _putPos)
+    {
+        uint32_t putPos = _putPos;
+        uint32_t runEnd = (putPos > _getPos) ? putPos : TRACE_BUF_RECORDS;
+        uint32_t runLen = runEnd - _getPos;
+        if (runLen > DRAIN_RECORDS_MAX)
+            runLen = DRAIN_RECORDS_MAX;
+        if (_pFile)
+            _pFileManager->writeFileBlock(_pFile, (const uint8_t *)(_pBuf + _getPos), runLen * sizeof(StepTraceRecord));
+        _recordsWritten += runLen;
+        _getPos = (_getPos + runLen) % TRACE_BUF_RECORDS;
+    }
+}
+
+void StepTrace::cleanUp()
+{
+    if (_pFile)
+        _pFileManager->writeFileClose(_pFile);
+    _pFile = NULL;
+    delete[] _pBuf;
+    _pBuf = NULL;
+}
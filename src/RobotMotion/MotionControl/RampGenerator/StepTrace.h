@@ -0,0 +1,125 @@
+// RBotFirmware
+// Rob Dobson 2016-2018
+
+#pragma once
+
+#include <Arduino.h>
+#include <stdio.h>
+#include "xtensa/core-macros.h"
+#include "RobotConsts.h"
+
+class FileManager;
+
+// Step trace - records the step events emitted by the ramp generator ISR
+// Records are written by the ISR into a ring buffer (single producer, single consumer - the
+// indices are volatile which on the ESP32 also serialises the memory accesses) and a low
+// priority task drains the buffer to a binary file through the FileManager (so file system
+// access is serialised with other users) - see tools/steptrace_to_vcd.py
+// File format (little-endian):
+//    header  - StepTraceFileHeader
+//    records - StepTraceRecord repeated
+class StepTrace
+{
+public:
+    static constexpr uint32_t FILE_MAGIC = 0x54534252; // "RBST"
+    static constexpr uint16_t FILE_VERSION = 1;
+    static constexpr int TRACE_BUF_RECORDS = 2048;
+    static constexpr int DRAIN_RECORDS_MAX = 256;
+    static constexpr uint32_t DRAIN_INTERVAL_MS = 20;
+    static constexpr const char *TRACE_FILE_SYSTEM = "sd";
+    static constexpr const char *TRACE_FILE_NAME = "steptrace.bin";
+
+    struct StepTraceFileHeader
+    {
+        uint32_t _magic;
+        uint16_t _version;
+        uint16_t _recordSize;
+        uint32_t _cycleCountHz;
+        uint8_t _numAxes;
+        uint8_t _pad[3];
+    };
+
+    // Cycle count is extended by the number of times it has wrapped
+    struct StepTraceRecord
+    {
+        uint32_t _cycleCount;
+        uint16_t _cycleCountWraps;
+        uint16_t _blockIdx;
+        uint8_t _stepBits;
+        uint8_t _dirnBits;
+        uint8_t _pad[2];
+    };
+
+private:
+    // Ring buffer (only allocated while tracing)
+    StepTraceRecord *_pBuf;
+    volatile uint32_t _putPos;
+    volatile uint32_t _getPos;
+    volatile bool _isActive;
+    volatile bool _stopRequested;
+    volatile uint32_t _droppedCount;
+
+    // Cycle count wrap tracking
+    uint32_t _lastCycleCount;
+    uint16_t _cycleCountWraps;
+
+    // Output
+    FileManager *_pFileManager;
+    FILE *_pFile;
+    TaskHandle_t _drainTask;
+    uint32_t _recordsWritten;
+
+public:
+    StepTrace();
+    ~StepTrace();
+
+    // Start and stop - recording stops when the file is closed by the drain task
+    bool start(FileManager &fileManager, const char *pFileSystem = TRACE_FILE_SYSTEM,
+                const char *pFilename = TRACE_FILE_NAME);
+    void stop();
+    bool isBusy()
+    {
+        return _drainTask != NULL;
+    }
+    String getStatusJSON();
+
+    // Called at the start of every ISR tick to track cycle counter wraps
+    inline void IRAM_ATTR tick()
+    {
+        if (!_isActive)
+            return;
+        uint32_t cycleCount = XTHAL_GET_CCOUNT();
+        if (cycleCount < _lastCycleCount)
+            _cycleCountWraps++;
+        _lastCycleCount = cycleCount;
+    }
+
+    // Called from the ISR for each step event (bits are per axis)
+    inline void IRAM_ATTR record(uint8_t stepBits, uint8_t dirnBits, uint16_t blockIdx)
+    {
+        if (!_isActive)
+            return;
+        uint32_t nextPos = (_putPos + 1) % TRACE_BUF_RECORDS;
+        if (nextPos == _getPos)
+        {
+            _droppedCount++;
+            return;
+        }
+        uint32_t cycleCount = XTHAL_GET_CCOUNT();
+        if (cycleCount < _lastCycleCount)
+            _cycleCountWraps++;
+        _lastCycleCount = cycleCount;
+        StepTraceRecord &rec = _pBuf[_putPos];
+        rec._cycleCount = cycleCount;
+        rec._cycleCountWraps = _cycleCountWraps;
+        rec._blockIdx = blockIdx;
+        rec._stepBits = stepBits;
+        rec._dirnBits = dirnBits;
+        _putPos = nextPos;
+    }
+
+private:
+    static void drainTaskFn(void *pParam);
+    void drain();
+    void cleanUp();
+};
@@ -19,13 +19,28 @@ TrinamicsController* TrinamicsController::_pThisObj = NULL;
 
 TrinamicsController::TrinamicsController(AxesParams& axesParams, MotionPipeline& motionPipeline)
     : _axesParams(axesParams), _motionPipeline(motionPipeline) {
-    _pThisObj = this;
+    // Timer callback goes to the first instance (others, such as dry-run, have no hardware)
+    if (!_pThisObj) _pThisObj = this;
     _isEnabled = false;
     _isRampGenerator = false;
     _tx1 = _tx2 = -1;
+    _microsteps = 16;
+    _highSpeedMicrostepShift = 0;
+    _highSpeedStepRatePerSec = 0;
+    _curMicrostepShift = 0;
+    _uartDriversAreTMC2209 = false;
+    for (int driverIdx = 0; driverIdx < MAX_TMC_UART_DRIVERS; driverIdx++) {
+        _pUartSerial[driverIdx] = NULL;
+        _pUartDrivers[driverIdx] = NULL;
+        _fullStepPhase[driverIdx]._polarity = 0;
+    }
+    invalidateFullStepPhase();
 }
 
-TrinamicsController::~TrinamicsController() { deinit(); }
+TrinamicsController::~TrinamicsController() {
+    deinit();
+    if (_pThisObj == this) _pThisObj = NULL;
+}
 
 void TrinamicsController::deinit() {
     // Release pins
@@ -33,6 +48,21 @@ void TrinamicsController::deinit() {
     if (_tx2 >= 0) pinMode(_tx2, INPUT);
     _tx1 = _tx2 = -1;
 
+    // Release drivers
+    for (int driverIdx = 0; driverIdx < MAX_TMC_UART_DRIVERS; driverIdx++) {
+        if (_uartDriversAreTMC2209)
+            delete static_cast<TMC2209Stepper*>(_pUartDrivers[driverIdx]);
+        else
+            delete _pUartDrivers[driverIdx];
+        _pUartDrivers[driverIdx] = NULL;
+        delete _pUartSerial[driverIdx];
+        _pUartSerial[driverIdx] = NULL;
+    }
+    _uartDriversAreTMC2209 = false;
+    _highSpeedMicrostepShift = 0;
+    _curMicrostepShift = 0;
+    invalidateFullStepPhase();
+
     _isEnabled = false;
 }
 
@@ -69,85 +99,146 @@ void TrinamicsController::configure(const char* configJSON) {
         int _irun = RdJson::getDouble("run_current", 600, motionController.c_str());
         int _msteps = RdJson::getDouble("microsteps", 16, motionController.c_str());
         int _stealthChop = RdJson::getDouble("stealthChop", 0, motionController.c_str());
+        _microsteps = _msteps;
 
-        // Configure TMC2208s
-        if (mcChip == "TMC2208") {
-            HardwareSerial serial1 = HardwareSerial(1);
-            HardwareSerial serial2 = HardwareSerial(2);
-            TMC2208Stepper driver_1 = TMC2208Stepper(&serial1, 0.11f);
-            TMC2208Stepper driver_2 = TMC2208Stepper(&serial2, 0.11f);
-
-            serial1.begin(115200, SERIAL_8N1, 34, _tx1);
-            serial2.begin(115200, SERIAL_8N1, 34, _tx2);
-            
-            driver_1.reset();
-            driver_2.reset();
-
-            driver_1.begin();
-            driver_1.toff(_toff);          // Enables driver in software
-            driver_1.rms_current(_irun);   // Set motor RMS current
-            driver_1.microsteps(_msteps);  // Set microsteps to 1/16th
-            driver_1.intpol(true);
-
-            if (_stealthChop == 1) {
-                driver_1.pwm_autoscale(true);
-                driver_1.en_spreadCycle(false);
-            } else {
-                driver_1.en_spreadCycle(true);
+        // Speed-dependent microstep switching (highSpeedMicrosteps must be a power-of-two fraction of microsteps)
+        int highSpeedMicrosteps = RdJson::getLong("highSpeedMicrosteps", 0, motionController.c_str());
+        _highSpeedStepRatePerSec = RdJson::getDouble("highSpeedStepRate", 0, motionController.c_str());
+        _highSpeedMicrostepShift = 0;
+        if ((highSpeedMicrosteps > 0) && (_highSpeedStepRatePerSec > 0)) {
+            while ((_highSpeedMicrostepShift < 8) && ((_msteps >> (_highSpeedMicrostepShift + 1)) >= highSpeedMicrosteps))
+                _highSpeedMicrostepShift++;
+            if ((_msteps >> _highSpeedMicrostepShift) != highSpeedMicrosteps) {
+                Log.warning("%shighSpeedMicrosteps %d invalid for microsteps %d\n", MODULE_PREFIX, highSpeedMicrosteps, _msteps);
+                _highSpeedMicrostepShift = 0;
             }
+        }
+        Log.notice("%s%s microsteps %d highSpeedMicrosteps %d above %F steps/s\n", MODULE_PREFIX, mcChip.c_str(), _msteps,
+                   _msteps >> _highSpeedMicrostepShift, _highSpeedStepRatePerSec);
 
-            driver_2.begin();
-            driver_2.toff(_toff);          // Enables driver in software
-            driver_2.rms_current(_irun);   // Set motor RMS current
-            driver_2.microsteps(_msteps);  // Set microsteps to 1/16th
-            driver_2.intpol(true);
-
-            if (_stealthChop == 1) {
-                driver_2.pwm_autoscale(true);
-                driver_2.en_spreadCycle(false);
-            } else {
-                driver_2.en_spreadCycle(true);
-            }
+        // Serial ports and drivers are retained so that the microstep mode can be changed while running
+        _pUartSerial[0] = new HardwareSerial(1);
+        _pUartSerial[1] = new HardwareSerial(2);
+        _pUartSerial[0]->begin(115200, SERIAL_8N1, 34, _tx1);
+        _pUartSerial[1]->begin(115200, SERIAL_8N1, 34, _tx2);
+
+        // Configure TMC2208s
+        if (mcChip == "TMC2208") {
+            _pUartDrivers[0] = new TMC2208Stepper(_pUartSerial[0], 0.11f);
+            _pUartDrivers[1] = new TMC2208Stepper(_pUartSerial[1], 0.11f);
         }
 
         // Configure TMC2209s
         if (mcChip == "TMC2209") {
-            HardwareSerial serial1 = HardwareSerial(1);
-            HardwareSerial serial2 = HardwareSerial(2);
-            TMC2209Stepper driver_1 = TMC2209Stepper(&serial1, 0.11f, 0);
-            TMC2209Stepper driver_2 = TMC2209Stepper(&serial2, 0.11f, 0);
-
-            serial1.begin(115200, SERIAL_8N1, 34, _tx1);
-            serial2.begin(115200, SERIAL_8N1, 34, _tx2);
-            driver_1.reset();
-            driver_2.reset();
-
-            driver_1.begin();
-            driver_1.toff(_toff);          // Enables driver in software
-            driver_1.rms_current(_irun);   // Set motor RMS current
-            driver_1.microsteps(_msteps);  // Set microsteps to 1/16th
-            driver_1.intpol(true);
-
-            if (_stealthChop == 1) {
-                driver_1.pwm_autoscale(true);
-                driver_1.en_spreadCycle(false);
-            } else {
-                driver_1.en_spreadCycle(true);
-            }
+            _pUartDrivers[0] = new TMC2209Stepper(_pUartSerial[0], 0.11f, 0);
+            _pUartDrivers[1] = new TMC2209Stepper(_pUartSerial[1], 0.11f, 0);
+            _uartDriversAreTMC2209 = true;
+        }
+
+        for (int driverIdx = 0; driverIdx < MAX_TMC_UART_DRIVERS; driverIdx++)
+            _pUartDrivers[driverIdx]->reset();
+        for (int driverIdx = 0; driverIdx < MAX_TMC_UART_DRIVERS; driverIdx++)
+            setupUartDriver(_pUartDrivers[driverIdx], _toff, _irun, _stealthChop);
+    }
+}
+
+void TrinamicsController::setupUartDriver(TMC2208Stepper* pDriver, int toff, int irun, int stealthChop) {
+    pDriver->begin();
+    pDriver->toff(toff);               // Enables driver in software
+    pDriver->rms_current(irun);        // Set motor RMS current
+    pDriver->microsteps(_microsteps);  // Set microsteps (normally 1/16th)
+    pDriver->intpol(true);
 
-            driver_2.begin();
-            driver_2.toff(_toff);          // Enables driver in software
-            driver_2.rms_current(_irun);   // Set motor RMS current
-            driver_2.microsteps(_msteps);  // Set microsteps to 1/16th
-            driver_2.intpol(true);
-
-            if (_stealthChop == 1) {
-                driver_2.pwm_autoscale(true);
-                driver_2.en_spreadCycle(false);
-            } else {
-                driver_2.en_spreadCycle(true);
+    if (stealthChop == 1) {
+        pDriver->pwm_autoscale(true);
+        pDriver->en_spreadCycle(false);
+    } else {
+        pDriver->en_spreadCycle(true);
+    }
+}
+
+// Change the microstep resolution of all drivers - the caller must ensure this happens between
+// blocks with the motors at a full-step position
+bool TrinamicsController::setMicrostepShift(uint8_t microstepShift) {
+    if (!_isEnabled || (microstepShift > _highSpeedMicrostepShift))
+        return false;
+    if (microstepShift == _curMicrostepShift)
+        return true;
+    for (int driverIdx = 0; driverIdx < MAX_TMC_UART_DRIVERS; driverIdx++) {
+        if (_pUartDrivers[driverIdx])
+            _pUartDrivers[driverIdx]->microsteps(_microsteps >> microstepShift);
+    }
+    _curMicrostepShift = microstepShift;
+    return true;
+}
+
+// Sample MSCNT for each driver (call only when motion is idle) and derive the step count
+// positions which coincide with a full step - the full step positions (equal coil currents) are
+// at MSCNT 128 + 256k - once the phase is known each later sample (at a different position) is
+// checked against it and a mismatch (e.g. lost steps or a driver reset) means relearning
+void TrinamicsController::calibrateFullStepPhase(AxisInt32s& actuatorPos) {
+    if (!isMicrostepSwitchEnabled())
+        return;
+    int32_t mscntPerMicrostep = TMC_MSCNT_PER_FULL_STEP / _microsteps;
+    int32_t tableSizeSteps = TMC_MSCNT_TABLE_SIZE / mscntPerMicrostep;
+    for (int driverIdx = 0; driverIdx < MAX_TMC_UART_DRIVERS; driverIdx++) {
+        if (!_pUartDrivers[driverIdx])
+            continue;
+        FullStepPhase& fsp = _fullStepPhase[driverIdx];
+        int32_t steps = actuatorPos.getVal(driverIdx);
+
+        // Microsteps from the full step position at MSCNT 128 (which must be on a microstep)
+        int32_t mscntFromFullStep = (_pUartDrivers[driverIdx]->MSCNT() + TMC_MSCNT_TABLE_SIZE - TMC_MSCNT_FULL_STEP_OFFSET) %
+                    TMC_MSCNT_TABLE_SIZE;
+        if ((mscntFromFullStep % mscntPerMicrostep) != 0) {
+            Log.warning("%sdriver %d MSCNT %d not on a microstep\n", MODULE_PREFIX, driverIdx, _pUartDrivers[driverIdx]->MSCNT());
+            fsp._sampleValid = false;
+            fsp._phaseValid = false;
+            continue;
+        }
+        int32_t microstepCount = mscntFromFullStep / mscntPerMicrostep;
+
+        // MSCNT direction depends on wiring and DIR polarity so learn it from two differing samples
+        // and, once known, check that later samples agree (to within the whole MSCNT table)
+        if (fsp._sampleValid && (steps != fsp._sampleSteps)) {
+            int32_t stepsDiff = steps - fsp._sampleSteps;
+            int32_t countDiff = microstepCount - fsp._sampleMicrostepCount;
+            bool fwdMatch = ((((countDiff - stepsDiff) % tableSizeSteps) + tableSizeSteps) % tableSizeSteps) == 0;
+            bool revMatch = ((((countDiff + stepsDiff) % tableSizeSteps) + tableSizeSteps) % tableSizeSteps) == 0;
+            if (fsp._polarity == 0) {
+                if (fwdMatch != revMatch)
+                    fsp._polarity = fwdMatch ? 1 : -1;
+            } else if (!(fsp._polarity > 0 ? fwdMatch : revMatch)) {
+                Log.warning("%sdriver %d MSCNT doesn't match step position - relearning full-step phase\n",
+                            MODULE_PREFIX, driverIdx);
+                fsp._polarity = 0;
+                fsp._phaseValid = false;
             }
         }
+        fsp._sampleValid = true;
+        fsp._sampleSteps = steps;
+        fsp._sampleMicrostepCount = microstepCount;
+
+        // Phase is the step count (modulo a full step) at which MSCNT is on a full step
+        if (fsp._polarity != 0) {
+            fsp._phase = (((steps - fsp._polarity * microstepCount) % _microsteps) + _microsteps) % _microsteps;
+            fsp._phaseValid = true;
+        }
+    }
+}
+
+bool TrinamicsController::getFullStepPhase(int axisIdx, int32_t& phase) {
+    if ((axisIdx < 0) || (axisIdx >= MAX_TMC_UART_DRIVERS) || !_fullStepPhase[axisIdx]._phaseValid)
+        return false;
+    phase = _fullStepPhase[axisIdx]._phase;
+    return true;
+}
+
+// Step count positions changed (e.g. homed) - the MSCNT polarity is retained
+void TrinamicsController::invalidateFullStepPhase() {
+    for (int driverIdx = 0; driverIdx < MAX_TMC_UART_DRIVERS; driverIdx++) {
+        _fullStepPhase[driverIdx]._sampleValid = false;
+        _fullStepPhase[driverIdx]._phaseValid = false;
     }
 }
 
@@ -8,6 +8,9 @@
 #include "../../AxesParams.h"
 #include "../MotionPipeline.h"
 
+class TMC2208Stepper;
+class HardwareSerial;
+
 class TrinamicsController
 {
 public:
@@ -30,6 +33,35 @@ public:
         return _isRampGenerator;
     }
 
+    // Speed-dependent microstep switching - the high speed mode is expressed as a
+    // power-of-two reduction (shift) of the configured microstep count
+    bool isMicrostepSwitchEnabled()
+    {
+        return _isEnabled && (_highSpeedMicrostepShift > 0);
+    }
+    uint8_t getHighSpeedMicrostepShift()
+    {
+        return _highSpeedMicrostepShift;
+    }
+    float getHighSpeedStepRatePerSec()
+    {
+        return _highSpeedStepRatePerSec;
+    }
+    int getMicrosteps()
+    {
+        return _microsteps;
+    }
+    int getNumMicrostepSwitchAxes()
+    {
+        return MAX_TMC_UART_DRIVERS;
+    }
+    bool setMicrostepShift(uint8_t microstepShift);
+
+    // Full-step phase of each driver relative to the step count (from MSCNT)
+    void calibrateFullStepPhase(AxisInt32s& actuatorPos);
+    bool getFullStepPhase(int axisIdx, int32_t& phase);
+    void invalidateFullStepPhase();
+
     void _timerCallback(void* arg);
 
     static void _staticTimerCb(void* arg)
@@ -215,7 +247,16 @@ private:
     static const int TMC2130_REG_DCCTRL = 0x6E;
     static const int TMC2130_REG_DRVSTATUS = 0x6F;
 
+    // TMC UART drivers
+    static constexpr int MAX_TMC_UART_DRIVERS = 2;
+
+    // Size of the MSCNT microstep table (covers 4 full steps) - full steps are at 128 + 256k
+    static constexpr int TMC_MSCNT_TABLE_SIZE = 1024;
+    static constexpr int TMC_MSCNT_PER_FULL_STEP = 256;
+    static constexpr int TMC_MSCNT_FULL_STEP_OFFSET = 128;
+
     // Helpers
+    void setupUartDriver(TMC2208Stepper* pDriver, int toff, int irun, int stealthChop);
     int getPinAndConfigure(const char* configJSON, const char* pinSelector, int direction, int initValue);
     uint64_t tmcWrite(int chipIdx, uint8_t cmd, uint32_t data, bool addWriteFlag=true);
     uint8_t tmcReadLastAndSetCmd(int chipIdx, uint8_t cmd, uint32_t& dataOut);
@@ -288,6 +329,30 @@ private:
     int _tx1;
     int _tx2;
 
+    // UART drivers (driver index is axis index)
+    HardwareSerial* _pUartSerial[MAX_TMC_UART_DRIVERS];
+    TMC2208Stepper* _pUartDrivers[MAX_TMC_UART_DRIVERS];
+    bool _uartDriversAreTMC2209;
+
+    // Microstepping - configured (fine) value, high speed reduction and threshold
+    int _microsteps;
+    uint8_t _highSpeedMicrostepShift;
+    float _highSpeedStepRatePerSec;
+    uint8_t _curMicrostepShift;
+
+    // Full-step phase - MSCNT polarity relative to step count is learned from two
+    // samples taken at different positions and checked by each later sample
+    struct FullStepPhase
+    {
+        bool _sampleValid;
+        int32_t _sampleSteps;
+        int32_t _sampleMicrostepCount;
+        int _polarity;
+        bool _phaseValid;
+        int32_t _phase;
+    };
+    FullStepPhase _fullStepPhase[MAX_TMC_UART_DRIVERS];
+
     static constexpr uint32_t TRINAMIC_TIMER_PERIOD_US = 500;
     static constexpr double TRINAMIC_CLOCK_FACTOR = 75.0;
     static const int SPI_CLOCK_HZ = 2000000;
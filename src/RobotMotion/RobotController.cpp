@@ -8,6 +8,7 @@
 #include "ConfigBase.h"
 #include "RdJson.h"
 #include "RobotCommandArgs.h"
+#include "MoveCmd.h"
 
 // Robot types
 #include "Robots/RobotSandTableRotary.h"
@@ -16,11 +17,13 @@ RobotController::RobotController()
 {
     // Init
     _pRobot = NULL;
+    _pMotionHelper = NULL;
 }
 
 RobotController::~RobotController()
 {
     delete _pRobot;
+    delete _pMotionHelper;
 }
 
 bool RobotController::init(const char* configStr)
@@ -37,7 +40,9 @@ bool RobotController::init(const char* configStr)
     if (robotModel.equalsIgnoreCase("SandBotRotary"))
     {
         Log.notice("Constructing %s\n", robotModel.c_str());
-        _pRobot = new RobotSandTableRotary(robotModel.c_str(), _motionHelper);
+        if (!_pMotionHelper)
+            _pMotionHelper = new MotionHelperSandTableRotary();
+        _pRobot = new RobotSandTableRotary(robotModel.c_str(), *_pMotionHelper);
         if (!_pRobot)
             return false;
         _pRobot->init(configStr);
@@ -49,7 +54,7 @@ bool RobotController::init(const char* configStr)
 
     if (_pRobot)
     {
-        _motionHelper.setIntrumentationMode(INSTRUMENT_MOTION_ACTUATOR_CONFIG);
+        _pMotionHelper->setIntrumentationMode(INSTRUMENT_MOTION_ACTUATOR_CONFIG);
         _pRobot->pause(false);
     }
 
@@ -109,11 +114,11 @@ bool RobotController::canAcceptCommand()
     return _pRobot->canAcceptCommand();
 }
 
-void RobotController::moveTo(RobotCommandArgs& args)
+void RobotController::moveTo(MoveCmd& moveCmd)
 {
     if (!_pRobot)
         return;
-    _pRobot->moveTo(args);
+    _pRobot->moveTo(moveCmd);
 }
 
 // Set motion parameters
@@ -166,5 +171,120 @@ bool RobotController::wasActiveInLastNSeconds(int nSeconds)
 
 String RobotController::getDebugStr()
 {
-    return _motionHelper.getDebugStr();
+    if (!_pMotionHelper)
+        return "";
+    return _pMotionHelper->getDebugStr();
+}
+
+// Step trace recording
+bool RobotController::stepTraceStart(FileManager& fileManager)
+{
+    if (!_pMotionHelper)
+        return false;
+    return _pMotionHelper->getStepTrace().start(fileManager);
+}
+
+void RobotController::stepTraceStop()
+{
+    if (!_pMotionHelper)
+        return;
+    _pMotionHelper->getStepTrace().stop();
+}
+
+String RobotController::getStepTraceStatus()
+{
+    if (!_pMotionHelper)
+        return "{}";
+    return _pMotionHelper->getStepTrace().getStatusJSON();
+}
+
+// ISR execution time stats
+String RobotController::getIsrStats(bool reset)
+{
+    if (!_pMotionHelper)
+        return "{}";
+    String statsStr = _pMotionHelper->getIsrStats().getJSON();
+    if (reset)
+        _pMotionHelper->getIsrStats().reset();
+    return statsStr;
+}
+
+// Pattern motion stats
+void RobotController::setMotionWorkPending(bool workPending)
+{
+    if (!_pMotionHelper)
+        return;
+    _pMotionHelper->getMotionStats().setWorkPending(workPending);
+}
+
+bool RobotController::isMotionComplete()
+{
+    if (!_pMotionHelper)
+        return true;
+    return _pMotionHelper->canAccept() && _pMotionHelper->isIdle();
+}
+
+void RobotController::enableMotors(bool en)
+{
+    if (!_pMotionHelper)
+        return;
+    _pMotionHelper->enableMotors(en);
+}
+
+void RobotController::setSpeedFactor(float speedFactor)
+{
+    if (!_pMotionHelper)
+        return;
+    _pMotionHelper->setSpeedFactor(speedFactor);
+}
+
+int RobotController::getLastCompletedNumberedCmdIdx()
+{
+    if (!_pMotionHelper)
+        return RobotConsts::NUMBERED_COMMAND_NONE;
+    return _pMotionHelper->getLastCompletedNumberedCmdIdx();
+}
+
+void RobotController::resetMotionStats(int cmdIdxFirst, int cmdIdxLast)
+{
+    if (!_pMotionHelper)
+        return;
+    _pMotionHelper->resetPatternStats(cmdIdxFirst, cmdIdxLast);
+}
+
+String RobotController::getMotionStats()
+{
+    if (!_pMotionHelper)
+        return "{}";
+    return _pMotionHelper->getMotionStats().getJSON();
+}
+
+String RobotController::getPlannerStats()
+{
+    if (!_pMotionHelper)
+        return "{}";
+    return _pMotionHelper->getPlannerStatsJSON();
+}
+
+// Snapshot of the motion pipeline
+String RobotController::getPipelineSnapshot(unsigned int maxBlocks)
+{
+    if (!_pMotionHelper)
+        return "{}";
+    return _pMotionHelper->getPipelineSnapshotJSON(maxBlocks);
+}
+
+// Create a dry-run motion helper
+MotionHelper* RobotController::createDryRunMotionHelper(const char* configStr)
+{
+    ConfigBase robotGeom(RdJson::getString("robotGeom", "NONE", configStr).c_str());
+    String robotModel = robotGeom.getString("model", "");
+    MotionHelper* pMotionHelper = NULL;
+    if (robotModel.equalsIgnoreCase("SandBotRotary"))
+        pMotionHelper = new MotionHelperSandTableRotary();
+    if (!pMotionHelper)
+        return NULL;
+    pMotionHelper->setDryRun();
+    pMotionHelper->configure(configStr);
+    return pMotionHelper;
 }
@@ -7,12 +7,16 @@
 
 class RobotBase;
 class RobotCommandArgs;
+class FileManager;
+struct MoveCmd;
 
 class RobotController
 {
 private:
     RobotBase* _pRobot;
-    MotionHelper _motionHelper;
+    // Motion helper - type depends on the robot model and it is kept once created
+    // as the ramp generator ISR refers to it
+    MotionHelper* _pMotionHelper;
 
 public:
     RobotController();
@@ -37,7 +41,7 @@ public:
     // Check if the robot can accept a (motion) command
     bool canAcceptCommand();
 
-    void moveTo(RobotCommandArgs& args);
+    void moveTo(MoveCmd& moveCmd);
 
     // Set motion parameters
     void setMotionParams(RobotCommandArgs& args);
@@ -57,4 +61,40 @@ public:
     bool wasActiveInLastNSeconds(int nSeconds);
 
     String getDebugStr();
+
+    // Step trace recording
+    bool stepTraceStart(FileManager& fileManager);
+    void stepTraceStop();
+    String getStepTraceStatus();
+
+    // ISR execution time stats (optionally reset after reading)
+    String getIsrStats(bool reset);
+
+    // Pattern motion stats - work pending is set by the work manager so that motion
+    // underruns can be attributed to work not reaching the planner - the stats are reset when
+    // the first move numbered in the range given starts (immediately if none)
+    void setMotionWorkPending(bool workPending);
+    void resetMotionStats(int cmdIdxFirst = RobotConsts::NUMBERED_COMMAND_NONE,
+                int cmdIdxLast = RobotConsts::NUMBERED_COMMAND_NONE);
+    String getMotionStats();
+    String getPlannerStats();
+
+    // Check if all motion is complete (nothing waiting to be planned or executed)
+    bool isMotionComplete();
+
+    // Enable or disable motors
+    void enableMotors(bool en);
+
+    // Speed factor applied to subsequent moves (1.0 is the planned speed)
+    void setSpeedFactor(float speedFactor);
+
+    // Index of the last numbered command which has completed
+    int getLastCompletedNumberedCmdIdx();
+
+    // Snapshot of the motion pipeline (JSON)
+    String getPipelineSnapshot(unsigned int maxBlocks);
+
+    // Create a motion helper for the robot model which plans without moving (for estimating
+    // pattern durations) - the caller owns the returned helper (NULL if the model is unknown)
+    static MotionHelper* createDryRunMotionHelper(const char* configStr);
 };
@@ -59,9 +59,9 @@ void RobotBase::actuator(double value)
 {
 }
 
-void RobotBase::moveTo(RobotCommandArgs &args)
+void RobotBase::moveTo(MoveCmd &moveCmd)
 {
-    _motionHelper.moveTo(args);
+    _motionHelper.moveTo(moveCmd);
 }
 
 void RobotBase::setMotionParams(RobotCommandArgs &args)
@@ -5,6 +5,7 @@
 
 class MotionHelper;
 class RobotCommandArgs;
+struct MoveCmd;
 
 class RobotBase
 {
@@ -28,7 +29,7 @@ class RobotBase
     virtual void service();
     // Movement commands
     virtual void actuator(double value);
-    virtual void moveTo(RobotCommandArgs &args);
+    virtual void moveTo(MoveCmd &moveCmd);
     virtual void setMotionParams(RobotCommandArgs &args);
     virtual void getCurStatus(RobotCommandArgs &args);
     virtual void getRobotAttributes(String& robotAttrs);
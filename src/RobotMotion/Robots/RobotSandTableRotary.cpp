@@ -3,8 +3,9 @@
 
 #include <Arduino.h>
 #include "RobotSandTableRotary.h"
-#include "../MotionControl/MotionHelper.h"
+#include "../MotionControl/MotionHelperT.h"
 #include "Utils.h"
+#include "FastTrig.h"
 #include "math.h"
 
 static const char* MODULE_PREFIX = "SandTableRotary: ";
@@ -27,16 +28,44 @@ RobotSandTableRotary::~RobotSandTableRotary()
 {
 }
 
+// Compile-time kinematics motion helper - instantiated here so the kinematics can be inlined
+template class MotionHelperT<RobotSandTableRotary, RobotSandTableRotary::NUM_ROBOT_AXES>;
+
+// Kinematics constants
+void RobotSandTableRotary::computeKinematicsConsts(AxesParams& axesParams, KinematicsConsts& k)
+{
+    // Linear axis length (default to avoid arithmetic errors)
+    float maxLinear = -1;
+    axesParams.getMaxVal(1, maxLinear);
+    if (maxLinear == -1)
+        maxLinear = 100;
+    k._maxLinearMM = maxLinear;
+    k._maxLinearMMInv = 1.0f / maxLinear;
+
+    // Rotation
+    k._stepsPerRotTheta = int32_t(axesParams.getStepsPerRot(0));
+    k._stepsPerRotRho = int32_t(axesParams.getStepsPerRot(1));
+    k._thetaStepsPerDegree = float(axesParams.getStepsPerRot(0) / 360);
+    k._thetaDegreesPerStep = float(360 / axesParams.getStepsPerRot(0));
+    k._rhoStepsPerDegreeTheta = float(axesParams.getStepsPerRot(1) / 360);
+    k._rhoStepsPerThetaStep = float(axesParams.getStepsPerRot(1) / axesParams.getStepsPerRot(0));
+
+    // Linear
+    k._rhoStepsPerMM = float(axesParams.getStepsPerUnit(1));
+    int32_t maxStepsRho = maxLinear * axesParams.getStepsPerUnit(1);
+    k._maxStepsRhoInv = 1.0f / float(maxStepsRho);
+}
+
 // Convert a cartesian point to actuator coordinates
 //MARK: REVIEWED
-bool RobotSandTableRotary::ptToActuator(AxisFloats& targetPt, AxisFloats& outActuator, 
-            AxisPosition& curAxisPositions, AxesParams& axesParams, bool allowOutOfBounds)
+bool RobotSandTableRotary::ptToActuator(const KinematicsConsts& k, AxisFloats& targetPt, AxisFloats& outActuator, 
+            AxisPosition& curAxisPositions, bool allowOutOfBounds)
 {
     // Convert the current position to polar wrapped 0..360 degrees
     // Val0 is theta
     // Val0 is rho
     AxisFloats curPolar;
-    actuatorToPolar(curAxisPositions._stepsFromHome, curPolar, axesParams);
+    actuatorToPolar(k, curAxisPositions._stepsFromHome, curPolar);
     // Best relative polar solution
     AxisFloats relativePolarSolution;
 
@@ -50,7 +79,7 @@ bool RobotSandTableRotary::ptToActuator(AxisFloats& targetPt, AxisFloats& outAct
     else {
         // Convert the target cartesian coords to polar wrapped to 0..360 degrees
         AxisFloats targetPolar;
-        bool isValid = cartesianToPolar(targetPt, targetPolar, axesParams);
+        bool isValid = cartesianToPolar(k, targetPt, targetPolar);
         if ((!isValid) && (!allowOutOfBounds))
         {
             Log.verbose("%sOut of bounds not allowed\n", MODULE_PREFIX);
@@ -66,38 +95,108 @@ bool RobotSandTableRotary::ptToActuator(AxisFloats& targetPt, AxisFloats& outAct
     }
 
     // Apply this to calculate required steps
-    relativePolarToSteps(relativePolarSolution, curAxisPositions, outActuator, axesParams);
+    relativePolarToSteps(k, relativePolarSolution, curAxisPositions, outActuator);
 
     return true;
 }
 
+// Runtime (function pointer) forms derive the constants from the axis parameters on each call
+bool RobotSandTableRotary::ptToActuator(AxisFloats& targetPt, AxisFloats& outActuator, 
+            AxisPosition& curAxisPositions, AxesParams& axesParams, bool allowOutOfBounds)
+{
+    KinematicsConsts k;
+    computeKinematicsConsts(axesParams, k);
+    return ptToActuator(k, targetPt, outActuator, curAxisPositions, allowOutOfBounds);
+}
+
+// Batch form of ptToActuator - the loop body avoids data-dependent branches (the near-origin,
+// out-of-bounds and wrap-around cases are all handled by selects) so that the float
+// operations of successive points can be pipelined
+void RobotSandTableRotary::ptsToActuatorBatch(const KinematicsConsts& k, const AxisFloats* pTargetPts, AxisFloats* pOutActuator,
+            bool* pOutValid, int numPts, AxisPosition& curPos, bool allowOutOfBounds)
+{
+    // Running actuator position
+    int32_t curStepsTheta = curPos._stepsFromHome.getVal(0);
+    int32_t curStepsRho = curPos._stepsFromHome.getVal(1);
+    float rhoStepsPerRho = k._maxLinearMM * k._rhoStepsPerMM;
+
+    for (int ptIdx = 0; ptIdx < numPts; ptIdx++)
+    {
+        float x = pTargetPts[ptIdx]._pt[0];
+        float y = pTargetPts[ptIdx]._pt[1];
+
+        // Current polar (as actuatorToPolar) from the position with step overflow corrected (as
+        // correctStepOverflow) - the caller corrects the position after each point so this
+        // gives the same rounding as converting one point at a time
+        int32_t rotFix = (curStepsTheta > k._stepsPerRotTheta) ? -((curStepsTheta - 1) / k._stepsPerRotTheta) :
+                    ((curStepsTheta <= -k._stepsPerRotTheta) ? (-curStepsTheta / k._stepsPerRotTheta) : 0);
+        int32_t polarStepsTheta = curStepsTheta + rotFix * k._stepsPerRotTheta;
+        int32_t polarStepsRho = curStepsRho + rotFix * k._stepsPerRotRho;
+        float curTheta = FastTrig::wrapDegrees(float(polarStepsTheta) * k._thetaDegreesPerStep);
+        int32_t linearStepsFromHome = polarStepsRho - float(polarStepsTheta) * k._rhoStepsPerThetaStep;
+        float curRho = float(linearStepsFromHome) * k._maxStepsRhoInv;
+
+        // Target polar (theta made positive in radians first, as cartesianToPolar, so the steps match)
+        float targetThetaRad = FastTrig::atan2(y, x);
+        targetThetaRad += (targetThetaRad < 0) ? FastTrig::TWO_PI_F : 0;
+        float targetTheta = FastTrig::wrapDegrees(targetThetaRad * FastTrig::RAD_TO_DEG_F);
+        float targetRho = sqrtf(x * x + y * y) * k._maxLinearMMInv;
+        bool nearOrigin = (fabsf(x) < 1) & (fabsf(y) < 1);
+        bool isValid = allowOutOfBounds | (targetRho <= 1.0f) | nearOrigin;
+
+        // Minimum rotation for theta in the range -180 < rel <= 180 (keep theta if near origin)
+        float thetaRel = targetTheta - curTheta;
+        thetaRel -= 360.0f * ceilf((thetaRel - 180.0f) * (1.0f / 360.0f));
+        thetaRel = nearOrigin ? 0 : thetaRel;
+        float rhoRel = (nearOrigin ? 0 : targetRho) - curRho;
+
+        // Steps (as relativePolarToSteps)
+        int32_t stepsTheta = curStepsTheta + int32_t(roundf(thetaRel * k._thetaStepsPerDegree));
+        int32_t stepsRho = curStepsRho + int32_t(roundf(thetaRel * k._rhoStepsPerDegreeTheta + rhoRel * rhoStepsPerRho));
+        pOutActuator[ptIdx]._pt[0] = float(stepsTheta);
+        pOutActuator[ptIdx]._pt[1] = float(stepsRho);
+        pOutActuator[ptIdx]._pt[2] = 0;
+        pOutValid[ptIdx] = isValid;
+
+        // Rejected points don't move the position
+        curStepsTheta = isValid ? stepsTheta : curStepsTheta;
+        curStepsRho = isValid ? stepsRho : curStepsRho;
+    }
+}
+
 void RobotSandTableRotary::actuatorToPt(AxisInt32s& actuatorPos, AxisFloats& outPt, AxisPosition& curPos, AxesParams& axesParams)
+{
+    KinematicsConsts k;
+    computeKinematicsConsts(axesParams, k);
+    actuatorToPt(k, actuatorPos, outPt);
+}
+
+void RobotSandTableRotary::actuatorToPt(const KinematicsConsts& k, AxisInt32s& actuatorPos, AxisFloats& outPt)
 {
     // Get current polar
     AxisFloats curPolar;
-    actuatorToPolar(actuatorPos, curPolar, axesParams);
-
-	// Calculate max linear axis
-	float maxLinear = -1;
-    axesParams.getMaxVal(1, maxLinear);
-    if(maxLinear == -1)
-        maxLinear = 100;
+    actuatorToPolar(k, actuatorPos, curPolar);
 
     // Compute axis positions from polar values
-    float rho = float(curPolar.getVal(1) * maxLinear);
-    float theta = curPolar.getVal(0);
-
-    float x = rho * cos(AxisUtils::d2r(theta));
-    float y = rho * sin(AxisUtils::d2r(theta));
+    float rho = curPolar.getVal(1) * k._maxLinearMM;
+    float sinTheta, cosTheta;
+    FastTrig::sinCos(curPolar.getVal(0) * FastTrig::DEG_TO_RAD_F, sinTheta, cosTheta);
 
-    outPt.setVal(0, x);
-    outPt.setVal(1, y);    
+    outPt.setVal(0, rho * cosTheta);
+    outPt.setVal(1, rho * sinTheta);
 }
 
 void RobotSandTableRotary::correctStepOverflow(AxisPosition& curPos, AxesParams& axesParams)
 {
-    int rotationStepsTheta = (int)(axesParams.getStepsPerRot(0));
-    int rotationStepsRho = (int)(axesParams.getStepsPerRot(1));
+    KinematicsConsts k;
+    computeKinematicsConsts(axesParams, k);
+    correctStepOverflow(k, curPos);
+}
+
+void RobotSandTableRotary::correctStepOverflow(const KinematicsConsts& k, AxisPosition& curPos)
+{
+    int rotationStepsTheta = k._stepsPerRotTheta;
+    int rotationStepsRho = k._stepsPerRotRho;
     bool showDebug = false;
         if (curPos._stepsFromHome.getVal(0) > rotationStepsTheta || curPos._stepsFromHome.getVal(0) <= -rotationStepsTheta)
         {
@@ -119,35 +218,23 @@ void RobotSandTableRotary::correctStepOverflow(AxisPosition& curPos, AxesParams&
         Log.info("CORRECTED ax0 %d ax1 %d\n", curPos._stepsFromHome.getVal(0), curPos._stepsFromHome.getVal(1));
 }
 
-bool RobotSandTableRotary::cartesianToPolar(AxisFloats& targetPt, AxisFloats& targetSoln1, AxesParams& axesParams)
+bool RobotSandTableRotary::cartesianToPolar(const KinematicsConsts& k, AxisFloats& targetPt, AxisFloats& targetSoln1)
 {
-	// Calculate arm lengths
-	// The maxVal for axis0 and axis1 are used to determine the arm lengths
-	// The radius of the machine is the sum of these two lengths
-	float linearLength = 0;
-
-	bool axis1MaxValid = axesParams.getMaxVal(1, linearLength);
-
-    //  If not valid set to some values to avoid arithmetic errors
-
-	if (!axis1MaxValid)
-		linearLength = 100;
-
-	// Calculate distance from origin to pt (forms one side of triangle where arm segments form other sides)
-	float distFromOrigin = sqrt(pow(targetPt._pt[0], 2) + pow(targetPt._pt[1], 2));
+	// Calculate distance from origin to pt
+	float distFromOrigin = sqrtf(targetPt._pt[0] * targetPt._pt[0] + targetPt._pt[1] * targetPt._pt[1]);
 	// Check validity of position (distance from origin cannot be greater than linear axis max length)
-	bool posValid = distFromOrigin <= linearLength;
+	bool posValid = distFromOrigin <= k._maxLinearMM;
 
 	// Calculate theta. Will always be POSITIVE (0 -> 2PI)
-	float theta = atan2(targetPt._pt[1], targetPt._pt[0]);
+	float theta = FastTrig::atan2(targetPt._pt[1], targetPt._pt[0]);
 	if (theta < 0)
-		theta += M_PI * 2;
+		theta += FastTrig::TWO_PI_F;
 
 	// Calculate required radius
-	float rho = float(distFromOrigin / linearLength);
+	float rho = distFromOrigin * k._maxLinearMMInv;
 
 	//Return theta in DEGREES and rho.
-	targetSoln1.setVal(0, AxisUtils::r2d(AxisUtils::wrapRadians(theta)));
+	targetSoln1.setVal(0, FastTrig::wrapDegrees(theta * FastTrig::RAD_TO_DEG_F));
 	targetSoln1.setVal(1, rho);
 
     return posValid;
@@ -167,29 +254,20 @@ float RobotSandTableRotary::calcRelativePolar(float targetRotation, float curRot
     return bestRotation;
 }
 
-void RobotSandTableRotary::relativePolarToSteps(AxisFloats& relativePolar, AxisPosition& curAxisPositions, 
-            AxisFloats& outActuator, AxesParams& axesParams)
+void RobotSandTableRotary::relativePolarToSteps(const KinematicsConsts& k, AxisFloats& relativePolar, AxisPosition& curAxisPositions, 
+            AxisFloats& outActuator)
 {
-    float maxLinear = -1;
-    axesParams.getMaxVal(1, maxLinear);
-    if(maxLinear == -1)
-        maxLinear = 100;
-
     // Convert relative polar to steps
-
-    float fractionalRotation = float(relativePolar.getVal(0) / float(360));
-    int32_t stepsRelTheta = int32_t(roundf(float(fractionalRotation * float(axesParams.getStepsPerRot(0)))));
+    int32_t stepsRelTheta = int32_t(roundf(relativePolar.getVal(0) * k._thetaStepsPerDegree));
 
     //Rho axis is a special one! Step it to rotate the gear the same degree as the theta.
     //Theta is moving relativePolar.getVal(0) degrees, therefore rho would be moving 
     //relativePolar.getVal(0) * axesParams.getStepsPerRot(1) steps.
-    float rhoCounteractSteps = float(fractionalRotation * float(axesParams.getStepsPerRot(1)));
+    float rhoCounteractSteps = relativePolar.getVal(0) * k._rhoStepsPerDegreeTheta;
 
     //Then, rho really NEEDS to move relPolar[1] * maxLinear in mm.
     //which, mm -> steps is (mm / mm/rot) * stepsPerRot
-    
-    float rhoMM = relativePolar.getVal(1) * maxLinear;
-    float rhoActiveSteps = rhoMM * axesParams.getStepsPerUnit(1);
+    float rhoActiveSteps = relativePolar.getVal(1) * k._maxLinearMM * k._rhoStepsPerMM;
 
     int32_t stepsRelRho = int32_t(roundf(rhoCounteractSteps + rhoActiveSteps));
 
@@ -198,27 +276,19 @@ void RobotSandTableRotary::relativePolarToSteps(AxisFloats& relativePolar, AxisP
     outActuator.setVal(1, curAxisPositions._stepsFromHome.getVal(1) + stepsRelRho);
 }
 
-void RobotSandTableRotary::actuatorToPolar(AxisInt32s& actuatorCoords, AxisFloats& polarCoords, AxesParams& axesParams)
-    {
-        // Calculate azimuth
-        double currentTheta = AxisUtils::wrapDegrees(actuatorCoords.getVal(0) * 360 / axesParams.getStepsPerRot(0));
-        polarCoords.setVal(0, currentTheta);
-
-        float maxLinear = -1;
-        axesParams.getMaxVal(1, maxLinear);
-        if(maxLinear == -1)
-            maxLinear = 100;
-
-        // Calculate linear position (note that this robot has interaction between azimuth and linear motion as the rack moves
-        // if the pinion gear remains still and the arm assembly moves around it) - so the required linear calculation uses the
-        // difference in linear and arm rotation steps
-        long linearStepsFromHome = actuatorCoords.getVal(1) - (float(actuatorCoords.getVal(0)) * float(axesParams.getStepsPerRot(1)/axesParams.getStepsPerRot(0)));
-        int32_t maxStepsRho = maxLinear * axesParams.getStepsPerUnit(1);
-        float currentRho = float(linearStepsFromHome) / float(maxStepsRho);
-        polarCoords.setVal(1, currentRho);
-    }
+void RobotSandTableRotary::actuatorToPolar(const KinematicsConsts& k, AxisInt32s& actuatorCoords, AxisFloats& polarCoords)
+{
+    // Calculate azimuth
+    polarCoords.setVal(0, FastTrig::wrapDegrees(float(actuatorCoords.getVal(0)) * k._thetaDegreesPerStep));
+
+    // Calculate linear position (note that this robot has interaction between azimuth and linear motion as the rack moves
+    // if the pinion gear remains still and the arm assembly moves around it) - so the required linear calculation uses the
+    // difference in linear and arm rotation steps
+    int32_t linearStepsFromHome = actuatorCoords.getVal(1) - float(actuatorCoords.getVal(0)) * k._rhoStepsPerThetaStep;
+    polarCoords.setVal(1, float(linearStepsFromHome) * k._maxStepsRhoInv);
+}
 
-void RobotSandTableRotary::convertCoords(RobotCommandArgs& cmdArgs, AxesParams& axesParams)
+void RobotSandTableRotary::convertCoords(MoveCmd& moveCmd, AxesParams& axesParams)
 {
     // Coordinates can be converted here if required
 }
@@ -226,20 +296,31 @@ void RobotSandTableRotary::convertCoords(RobotCommandArgs& cmdArgs, AxesParams&
 
 void RobotSandTableRotary::setRobotAttributes(AxesParams& axesParams, String& robotAttributes)
 {
+    KinematicsConsts k;
+    computeKinematicsConsts(axesParams, k);
+
     // Calculate max and min cartesian size of robot
-	// Calculate arm lengths
-	// The maxVal for axis0 and axis1 are used to determine the arm lengths
-	// The radius of the machine is the sum of these two lengths
-	float maxLinear = -1;
-    axesParams.getMaxVal(1, maxLinear);
-    if(maxLinear == -1)
-        maxLinear = 100;
+    float maxLinear = k._maxLinearMM;
+
+    // Motion limits (used to plan transits) - the feedrate is that of the primary axis used by
+    // the motion planner, the actuator rates are from max RPM and the rho actuator moves by
+    // unitsPerRot for each rotation of theta
+    int primaryAxisIdx = 0;
+    for (int axisIdx = 0; axisIdx < RobotConsts::MAX_AXES; axisIdx++)
+        if (axesParams.isPrimaryAxis(axisIdx))
+            primaryAxisIdx = axisIdx;
+    float thetaMaxDegps = axesParams.getMaxStepRatePerSec(0, true) * k._thetaDegreesPerStep;
+    float rhoMaxMMps = axesParams.getMaxStepRatePerSec(1, true) / k._rhoStepsPerMM;
+    float rhoMMPerDegTheta = k._rhoStepsPerDegreeTheta / k._rhoStepsPerMM;
 
     // Set attributes
     constexpr int MAX_ATTR_STR_LEN = 400;
     char attrStr[MAX_ATTR_STR_LEN];
-    sprintf(attrStr, "{\"sizeX\":%0.2f,\"sizeY\":%0.2f,\"sizeZ\":%0.2f,\"originX\":%0.2f,\"originY\":%0.2f,\"originZ\":%0.2f}",
+    sprintf(attrStr, "{\"sizeX\":%0.2f,\"sizeY\":%0.2f,\"sizeZ\":%0.2f,\"originX\":%0.2f,\"originY\":%0.2f,\"originZ\":%0.2f,"
+            "\"maxSpeedMMps\":%0.2f,\"maxAccMMps2\":%0.2f,\"thetaMaxDegps\":%0.3f,\"rhoMaxMMps\":%0.3f,\"rhoMMPerDegTheta\":%0.5f}",
             maxLinear*2, maxLinear*2, 0.0,
-            maxLinear, maxLinear, 0.0);
+            maxLinear, maxLinear, 0.0,
+            axesParams.getMaxSpeed(primaryAxisIdx), axesParams._masterAxisMaxAccMMps2,
+            thetaMaxDegps, rhoMaxMMps, rhoMMPerDegTheta);
     robotAttributes = attrStr;
 }
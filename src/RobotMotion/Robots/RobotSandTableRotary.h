@@ -4,6 +4,7 @@
 #pragma once
 
 #include "RobotBase.h"
+#include "../MotionControl/MotionHelperT.h"
 
 class AxisFloats;
 class AxisPosition;
@@ -37,28 +38,64 @@ public:
     ~RobotSandTableRotary();
 
 private:
+    // Kinematics are called directly by the compile-time motion helper
+    template <typename Kinematics, int NumAxes> friend class MotionHelperT;
+
+    // Constants derived from axis parameters - each motion helper holds its own (computed when
+    // its axes are configured) so that the kinematics don't re-read axis parameters on every call
+    struct KinematicsConsts
+    {
+        // Linear axis (rho) length
+        float _maxLinearMM;
+        float _maxLinearMMInv;
+        // Steps per rotation (rho steps per rotation are needed to counteract theta rotation)
+        int32_t _stepsPerRotTheta;
+        int32_t _stepsPerRotRho;
+        float _thetaStepsPerDegree;
+        float _thetaDegreesPerStep;
+        float _rhoStepsPerDegreeTheta;
+        float _rhoStepsPerThetaStep;
+        // Rho steps for linear motion
+        float _rhoStepsPerMM;
+        float _maxStepsRhoInv;
+    };
+    static void computeKinematicsConsts(AxesParams& axesParams, KinematicsConsts& k);
 
     // Convert a cartesian point to actuator coordinates
+    static bool ptToActuator(const KinematicsConsts& k, AxisFloats& targetPt, AxisFloats& outActuator,
+                AxisPosition& curPos, bool allowOutOfBounds);
     static bool ptToActuator(AxisFloats& targetPt, AxisFloats& outActuator, 
                 AxisPosition& curPos, AxesParams& axesParams, bool allowOutOfBounds);
 
+    // Convert a batch of cartesian points to actuator coordinates
+    // starting from the current position - pOutValid is false for points rejected as out of bounds
+    // and these do not change the position used for subsequent points
+    static void ptsToActuatorBatch(const KinematicsConsts& k, const AxisFloats* pTargetPts, AxisFloats* pOutActuator,
+                bool* pOutValid, int numPts, AxisPosition& curPos, bool allowOutOfBounds);
+
     // Convert actuator values to cartesian point
+    static void actuatorToPt(const KinematicsConsts& k, AxisInt32s& targetActuator, AxisFloats& outPt);
     static void actuatorToPt(AxisInt32s& targetActuator, AxisFloats& outPt,
                 AxisPosition& curPos, AxesParams& axesParams);
 
     // Correct overflow (necessary for continuous rotation robots)
+    static void correctStepOverflow(const KinematicsConsts& k, AxisPosition& curPos);
     static void correctStepOverflow(AxisPosition& curPos, AxesParams& axesParams);
 
     // Convert coordinates in place
-    static void convertCoords(RobotCommandArgs& cmdArgs, AxesParams& axesParams);
+    static void convertCoords(MoveCmd& moveCmd, AxesParams& axesParams);
 
     // Set robot attributes
     static void setRobotAttributes(AxesParams& axesParams, String& robotAttributes);
 
 private:
-    static bool cartesianToPolar(AxisFloats& targetPt, AxisFloats& targetSoln1, AxesParams& axesParams);
+    static bool cartesianToPolar(const KinematicsConsts& k, AxisFloats& targetPt, AxisFloats& targetSoln1);
     static float calcRelativePolar(float targetRotation, float curRotation);
-    static void relativePolarToSteps(AxisFloats& relativePolar, AxisPosition& curAxisPositions, 
-            AxisFloats& outActuator, AxesParams& axesParams);
-    static void actuatorToPolar(AxisInt32s &actuatorCoords, AxisFloats &polarCoords, AxesParams &axesParams);
+    static void relativePolarToSteps(const KinematicsConsts& k, AxisFloats& relativePolar, AxisPosition& curAxisPositions, 
+            AxisFloats& outActuator);
+    static void actuatorToPolar(const KinematicsConsts& k, AxisInt32s &actuatorCoords, AxisFloats &polarCoords);
 };
+
+// Motion helper with sand table kinematics inlined (instantiated in RobotSandTableRotary.cpp)
+typedef MotionHelperT<RobotSandTableRotary, RobotSandTableRotary::NUM_ROBOT_AXES> MotionHelperSandTableRotary;
+extern template class MotionHelperT<RobotSandTableRotary, RobotSandTableRotary::NUM_ROBOT_AXES>;
@@ -0,0 +1,186 @@
+// RBotFirmware
+// Rob Dobson 2016-2018
+
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+
+// Command ingress - commands posted from any task (REST handlers on the AsyncTCP task, the
+// command scheduler, etc) are held here until the work manager drains them in its own service
+// loop so that the work item queue is only used by one task
+// Lock-free bounded multi-producer single-consumer queue - each slot has a sequence number
+// which tells producers when it is free (seq == put position) and the consumer when it has
+// been filled (seq == get position + 1)
+// A producer can ask for the result of its command - the slot is then held after the command is
+// processed until the producer has collected the result (or given up waiting for it)
+class CommandIngress
+{
+public:
+    static constexpr uint32_t NUM_SLOTS = 16;
+    static constexpr uint32_t MAX_CMD_LEN = 199;
+    static_assert((NUM_SLOTS & (NUM_SLOTS - 1)) == 0, "NUM_SLOTS must be a power of 2");
+
+private:
+    // Result states - a producer gives up waiting by changing WAITING to ABANDONED and the
+    // consumer hands over the result by changing WAITING to READY so only one of them wins
+    enum
+    {
+        RSLT_NONE,
+        RSLT_WAITING,
+        RSLT_READY,
+        RSLT_ABANDONED
+    };
+    struct Slot
+    {
+        std::atomic<uint32_t> _seq;
+        std::atomic<uint32_t> _rsltState;
+        uint32_t _postedUs;
+        char _cmdStr[MAX_CMD_LEN + 1];
+        String _rsltStr;
+    };
+    Slot _slots[NUM_SLOTS];
+
+    // Producers claim slots by advancing the put position
+    std::atomic<uint32_t> _putPos;
+    // Only used by the consumer
+    uint32_t _getPos;
+
+    // Stats
+    std::atomic<uint32_t> _statsRejected;
+    uint32_t _statsDrained;
+    uint64_t _statsLatencyTotalUs;
+    uint32_t _statsLatencyMaxUs;
+
+public:
+    CommandIngress()
+    {
+        for (uint32_t slotIdx = 0; slotIdx < NUM_SLOTS; slotIdx++)
+        {
+            _slots[slotIdx]._seq.store(slotIdx, std::memory_order_relaxed);
+            _slots[slotIdx]._rsltState.store(RSLT_NONE, std::memory_order_relaxed);
+        }
+        _putPos.store(0, std::memory_order_relaxed);
+        _getPos = 0;
+        _statsRejected.store(0, std::memory_order_relaxed);
+        _statsDrained = 0;
+        _statsLatencyTotalUs = 0;
+        _statsLatencyMaxUs = 0;
+    }
+
+    // Post a command (any task) - false if the ingress is full or the command too long - if a
+    // ticket is requested the result must be collected with waitResult
+    bool post(const char* pCmdStr, uint32_t* pTicket = NULL)
+    {
+        unsigned int cmdLen = strlen(pCmdStr);
+        if (cmdLen > MAX_CMD_LEN)
+        {
+            _statsRejected.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        // Claim a slot
+        uint32_t pos = _putPos.load(std::memory_order_relaxed);
+        Slot* pSlot = NULL;
+        while (true)
+        {
+            pSlot = &_slots[pos & (NUM_SLOTS - 1)];
+            int32_t diff = int32_t(pSlot->_seq.load(std::memory_order_acquire) - pos);
+            if (diff == 0)
+            {
+                if (_putPos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+            {
+                // Full
+                _statsRejected.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            else
+            {
+                pos = _putPos.load(std::memory_order_relaxed);
+            }
+        }
+
+        // Fill and publish
+        memcpy(pSlot->_cmdStr, pCmdStr, cmdLen + 1);
+        pSlot->_postedUs = micros();
+        pSlot->_rsltState.store(pTicket ? RSLT_WAITING : RSLT_NONE, std::memory_order_relaxed);
+        if (pTicket)
+            *pTicket = pos;
+        pSlot->_seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Wait for the result of a command posted with a ticket (producer) - false if it wasn't
+    // processed in time (it is still processed later but the result is discarded)
+    bool waitResult(uint32_t ticket, String& rsltStr, uint32_t timeoutMs)
+    {
+        Slot& slot = _slots[ticket & (NUM_SLOTS - 1)];
+        uint32_t startMs = millis();
+        while (slot._rsltState.load(std::memory_order_acquire) != RSLT_READY)
+        {
+            if (millis() - startMs > timeoutMs)
+            {
+                uint32_t state = RSLT_WAITING;
+                if (slot._rsltState.compare_exchange_strong(state, RSLT_ABANDONED, std::memory_order_acq_rel))
+                    return false;
+                break;
+            }
+            delay(1);
+        }
+        rsltStr = slot._rsltStr;
+        slot._rsltStr = "";
+        release(slot, ticket);
+        return true;
+    }
+
+    // Next command (consumer only) - NULL if none
+    const char* peek()
+    {
+        Slot& slot = _slots[_getPos & (NUM_SLOTS - 1)];
+        if (slot._seq.load(std::memory_order_acquire) != _getPos + 1)
+            return NULL;
+        return slot._cmdStr;
+    }
+
+    // Release the command returned by peek with its result (consumer only) - the slot is held
+    // for the producer if it is waiting for the result
+    void pop(const String& rsltStr)
+    {
+        Slot& slot = _slots[_getPos & (NUM_SLOTS - 1)];
+        uint32_t latencyUs = micros() - slot._postedUs;
+        _statsDrained++;
+        _statsLatencyTotalUs += latencyUs;
+        if (_statsLatencyMaxUs < latencyUs)
+            _statsLatencyMaxUs = latencyUs;
+        uint32_t pos = _getPos++;
+        if (slot._rsltState.load(std::memory_order_acquire) == RSLT_WAITING)
+        {
+            slot._rsltStr = rsltStr;
+            uint32_t state = RSLT_WAITING;
+            if (slot._rsltState.compare_exchange_strong(state, RSLT_READY, std::memory_order_acq_rel))
+                return;
+            slot._rsltStr = "";
+        }
+        release(slot, pos);
+    }
+
+    // Stats (consumer only) - latency is from posting to being drained
+    String getDebugStr()
+    {
+        return " IN:" + String(_statsDrained) +
+                    "/" + String(_statsRejected.load(std::memory_order_relaxed)) +
+                    " LAT:" + String(uint32_t(_statsDrained ? _statsLatencyTotalUs / _statsDrained : 0)) +
+                    "/" + String(_statsLatencyMaxUs) + "us";
+    }
+
+private:
+    // Free a slot for producers
+    void release(Slot& slot, uint32_t pos)
+    {
+        slot._rsltState.store(RSLT_NONE, std::memory_order_relaxed);
+        slot._seq.store(pos + NUM_SLOTS, std::memory_order_release);
+    }
+};
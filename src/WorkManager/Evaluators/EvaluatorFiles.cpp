@@ -5,21 +5,45 @@
 #include <ArduinoLog.h>
 #include "EvaluatorFiles.h"
 #include "RdJson.h"
+#include "Utils.h"
+#include "EvaluatorThetaRhoLine.h"
+#include "ThetaRhoTokenizer.h"
 #include "../WorkManager.h"
 
 static const char* MODULE_PREFIX = "EvaluatorFiles: ";
 
-EvaluatorFiles::EvaluatorFiles(FileManager& fileManager, WorkManager& workManager) :
-         _fileManager(fileManager), _workManager(workManager)
+EvaluatorFiles::EvaluatorFiles(FileManager& fileManager, WorkManager& workManager, EvaluatorThetaRhoLine& thrEvaluator) :
+         _fileManager(fileManager), _workManager(workManager), _thrEvaluator(thrEvaluator)
 {
     _inProgress = false;
     _fileType = FILE_TYPE_UNKNOWN;
     _firstValidLineProcessed = false;
     _interpolate = true;
+    _fileLen = 0;
+    _filePos = 0;
+    _chunkLen = 0;
+    _thrReadBufLen = 0;
+    _thrReadBufPos = 0;
+    _thrReadBufFilePos = 0;
+    _thrReadAtEnd = false;
+    _thrNumPoints = 0;
+    _thrPointIdx = 0;
+    _thrRotation = 0;
+    _thrReversed = false;
+    _thrModTime = 0;
+    _thrItemsAhead = THR_ITEMS_AHEAD_DEFAULT;
+    _thrCmdIdxBase = THR_CMD_IDX_FIRST;
+    _thrNextCmdIdxBase = THR_CMD_IDX_FIRST;
+    _prefetchReversed = false;
+    _prefetchInterpolate = true;
+    _prefetchFileLen = 0;
+    _prefetchModTime = 0;
+    _prefetchReadLen = 0;
 }
 
 void EvaluatorFiles::setConfig(const char* configStr)
 {
+    _thrItemsAhead = RdJson::getLong("thrItemsAhead", THR_ITEMS_AHEAD_DEFAULT, configStr);
 }
 
 const char* EvaluatorFiles::getConfig()
@@ -41,24 +65,77 @@ String EvaluatorFiles::fileName()
 
 int EvaluatorFiles::getFileTypeFromExtension(String& fileName)
 {
-    String fileExt = FileManager::getFileExtension(fileName);
-    int fileType = FILE_TYPE_UNKNOWN;
-    if (fileExt.equalsIgnoreCase("gcode"))
-        fileType = FILE_TYPE_GCODE;
-    if (fileExt.equalsIgnoreCase("thr"))
-        fileType = FILE_TYPE_THETA_RHO;
-    return fileType;
+    return getFileTypeFromExtension(fileName.c_str(), fileName.length());
+}
+
+int EvaluatorFiles::getFileTypeFromExtension(const char* pFileName, unsigned int nameLen)
+{
+    if (FileManager::hasFileExtension(pFileName, nameLen, "gcode"))
+        return FILE_TYPE_GCODE;
+    if (FileManager::hasFileExtension(pFileName, nameLen, "thr"))
+        return FILE_TYPE_THETA_RHO;
+    return FILE_TYPE_UNKNOWN;
+}
+
+// Length of the file name in a file work item (less any options - R<degrees> and REV after the
+// name, each at most once)
+unsigned int EvaluatorFiles::getFileNameLen(const char* pStr, unsigned int len, double& rotationDegs, bool& reversed)
+{
+    rotationDegs = 0;
+    reversed = false;
+    bool rotationFound = false;
+    unsigned int nameLen = len;
+    while (true)
+    {
+        // Last word
+        unsigned int optPos = nameLen;
+        while ((optPos > 0) && (pStr[optPos - 1] != ' '))
+            optPos--;
+        if ((optPos == 0) || (optPos >= nameLen) || (toupper((unsigned char)pStr[optPos]) != 'R'))
+            break;
+        if ((nameLen - optPos == 3) && (strncasecmp(pStr + optPos, "REV", 3) == 0) && !reversed)
+        {
+            reversed = true;
+        }
+        else
+        {
+            const char* pRotStr = pStr + optPos + 1;
+            const char* pEnd = pStr + nameLen;
+            double rotation = 0;
+            if (rotationFound || !ThetaRhoTokenizer::parseDecimal(pRotStr, pEnd, rotation) || (pRotStr != pEnd))
+                break;
+            rotationDegs = rotation;
+            rotationFound = true;
+        }
+        nameLen = optPos - 1;
+        while ((nameLen > 0) && isspace((unsigned char)pStr[nameLen - 1]))
+            nameLen--;
+    }
+    return nameLen;
+}
+
+// Split the options from a file work item
+void EvaluatorFiles::getFileNameAndOptions(const String& workItemStr, String& fileName, double& rotationDegs, bool& reversed)
+{
+    unsigned int nameLen = getFileNameLen(workItemStr.c_str(), workItemStr.length(), rotationDegs, reversed);
+    fileName = workItemStr;
+    if (nameLen == workItemStr.length())
+        return;
+    fileName = workItemStr.substring(0, nameLen);
+    fileName.trim();
 }
 
 // Check if valid
 bool EvaluatorFiles::isValid(WorkItem& workItem)
 {
-    // Form the file name
-    String fileName = workItem.getString();
-    // Check for supported extension
-    int fileType = getFileTypeFromExtension(fileName);
-    if (fileType == FILE_TYPE_UNKNOWN)
+    // Check for supported extension before forming the file name (most work items aren't files)
+    double rotationDegs = 0;
+    bool reversed = false;
+    unsigned int nameLen = getFileNameLen(workItem.getCString(), workItem.length(), rotationDegs, reversed);
+    if (getFileTypeFromExtension(workItem.getCString(), nameLen) == FILE_TYPE_UNKNOWN)
         return false;
+    String fileName;
+    getFileNameAndOptions(workItem.getString(), fileName, rotationDegs, reversed);
     // Check on file system
     int fileLen = 0;
     bool rslt = _fileManager.getFileInfo("", fileName, fileLen);
@@ -71,13 +148,21 @@ bool EvaluatorFiles::isValid(WorkItem& workItem)
 bool EvaluatorFiles::execWorkItem(WorkItem& workItem)
 {
     // Form the file name
-    String fileName = workItem.getString();
+    String fileName;
+    double rotationDegs = 0;
+    bool reversed = false;
+    getFileNameAndOptions(workItem.getString(), fileName, rotationDegs, reversed);
     _fileName = fileName;
+    _thrRotation = AxisUtils::d2r(rotationDegs);
     int fileType = getFileTypeFromExtension(fileName);
     if (fileType == FILE_TYPE_UNKNOWN)
         return false;
     _fileType = fileType;
 
+    // Theta-rho files are read ahead (gcode files can't be reversed)
+    if (fileType == FILE_TYPE_THETA_RHO)
+        return startThetaRho(fileName, reversed);
+
     // Start chunked file access
     bool retc = _fileManager.chunkedFileStart("", fileName, true);
     if (!retc)
@@ -88,16 +173,73 @@ bool EvaluatorFiles::execWorkItem(WorkItem& workItem)
     return retc;
 }
 
+void EvaluatorFiles::prefetch(WorkItem& workItem)
+{
+    // The read buffer is only free when no file is in progress
+    if (_inProgress)
+        return;
+    _prefetchFileName = "";
+    String fileName;
+    double rotationDegs = 0;
+    bool reversed = false;
+    getFileNameAndOptions(workItem.getString(), fileName, rotationDegs, reversed);
+    if (getFileTypeFromExtension(fileName) != FILE_TYPE_THETA_RHO)
+        return;
+    if (!_fileManager.getFileStatus("", fileName, _thrRootFilename, _prefetchFileLen, _prefetchModTime))
+        return;
+    int readPos = 0;
+    if (reversed)
+    {
+        _prefetchInterpolate = getThetaRhoStartInterpolate(_thrRootFilename);
+        readPos = std::max(_prefetchFileLen - THR_READ_BUF_LEN, 0);
+    }
+    _prefetchReadLen = _fileManager.readFileBlock(_thrRootFilename, readPos, (uint8_t*)_thrReadBuf,
+                std::min(THR_READ_BUF_LEN, _prefetchFileLen - readPos));
+    if (_prefetchReadLen < 0)
+        return;
+    _prefetchFileName = fileName;
+    _prefetchReversed = reversed;
+    Log.verbose("%sprefetched %s len %d\n", MODULE_PREFIX, fileName.c_str(), _prefetchReadLen);
+}
+
 int EvaluatorFiles::getCurrentFilePosition()
 {
     return _filePos;
 }
 
+int EvaluatorFiles::getMotionFilePosition(int lastCompletedCmdIdx)
+{
+    if (_fileType != FILE_TYPE_THETA_RHO)
+        return _filePos;
+    if ((lastCompletedCmdIdx < _thrCmdIdxBase) || (lastCompletedCmdIdx > _thrCmdIdxBase + _fileLen))
+        return 0;
+    return lastCompletedCmdIdx - _thrCmdIdxBase;
+}
+
 int EvaluatorFiles::getTotalFileLength()
 {
     return _fileLen;
 }
 
+bool EvaluatorFiles::getThetaRhoFileStatus(String& rootFilename, int& fileLen, time_t& modTime)
+{
+    if (_fileType != FILE_TYPE_THETA_RHO)
+        return false;
+    rootFilename = _thrRootFilename;
+    fileLen = _fileLen;
+    modTime = _thrModTime;
+    return true;
+}
+
+bool EvaluatorFiles::getNumberedCmdIdxRange(int& cmdIdxFirst, int& cmdIdxLast)
+{
+    if (_fileType != FILE_TYPE_THETA_RHO)
+        return false;
+    cmdIdxFirst = _thrCmdIdxBase;
+    cmdIdxLast = _thrCmdIdxBase + _fileLen;
+    return true;
+}
+
 int EvaluatorFiles::getCurrentLineLength()
 {
     return _chunkLen;
@@ -113,12 +255,11 @@ void EvaluatorFiles::service()
     if (!_workManager.canAcceptWorkItem())
         return;
 
-    // If the file type is not pure GCODE then
-    // only add to the queue if the queue is completely empty
-    if (_fileType != FILE_TYPE_GCODE)
+    // Theta-rho files
+    if (_fileType == FILE_TYPE_THETA_RHO)
     {
-        if (!_workManager.queueIsEmpty())
-            return;
+        serviceThetaRho();
+        return;
     }
 
     // Get next line from file
@@ -138,84 +279,268 @@ void EvaluatorFiles::service()
     {
         // Process the line
         String newLine = (char*)pLine;
-        newLine.replace("\n", "");
-        newLine.replace("\r", "");
-        newLine.trim();
-
-        // Check for flags (can be in comments or not)
-        if (_fileType == FILE_TYPE_THETA_RHO)
+        if (lineToWorkItemStr(newLine))
         {
-            if (newLine.indexOf("_NO_INTERPOLATE_") >= 0)
-            {
-                Log.notice("%sservice THR Interpolation Off\n", MODULE_PREFIX);
-                _interpolate = false;
-            }
-            else if (newLine.indexOf("_INTERPOLATE_") >= 0)
-            {
-                Log.notice("%sservice THR Interpolation On\n", MODULE_PREFIX);
-                _interpolate = true;
-            }
+            Log.verbose("%sservice new line %s\n", MODULE_PREFIX, newLine.c_str());
+            String retStr;
+            WorkItem workItem(newLine.c_str());
+            _workManager.addWorkItem(workItem, retStr);
+            _firstValidLineProcessed = true;
         }
+    }
+
+    // Check for finished
+    if (finalChunk)
+    {
+        // Process the line
+        Log.verbose("%sservice file finished\n", MODULE_PREFIX);
+        _inProgress = false;
+    }
+
+}
+
+// Convert a line of a gcode file to a work item string
+bool EvaluatorFiles::lineToWorkItemStr(String& line)
+{
+    line.replace("\n", "");
+    line.replace("\r", "");
+    line.trim();
 
-        // Check for comments
-        bool isComment = false;
-        if (_fileType == FILE_TYPE_THETA_RHO)
-            isComment = newLine.startsWith("#");
-        else if (_fileType == FILE_TYPE_GCODE)
-            isComment = newLine.startsWith(";");
+    // Check for comments
+    return !line.startsWith(";");
+}
 
-        // Handle non-comments
-        if (!isComment)
+// Start a theta-rho file
+bool EvaluatorFiles::startThetaRho(const String& fileName, bool reversed)
+{
+    // Use the prefetched status and first (or last) block if this file was prefetched
+    bool isPrefetched = (_prefetchFileName.length() != 0) && (_prefetchFileName == fileName) &&
+                (_prefetchReversed == reversed);
+    _prefetchFileName = "";
+    if (isPrefetched)
+    {
+        _fileLen = _prefetchFileLen;
+        _thrModTime = _prefetchModTime;
+    }
+    else if (!_fileManager.getFileStatus("", fileName, _thrRootFilename, _fileLen, _thrModTime))
+    {
+        return false;
+    }
+    if (_thrNextCmdIdxBase > THR_CMD_IDX_MAX - _fileLen)
+        _thrNextCmdIdxBase = THR_CMD_IDX_FIRST;
+    _thrCmdIdxBase = _thrNextCmdIdxBase;
+    _thrNextCmdIdxBase += _fileLen + 1;
+    _thrReversed = reversed;
+    _interpolate = true;
+    if (reversed)
+    {
+        // Interpolation flags are only taken from before the first point (the whole file is
+        // played with them)
+        if (isPrefetched)
+            _interpolate = _prefetchInterpolate;
+        else
+            _interpolate = getThetaRhoStartInterpolate(_thrRootFilename);
+        _thrReadBufLen = isPrefetched ? _prefetchReadLen : 0;
+        _thrReadBufPos = _thrReadBufLen;
+        _thrReadBufFilePos = _fileLen - _thrReadBufLen;
+        _thrReadAtEnd = _thrReadBufFilePos <= 0;
+    }
+    else
+    {
+        _thrReadBufLen = isPrefetched ? _prefetchReadLen : 0;
+        _thrReadBufPos = 0;
+        _thrReadBufFilePos = 0;
+        _thrReadAtEnd = isPrefetched && (_prefetchReadLen < THR_READ_BUF_LEN);
+    }
+    _thrNumPoints = 0;
+    _thrPointIdx = 0;
+    _filePos = 0;
+    _chunkLen = 0;
+    _inProgress = true;
+    _firstValidLineProcessed = false;
+    return true;
+}
+
+// Interpolation at the first point of a file (set by flags and the Sandify header in the first
+// block before it) - reversed files are played with this throughout
+bool EvaluatorFiles::getThetaRhoStartInterpolate(const String& rootFilename)
+{
+    bool interpolate = true;
+    int readLen = _fileManager.readFileBlock(rootFilename, 0, (uint8_t*)_thrReadBuf, THR_READ_BUF_LEN);
+    const char* pLine = _thrReadBuf;
+    const char* pBufEnd = _thrReadBuf + std::max(readLen, 0);
+    while (pLine < pBufEnd)
+    {
+        const char* pLineEnd = (const char*)memchr(pLine, '\n', pBufEnd - pLine);
+        if (!pLineEnd)
+            pLineEnd = pBufEnd;
+        double theta = 0, rho = 0;
+        if (ThetaRhoTokenizer::parseLine(pLine, pLineEnd, interpolate, theta, rho))
+            break;
+        pLine = pLineEnd + 1;
+    }
+    return interpolate;
+}
+
+// Points are added when the theta-rho evaluator is idle (the file evaluator isn't serviced while
+// it is busy) and the moves from previous lines in the queue are running low - points which don't
+// start a line (e.g. the first point of an interpolated file) are passed on until one does
+void EvaluatorFiles::serviceThetaRho()
+{
+    if (_workManager.queueSize() > _thrItemsAhead)
+        return;
+    while (!_thrEvaluator.isBusy())
+    {
+        // Next batch
+        if (_thrPointIdx >= _thrNumPoints)
         {
-            bool isValid = true;
-            // Format line if Theta-Rho
-            if (_fileType == FILE_TYPE_THETA_RHO)
+            fillThetaRhoBatch();
+            if (_thrNumPoints == 0)
             {
-                int spacePos = newLine.indexOf(" ");
-                if (spacePos > 0)
-                {
-                    newLine = (_interpolate ? (!_firstValidLineProcessed ? "_THRLINE0_/" : "_THRLINEN_/") : "_THRLINE_/") +
-                             newLine.substring(0,spacePos) + "/" + newLine.substring(spacePos+1);
-                }
-                else
+                // Reversed files are read back to the start of the buffer
+                bool bufDone = _thrReversed ? (_thrReadBufPos == 0) : (_thrReadBufPos >= _thrReadBufLen);
+                if (_thrReadAtEnd && bufDone)
                 {
-                    isValid = false;
+                    Log.verbose("%sservice file finished\n", MODULE_PREFIX);
+                    _inProgress = false;
                 }
+                return;
             }
-            // Form the work item if valid
-            if (isValid)
+        }
+
+        // Pass the point to the theta-rho evaluator
+        ThetaRhoPoint& point = _thrPoints[_thrPointIdx++];
+        _filePos = point._filePos;
+        _chunkLen = point._lineLen;
+        _thrEvaluator.addPolarPoint(point._theta + _thrRotation, point._rho, point._interpolate, !_firstValidLineProcessed,
+                    _thrCmdIdxBase + point._filePos + point._lineLen);
+        _firstValidLineProcessed = true;
+    }
+}
+
+// Tokenize lines from the read-ahead buffer (reading more of the file as required) until the
+// batch of points is full or the time budget is used
+void EvaluatorFiles::fillThetaRhoBatch()
+{
+    _thrNumPoints = 0;
+    _thrPointIdx = 0;
+    uint32_t startUs = micros();
+    while ((_thrNumPoints < THR_POINT_BATCH_SIZE) && (micros() - startUs < THR_BATCH_TIME_BUDGET_US))
+    {
+        char* pLine = NULL;
+        char* pLineEnd = NULL;
+        int lineFilePos = 0;
+        if (!(_thrReversed ? prevThetaRhoLine(pLine, pLineEnd, lineFilePos) : nextThetaRhoLine(pLine, pLineEnd, lineFilePos)))
+            return;
+
+        // Tokenize - flags in reversed files would apply to the wrong lines so are ignored
+        bool wasInterpolating = _interpolate;
+        bool reversedInterpolate = _interpolate;
+        ThetaRhoPoint& point = _thrPoints[_thrNumPoints];
+        bool isPoint = ThetaRhoTokenizer::parseLine(pLine, pLineEnd, _thrReversed ? reversedInterpolate : _interpolate,
+                    point._theta, point._rho);
+        if (wasInterpolating != _interpolate)
+            Log.notice("%sservice THR Interpolation %s\n", MODULE_PREFIX, _interpolate ? "On" : "Off");
+        if (isPoint)
+        {
+            // Positions in reversed files are from the end (so they increase as the file is read)
+            int lineLen = pLineEnd - pLine;
+            point._interpolate = _interpolate;
+            point._filePos = _thrReversed ? _fileLen - lineFilePos - lineLen : lineFilePos;
+            point._lineLen = lineLen;
+            _thrNumPoints++;
+        }
+    }
+}
+
+// Next line from the read-ahead buffer (reading more of the file as required) - false at the end
+// of the file
+bool EvaluatorFiles::nextThetaRhoLine(char*& pLine, char*& pLineEnd, int& lineFilePos)
+{
+    while (true)
+    {
+        // Find the end of the next line
+        pLine = _thrReadBuf + _thrReadBufPos;
+        char* pBufEnd = _thrReadBuf + _thrReadBufLen;
+        pLineEnd = (char*)memchr(pLine, '\n', pBufEnd - pLine);
+        if (!pLineEnd)
+        {
+            if (!_thrReadAtEnd)
             {
-                Log.verbose("%sservice new line %s\n", MODULE_PREFIX, newLine.c_str());
-                String retStr;
-                WorkItem workItem(newLine.c_str());
-                _workManager.addWorkItem(workItem, retStr);
-                _firstValidLineProcessed = true;
+                // Move the partial line to the start of the buffer and read more - lines longer
+                // than the buffer are split
+                int partialLen = pBufEnd - pLine;
+                if (partialLen >= THR_READ_BUF_LEN)
+                    partialLen = 0;
+                memmove(_thrReadBuf, pBufEnd - partialLen, partialLen);
+                _thrReadBufFilePos += _thrReadBufLen - partialLen;
+                int readLen = _fileManager.readFileBlock(_thrRootFilename, _thrReadBufFilePos + partialLen,
+                            (uint8_t*)_thrReadBuf + partialLen, THR_READ_BUF_LEN - partialLen);
+                if (readLen < THR_READ_BUF_LEN - partialLen)
+                    _thrReadAtEnd = true;
+                _thrReadBufLen = partialLen + ((readLen > 0) ? readLen : 0);
+                _thrReadBufPos = 0;
+                continue;
             }
+
+            // The final line may not be terminated
+            if (pLine >= pBufEnd)
+                return false;
+            pLineEnd = pBufEnd;
         }
-        else
+        lineFilePos = _thrReadBufFilePos + _thrReadBufPos;
+        _thrReadBufPos = std::min(int(pLineEnd - _thrReadBuf) + 1, _thrReadBufLen);
+        return true;
+    }
+}
+
+// Previous line of a reversed file (reading earlier blocks of the file as required) - the line
+// is the text after the last newline before the read position - false at the start of the file
+bool EvaluatorFiles::prevThetaRhoLine(char*& pLine, char*& pLineEnd, int& lineFilePos)
+{
+    while (true)
+    {
+        pLineEnd = _thrReadBuf + _thrReadBufPos;
+        pLine = pLineEnd;
+        while ((pLine > _thrReadBuf) && (*(pLine - 1) != '\n'))
+            pLine--;
+        if (pLine == _thrReadBuf)
         {
-            if (_fileType == FILE_TYPE_THETA_RHO)
+            if (!_thrReadAtEnd)
             {
-                if (newLine.indexOf("Sandify") >= 0)
+                // Move the partial line to after the space for the previous block and read it -
+                // lines longer than the buffer are split
+                int partialLen = _thrReadBufPos;
+                if (partialLen >= THR_READ_BUF_LEN)
+                    partialLen = 0;
+                int readLen = std::min(THR_READ_BUF_LEN - partialLen, _thrReadBufFilePos);
+                memmove(_thrReadBuf + readLen, _thrReadBuf, partialLen);
+                _thrReadBufFilePos -= readLen;
+                if (_fileManager.readFileBlock(_thrRootFilename, _thrReadBufFilePos, (uint8_t*)_thrReadBuf, readLen) != readLen)
                 {
-                    Log.notice("%sservice THR Interpolation Off\n", MODULE_PREFIX);
-                    _interpolate = false;
+                    _thrReadBufFilePos = 0;
+                    readLen = 0;
+                    partialLen = 0;
                 }
+                _thrReadAtEnd = _thrReadBufFilePos == 0;
+                _thrReadBufLen = readLen + partialLen;
+                _thrReadBufPos = _thrReadBufLen;
+                continue;
             }
-        }
-    }
 
-    // Check for finished
-    if (finalChunk)
-    {
-        // Process the line
-        Log.verbose("%sservice file finished\n", MODULE_PREFIX);
-        _inProgress = false;
+            // The first line of the file
+            if (pLineEnd == _thrReadBuf)
+                return false;
+        }
+        lineFilePos = _thrReadBufFilePos + (pLine - _thrReadBuf);
+        _thrReadBufPos = std::max(int(pLine - _thrReadBuf) - 1, 0);
+        return true;
     }
-
 }
 
 void EvaluatorFiles::stop()
 {
     _inProgress = false;
+    _thrReversed = false;
+    _prefetchFileName = "";
 }
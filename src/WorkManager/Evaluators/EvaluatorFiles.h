@@ -7,11 +7,12 @@
 
 class WorkManager;
 class WorkItem;
+class EvaluatorThetaRhoLine;
 
 class EvaluatorFiles
 {
 public:
-    EvaluatorFiles(FileManager& fileManager, WorkManager& workManager);
+    EvaluatorFiles(FileManager& fileManager, WorkManager& workManager, EvaluatorThetaRhoLine& thrEvaluator);
 
     // Config
     void setConfig(const char* configStr);
@@ -26,9 +27,21 @@ public:
     //Total file length
     int getTotalFileLength();
 
+    // Status of the theta-rho file in progress (as looked up or prefetched when it started) -
+    // false for other files
+    bool getThetaRhoFileStatus(String& rootFilename, int& fileLen, time_t& modTime);
+
+    // Range of the numbered moves of the file in progress - false if its moves aren't numbered
+    // uniquely (only theta-rho files are)
+    bool getNumberedCmdIdxRange(int& cmdIdxFirst, int& cmdIdxLast);
+
     //Current file position
     int getCurrentFilePosition();
 
+    // File position reached by the motion (theta-rho files are read ahead so this is found
+    // from the last completed numbered command)
+    int getMotionFilePosition(int lastCompletedCmdIdx);
+
     //Current line length
     int getCurrentLineLength();
     
@@ -38,6 +51,11 @@ public:
     // Process WorkItem
     bool execWorkItem(WorkItem& workItem);
 
+    // Prefetch a theta-rho file which has been queued (e.g. the next pattern of a sequence behind
+    // the final moves of the one in progress) - its status and first block are read so that it
+    // starts without waiting for the file system - only done when no file is being read
+    void prefetch(WorkItem& workItem);
+
     // Call frequently
     void service();
 
@@ -50,14 +68,27 @@ public:
         FILE_TYPE_GCODE,
         FILE_TYPE_THETA_RHO
     };
-    
-private:
+    static int getFileTypeFromExtension(String& fileName);
+    static int getFileTypeFromExtension(const char* pFileName, unsigned int nameLen);
+
+    // File work items are a file name optionally followed by R<degrees> to rotate a theta-rho
+    // pattern and REV to play it reversed (from its last point to its first) in either order
+    // (e.g. as ordered by the playlist optimiser)
+    static void getFileNameAndOptions(const String& workItemStr, String& fileName, double& rotationDegs, bool& reversed);
+    static unsigned int getFileNameLen(const char* pStr, unsigned int len, double& rotationDegs, bool& reversed);
+
+    // Convert a line of a gcode file (in place) to a work item string - returns false if the
+    // line isn't a work item
+    static bool lineToWorkItemStr(String& line);
+
+protected:
     // Filename in progress
     bool _inProgress;
 
-    // File manager & work manager
+    // File manager, work manager and theta-rho evaluator
     FileManager& _fileManager;
     WorkManager& _workManager;
+    EvaluatorThetaRhoLine& _thrEvaluator;
 
     // File type
     int _fileType;
@@ -74,7 +105,60 @@ private:
     // Settings
     bool _interpolate;
 
-private:
-    int getFileTypeFromExtension(String& fileName);
-
+    // Theta-rho lines are fed while there are no more than this number of items in the work
+    // queue so that the planner has moves across line boundaries (0 waits for an empty queue)
+    static const int THR_ITEMS_AHEAD_DEFAULT = 10;
+    int _thrItemsAhead;
+
+    // Moves at the end of each theta-rho line are numbered with the file position (after the
+    // line) plus a base which is different for each file
+    static const int THR_CMD_IDX_FIRST = 1000000;
+    static const int THR_CMD_IDX_MAX = 1000000000;
+    int _thrCmdIdxBase;
+    int _thrNextCmdIdxBase;
+
+    // Theta-rho files are read ahead in blocks and tokenized in place into batches of points
+    // which are passed directly to the theta-rho evaluator
+    static const int THR_READ_BUF_LEN = 1000;
+    static const int THR_POINT_BATCH_SIZE = 16;
+    static const uint32_t THR_BATCH_TIME_BUDGET_US = 2000;
+    struct ThetaRhoPoint
+    {
+        double _theta;
+        double _rho;
+        bool _interpolate;
+        int _filePos;
+        int _lineLen;
+    };
+    String _thrRootFilename;
+    time_t _thrModTime;
+    char _thrReadBuf[THR_READ_BUF_LEN];
+    int _thrReadBufLen;
+    int _thrReadBufPos;
+    int _thrReadBufFilePos;
+    bool _thrReadAtEnd;
+    ThetaRhoPoint _thrPoints[THR_POINT_BATCH_SIZE];
+    int _thrNumPoints;
+    int _thrPointIdx;
+    double _thrRotation;
+
+    // Reversed theta-rho files are read backwards from the end - the buffer then holds the file
+    // from _thrReadBufFilePos with the lines before _thrReadBufPos still to be read and
+    // _thrReadAtEnd set when the start of the file is in the buffer
+    bool _thrReversed;
+
+    // Prefetched file - the first block (or the last if reversed) is in the read buffer
+    String _prefetchFileName;
+    bool _prefetchReversed;
+    bool _prefetchInterpolate;
+    int _prefetchFileLen;
+    time_t _prefetchModTime;
+    int _prefetchReadLen;
+
+    bool startThetaRho(const String& fileName, bool reversed);
+    void serviceThetaRho();
+    void fillThetaRhoBatch();
+    bool nextThetaRhoLine(char*& pLine, char*& pLineEnd, int& lineFilePos);
+    bool prevThetaRhoLine(char*& pLine, char*& pLineEnd, int& lineFilePos);
+    bool getThetaRhoStartInterpolate(const String& rootFilename);
 };
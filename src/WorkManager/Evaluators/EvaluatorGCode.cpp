@@ -4,6 +4,7 @@
 #include "Arduino.h"
 #include "EvaluatorGCode.h"
 #include "RobotCommandArgs.h"
+#include "MoveCmd.h"
 #include "../../RobotMotion/RobotController.h"
 
 // #define DEBUG_GCODE_EVALUATOR 1
@@ -12,122 +13,134 @@
 static const char *MODULE_PREFIX = "EvaluatorGCode: ";
 #endif
 
-bool EvaluatorGCode::getCmdNumber(const char* pCmdStr, int& cmdNum)
+// Args for other commands
+void EvaluatorGCode::getGcodeCmdArgs(const GCodeCommand& cmd, RobotCommandArgs& cmdArgs)
 {
-    // String passed in should start with a G or M
-    // And be followed immediately by a number
-    if (strlen(pCmdStr) < 1)
-        return false;
-    const char* pStr = pCmdStr + 1;
-    if (!isdigit(*pStr))
+    for (int axisIdx = 0; axisIdx < 3; axisIdx++)
+    {
+        if (cmd.hasWord('A' + axisIdx))
+            cmdArgs.setAxisSteps(axisIdx, int(cmd.getWord('A' + axisIdx)), true);
+        if (cmd.hasWord('X' + axisIdx))
+            cmdArgs.setAxisValMM(axisIdx, cmd.getWord('X' + axisIdx), true);
+    }
+    if (cmd.hasWord('E'))
+        cmdArgs.setExtrude(cmd.getWord('E'));
+    if (cmd.hasWord('F'))
+        cmdArgs.setFeedrate(cmd.getWord('F'));
+    if (cmd.hasWord('R') || cmd.hasBareWord('R'))
+        cmdArgs.setMoveType(RobotMoveTypeArg_Relative);
+    if (cmd.hasWord('S'))
+    {
+        int endstopIdx = int(cmd.getWord('S'));
+        if (endstopIdx == 1)
+            cmdArgs.setTestAllEndStops();
+        else if (endstopIdx == 0)
+            cmdArgs.setTestNoEndStops();
+    }
+}
+
+// Args for move commands are put straight into the compact move form
+void EvaluatorGCode::getGcodeMoveCmd(const GCodeCommand& cmd, MoveCmd& moveCmd)
+{
+    moveCmd.clear();
+    for (int axisIdx = 0; axisIdx < 3; axisIdx++)
+    {
+        if (cmd.hasWord('A' + axisIdx))
+            moveCmd.setAxisSteps(axisIdx, int(cmd.getWord('A' + axisIdx)));
+        if (cmd.hasWord('X' + axisIdx))
+            moveCmd.setAxisValMM(axisIdx, cmd.getWord('X' + axisIdx));
+    }
+    // Extrusion (E) is not used for motion
+    if (cmd.hasWord('F'))
+        moveCmd.setFeedrate(cmd.getWord('F'));
+    // Numbered command - completion can be tracked through the motion pipeline
+    if (cmd._hasLineNum)
+        moveCmd._numberedCommandIndex = cmd._lineNum;
+    // D1 - direct move (not split into blocks) - e.g. a theta-rho step which is linear in
+    // actuator space
+    if (cmd.hasWord('D'))
+        moveCmd.setFlag(MoveCmd::FLAG_DONT_SPLIT, cmd.getWord('D') != 0);
+    if (cmd.hasWord('I'))
+        moveCmd._arcCentreOffset[0] = cmd.getWord('I');
+    if (cmd.hasWord('J'))
+        moveCmd._arcCentreOffset[1] = cmd.getWord('J');
+    // R with a value is an arc radius - otherwise it indicates relative motion
+    if (cmd.hasWord('R'))
+        moveCmd._arcRadius = cmd.getWord('R');
+    if (cmd.hasBareWord('R'))
+        moveCmd._moveType = RobotMoveTypeArg_Relative;
+    if (cmd.hasWord('S'))
+    {
+        int endstopIdx = int(cmd.getWord('S'));
+        AxisMinMaxBools endstops;
+        if (endstopIdx == 1)
+            endstops.all();
+        if (endstopIdx == 0 || endstopIdx == 1)
+            moveCmd._endstops = endstops.uintVal();
+    }
+}
+
+bool EvaluatorGCode::isMoveCode(const GCodeCommand::Code& code)
+{
+    if ((code._letter != 'G') || (code._subCode != 0))
         return false;
-    long rsltStr = strtol(pStr, NULL, 10);
-    cmdNum = (int) rsltStr;
-    return true;
+    return (code._num <= 3) || (code._num == 6);
 }
 
-bool EvaluatorGCode::getGcodeCmdArgs(const char* pArgStr, RobotCommandArgs& cmdArgs)
+// Get the move for a G-code move command
+bool EvaluatorGCode::getMoveCmd(const GCodeCommand& cmd, const GCodeCommand::Code& code, MoveCmd& moveCmd)
 {
-    const char* pStr = pArgStr;
-    char* pEndStr = NULL;
-    while (*pStr)
+    if (!isMoveCode(code))
+        return false;
+    getGcodeMoveCmd(cmd, moveCmd);
+    switch(code._num)
     {
-        switch(toupper(*pStr))
-        {
-            case 'A':
-                cmdArgs.setAxisSteps(0, int(strtod(++pStr, &pEndStr)), true);
-                pStr = pEndStr;
-                break;
-            case 'B':
-                cmdArgs.setAxisSteps(1, int(strtod(++pStr, &pEndStr)), true);
-                pStr = pEndStr;
-                break;
-            case 'C':
-                cmdArgs.setAxisSteps(2, int(strtod(++pStr, &pEndStr)), true);
-                pStr = pEndStr;
-                break;
-            case 'X':
-                cmdArgs.setAxisValMM(0, strtod(++pStr, &pEndStr), true);
-                pStr = pEndStr;
-                break;
-            case 'Y':
-                cmdArgs.setAxisValMM(1, strtod(++pStr, &pEndStr), true);
-                pStr = pEndStr;
-                break;
-            case 'Z':
-                cmdArgs.setAxisValMM(2, strtod(++pStr, &pEndStr), true);
-                pStr = pEndStr;
-                break;
-            case 'E':
-                cmdArgs.setExtrude(strtod(++pStr, &pEndStr));
-                pStr = pEndStr;
-                break;
-            case 'F':
-                cmdArgs.setFeedrate(strtod(++pStr, &pEndStr));
-                pStr = pEndStr;
-                break;
-            case 'R':
-                cmdArgs.setMoveType(RobotMoveTypeArg_Relative);
-                pStr++;
-                break;
-            case 'S':
-            {
-                    int endstopIdx = strtol(++pStr, &pEndStr, 10);
-                    pStr = pEndStr;
-                    if (endstopIdx == 1)
-                        cmdArgs.setTestAllEndStops();
-                    else if (endstopIdx == 0)
-                        cmdArgs.setTestNoEndStops();
-                    break;
-            }
-            default:
-            {
-                pStr++;
-                break;
-            }
-        }
+        case 2: // Arc clockwise
+        case 3: // Arc anti-clockwise
+            if (moveCmd.isStepwise())
+                return false;
+            moveCmd.setFlag(MoveCmd::FLAG_ARC, true);
+            moveCmd.setFlag(MoveCmd::FLAG_ARC_CW, code._num == 2);
+            break;
     }
     return true;
 }
 
-// Interpret GCode G commands
-bool EvaluatorGCode::interpG(String& cmdStr, RobotController* pRobotController, bool takeAction)
+bool EvaluatorGCode::getMoveCmd(const char* pCmdStr, MoveCmd& moveCmd)
 {
-    // Command string as a text buffer
-    const char* pCmdStr = cmdStr.c_str();
+    GCodeCommand cmd;
+    if (!GCodeParser::parse(pCmdStr, pCmdStr + strlen(pCmdStr), cmd))
+        return false;
+    for (int codeIdx = 0; codeIdx < cmd._numCodes; codeIdx++)
+        if (isMoveCode(cmd._codes[codeIdx]))
+            return getMoveCmd(cmd, cmd._codes[codeIdx], moveCmd);
+    return false;
+}
 
-    // Command number
-    int cmdNum = 0;
-    bool rslt = getCmdNumber(cmdStr.c_str(), cmdNum);
-    if (!rslt)
+// Interpret GCode G commands
+bool EvaluatorGCode::interpG(const GCodeCommand& cmd, const GCodeCommand::Code& code,
+            RobotController* pRobotController, bool takeAction)
+{
+    // Moves
+    if (isMoveCode(code))
+    {
+        if (takeAction)
+        {
+            MoveCmd moveCmd;
+            if (!getMoveCmd(cmd, code, moveCmd))
+                return false;
+            pRobotController->moveTo(moveCmd);
+        }
+        return true;
+    }
+    if (code._subCode != 0)
         return false;
 
-    // Get args string (separated from the GXX or MXX by a space)
-    const char* pArgsStr = "";
-    const char* pArgsPos = strstr(pCmdStr, " ");
-    if (pArgsPos != 0)
-        pArgsStr = pArgsPos + 1;
+    // Other commands
     RobotCommandArgs cmdArgs;
-    rslt = getGcodeCmdArgs(pArgsStr, cmdArgs);
-
-    // Switch on number
-    switch(cmdNum)
+    getGcodeCmdArgs(cmd, cmdArgs);
+    switch(code._num)
     {
-        case 0: // Move rapid
-        case 1: // Move
-            if (takeAction)
-            {
-                cmdArgs.setMoveRapid(cmdNum == 0);
-                pRobotController->moveTo(cmdArgs);
-            }
-            return true;
-        case 6: // Direct stepper move
-            if (takeAction)
-            {
-                cmdArgs.setMoveRapid(true);
-                pRobotController->moveTo(cmdArgs);
-            }
-            return true;
         case 28: // Home axes
             if (takeAction)
             {
@@ -161,27 +174,134 @@ bool EvaluatorGCode::interpG(String& cmdStr, RobotController* pRobotController,
     return false;
 }
 
+// M code handlers
+static void mCodePause(const GCodeCommand& cmd, RobotController* pRobotController)
+{
+    pRobotController->pause(true);
+}
+
+static void mCodeEnd(const GCodeCommand& cmd, RobotController* pRobotController)
+{
+    // Modal state back to defaults
+    RobotCommandArgs cmdArgs;
+    cmdArgs.setMoveType(RobotMoveTypeArg_Absolute);
+    pRobotController->setMotionParams(cmdArgs);
+    pRobotController->setSpeedFactor(1.0f);
+}
+
+static void mCodeMotorsOn(const GCodeCommand& cmd, RobotController* pRobotController)
+{
+    pRobotController->enableMotors(true);
+}
+
+static void mCodeMotorsOff(const GCodeCommand& cmd, RobotController* pRobotController)
+{
+    pRobotController->enableMotors(false);
+}
+
+static void mCodeSpeedFactor(const GCodeCommand& cmd, RobotController* pRobotController)
+{
+    if (cmd.getWord('S') > 0)
+        pRobotController->setSpeedFactor(cmd.getWord('S') / 100);
+}
+
+static void mCodeWaitForMotion(const GCodeCommand& cmd, RobotController* pRobotController)
+{
+    // Nothing to do - the command is held until motion is complete
+}
+
+const EvaluatorGCode::MCodeDef EvaluatorGCode::_mCodes[] = {
+    { 0, true, mCodePause },            // M0 - pause when motion completes (until resumed)
+    { 2, true, mCodeEnd },              // M2 - program end
+    { 17, false, mCodeMotorsOn },       // M17 - enable motors
+    { 18, true, mCodeMotorsOff },       // M18 - disable motors
+    { 84, true, mCodeMotorsOff },       // M84 - disable motors
+    { 220, false, mCodeSpeedFactor },   // M220 Snnn - speed factor percentage
+    { 400, true, mCodeWaitForMotion },  // M400 - wait for motion to complete
+};
+
+const EvaluatorGCode::MCodeDef* EvaluatorGCode::findMCode(const GCodeCommand::Code& code)
+{
+    if ((code._letter != 'M') || (code._subCode != 0))
+        return NULL;
+    for (const MCodeDef& mCode : _mCodes)
+        if (mCode._num == code._num)
+            return &mCode;
+    return NULL;
+}
+
 // Interpret GCode M commands
-bool EvaluatorGCode::interpM(String& cmdStr, RobotController* pRobotController, bool takeAction)
+bool EvaluatorGCode::interpM(const GCodeCommand& cmd, const GCodeCommand::Code& code,
+            RobotController* pRobotController, bool takeAction)
+{
+    const MCodeDef* pMCode = findMCode(code);
+    if (!pMCode)
+        return false;
+    if (takeAction)
+        pMCode->_fn(cmd, pRobotController);
+    return true;
+}
+
+bool EvaluatorGCode::waitsForMotion(const WorkItem& workItem)
+{
+    // Only lines with an M code need to be parsed
+    const char* pStr = workItem.getCString();
+    if (!strpbrk(pStr, "Mm"))
+        return false;
+    GCodeCommand cmd;
+    if (!GCodeParser::parse(pStr, pStr + workItem.length(), cmd))
+        return false;
+    for (int codeIdx = 0; codeIdx < cmd._numCodes; codeIdx++)
+    {
+        const MCodeDef* pMCode = findMCode(cmd._codes[codeIdx]);
+        if (pMCode && pMCode->_waitsForMotion)
+            return true;
+    }
+    return false;
+}
+
+bool EvaluatorGCode::changesPosition(const WorkItem& workItem)
 {
+    // Only lines with a G code need to be parsed
+    const char* pStr = workItem.getCString();
+    if (!strpbrk(pStr, "Gg"))
+        return false;
+    GCodeCommand cmd;
+    if (!GCodeParser::parse(pStr, pStr + workItem.length(), cmd))
+        return false;
+    for (int codeIdx = 0; codeIdx < cmd._numCodes; codeIdx++)
+    {
+        const GCodeCommand::Code& code = cmd._codes[codeIdx];
+        if (isMoveCode(code) || ((code._letter == 'G') && (code._subCode == 0) && ((code._num == 28) || (code._num == 92))))
+            return true;
+    }
     return false;
 }
 
 // Interpret GCode commands
 bool EvaluatorGCode::interpretGcode(WorkItem& workItem, RobotController* pRobotController, bool takeAction)
 {
-    // Extract code
-    String cmdStr = workItem.getString();
-    cmdStr.trim();
-    if (cmdStr.length() == 0)
+    // Parse in place
+    GCodeCommand cmd;
+    const char* pStr = workItem.getCString();
+    if (!GCodeParser::parse(pStr, pStr + workItem.length(), cmd) || (cmd._numCodes == 0))
         return false;
 
-    // Check for G or M codes
-    if (toupper(cmdStr.charAt(0)) == 'G')
-        return interpG(cmdStr, pRobotController, takeAction);
-    else if (toupper(cmdStr.charAt(0)) == 'M')
-        return interpM(cmdStr, pRobotController, takeAction);
-
-    // Failed
-    return false;
+    // Codes are interpreted in order apart from a move which is last as other codes on the
+    // line (e.g. G91) may affect it
+    bool rslt = true;
+    int moveCodeIdx = -1;
+    for (int codeIdx = 0; codeIdx < cmd._numCodes; codeIdx++)
+    {
+        const GCodeCommand::Code& code = cmd._codes[codeIdx];
+        if (isMoveCode(code))
+            moveCodeIdx = codeIdx;
+        else if (code._letter == 'G')
+            rslt = interpG(cmd, code, pRobotController, takeAction) && rslt;
+        else
+            rslt = interpM(cmd, code, pRobotController, takeAction) && rslt;
+    }
+    if (moveCodeIdx >= 0)
+        rslt = interpG(cmd, cmd._codes[moveCodeIdx], pRobotController, takeAction) && rslt;
+    return rslt;
 }
@@ -4,19 +4,44 @@
 #pragma once
 
 #include "../WorkItem.h"
+#include "GCodeParser.h"
 class RobotCommandArgs;
+struct MoveCmd;
 class RobotController;
 
 class EvaluatorGCode
 {
 
 public:
-    static bool getCmdNumber(const char* pCmdStr, int& cmdNum);
-    static bool getGcodeCmdArgs(const char* pArgStr, RobotCommandArgs& cmdArgs);
-    // Interpret GCode G commands
-    static bool interpG(String& cmdStr, RobotController* pRobotController, bool takeAction);
-    // Interpret GCode M commands
-    static bool interpM(String& cmdStr, RobotController* pRobotController, bool takeAction);
+    static void getGcodeCmdArgs(const GCodeCommand& cmd, RobotCommandArgs& cmdArgs);
+    static void getGcodeMoveCmd(const GCodeCommand& cmd, MoveCmd& moveCmd);
+    // Get the move for a G-code move command (G0, G1, G2, G3, G6) - false if not a move
+    static bool getMoveCmd(const char* pCmdStr, MoveCmd& moveCmd);
+    // Check if a command has to wait for motion to complete before it is interpreted (e.g. M400)
+    static bool waitsForMotion(const WorkItem& workItem);
+    // Check if a command moves the robot or changes its position (moves, G28 and G92)
+    static bool changesPosition(const WorkItem& workItem);
+    // Interpret a G code of a parsed line
+    static bool interpG(const GCodeCommand& cmd, const GCodeCommand::Code& code,
+                RobotController* pRobotController, bool takeAction);
+    // Interpret an M code of a parsed line
+    static bool interpM(const GCodeCommand& cmd, const GCodeCommand::Code& code,
+                RobotController* pRobotController, bool takeAction);
     // Interpret GCode commands
     static bool interpretGcode(WorkItem& workItem, RobotController* pRobotController, bool takeAction);
+
+private:
+    // M codes are dispatched through a table
+    typedef void (*MCodeFnType)(const GCodeCommand& cmd, RobotController* pRobotController);
+    struct MCodeDef
+    {
+        uint16_t _num;
+        bool _waitsForMotion;
+        MCodeFnType _fn;
+    };
+    static const MCodeDef _mCodes[];
+    static const MCodeDef* findMCode(const GCodeCommand::Code& code);
+
+    static bool isMoveCode(const GCodeCommand::Code& code);
+    static bool getMoveCmd(const GCodeCommand& cmd, const GCodeCommand::Code& code, MoveCmd& moveCmd);
 };
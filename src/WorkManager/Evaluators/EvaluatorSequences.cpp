@@ -5,21 +5,55 @@
 #include <ArduinoLog.h>
 #include "EvaluatorSequences.h"
 #include "RdJson.h"
+#include "Utils.h"
 #include "../WorkManager.h"
+#include "EvaluatorFiles.h"
 
 static const char* MODULE_PREFIX = "EvaluatorSequences: ";
 
+// Mode names which can appear anywhere in a playlist - the longest sets how much of each block
+// is kept for the next when indexing
+static const char* MODE_SHUFFLE_ON = "ShuffleMode";
+static const char* MODE_SHUFFLE_OFF = "NoShuffleMode";
+static const char* MODE_REPEAT_ON = "RepeatMode";
+static const char* MODE_REPEAT_OFF = "NoRepeatMode";
+static const int MODE_NAME_MAX_LEN = 13;
+
+static bool findStr(const char* pStart, const char* pEnd, const char* pToFind)
+{
+    int findLen = strlen(pToFind);
+    for (const char* p = pStart; p + findLen <= pEnd; p++)
+        if ((*p == *pToFind) && (strncmp(p, pToFind, findLen) == 0))
+            return true;
+    return false;
+}
+
 EvaluatorSequences::EvaluatorSequences(FileManager& fileManager, WorkManager& workManager) :
-         _fileManager(fileManager), _workManager(workManager)
+         _fileManager(fileManager), _workManager(workManager), _optimiser(fileManager)
 {
     _inProgress = 0;
+    _seqPos = 0;
     _reqLineIdx = 0;
-    _linesDone = 0;
+    _queuedPos = -1;
     _defaultShuffleMode = false;
     _defaultRepeatMode = false;
     _shuffleMode = false;
     _repeatMode = false;
+    _optimiseOrder = false;
+    _optimiseRotate = false;
+    _optimiseReverse = false;
     _lineCount = 0;
+    _fileLen = 0;
+    _scanning = false;
+    _scanLineIdx = 0;
+    _indexing = false;
+    _indexFilePos = 0;
+    _indexInLine = false;
+    _fileShuffleOn = _fileShuffleOff = _fileRepeatOn = _fileRepeatOff = false;
+    _readBufCarry = 0;
+    _seqItemsAhead = SEQ_ITEMS_AHEAD_DEFAULT;
+    _lineQueued = false;
+    _lineQueuedRemovedCount = 0;
 }
 
 void EvaluatorSequences::setConfig(const char* configStr)
@@ -28,6 +62,10 @@ void EvaluatorSequences::setConfig(const char* configStr)
     _jsonConfigStr = configStr;
     _defaultShuffleMode = RdJson::getLong("seqShuffleMode", 0, configStr) != 0;
     _defaultRepeatMode = RdJson::getLong("seqRepeatMode", 0, configStr) != 0;
+    _seqItemsAhead = RdJson::getLong("seqItemsAhead", SEQ_ITEMS_AHEAD_DEFAULT, configStr);
+    _optimiseOrder = RdJson::getLong("seqOptimise", 0, configStr) != 0;
+    _optimiseRotate = RdJson::getLong("seqOptimiseRotate", 0, configStr) != 0;
+    _optimiseReverse = RdJson::getLong("seqOptimiseReverse", 0, configStr) != 0;
     _lineCount = 0;
 }
 
@@ -57,12 +95,10 @@ int EvaluatorSequences::currentWorkItemIndex()
 // Check if valid
 bool EvaluatorSequences::isValid(WorkItem& workItem)
 {
-    // Form the file name
-    String fileName = workItem.getString();
-    // Check extension valid
-    String fileExt = FileManager::getFileExtension(fileName);
-    if (!fileExt.equalsIgnoreCase("seq"))
+    // Check extension valid before forming the file name
+    if (!FileManager::hasFileExtension(workItem.getCString(), workItem.length(), "seq"))
         return false;
+    String fileName = workItem.getString();
     // Check on file system
     int fileLen = 0;
     bool rslt = _fileManager.getFileInfo("", fileName, fileLen);
@@ -71,147 +107,358 @@ bool EvaluatorSequences::isValid(WorkItem& workItem)
     return rslt;
 }
 
-// Count lines
-int EvaluatorSequences::countLines(String& lines)
+// Process WorkItem
+bool EvaluatorSequences::execWorkItem(WorkItem& workItem)
 {
-    int lineCount = 0;
-    bool lineBlank = true;
-    const char* pStr = lines.c_str();
-    while(true)
+    // The playlist is indexed in service
+    String fileName = workItem.getString();
+    _fileName = fileName;
+    time_t modTime = 0;
+    if (!_fileManager.getFileStatus("", fileName, _rootFilename, _fileLen, modTime))
+        return false;
+    stop();
+    _indexing = true;
+    _indexFilePos = 0;
+    _indexInLine = false;
+    _fileShuffleOn = _fileShuffleOff = _fileRepeatOn = _fileRepeatOff = false;
+    _readBufCarry = 0;
+    _inProgress = true;
+    _shuffleMode = _defaultShuffleMode;
+    _repeatMode = _defaultRepeatMode;
+    _lineCount = 0;
+    _seqPos = 0;
+    _reqLineIdx = 0;
+    _queuedPos = -1;
+    _lineQueued = false;
+    return true;
+}
+
+// Index a block of the playlist
+bool EvaluatorSequences::indexBlock()
+{
+    // Read after the end of the previous block
+    char* pNew = _readBuf + _readBufCarry;
+    int maxLen = SEQ_READ_BUF_LEN - _readBufCarry;
+    int readLen = _fileManager.readFileBlock(_rootFilename, _indexFilePos, (uint8_t*)pNew, maxLen);
+    if (readLen < 0)
+        return false;
+
+    // Lines start at the first non-whitespace character after a line end
+    for (int i = 0; i < readLen; i++)
     {
-        if ((*pStr == '\n') || (*pStr == 0))
+        if (pNew[i] == '\n')
+            _indexInLine = false;
+        else if (!_indexInLine && !isspace((unsigned char)pNew[i]))
         {
-            if (!lineBlank)
-                lineCount++;
-            lineBlank = true;
-            if (*pStr == 0)
-                break;
+            _indexInLine = true;
+            _lineOffsets.push_back(_indexFilePos + i);
         }
-        else
-        {
-            if (*pStr != '\r')
-                lineBlank = false;
-        }
-        pStr++;
     }
-    return lineCount;
+
+    // Modes
+    const char* pEnd = pNew + readLen;
+    _fileShuffleOn = _fileShuffleOn || findStr(_readBuf, pEnd, MODE_SHUFFLE_ON);
+    _fileShuffleOff = _fileShuffleOff || findStr(_readBuf, pEnd, MODE_SHUFFLE_OFF);
+    _fileRepeatOn = _fileRepeatOn || findStr(_readBuf, pEnd, MODE_REPEAT_ON);
+    _fileRepeatOff = _fileRepeatOff || findStr(_readBuf, pEnd, MODE_REPEAT_OFF);
+    _readBufCarry = min(MODE_NAME_MAX_LEN - 1, int(pEnd - _readBuf));
+    memmove(_readBuf, pEnd - _readBufCarry, _readBufCarry);
+
+    // Check for the end
+    _indexFilePos += readLen;
+    if ((readLen < maxLen) || (_indexFilePos >= _fileLen))
+        indexDone();
+    return true;
 }
 
-// Process WorkItem
-bool EvaluatorSequences::execWorkItem(WorkItem& workItem)
+// Index complete
+void EvaluatorSequences::indexDone()
 {
-    // Find the command info
-    String fileName = workItem.getString();
-    _fileName = fileName;
-    _commandList = _fileManager.getFileContents("", fileName, MAX_SEQUENCE_FILE_LEN);
-    if (_commandList.length() > 0)
-    {
-        _inProgress = true;
-        _shuffleMode = _defaultShuffleMode;
-        _repeatMode = _defaultRepeatMode;
-        _lineCount = countLines(_commandList);
-        if (_commandList.indexOf("ShuffleMode") >= 0)
-            _shuffleMode = true;
-        if (_commandList.indexOf("NoShuffleMode") >= 0)
-            _shuffleMode = false;
-        if (_commandList.indexOf("RepeatMode") >= 0)
-            _repeatMode = true;
-        if (_commandList.indexOf("NoRepeatMode") >= 0)
-            _repeatMode = false;
-        _linesDone = 0;
-        _reqLineIdx = 0;
-        if (_shuffleMode)
-            _reqLineIdx = rand() % _lineCount;
-        return true;
+    _indexing = false;
+    _lineOffsets.shrink_to_fit();
+    _lineCount = _lineOffsets.size();
+    if (_lineCount == 0)
+    {
+        stop();
+        return;
     }
-    return false;
+    if (_fileShuffleOn)
+        _shuffleMode = true;
+    if (_fileShuffleOff)
+        _shuffleMode = false;
+    if (_fileRepeatOn)
+        _repeatMode = true;
+    if (_fileRepeatOff)
+        _repeatMode = false;
+    Log.notice("%s%s has %d lines\n", MODULE_PREFIX, _fileName.c_str(), _lineCount);
+    if (_shuffleMode)
+    {
+        shuffleFrom(0);
+    }
+    else if (_optimiseOrder && (_lineCount <= SEQ_OPTIMISE_MAX_LINES))
+    {
+        // Scan each pattern in service then optimise
+        _scanning = true;
+        _scanLineIdx = 0;
+        _lineEnds.resize(_lineCount);
+    }
+    _reqLineIdx = lineAtPos(0);
 }
 
-void EvaluatorSequences::service()
+// Scan a line for the start and end of its pattern - lines which aren't theta-rho patterns, or
+// which have their own rotation or reversal, are pinned and the position after them isn't known
+void EvaluatorSequences::scanLine(int lineIdx)
 {
-    // Only add process commands at this level if the workitem queue is completely empty
-    if (!_workManager.queueIsEmpty())
+    PlaylistOptimiser::Entry& entry = _lineEnds[lineIdx];
+    entry._known = false;
+    bool isPinned = false;
+    if (readLine(lineIdx, isPinned) > 0)
+    {
+        String fileName;
+        double rotationDegs = 0;
+        bool reversed = false;
+        EvaluatorFiles::getFileNameAndOptions(_readBuf, fileName, rotationDegs, reversed);
+        if ((fileName.length() == strlen(_readBuf)) &&
+                    (EvaluatorFiles::getFileTypeFromExtension(fileName) == EvaluatorFiles::FILE_TYPE_THETA_RHO))
+            _optimiser.getEnds(fileName, entry);
+    }
+    entry._pinned = isPinned || !entry._known;
+}
+
+// Scan complete - order the lines
+void EvaluatorSequences::scanDone()
+{
+    _scanning = false;
+    if (_shuffleMode)
+    {
+        std::vector<PlaylistOptimiser::Entry>().swap(_lineEnds);
+        shuffleFrom(0);
+        _reqLineIdx = lineAtPos(0);
         return;
+    }
+    std::vector<uint32_t> lineOrder(_lineCount);
+    for (int i = 0; i < _lineCount; i++)
+        lineOrder[i] = i;
+    float transitBefore = PlaylistOptimiser::pathCost(_lineEnds, lineOrder, _optimiseRotate);
+    float transitAfter = PlaylistOptimiser::optimise(_lineEnds, _optimiseRotate, _optimiseReverse, _playOrder,
+                _rotations, _reversals);
+    std::vector<PlaylistOptimiser::Entry>().swap(_lineEnds);
+    _reqLineIdx = lineAtPos(0);
+    Log.notice("%soptimised transit %F to %F (radii)\n", MODULE_PREFIX, transitBefore, transitAfter);
+}
+
+// Read a line into the read buffer
+int EvaluatorSequences::readLine(int lineIdx, bool& isPinned)
+{
+    isPinned = false;
+    int readLen = _fileManager.readFileBlock(_rootFilename, _lineOffsets[lineIdx], (uint8_t*)_readBuf,
+                    SEQ_READ_BUF_LEN);
+    if (readLen <= 0)
+        return 0;
+    int lineLen = 0;
+    while ((lineLen < readLen) && (_readBuf[lineLen] != '\n'))
+        lineLen++;
+    if (lineLen == SEQ_READ_BUF_LEN)
+    {
+        Log.warning("%sline %d too long\n", MODULE_PREFIX, lineIdx);
+        return 0;
+    }
+    while ((lineLen > 0) && isspace((unsigned char)_readBuf[lineLen - 1]))
+        lineLen--;
+    _readBuf[lineLen] = 0;
+    if ((lineLen > 0) && (_readBuf[0] == '!'))
+    {
+        isPinned = true;
+        int markerLen = 1;
+        while ((markerLen < lineLen) && isspace((unsigned char)_readBuf[markerLen]))
+            markerLen++;
+        lineLen -= markerLen;
+        memmove(_readBuf, _readBuf + markerLen, lineLen + 1);
+    }
+    return lineLen;
+}
 
+// Shuffle the play order from a position onwards (positions before it are unchanged) - patterns
+// are no longer rotated or reversed as that was for the optimised order
+void EvaluatorSequences::shuffleFrom(int pos)
+{
+    if (_playOrder.empty())
+    {
+        _playOrder.resize(_lineCount);
+        for (int i = 0; i < _lineCount; i++)
+            _playOrder[i] = i;
+    }
+    for (int i = _lineCount - 1; i > pos; i--)
+    {
+        int j = pos + rand() % (i - pos + 1);
+        uint32_t tmp = _playOrder[i];
+        _playOrder[i] = _playOrder[j];
+        _playOrder[j] = tmp;
+    }
+    std::vector<float>().swap(_rotations);
+    std::vector<bool>().swap(_reversals);
+}
+
+void EvaluatorSequences::service()
+{
     // Check if operative
     if (!_inProgress)
         return;
 
-    if ((_linesDone == _lineCount) && !_repeatMode)
+    // Index the playlist
+    if (_indexing)
     {
-        _inProgress = false;
+        for (int i = 0; (i < SEQ_INDEX_BLOCKS_PER_SERVICE) && _indexing; i++)
+        {
+            if (!indexBlock())
+            {
+                Log.warning("%sfailed to read %s\n", MODULE_PREFIX, _fileName.c_str());
+                stop();
+                return;
+            }
+        }
         return;
     }
-        
-    // Get required line
-    const char* pCommandList = _commandList.c_str();
-    const char* pStr = pCommandList;
-    int lineStartPos = 0;
-    int sepIdx = 0;
-    bool lineBlank = true;
-    while(true)
+
+    // Scan patterns and optimise the order
+    if (_scanning)
     {
-        if ((*pStr == '\n') || (*pStr == 0))
+        for (int i = 0; (i < SEQ_SCAN_LINES_PER_SERVICE) && (_scanLineIdx < _lineCount); i++)
+            scanLine(_scanLineIdx++);
+        if (_scanLineIdx >= _lineCount)
+            scanDone();
+        return;
+    }
+
+    // This is only serviced when other evaluators are idle (so a pattern file has been read to
+    // its end) - the next line is queued behind the pattern's final moves so that the next file
+    // is opened and starts feeding the planner before the motion pipeline drains
+    if (lineQueuedPending())
+        return;
+    _lineQueued = false;
+    if (_workManager.queueSize() > _seqItemsAhead)
+        return;
+
+    // End of the play order - when repeating a new shuffle doesn't start with the line just played
+    if (_seqPos >= _lineCount)
+    {
+        if (!_repeatMode)
         {
-            if (!lineBlank)
-                sepIdx++;
-            if ((sepIdx == _reqLineIdx+1) || (*pStr == 0))
-                break;
-            lineBlank = true;
-            lineStartPos = pStr - pCommandList;
+            stop();
+            return;
         }
-        else
+        int lastLineIdx = (_queuedPos >= 0) ? lineAtPos(_queuedPos) : -1;
+        _seqPos = 0;
+        if (_shuffleMode)
         {
-            if (*pStr != '\r')
-                lineBlank = false;
+            shuffleFrom(0);
+            if ((_lineCount > 1) && (int(_playOrder[0]) == lastLineIdx))
+            {
+                int j = 1 + rand() % (_lineCount - 1);
+                _playOrder[0] = _playOrder[j];
+                _playOrder[j] = lastLineIdx;
+            }
         }
-        pStr++;
     }
-    if (sepIdx == _reqLineIdx+1)
+
+    // Line to process
+    int lineIdx = lineAtPos(_seqPos);
+    bool isPinned = false;
+    int lineLen = readLine(lineIdx, isPinned);
+    if (lineLen > 0)
     {
-        // Line to process
-        String newCmd = _commandList.substring(lineStartPos, pStr-pCommandList);
-        newCmd.trim();
+        // Reversal and rotation from the optimiser
+        if ((lineIdx < int(_reversals.size())) && _reversals[lineIdx] && (lineLen < SEQ_READ_BUF_LEN - 4))
+            lineLen += snprintf(_readBuf + lineLen, SEQ_READ_BUF_LEN + 1 - lineLen, " REV");
+        if ((lineIdx < int(_rotations.size())) && (_rotations[lineIdx] != 0) && (lineLen < SEQ_READ_BUF_LEN - 16))
+            snprintf(_readBuf + lineLen, SEQ_READ_BUF_LEN + 1 - lineLen, " R%0.2f", AxisUtils::r2d(_rotations[lineIdx]));
 
-        if (newCmd.length() > 0)
-        {
-            String retStr;
-            WorkItem workItem(newCmd);
-            _workManager.addWorkItem(workItem, retStr, _reqLineIdx);
-        }
-        // Bump
-        _linesDone++;
+        String retStr;
+        WorkItem workItem(_readBuf);
+        _workManager.addWorkItem(workItem, retStr, lineIdx);
 
-        // Next req item
-        _reqLineIdx++;
-        if (_reqLineIdx >= _lineCount)
-            _reqLineIdx = 0;
-        if (_shuffleMode)
-            _reqLineIdx = rand() % _lineCount;
-    }
-    else
-    {
-        // Separator not found so stop
-        _inProgress = false;
+        // The line has been started when everything now queued has been removed
+        _lineQueued = true;
+        _lineQueuedRemovedCount = _workManager.queueNumRemoved() + _workManager.queueSize();
     }
+
+    // Next
+    _queuedPos = _seqPos++;
+    _reqLineIdx = (_seqPos < _lineCount) ? lineAtPos(_seqPos) : 0;
 }
 
 void EvaluatorSequences::stop()
 {
     _inProgress = false;
+    _indexing = false;
+    _lineQueued = false;
+    _scanning = false;
+    std::vector<uint32_t>().swap(_lineOffsets);
+    std::vector<uint32_t>().swap(_playOrder);
+    std::vector<PlaylistOptimiser::Entry>().swap(_lineEnds);
+    std::vector<float>().swap(_rotations);
+    std::vector<bool>().swap(_reversals);
+    _lineCount = 0;
 }
 
-void EvaluatorSequences::loadPrevious() {
-    _linesDone = min(0, _linesDone - 1);
-    _reqLineIdx = min(0, _reqLineIdx - 2);
+// Line queued but not yet started (removed from the queue)
+bool EvaluatorSequences::lineQueuedPending()
+{
+    return _lineQueued && (int32_t(_workManager.queueNumRemoved() - _lineQueuedRemovedCount) < 0);
+}
+
+// Step back to the line before the one playing
+void EvaluatorSequences::loadPrevious()
+{
+    if (_indexing || _scanning || (_queuedPos < 0))
+        return;
+    int playingPos = lineQueuedPending() ? _queuedPos - 1 : _queuedPos;
+    _seqPos = max(0, playingPos - 1);
+    _queuedPos = _seqPos - 1;
+    _lineQueued = false;
+    _reqLineIdx = lineAtPos(_seqPos);
+}
+
+// Step forward to the line after the one playing - this is the next position unless the line
+// there has been queued but not started (it is then removed with the rest of the queue)
+void EvaluatorSequences::loadNext()
+{
+    if (_indexing || _scanning || (_queuedPos < 0))
+        return;
+    if (lineQueuedPending())
+    {
+        _seqPos = _queuedPos;
+        _queuedPos--;
+        _reqLineIdx = lineAtPos(_seqPos);
+    }
+    _lineQueued = false;
 }
 
 void EvaluatorSequences::setRepeatMode(bool repeat) {
     _repeatMode = repeat;
 }
 
+// Shuffle the lines not yet played or continue in line order from the next line
 void EvaluatorSequences::setShuffle(bool shuffle) {
+    if ((shuffle == _shuffleMode) || _indexing || _scanning)
+    {
+        _shuffleMode = shuffle;
+        return;
+    }
+    if (shuffle)
+    {
+        shuffleFrom(_seqPos);
+    }
+    else
+    {
+        int nextLineIdx = (_seqPos < _lineCount) ? lineAtPos(_seqPos) : _lineCount;
+        int queuedLineIdx = (_queuedPos >= 0) ? lineAtPos(_queuedPos) : -1;
+        _seqPos = nextLineIdx;
+        _queuedPos = queuedLineIdx;
+        std::vector<uint32_t>().swap(_playOrder);
+    }
     _shuffleMode = shuffle;
+    _reqLineIdx = (_seqPos < _lineCount) ? lineAtPos(_seqPos) : 0;
 }
 
 bool EvaluatorSequences::getRepeat() {
@@ -220,4 +467,4 @@ bool EvaluatorSequences::getRepeat() {
 
 bool EvaluatorSequences::getShuffle() {
     return _shuffleMode;
-}
\ No newline at end of file
+}
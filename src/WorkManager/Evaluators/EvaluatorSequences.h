@@ -3,6 +3,9 @@
 
 #pragma once
 
+#include <vector>
+#include "../PlaylistOptimiser.h"
+
 class WorkManager;
 class WorkItem;
 class FileManager;
@@ -10,7 +13,14 @@ class FileManager;
 class EvaluatorSequences
 {
 public:
-    static const int MAX_SEQUENCE_FILE_LEN = 2000;
+    // Playlists are read in blocks - lines longer than this are skipped
+    static const int SEQ_READ_BUF_LEN = 256;
+    // Blocks indexed on each service call (so a large playlist doesn't stall the service loop)
+    static const int SEQ_INDEX_BLOCKS_PER_SERVICE = 4;
+    // Patterns scanned (for their start and end) on each service call when optimising and the
+    // largest playlist which is optimised
+    static const int SEQ_SCAN_LINES_PER_SERVICE = 2;
+    static const int SEQ_OPTIMISE_MAX_LINES = 1000;
 
     EvaluatorSequences(FileManager& fileManager, WorkManager& workManager);
 
@@ -23,6 +33,9 @@ public:
     bool _repeatMode;
     bool _defaultShuffleMode;
     bool _defaultRepeatMode;
+    bool _optimiseOrder;
+    bool _optimiseRotate;
+    bool _optimiseReverse;
     int _lineCount;
 
     // Is Busy
@@ -47,13 +60,33 @@ public:
 
     // Control
     void stop();
+    // Step back or forward a line - call before the work queue is cleared
     void loadPrevious();
+    void loadNext();
     void setRepeatMode(bool repeat);
     void setShuffle(bool shuffle);
     
 private:
-    // Count lines
-    int countLines(String& lines);
+    // Index a block of the playlist - returns false on a read failure
+    bool indexBlock();
+    // Index complete - apply modes and start
+    void indexDone();
+    // Scan a line for the start and end of its pattern
+    void scanLine(int lineIdx);
+    // Scan complete - order the lines
+    void scanDone();
+    // Read a line into the read buffer - returns the length (0 if it can't be read) - lines
+    // starting with ! are pinned (the optimiser doesn't move them) and the ! is removed
+    int readLine(int lineIdx, bool& isPinned);
+    // Line at a position in the play order
+    int lineAtPos(int pos)
+    {
+        return _playOrder.empty() ? pos : _playOrder[pos];
+    }
+    // Shuffle the play order from a position onwards
+    void shuffleFrom(int pos);
+    // Line queued but not yet started
+    bool lineQueuedPending();
 
     // Full configuration JSON
     String _jsonConfigStr;
@@ -62,12 +95,49 @@ private:
     FileManager& _fileManager;
     WorkManager& _workManager;
 
-    // List of commands to add to workflow - delimited string
-    String _commandList;
+    // Playlist file
     String _fileName;
-
-    // Busy and current line
+    String _rootFilename;
+    int _fileLen;
+
+    // Offset in the file of each (non-blank) line and the play order when shuffling or
+    // optimised (a permutation of line indices so lines aren't repeated until all have been
+    // played) - lines are played in line order when it is empty
+    std::vector<uint32_t> _lineOffsets;
+    std::vector<uint32_t> _playOrder;
+
+    // Optimiser - the start and end of each line's pattern while scanning and the rotation
+    // (radians) of each line's pattern when the order has been optimised with rotation and
+    // whether it is played reversed
+    PlaylistOptimiser _optimiser;
+    bool _scanning;
+    int _scanLineIdx;
+    std::vector<PlaylistOptimiser::Entry> _lineEnds;
+    std::vector<float> _rotations;
+    std::vector<bool> _reversals;
+
+    // Indexing - file position, whether the last byte indexed was in a non-blank line and modes
+    // found in the file
+    bool _indexing;
+    int _indexFilePos;
+    bool _indexInLine;
+    bool _fileShuffleOn, _fileShuffleOff, _fileRepeatOn, _fileRepeatOff;
+
+    // Read buffer - when indexing the end of the previous block is kept at the start so that
+    // mode names split across blocks are found
+    char _readBuf[SEQ_READ_BUF_LEN + 1];
+    int _readBufCarry;
+
+    // Busy, next position in the play order (and its line) and position of the line last queued
     int _inProgress;
+    int _seqPos;
     int _reqLineIdx;
-    int _linesDone;
+    int _queuedPos;
+
+    // Look-ahead - the next line is queued when no more than this many items are queued (0
+    // waits for the queue to empty) and once the previous line has left the queue
+    static const int SEQ_ITEMS_AHEAD_DEFAULT = 10;
+    int _seqItemsAhead;
+    bool _lineQueued;
+    uint32_t _lineQueuedRemovedCount;
 };
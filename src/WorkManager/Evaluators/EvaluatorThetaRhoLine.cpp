@@ -3,9 +3,13 @@
 
 #include <Arduino.h>
 #include <ArduinoLog.h>
+#include <limits.h>
 #include "EvaluatorThetaRhoLine.h"
 #include "RdJson.h"
 #include "Utils.h"
+#include "ThetaRhoTokenizer.h"
+#include "EvaluatorGCode.h"
+#include "FastTrig.h"
 #include "../WorkManager.h"
 
 // #define THETA_RHO_DEBUG 1
@@ -28,6 +32,31 @@ EvaluatorThetaRhoLine::EvaluatorThetaRhoLine(WorkManager& workManager) :
     _centreOffsetX = 0;
     _centreOffsetY = 0;
     _isInterpolating = false;
+    _hasPendingPoint = false;
+    _lineCmdIdx = RobotConsts::NUMBERED_COMMAND_NONE;
+    _thetaOffsetAngle = 0;
+    _thetaMirrored = false;
+    _stepAngleAtRhoZero = 0;
+    _stepAngleSlopeBelow = 0;
+    _stepAngleSlopeAbove = 0;
+    _xform[0][0] = _xform[0][1] = _xform[1][0] = _xform[1][1] = 0;
+    _unitSin = _rotSin = 0;
+    _unitCos = _rotCos = 1;
+    _kernelRhoStart = _kernelRhoInc = 0;
+    _chordTolMM = 0;
+    _kernelRhoPerRad = 0;
+    _lineAngleTotal = _lineAngleDone = 0;
+    _lineAnglePositive = true;
+    _lineEndTheta = _lineEndRho = 0;
+    _transitEnabled = false;
+    _transitPlan._numWaypoints = 0;
+    _transitIdx = 0;
+    _isTransitPoint = false;
+    _lastPosValid = false;
+    _lastX = _lastY = 0;
+    _lastAwayX = 1;
+    _lastAwayY = 0;
+    _isQueueingPoint = false;
 }
 
 void EvaluatorThetaRhoLine::setConfig(const char *configStr, const char* robotAttributes)
@@ -36,6 +65,9 @@ void EvaluatorThetaRhoLine::setConfig(const char *configStr, const char* robotAt
     _stepAngle = AxisUtils::d2r(RdJson::getDouble("thrStepDegs", AxisUtils::r2d(DEFAULT_STEP_ANGLE), configStr));
     _stepAdaptation = RdJson::getLong("thrStepAdaptation", 1, configStr) != 0;
     _continueFromPrevious = RdJson::getLong("thrContinue", 1, configStr) != 0;
+    _chordTolMM = float(RdJson::getDouble("thrChordTolMM", 0, configStr));
+    if (_chordTolMM < 0)
+        _chordTolMM = 0;
     // Set the size of the max radius
     double sizeX = RdJson::getDouble("sizeX", 0, robotAttributes);
     double sizeY = RdJson::getDouble("sizeY", 0, robotAttributes);
@@ -48,6 +80,38 @@ void EvaluatorThetaRhoLine::setConfig(const char *configStr, const char* robotAt
     _bedRadiusMM = std::min(sizeX, sizeY) / 2;
     _centreOffsetX = sizeX / 2 - originX;
     _centreOffsetY = sizeY / 2 - originY;
+
+    // Step angle adaptation - from maxStepAngle at rho 0 to the configured step angle at
+    // RHO_AT_DEFAULT_STEP_ANGLE then to minStepAngle at rho 1
+    double maxStepAngle = _stepAngle * 16;
+    if (maxStepAngle > M_PI / 2)
+        maxStepAngle = M_PI / 2;
+    double minStepAngle = _stepAngle / 4;
+    _stepAngleAtRhoZero = maxStepAngle;
+    _stepAngleSlopeBelow = (_stepAngle - maxStepAngle) / RHO_AT_DEFAULT_STEP_ANGLE;
+    _stepAngleSlopeAbove = (minStepAngle - _stepAngle) / (1 - RHO_AT_DEFAULT_STEP_ANGLE);
+
+    // Theta' = m * theta + offset (m = -1 if mirrored) so
+    // sin(theta') = m * cos(offset) * sin(theta) + sin(offset) * cos(theta)
+    // cos(theta') = -m * sin(offset) * sin(theta) + cos(offset) * cos(theta)
+    double mirror = _thetaMirrored ? -1.00 : 1.00;
+    double offset = M_PI * (_thetaOffsetAngle / 180);
+    _xform[0][0] = mirror * cos(offset) * _bedRadiusMM;
+    _xform[0][1] = sin(offset) * _bedRadiusMM;
+    _xform[1][0] = -mirror * sin(offset) * _bedRadiusMM;
+    _xform[1][1] = cos(offset) * _bedRadiusMM;
+
+    // Transit planning - limits are from the robot attributes
+    _transitEnabled = RdJson::getLong("thrTransit", 0, configStr) != 0;
+    TransitPlanner::Limits limits;
+    limits._bedRadiusMM = float(_bedRadiusMM);
+    limits._maxSpeedMMps = float(RdJson::getDouble("maxSpeedMMps", 0, robotAttributes));
+    limits._maxAccMMps2 = float(RdJson::getDouble("maxAccMMps2", 0, robotAttributes));
+    limits._thetaMaxDegps = float(RdJson::getDouble("thetaMaxDegps", 0, robotAttributes));
+    limits._rhoMaxMMps = float(RdJson::getDouble("rhoMaxMMps", 0, robotAttributes));
+    limits._rhoMMPerDegTheta = float(RdJson::getDouble("rhoMMPerDegTheta", 0, robotAttributes));
+    if (!_transitPlanner.setLimits(limits, float(RdJson::getDouble("thrTransitDisturb", 0, configStr))) && _transitEnabled)
+        Log.notice("%stransit planning needs robot limits\n", MODULE_PREFIX);
 }
 
 // Is Busy
@@ -65,47 +129,57 @@ const char *EvaluatorThetaRhoLine::getConfig()
 bool EvaluatorThetaRhoLine::isValid(WorkItem &workItem)
 {
     // Check if theta-rho
-    String cmdStr = workItem.getString();
-    cmdStr.trim();
-    return cmdStr.startsWith("_THRLINE");
+    return workItem.startsWith("_THRLINE");
 }
 
-double EvaluatorThetaRhoLine::getLineProgress() {
-    if(!_isInterpolating) {
-        return 0.50;
-    }
+// Process WorkItem
+bool EvaluatorThetaRhoLine::execWorkItem(WorkItem &workItem)
+{
+    // Extract the details - _THRLINE?_/theta/rho
+    const char* pStr = strchr(workItem.getCString(), '/');
+    if (!pStr)
+        return false;
+    const char* pEnd = pStr + strlen(pStr);
+    double theta = 0, rho = 0;
+    pStr++;
+    if (!ThetaRhoTokenizer::parseDecimal(pStr, pEnd, theta))
+        return false;
+    if (*pStr == '/')
+        pStr++;
+    if (!ThetaRhoTokenizer::parseDecimal(pStr, pEnd, rho))
+        return false;
 
-    return (double) (1.00 / (double) _interpolateSteps) * (double) _curStep;
+    // Uninterpolated line, first line of an interpolated file or a subsequent line
+    bool interpolate = !workItem.startsWith("_THRLINE_");
+    addPolarPoint(theta, rho, interpolate, workItem.startsWith("_THRLINE0_"));
+    return true;
 }
 
-// Process WorkItem
-bool EvaluatorThetaRhoLine::execWorkItem(WorkItem &workItem)
+void EvaluatorThetaRhoLine::addPolarPoint(double theta, double rho, bool interpolate, bool isFirst, int cmdIdx)
 {
-    // Extract the details
-    String thetaStr = Utils::getNthField(workItem.getCString(), 1, '/');
-    String rhoStr = Utils::getNthField(workItem.getCString(), 2, '/');
-    double mirrored = _thetaMirrored ? -1.00 : 1.00;
-    double newTheta = atof(thetaStr.c_str()) * mirrored + (M_PI * (_thetaOffsetAngle / 180));
-    double newRho = atof(rhoStr.c_str());
+    _lineCmdIdx = cmdIdx;
+
+    // Mirroring and theta offset are applied by the transform when positions are calculated
+    double newTheta = theta;
+    double newRho = rho;
+
+    // Transit from the last point to the start
+    if (isFirst)
+        planTransit(newTheta, newRho);
 
     // Check for an uninterpolated line
-    if (workItem.getString().startsWith("_THRLINE_"))
+    if (!interpolate)
     {
         _isInterpolating = false;
-        // Next iteration
-        char lineBuf[100];
-        // Calculate coords
-        double x,y;
-        calcXYPos(newTheta, newRho, x, y);
-        sprintf(lineBuf, "G0 X%0.3f Y%0.3f", x, y);
-        String retStr;
-        WorkItem workItem(lineBuf);
-        _workManager.addWorkItem(workItem, retStr);
-        return true;
+        _curTheta = newTheta;
+        _curRho = newRho;
+        _hasPendingPoint = true;
+        _inProgress = true;
+        return;
     }
 
     // Check for first line of interpolated file
-    if (workItem.getString().startsWith("_THRLINE0_"))
+    if (isFirst)
     {
         if (_continueFromPrevious)
         {
@@ -118,56 +192,64 @@ bool EvaluatorThetaRhoLine::execWorkItem(WorkItem &workItem)
         _prevTheta = newTheta;
         _prevRho = newRho;
         _isInterpolating = false;
-        return true;
+        return;
     }
 
-    // Must be a _THRLINEN_ then
+    // Subsequent line of an interpolated file
     double deltaTheta = newTheta - _thetaStartOffset - _prevTheta;
-    double absDeltaTheta = abs(deltaTheta);
-    double adaptedStepAngle = _stepAngle;
-    if (_stepAdaptation)
+    double absDeltaTheta = fabs(deltaTheta);
+
+    // Curvature stepping - the number of steps is only known when the end is reached
+    if (_chordTolMM > 0)
     {
-        double avgRho = std::max(fabs(newRho), fabs(_prevRho));
-        if (avgRho > 1)
-            avgRho = 1;
-        double maxStepAngle = _stepAngle * 16;
-        if (maxStepAngle > M_PI / 2)
-            maxStepAngle = M_PI / 2;
-        double minStepAngle = _stepAngle / 4;
-        if (avgRho > RHO_AT_DEFAULT_STEP_ANGLE)
-        {
-            adaptedStepAngle = ((avgRho - RHO_AT_DEFAULT_STEP_ANGLE) / (1 - RHO_AT_DEFAULT_STEP_ANGLE)) * 
-                    (minStepAngle - _stepAngle) + _stepAngle;
-        }
-        else
-        {
-            adaptedStepAngle = (avgRho / RHO_AT_DEFAULT_STEP_ANGLE) * 
-                    (_stepAngle - maxStepAngle) + maxStepAngle;
-        }
+        _unitSin = sin(_prevTheta);
+        _unitCos = cos(_prevTheta);
+        _kernelRhoStart = _prevRho;
+        _kernelRhoPerRad = (absDeltaTheta > 0) ? (newRho - _prevRho) / absDeltaTheta : 0;
+        _lineAngleTotal = absDeltaTheta;
+        _lineAngleDone = 0;
+        _lineAnglePositive = deltaTheta >= 0;
+        _lineEndTheta = _prevTheta + deltaTheta;
+        _lineEndRho = newRho;
+        _interpolateSteps = INT_MAX;
+        _prevTheta = newTheta;
+        _prevRho = newRho;
+        _curStep = 0;
+        _inProgress = true;
+        _isInterpolating = true;
+        return;
     }
-    _thetaInc = deltaTheta >= 0 ? adaptedStepAngle : -adaptedStepAngle;
+
+    double adaptedStepAngle = _stepAdaptation ? getStepAngle(std::max(fabs(newRho), fabs(_prevRho))) : _stepAngle;
+    double thetaInc = deltaTheta >= 0 ? adaptedStepAngle : -adaptedStepAngle;
     double deltaRho = newRho - _prevRho;
+    double rhoInc = 0;
     if (absDeltaTheta < adaptedStepAngle)
     {
-        _thetaInc = deltaTheta;
+        thetaInc = deltaTheta;
         _interpolateSteps = 1;
-        _rhoInc = deltaRho;
+        rhoInc = deltaRho;
     }
     else
     {
         _interpolateSteps = int(floor(absDeltaTheta / adaptedStepAngle));
         if (_interpolateSteps < 1)
-            return true;
-        _rhoInc = deltaRho * adaptedStepAngle / absDeltaTheta;
+            return;
+        rhoInc = deltaRho * adaptedStepAngle / absDeltaTheta;
     }
-    _curTheta = _prevTheta;
-    _curRho = _prevRho;
+
+    // Set up the kernel for the line
+    _unitSin = sin(_prevTheta);
+    _unitCos = cos(_prevTheta);
+    _rotSin = sin(thetaInc);
+    _rotCos = cos(thetaInc);
+    _kernelRhoStart = _prevRho;
+    _kernelRhoInc = rhoInc;
     _prevTheta = newTheta;
     _prevRho = newRho;
     _curStep = 0;
     _inProgress = true;
     _isInterpolating = true;
-    return true;
 }
 
 void EvaluatorThetaRhoLine::service()
@@ -176,49 +258,214 @@ void EvaluatorThetaRhoLine::service()
     if (!_inProgress)
         return;
 
-    // Check if interpolating
-    if (!_isInterpolating)
-        return;
-
     // Process multiple if possible
     for (int i = 0; i < PROCESS_STEPS_PER_SERVICE; i++)
     {
-        if (_curStep >= _interpolateSteps)
+        // See if we can add to the queue
+        if (!_workManager.canAcceptWorkItem())
+            return;
+
+        // Next point
+        double x,y;
+        if (!getNextPoint(x, y))
         {
             _inProgress = false;
             return;
         }
+        char lineBuf[100];
+        int lineLen = sprintf(lineBuf, "G0 X%0.3f Y%0.3f", x, y);
+        if (isDirectPoint())
+            lineLen += sprintf(lineBuf + lineLen, " D1");
+        bool isLastPoint = !_hasPendingPoint && !transitPending() && (!_isInterpolating || (_curStep >= _interpolateSteps));
+        if (isLastPoint && (_lineCmdIdx != RobotConsts::NUMBERED_COMMAND_NONE))
+            sprintf(lineBuf + lineLen, " N%d", _lineCmdIdx);
+        String retStr;
+        WorkItem workItem(lineBuf);
+        _isQueueingPoint = true;
+        _workManager.addWorkItem(workItem, retStr);
+        _isQueueingPoint = false;
+    }
+}
 
-        // See if we can add to the queue
-        if (!_workManager.canAcceptWorkItem())
-            return;
+bool EvaluatorThetaRhoLine::getNextPoint(double& x, double& y)
+{
+    if (!nextPoint(x, y))
+        return false;
+    _lastX = x;
+    _lastY = y;
+    _lastPosValid = true;
+    float awayX = float(x - _centreOffsetX);
+    float awayY = float(y - _centreOffsetY);
+    if (!TransitPlanner::isNearCentre(awayX, awayY))
+    {
+        _lastAwayX = awayX;
+        _lastAwayY = awayY;
+    }
+    return true;
+}
 
-        // Step
-        _curStep++;
+// Plan the transit from the last point to the start of a pattern
+void EvaluatorThetaRhoLine::planTransit(double theta, double rho)
+{
+    _transitIdx = 0;
+    _transitPlan._numWaypoints = 0;
+    if (!_transitEnabled || !_lastPosValid || !_transitPlanner.isValid())
+        return;
+    double startX = 0, startY = 0;
+    calcXYPos(theta, rho, startX, startY);
+    _transitPlanner.plan(_lastX - _centreOffsetX, _lastY - _centreOffsetY, FastTrig::atan2(_lastAwayY, _lastAwayX),
+                startX - _centreOffsetX, startY - _centreOffsetY, _transitPlan);
+    _inProgress = true;
+}
 
-        // Inc
-        _curTheta += _thetaInc;
-        _curRho += _rhoInc;
+bool EvaluatorThetaRhoLine::nextPoint(double& x, double& y)
+{
+    // Transit to the start of a pattern
+    _isTransitPoint = transitPending();
+    if (_isTransitPoint)
+    {
+        const TransitPlanner::Waypoint& waypoint = _transitPlan._waypoints[_transitIdx++];
+        x = waypoint._x + _centreOffsetX;
+        y = waypoint._y + _centreOffsetY;
+        return true;
+    }
 
-        // Next iteration
-        char lineBuf[100];
-        // Calculate coords
-        double x,y;
+    // Uninterpolated line
+    if (_hasPendingPoint)
+    {
+        _hasPendingPoint = false;
         calcXYPos(_curTheta, _curRho, x, y);
-        sprintf(lineBuf, "G0 X%0.3f Y%0.3f", x, y);
-        String retStr;
-        WorkItem workItem(lineBuf);
-        _workManager.addWorkItem(workItem, retStr);
+        return true;
+    }
+
+    // Interpolated line
+    if (!_isInterpolating || (_curStep >= _interpolateSteps))
+        return false;
+    if (_chordTolMM > 0)
+    {
+        stepByCurvature(x, y);
+        return true;
+    }
+
+    // Step - rotate the unit vector (renormalising its length periodically as rounding errors
+    // accumulate)
+    _curStep++;
+    float unitSin = _unitSin * _rotCos + _unitCos * _rotSin;
+    float unitCos = _unitCos * _rotCos - _unitSin * _rotSin;
+    if ((_curStep % RENORMALISE_STEPS) == 0)
+    {
+        float lenCorrection = (3 - (unitSin * unitSin + unitCos * unitCos)) / 2;
+        unitSin *= lenCorrection;
+        unitCos *= lenCorrection;
+    }
+    _unitSin = unitSin;
+    _unitCos = unitCos;
+
+    // Calculate coords
+    calcXYPos(_unitSin, _unitCos, _kernelRhoStart + _kernelRhoInc * _curStep, x, y);
+    return true;
+}
+
+bool EvaluatorThetaRhoLine::isDirectPoint()
+{
+    if (_isTransitPoint)
+        return _transitPlan._waypoints[_transitIdx - 1]._direct;
+    return _isInterpolating && (_chordTolMM > 0);
+}
+
+// Step along the spiral by the angle which keeps the chord within tolerance at the local
+// curvature - the last step of the line goes exactly to its end point
+void EvaluatorThetaRhoLine::stepByCurvature(double& x, double& y)
+{
+    _curStep++;
+    float rho = _kernelRhoStart + _kernelRhoPerRad * _lineAngleDone;
+    float stepAngle = getChordStepAngle(fabsf(rho) * _bedRadiusMM, fabsf(_kernelRhoPerRad) * _bedRadiusMM);
+    float remaining = _lineAngleTotal - _lineAngleDone;
+    if (remaining <= stepAngle)
+    {
+        _interpolateSteps = _curStep;
+        calcXYPos(_lineEndTheta, _lineEndRho, x, y);
+        return;
+    }
+
+    // Avoid a short final step by splitting what remains of the last two steps equally
+    if (remaining < stepAngle * 2)
+        stepAngle = remaining / 2;
+
+    // Rotate the unit vector
+    float rotSin = 0, rotCos = 1;
+    FastTrig::sinCos(_lineAnglePositive ? stepAngle : -stepAngle, rotSin, rotCos);
+    float unitSin = _unitSin * rotCos + _unitCos * rotSin;
+    float unitCos = _unitCos * rotCos - _unitSin * rotSin;
+    if ((_curStep % RENORMALISE_STEPS) == 0)
+    {
+        float lenCorrection = (3 - (unitSin * unitSin + unitCos * unitCos)) / 2;
+        unitSin *= lenCorrection;
+        unitCos *= lenCorrection;
     }
+    _unitSin = unitSin;
+    _unitCos = unitCos;
+    _lineAngleDone += stepAngle;
+    calcXYPos(_unitSin, _unitCos, _kernelRhoStart + _kernelRhoPerRad * _lineAngleDone, x, y);
+}
+
+// Step angle for which the sagitta of a chord is the tolerance - the radius of curvature of the
+// spiral r = r0 + r' * theta is (r^2 + r'^2)^1.5 / (r^2 + 2r'^2) and the chord length for a
+// sagitta s at radius of curvature R is 2 * sqrt(s * (2R - s)) (not sqrt(8sR) as near the centre
+// R is close to the tolerance)
+float EvaluatorThetaRhoLine::getChordStepAngle(float rhoMM, float rhoPerRadMM)
+{
+    float rhoSq = rhoMM * rhoMM;
+    float rhoPerRadSq = rhoPerRadMM * rhoPerRadMM;
+    float denom = rhoSq + 2 * rhoPerRadSq;
+    if (denom <= 0)
+        return MAX_CHORD_STEP_ANGLE;
+    float speedSq = rhoSq + rhoPerRadSq;
+    float curvatureRadius = speedSq * sqrtf(speedSq) / denom;
+    if (curvatureRadius * 2 <= _chordTolMM)
+        return MAX_CHORD_STEP_ANGLE;
+    float stepAngle = sqrtf(4 * _chordTolMM * (curvatureRadius * 2 - _chordTolMM) / speedSq);
+    if (stepAngle < MIN_CHORD_STEP_ANGLE)
+        return MIN_CHORD_STEP_ANGLE;
+    if (stepAngle > MAX_CHORD_STEP_ANGLE)
+        return MAX_CHORD_STEP_ANGLE;
+    return stepAngle;
 }
 
 void EvaluatorThetaRhoLine::stop()
 {
     _inProgress = false;
+    _hasPendingPoint = false;
+    _transitIdx = 0;
+    _transitPlan._numWaypoints = 0;
+    _isTransitPoint = false;
+    _lastPosValid = false;
+}
+
+void EvaluatorThetaRhoLine::workItemQueued(const WorkItem& workItem)
+{
+    if (_isQueueingPoint || !_lastPosValid)
+        return;
+    if (EvaluatorGCode::changesPosition(workItem))
+        _lastPosValid = false;
+}
+
+double EvaluatorThetaRhoLine::getStepAngle(double rho)
+{
+    if (rho > 1)
+        rho = 1;
+    if (rho > RHO_AT_DEFAULT_STEP_ANGLE)
+        return (rho - RHO_AT_DEFAULT_STEP_ANGLE) * _stepAngleSlopeAbove + _stepAngle;
+    return rho * _stepAngleSlopeBelow + _stepAngleAtRhoZero;
 }
 
 void EvaluatorThetaRhoLine::calcXYPos(double theta, double rho, double& x, double& y)
 {
-    x = sin(theta) * rho * _bedRadiusMM + _centreOffsetX;
-    y = cos(theta) * rho * _bedRadiusMM + _centreOffsetY;
+    calcXYPos(sin(theta), cos(theta), rho, x, y);
+}
+
+void EvaluatorThetaRhoLine::calcXYPos(float unitSin, float unitCos, float rho, double& x, double& y)
+{
+    x = (_xform[0][0] * unitSin + _xform[0][1] * unitCos) * rho + _centreOffsetX;
+    y = (_xform[1][0] * unitSin + _xform[1][1] * unitCos) * rho + _centreOffsetY;
 }
\ No newline at end of file
@@ -3,6 +3,9 @@
 
 #pragma once
 
+#include "RobotConsts.h"
+#include "../TransitPlanner.h"
+
 class WorkManager;
 class WorkItem;
 
@@ -24,14 +27,33 @@ public:
     // Process WorkItem
     bool execWorkItem(WorkItem& workItem);
 
+    // Add a point (as read from a theta-rho file) - the first point of a file plans the transit
+    // to it (if enabled) and the first point of an interpolated file sets the start position
+    // only - the command index (if any) is attached to the final move of the line so that its
+    // completion can be tracked
+    void addPolarPoint(double theta, double rho, bool interpolate, bool isFirst,
+                int cmdIdx = RobotConsts::NUMBERED_COMMAND_NONE);
+
     // Call frequently
     void service();
 
-    double getLineProgress();
+    // Get the next point (cartesian) of the line in progress (or of the transit to the start of
+    // a pattern) - returns false when the line is complete (the work item is only converted to
+    // points so it can also be used for estimates)
+    bool getNextPoint(double& x, double& y);
 
-    // Control
+    // Check if the point last returned by getNextPoint was stepped along the spiral (rather than
+    // being the end of a straight line) - such moves are not split by the motion helper as a move
+    // which is linear in actuator space follows the spiral on a polar table
+    bool isDirectPoint();
+
+    // Control (the position of the last point is forgotten as queued moves are discarded)
     void stop();
 
+    // Called when a G-code work item is queued - moves other than this evaluator's (and homing
+    // or setting home) make the last point unknown so no transit is planned from it
+    void workItemQueued(const WorkItem& workItem);
+
 private:
     // Config
     const double DEFAULT_STEP_ANGLE = M_PI / 64;
@@ -44,6 +66,22 @@ private:
     double _centreOffsetY;
     double _thetaOffsetAngle;
     bool _thetaMirrored;
+    // Max deviation of the moves from the spiral - 0 uses the step angle (and adaptation) instead
+    float _chordTolMM;
+    static constexpr float MIN_CHORD_STEP_ANGLE = 0.001f;
+    static constexpr float MAX_CHORD_STEP_ANGLE = float(M_PI / 4);
+    // Transit planning from the last point to the start of a pattern (otherwise the move to the
+    // first step of the pattern is the transit)
+    bool _transitEnabled;
+
+    // Step angle adaptation (step angle is linear in rho either side of RHO_AT_DEFAULT_STEP_ANGLE)
+    double _stepAngleAtRhoZero;
+    double _stepAngleSlopeBelow;
+    double _stepAngleSlopeAbove;
+
+    // Transform from (sin theta, cos theta) * rho to table coords - includes mirroring, theta
+    // offset and bed radius
+    float _xform[2][2];
 
     // Work manager
     WorkManager& _workManager;
@@ -53,19 +91,64 @@ private:
 
     // Pattern vars
     bool _isInterpolating;
+    bool _hasPendingPoint;
     double _curTheta;
     double _curRho;
     int _interpolateSteps;
     int _curStep;
-    double _thetaInc;
-    double _rhoInc;
     double _thetaStartOffset;
     double _prevTheta;
     double _prevRho;
+    int _lineCmdIdx;
+
+    // Interpolation kernel - the unit vector (sin theta, cos theta) is advanced by a rotation
+    // which is computed once per line and rho changes linearly (computed from the step number
+    // rather than accumulated as lines can have thousands of steps)
+    float _unitSin;
+    float _unitCos;
+    float _rotSin;
+    float _rotCos;
+    float _kernelRhoStart;
+    float _kernelRhoInc;
+    static const int RENORMALISE_STEPS = 16;
+
+    // Curvature stepping - steps vary so the angle is accumulated and the line ends exactly at
+    // its end point
+    float _kernelRhoPerRad;
+    float _lineAngleTotal;
+    float _lineAngleDone;
+    bool _lineAnglePositive;
+    double _lineEndTheta;
+    double _lineEndRho;
+
+    // Transit - planned when a pattern starts and the last point is known (the last point is
+    // tracked in table coords along with the last point away from the centre - relative to the
+    // centre - as the kinematics keep theta at the centre and its angle is only found when a
+    // transit is planned)
+    TransitPlanner _transitPlanner;
+    TransitPlanner::Plan _transitPlan;
+    int _transitIdx;
+    bool _isTransitPoint;
+    bool _lastPosValid;
+    double _lastX;
+    double _lastY;
+    float _lastAwayX;
+    float _lastAwayY;
+    bool _isQueueingPoint;
 
     // Process steps per service
     static const int PROCESS_STEPS_PER_SERVICE = 20;
 
+    bool nextPoint(double& x, double& y);
+    bool transitPending()
+    {
+        return _transitIdx < _transitPlan._numWaypoints;
+    }
+    void planTransit(double theta, double rho);
+    double getStepAngle(double rho);
+    float getChordStepAngle(float rhoMM, float rhoPerRadMM);
+    void stepByCurvature(double& x, double& y);
     void calcXYPos(double theta, double rho, double& x, double& y);
+    void calcXYPos(float unitSin, float unitCos, float rho, double& x, double& y);
 
 };
\ No newline at end of file
@@ -0,0 +1,141 @@
+// RBotFirmware
+// Rob Dobson 2016-2018
+
+#pragma once
+
+#include <stdint.h>
+#include <ctype.h>
+#include "ThetaRhoTokenizer.h"
+
+// G-code command - the words of a line in compact form - values are held as floats with a mask
+// of the letters present (letters without a value, e.g. R for relative moves, have their own
+// mask) and the line number (N) is an integer so that command indices are exact
+struct GCodeCommand
+{
+    // G and M codes (a line can have several) - the sub-code is the digit after a point (G38.2)
+    static constexpr int MAX_CODES = 4;
+    struct Code
+    {
+        char _letter;
+        uint8_t _subCode;
+        uint16_t _num;
+    };
+    Code _codes[MAX_CODES];
+    uint8_t _numCodes;
+    bool _hasLineNum;
+    int32_t _lineNum;
+    uint32_t _wordMask;
+    uint32_t _bareWordMask;
+    float _words[26];
+
+    void clear()
+    {
+        _numCodes = 0;
+        _hasLineNum = false;
+        _lineNum = 0;
+        _wordMask = 0;
+        _bareWordMask = 0;
+    }
+
+    bool hasWord(char letter) const
+    {
+        return (_wordMask & letterBit(letter)) != 0;
+    }
+
+    float getWord(char letter, float defaultVal = 0) const
+    {
+        return hasWord(letter) ? _words[letter - 'A'] : defaultVal;
+    }
+
+    bool hasBareWord(char letter) const
+    {
+        return (_bareWordMask & letterBit(letter)) != 0;
+    }
+
+    static uint32_t letterBit(char letter)
+    {
+        return 1UL << (letter - 'A');
+    }
+};
+
+// G-code parser - a single pass over the line in place (no copies or allocation) - words are
+// case-insensitive and need not be separated, comments (; to the end of the line or in
+// brackets) are skipped and a checksum (*nn - XOR of the bytes before the *) is checked
+class GCodeParser
+{
+public:
+    // Parse a line - returns false if the line is malformed or the checksum doesn't match
+    static bool parse(const char* pLine, const char* pEnd, GCodeCommand& cmd)
+    {
+        cmd.clear();
+        const char* p = pLine;
+        while (p < pEnd)
+        {
+            char ch = *p;
+            if ((ch == ';') || (ch == 0))
+                break;
+
+            // Bracketed comment
+            if (ch == '(')
+            {
+                while ((p < pEnd) && (*p != ')'))
+                    p++;
+                if (p < pEnd)
+                    p++;
+                continue;
+            }
+
+            // Checksum - ends the line
+            if (ch == '*')
+            {
+                const char* pChk = p + 1;
+                double chkVal = 0;
+                if (!ThetaRhoTokenizer::parseDecimal(pChk, pEnd, chkVal, false))
+                    return false;
+                uint8_t checksum = 0;
+                for (const char* pC = pLine; pC < p; pC++)
+                    checksum ^= uint8_t(*pC);
+                return checksum == chkVal;
+            }
+
+            // Skip whitespace and anything else between words
+            if (!isalpha((unsigned char)ch))
+            {
+                p++;
+                continue;
+            }
+
+            // Word
+            char letter = toupper((unsigned char)ch);
+            p++;
+            double val = 0;
+            if (!ThetaRhoTokenizer::parseDecimal(p, pEnd, val, false))
+            {
+                cmd._bareWordMask |= GCodeCommand::letterBit(letter);
+                continue;
+            }
+            if ((letter == 'G') || (letter == 'M'))
+            {
+                if ((cmd._numCodes >= GCodeCommand::MAX_CODES) || (val < 0) || (val > UINT16_MAX))
+                    return false;
+                GCodeCommand::Code& code = cmd._codes[cmd._numCodes++];
+                code._letter = letter;
+                code._num = uint16_t(val);
+                code._subCode = uint8_t((val - code._num) * 10 + 0.5);
+            }
+            else if (letter == 'N')
+            {
+                if ((val < INT32_MIN) || (val > INT32_MAX))
+                    return false;
+                cmd._hasLineNum = true;
+                cmd._lineNum = int32_t(val);
+            }
+            else
+            {
+                cmd._wordMask |= GCodeCommand::letterBit(letter);
+                cmd._words[letter - 'A'] = float(val);
+            }
+        }
+        return true;
+    }
+};
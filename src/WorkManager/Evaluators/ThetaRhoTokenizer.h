@@ -0,0 +1,163 @@
+// RBotFirmware
+// Rob Dobson 2016-2018
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+
+// Theta-rho file tokenizer - lines are scanned in place (in a buffer of file data) rather
+// than being copied into Strings and the theta and rho values are parsed with a decimal parser
+// which only handles the fixed formats found in THR files (no locale, hex, inf, etc)
+class ThetaRhoTokenizer
+{
+public:
+    // Parse a line (pLine to pEnd, without line ending) - interpolate is updated by flags in the
+    // file and the Sandify header - returns false if the line is not a point
+    static bool parseLine(const char* pLine, const char* pEnd, bool& interpolate, double& theta, double& rho)
+    {
+        // Trim
+        while ((pLine < pEnd) && isspace((unsigned char)*pLine))
+            pLine++;
+        while ((pEnd > pLine) && isspace((unsigned char)*(pEnd - 1)))
+            pEnd--;
+
+        // Check for flags (can be in comments or not)
+        if (findStr(pLine, pEnd, "_NO_INTERPOLATE_"))
+            interpolate = false;
+        else if (findStr(pLine, pEnd, "_INTERPOLATE_"))
+            interpolate = true;
+
+        // Check for comments
+        if ((pLine < pEnd) && (*pLine == '#'))
+        {
+            if (findStr(pLine, pEnd, "Sandify"))
+                interpolate = false;
+            return false;
+        }
+
+        // Theta and rho separated by whitespace
+        const char* pStr = pLine;
+        if (!parseDecimal(pStr, pEnd, theta))
+            return false;
+        if ((pStr >= pEnd) || !isspace((unsigned char)*pStr))
+            return false;
+        return parseDecimal(pStr, pEnd, rho);
+    }
+
+    // Parse a decimal number (optional leading whitespace, sign, digits with optional point and
+    // exponent) - pStr is left after the number - returns false if there are no digits - the
+    // exponent can be disallowed where E is a separate word (e.g. G-code)
+    static bool parseDecimal(const char*& pStr, const char* pEnd, double& val, bool allowExponent = true)
+    {
+        const char* p = pStr;
+        while ((p < pEnd) && ((*p == ' ') || (*p == '\t')))
+            p++;
+        bool isNeg = false;
+        if ((p < pEnd) && ((*p == '-') || (*p == '+')))
+            isNeg = (*p++ == '-');
+
+        // Significant digits are accumulated as an integer - digits beyond those which fit are
+        // dropped (only the exponent is adjusted)
+        uint64_t mantissa = 0;
+        int numSigDigits = 0;
+        int exp10 = 0;
+        bool anyDigits = false;
+        for (; (p < pEnd) && isdigit((unsigned char)*p); p++)
+        {
+            anyDigits = true;
+            if (numSigDigits < MAX_SIG_DIGITS)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                if (mantissa != 0)
+                    numSigDigits++;
+            }
+            else
+            {
+                exp10++;
+            }
+        }
+        if ((p < pEnd) && (*p == '.'))
+        {
+            for (p++; (p < pEnd) && isdigit((unsigned char)*p); p++)
+            {
+                anyDigits = true;
+                if (numSigDigits < MAX_SIG_DIGITS)
+                {
+                    mantissa = mantissa * 10 + (*p - '0');
+                    if (mantissa != 0)
+                        numSigDigits++;
+                    exp10--;
+                }
+            }
+        }
+        if (!anyDigits)
+            return false;
+
+        // Exponent
+        if (allowExponent && (p < pEnd) && ((*p == 'e') || (*p == 'E')))
+        {
+            const char* pExp = p + 1;
+            bool expNeg = false;
+            if ((pExp < pEnd) && ((*pExp == '-') || (*pExp == '+')))
+                expNeg = (*pExp++ == '-');
+            if ((pExp < pEnd) && isdigit((unsigned char)*pExp))
+            {
+                int expVal = 0;
+                for (; (pExp < pEnd) && isdigit((unsigned char)*pExp); pExp++)
+                    if (expVal < 10000)
+                        expVal = expVal * 10 + (*pExp - '0');
+                exp10 += expNeg ? -expVal : expVal;
+                p = pExp;
+            }
+        }
+
+        // Scale - exact (so correctly rounded) when the mantissa fits in a double and the power
+        // of ten is in the table
+        double result = double(mantissa);
+        if (mantissa != 0)
+        {
+            while (exp10 < -MAX_EXACT_POW10)
+            {
+                result /= getPow10(MAX_EXACT_POW10);
+                exp10 += MAX_EXACT_POW10;
+            }
+            while (exp10 > MAX_EXACT_POW10)
+            {
+                result *= getPow10(MAX_EXACT_POW10);
+                exp10 -= MAX_EXACT_POW10;
+            }
+            if (exp10 < 0)
+                result /= getPow10(-exp10);
+            else
+                result *= getPow10(exp10);
+        }
+        val = isNeg ? -result : result;
+        pStr = p;
+        return true;
+    }
+
+private:
+    static constexpr int MAX_SIG_DIGITS = 19;
+    static constexpr int MAX_EXACT_POW10 = 22;
+
+    // Powers of ten which are exact as doubles
+    static double getPow10(int exp10)
+    {
+        static const double POW10[MAX_EXACT_POW10 + 1] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+        };
+        return POW10[exp10];
+    }
+
+    static bool findStr(const char* pStart, const char* pEnd, const char* pToFind)
+    {
+        int findLen = strlen(pToFind);
+        for (const char* p = pStart; p + findLen <= pEnd; p++)
+            if ((*p == *pToFind) && (strncmp(p, pToFind, findLen) == 0))
+                return true;
+        return false;
+    }
+};
@@ -0,0 +1,355 @@
+// RBotFirmware
+// Rob Dobson 2016-2018
+
+#include "PatternEstimator.h"
+#include <ArduinoLog.h>
+#include "FileManager.h"
+#include "MoveCmd.h"
+#include "Evaluators/EvaluatorFiles.h"
+#include "Evaluators/EvaluatorGCode.h"
+#include "Evaluators/EvaluatorThetaRhoLine.h"
+#include "Evaluators/ThetaRhoTokenizer.h"
+#include "RobotMotion/RobotController.h"
+
+static const char* MODULE_PREFIX = "PatternEstimator: ";
+
+PatternEstimator::PatternEstimator(FileManager& fileManager, EvaluatorThetaRhoLine& thrEvaluator) :
+            _fileManager(fileManager), _thrEvaluator(thrEvaluator)
+{
+    for (int entryIdx = 0; entryIdx < CACHE_ENTRIES; entryIdx++)
+        _cache[entryIdx]._lastUsedMs = 0;
+    _cacheMutex = xSemaphoreCreateMutex();
+    _curModTime = 0;
+    _requestPending = false;
+    _requestFileType = EvaluatorFiles::FILE_TYPE_UNKNOWN;
+    _requestFileLen = 0;
+    _isEstimating = false;
+    _cancelRequested = false;
+    _jobFileType = EvaluatorFiles::FILE_TYPE_UNKNOWN;
+    _pJobMotionHelper = NULL;
+    _pJobThrEvaluator = NULL;
+    _jobInterpolate = true;
+    _jobFirstValidLineProcessed = false;
+    _jobTimeS = 0;
+    _jobLastYieldMs = 0;
+}
+
+PatternEstimator::~PatternEstimator()
+{
+    clear();
+    while (_isEstimating)
+        vTaskDelay(1);
+}
+
+void PatternEstimator::requestEstimate(const String& fileName, const String& robotConfigStr)
+{
+    String rootFilename;
+    int fileLen = 0;
+    time_t modTime = 0;
+    if (!_fileManager.getFileStatus("", fileName, rootFilename, fileLen, modTime))
+        rootFilename = "";
+    requestEstimate(fileName, rootFilename, fileLen, modTime, robotConfigStr);
+}
+
+void PatternEstimator::requestEstimate(const String& fileName, const String& rootFilename, int fileLen, time_t modTime,
+            const String& robotConfigStr)
+{
+    // Identify the file by path and modification time - the current file is read by getEstimate
+    // from other tasks so it is only changed with the cache mutex taken
+    xSemaphoreTake(_cacheMutex, portMAX_DELAY);
+    _curRootFilename = rootFilename;
+    _curModTime = modTime;
+    bool isCached = (rootFilename.length() > 0) && (findInCache(rootFilename, modTime) != NULL);
+    xSemaphoreGive(_cacheMutex);
+    if (rootFilename.length() == 0)
+        return;
+    String fileNameStr = fileName;
+    int fileType = EvaluatorFiles::getFileTypeFromExtension(fileNameStr);
+    if ((fileType == EvaluatorFiles::FILE_TYPE_UNKNOWN) || (fileLen == 0))
+        return;
+    _requestPending = false;
+    if (isCached)
+        return;
+
+    // Any estimate in progress for another file is abandoned
+    if (_isEstimating)
+    {
+        if ((_jobEstimate._rootFilename == rootFilename) && (_jobEstimate._modTime == modTime))
+            return;
+        _cancelRequested = true;
+    }
+
+    // Started by service when the task is free
+    _requestPending = true;
+    _requestFileType = fileType;
+    _requestFileLen = fileLen;
+    _requestRobotConfig = robotConfigStr;
+}
+
+void PatternEstimator::service()
+{
+    if (!_requestPending || _isEstimating)
+        return;
+    _requestPending = false;
+
+    // Setup the job
+    xSemaphoreTake(_cacheMutex, portMAX_DELAY);
+    _jobEstimate._rootFilename = _curRootFilename;
+    _jobEstimate._modTime = _curModTime;
+    xSemaphoreGive(_cacheMutex);
+    _jobEstimate._fileLen = _requestFileLen;
+    _jobEstimate._durationS = 0;
+    _jobEstimate._numCheckpoints = 0;
+    _jobFileType = _requestFileType;
+    _jobRobotConfig = _requestRobotConfig;
+    _requestRobotConfig = "";
+
+    // The theta-rho evaluator is copied from the live one for its settings
+    _pJobThrEvaluator = new EvaluatorThetaRhoLine(_thrEvaluator);
+    if (!_pJobThrEvaluator)
+        return;
+    _pJobThrEvaluator->stop();
+
+    // Start the task
+    _cancelRequested = false;
+    _isEstimating = true;
+    if (xTaskCreatePinnedToCore(estimateTaskFn, "PatternEst", TASK_STACK_SIZE, this, tskIDLE_PRIORITY, NULL, 0) != pdPASS)
+    {
+        Log.warning("%sfailed to start task\n", MODULE_PREFIX);
+        delete _pJobThrEvaluator;
+        _pJobThrEvaluator = NULL;
+        _isEstimating = false;
+    }
+}
+
+bool PatternEstimator::getEstimate(int filePos, float& durationS, float& remainingS)
+{
+    // The current file is changed by requestEstimate in the service loop
+    xSemaphoreTake(_cacheMutex, portMAX_DELAY);
+    Estimate* pEst = NULL;
+    if (_curRootFilename.length() > 0)
+        pEst = findInCache(_curRootFilename, _curModTime);
+    if (pEst)
+    {
+        pEst->_lastUsedMs = millis();
+
+        // Time reached at the file position (interpolated between checkpoints)
+        int prevPos = 0;
+        float prevS = 0;
+        float timeAtPosS = pEst->_durationS;
+        for (int cpIdx = 0; cpIdx <= pEst->_numCheckpoints; cpIdx++)
+        {
+            bool isEnd = cpIdx == pEst->_numCheckpoints;
+            int cpPos = isEnd ? pEst->_fileLen : pEst->_checkpointPos[cpIdx];
+            float cpS = isEnd ? pEst->_durationS : pEst->_checkpointS[cpIdx];
+            if (filePos <= cpPos)
+            {
+                timeAtPosS = (cpPos > prevPos) ? prevS + (cpS - prevS) * (filePos - prevPos) / (cpPos - prevPos) : cpS;
+                break;
+            }
+            prevPos = cpPos;
+            prevS = cpS;
+        }
+        durationS = pEst->_durationS;
+        remainingS = std::max(durationS - timeAtPosS, 0.0f);
+    }
+    xSemaphoreGive(_cacheMutex);
+    return pEst != NULL;
+}
+
+void PatternEstimator::clear()
+{
+    _requestPending = false;
+    if (_isEstimating)
+        _cancelRequested = true;
+    xSemaphoreTake(_cacheMutex, portMAX_DELAY);
+    for (int entryIdx = 0; entryIdx < CACHE_ENTRIES; entryIdx++)
+        _cache[entryIdx]._rootFilename = "";
+    xSemaphoreGive(_cacheMutex);
+}
+
+// Must be called with the cache mutex taken
+PatternEstimator::Estimate* PatternEstimator::findInCache(const String& rootFilename, time_t modTime)
+{
+    for (int entryIdx = 0; entryIdx < CACHE_ENTRIES; entryIdx++)
+    {
+        Estimate& est = _cache[entryIdx];
+        if ((est._rootFilename.length() > 0) && (est._rootFilename == rootFilename) && (est._modTime == modTime))
+            return &est;
+    }
+    return NULL;
+}
+
+void PatternEstimator::estimateTaskFn(void* pParam)
+{
+    PatternEstimator* pThis = (PatternEstimator*)pParam;
+    uint32_t startMs = millis();
+    bool estimateOk = pThis->estimate();
+
+    // Store in place of the least recently used entry (unless cancelled meanwhile)
+    xSemaphoreTake(pThis->_cacheMutex, portMAX_DELAY);
+    if (estimateOk && !pThis->_cancelRequested)
+    {
+        Estimate* pEntry = &pThis->_cache[0];
+        for (int entryIdx = 1; entryIdx < CACHE_ENTRIES; entryIdx++)
+        {
+            if (pEntry->_rootFilename.length() == 0)
+                break;
+            Estimate& est = pThis->_cache[entryIdx];
+            if ((est._rootFilename.length() == 0) || (est._lastUsedMs < pEntry->_lastUsedMs))
+                pEntry = &est;
+        }
+        *pEntry = pThis->_jobEstimate;
+        pEntry->_lastUsedMs = millis();
+    }
+    xSemaphoreGive(pThis->_cacheMutex);
+    if (estimateOk)
+        Log.notice("%s%s duration %ds (estimated in %dms)\n", MODULE_PREFIX, pThis->_jobEstimate._rootFilename.c_str(),
+                    int(pThis->_jobEstimate._durationS), millis() - startMs);
+    else if (!pThis->_cancelRequested)
+        Log.warning("%s%s estimate failed\n", MODULE_PREFIX, pThis->_jobEstimate._rootFilename.c_str());
+
+    // Clean up
+    delete pThis->_pJobMotionHelper;
+    pThis->_pJobMotionHelper = NULL;
+    delete pThis->_pJobThrEvaluator;
+    pThis->_pJobThrEvaluator = NULL;
+    pThis->_jobRobotConfig = "";
+    pThis->_isEstimating = false;
+    vTaskDelete(NULL);
+}
+
+bool PatternEstimator::estimate()
+{
+    _pJobMotionHelper = RobotController::createDryRunMotionHelper(_jobRobotConfig.c_str());
+    if (!_pJobMotionHelper)
+        return false;
+    _jobTimeS = 0;
+    _jobInterpolate = true;
+    _jobFirstValidLineProcessed = false;
+    _jobLastYieldMs = millis();
+
+    // Read the file in blocks and process the complete lines in each
+    uint8_t* pBuf = new uint8_t[READ_BUF_LEN + 1];
+    if (!pBuf)
+        return false;
+    int filePos = 0;
+    bool estimateOk = true;
+    while (estimateOk)
+    {
+        int readLen = _fileManager.readFileBlock(_jobEstimate._rootFilename, filePos, pBuf, READ_BUF_LEN);
+        if (readLen < 0)
+        {
+            estimateOk = false;
+            break;
+        }
+        int lineStart = 0;
+        for (int bufPos = 0; (bufPos < readLen) && estimateOk; bufPos++)
+        {
+            if (pBuf[bufPos] != '\n')
+                continue;
+            pBuf[bufPos] = 0;
+            estimateOk = processLine((char*)pBuf + lineStart, filePos + bufPos + 1);
+            lineStart = bufPos + 1;
+        }
+
+        // The final line may not be terminated
+        if (readLen < READ_BUF_LEN)
+        {
+            if (estimateOk && (lineStart < readLen))
+            {
+                pBuf[readLen] = 0;
+                estimateOk = processLine((char*)pBuf + lineStart, filePos + readLen);
+            }
+            break;
+        }
+
+        // Lines longer than the buffer are skipped
+        filePos += (lineStart > 0) ? lineStart : readLen;
+    }
+    delete[] pBuf;
+
+    // Complete all motion
+    int stalls = 0;
+    while (estimateOk && !(_pJobMotionHelper->canAccept() && _pJobMotionHelper->isIdle()))
+    {
+        float blocksTimeS = _pJobMotionHelper->dryRunService(true);
+        _jobTimeS += blocksTimeS;
+        stalls = (blocksTimeS > 0) ? 0 : stalls + 1;
+        estimateOk = (stalls < MAX_STALLS) && yieldIfDue();
+    }
+    _jobEstimate._durationS = _jobTimeS;
+    return estimateOk;
+}
+
+bool PatternEstimator::processLine(const char* pLine, int filePosAfterLine)
+{
+    // Lines are handled as they would be by the file and theta-rho evaluators
+    MoveCmd moveCmd;
+    if (_jobFileType == EvaluatorFiles::FILE_TYPE_THETA_RHO)
+    {
+        double theta = 0, rho = 0;
+        if (ThetaRhoTokenizer::parseLine(pLine, pLine + strlen(pLine), _jobInterpolate, theta, rho))
+        {
+            _pJobThrEvaluator->addPolarPoint(theta, rho, _jobInterpolate, !_jobFirstValidLineProcessed);
+            _jobFirstValidLineProcessed = true;
+            double x, y;
+            while (_pJobThrEvaluator->getNextPoint(x, y))
+            {
+                moveCmd.clear();
+                moveCmd.setAxisValMM(0, x);
+                moveCmd.setAxisValMM(1, y);
+                moveCmd.setFlag(MoveCmd::FLAG_DONT_SPLIT, _pJobThrEvaluator->isDirectPoint());
+                if (!addMove(moveCmd))
+                    return false;
+            }
+        }
+    }
+    else
+    {
+        if (EvaluatorGCode::getMoveCmd(pLine, moveCmd))
+        {
+            if (!addMove(moveCmd))
+                return false;
+        }
+    }
+
+    // Checkpoint when the next fraction of the file is reached
+    Estimate& est = _jobEstimate;
+    if ((est._numCheckpoints < NUM_CHECKPOINTS) &&
+                (int64_t(filePosAfterLine) * NUM_CHECKPOINTS >= int64_t(est._numCheckpoints + 1) * est._fileLen))
+    {
+        est._checkpointPos[est._numCheckpoints] = filePosAfterLine;
+        est._checkpointS[est._numCheckpoints] = _jobTimeS;
+        est._numCheckpoints++;
+    }
+    return yieldIfDue();
+}
+
+// Add a move once the dry-run motion helper can accept it - blocks are executed (and their
+// time added) as the pipeline fills
+bool PatternEstimator::addMove(MoveCmd& moveCmd)
+{
+    int stalls = 0;
+    while (!_pJobMotionHelper->canAccept())
+    {
+        float blocksTimeS = _pJobMotionHelper->dryRunService(false);
+        _jobTimeS += blocksTimeS;
+        stalls = (blocksTimeS > 0) ? 0 : stalls + 1;
+        if ((stalls >= MAX_STALLS) || !yieldIfDue())
+            return false;
+    }
+    _pJobMotionHelper->moveTo(moveCmd);
+    return true;
+}
+
+// Let other tasks (including idle) run - returns false if the estimate is cancelled
+bool PatternEstimator::yieldIfDue()
+{
+    if (millis() - _jobLastYieldMs >= YIELD_INTERVAL_MS)
+    {
+        vTaskDelay(1);
+        _jobLastYieldMs = millis();
+    }
+    return !_cancelRequested;
+}
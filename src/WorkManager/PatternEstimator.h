@@ -0,0 +1,98 @@
+// RBotFirmware
+// Rob Dobson 2016-2018
+
+#pragma once
+
+#include <Arduino.h>
+#include <time.h>
+
+class FileManager;
+class MotionHelper;
+class EvaluatorThetaRhoLine;
+struct MoveCmd;
+
+// Pattern duration estimator - a pattern file is run through a dry-run motion helper (the real
+// block splitting and planner but with block times computed analytically instead of by the ISR)
+// in a low priority task
+// Estimates are cached by file path and modification time and include the time reached at
+// points through the file so that the time remaining can be found from the file position
+class PatternEstimator
+{
+public:
+    static constexpr int CACHE_ENTRIES = 8;
+    static constexpr int NUM_CHECKPOINTS = 32;
+    static constexpr int READ_BUF_LEN = 1000;
+    static constexpr uint32_t YIELD_INTERVAL_MS = 10;
+    static constexpr int MAX_STALLS = 10;
+    static constexpr uint32_t TASK_STACK_SIZE = 8000;
+
+private:
+    struct Estimate
+    {
+        String _rootFilename;
+        time_t _modTime;
+        int _fileLen;
+        float _durationS;
+        int _numCheckpoints;
+        int _checkpointPos[NUM_CHECKPOINTS];
+        float _checkpointS[NUM_CHECKPOINTS];
+        uint32_t _lastUsedMs;
+    };
+
+    FileManager& _fileManager;
+    EvaluatorThetaRhoLine& _thrEvaluator;
+
+    // Cache (shared with the estimate task)
+    Estimate _cache[CACHE_ENTRIES];
+    SemaphoreHandle_t _cacheMutex;
+
+    // File currently being played
+    String _curRootFilename;
+    time_t _curModTime;
+
+    // Request waiting for the task to be free
+    bool _requestPending;
+    int _requestFileType;
+    int _requestFileLen;
+    String _requestRobotConfig;
+
+    // Estimate task - the job vars are only accessed by the task while it is running
+    volatile bool _isEstimating;
+    volatile bool _cancelRequested;
+    Estimate _jobEstimate;
+    int _jobFileType;
+    String _jobRobotConfig;
+    MotionHelper* _pJobMotionHelper;
+    EvaluatorThetaRhoLine* _pJobThrEvaluator;
+    bool _jobInterpolate;
+    bool _jobFirstValidLineProcessed;
+    float _jobTimeS;
+    uint32_t _jobLastYieldMs;
+
+public:
+    PatternEstimator(FileManager& fileManager, EvaluatorThetaRhoLine& thrEvaluator);
+    ~PatternEstimator();
+
+    // Called when a file starts - an estimate is made unless one is cached (the file's status is
+    // looked up unless it is given)
+    void requestEstimate(const String& fileName, const String& robotConfigStr);
+    void requestEstimate(const String& fileName, const String& rootFilename, int fileLen, time_t modTime,
+                const String& robotConfigStr);
+
+    // Call frequently
+    void service();
+
+    // Estimate for the file currently being played - false if none yet
+    bool getEstimate(int filePos, float& durationS, float& remainingS);
+
+    // Cancel any estimate in progress and forget cached estimates (e.g. on reconfiguration)
+    void clear();
+
+private:
+    Estimate* findInCache(const String& rootFilename, time_t modTime);
+    static void estimateTaskFn(void* pParam);
+    bool estimate();
+    bool processLine(const char* pLine, int filePosAfterLine);
+    bool addMove(MoveCmd& moveCmd);
+    bool yieldIfDue();
+};
@@ -0,0 +1,513 @@
+// RBotFirmware
+// Rob Dobson 2016-2018
+
+#include "PlaylistOptimiser.h"
+#include <ArduinoLog.h>
+#include <algorithm>
+#include "FileManager.h"
+#include "Evaluators/ThetaRhoTokenizer.h"
+
+static const char* MODULE_PREFIX = "PlaylistOptimiser: ";
+
+PlaylistOptimiser::PlaylistOptimiser(FileManager& fileManager) :
+            _fileManager(fileManager)
+{
+    for (int entryIdx = 0; entryIdx < CACHE_ENTRIES; entryIdx++)
+    {
+        _cache[entryIdx]._modTime = 0;
+        _cache[entryIdx]._lastUsedMs = 0;
+    }
+}
+
+bool PlaylistOptimiser::getEnds(const String& fileName, Entry& entry)
+{
+    // Identify the file by path and modification time
+    String rootFilename;
+    int fileLen = 0;
+    time_t modTime = 0;
+    entry._known = false;
+    entry._pinned = false;
+    if (!_fileManager.getFileStatus("", fileName, rootFilename, fileLen, modTime))
+        return false;
+
+    // Check cache - the least recently used entry is replaced
+    CachedEnds* pReplace = &_cache[0];
+    for (int entryIdx = 0; entryIdx < CACHE_ENTRIES; entryIdx++)
+    {
+        CachedEnds& cached = _cache[entryIdx];
+        if ((cached._rootFilename.length() > 0) && (cached._rootFilename == rootFilename) && (cached._modTime == modTime))
+        {
+            cached._lastUsedMs = millis();
+            entry = cached._ends;
+            return entry._known;
+        }
+        if (cached._lastUsedMs < pReplace->_lastUsedMs)
+            pReplace = &cached;
+    }
+
+    // Scan
+    scanEnds(rootFilename, fileLen, entry);
+    pReplace->_rootFilename = rootFilename;
+    pReplace->_modTime = modTime;
+    pReplace->_ends = entry;
+    pReplace->_lastUsedMs = millis();
+    return entry._known;
+}
+
+// The first and last points are found by reading lines forwards from the start and backwards
+// from the end of the file (up to SCAN_MAX_LEN from each so headers and trailers are skipped)
+bool PlaylistOptimiser::scanEnds(const String& rootFilename, int fileLen, Entry& entry)
+{
+    bool interpolate = true;
+    double theta = 0, rho = 0;
+
+    // First point
+    bool found = false;
+    int filePos = 0;
+    while (!found && (filePos < std::min(fileLen, SCAN_MAX_LEN)))
+    {
+        int readLen = _fileManager.readFileBlock(rootFilename, filePos, (uint8_t*)_scanBuf, SCAN_BUF_LEN);
+        if (readLen <= 0)
+            return false;
+        bool atEnd = filePos + readLen >= fileLen;
+        int lineStart = 0;
+        while (lineStart < readLen)
+        {
+            const char* pLineEnd = (const char*)memchr(_scanBuf + lineStart, '\n', readLen - lineStart);
+            // Partial lines are read again from their start (unless longer than the buffer)
+            if (!pLineEnd && !atEnd && (lineStart != 0))
+                break;
+            int lineEnd = pLineEnd ? pLineEnd - _scanBuf : readLen;
+            if (ThetaRhoTokenizer::parseLine(_scanBuf + lineStart, _scanBuf + lineEnd, interpolate, theta, rho))
+            {
+                found = true;
+                break;
+            }
+            lineStart = lineEnd + 1;
+        }
+        filePos += std::max(std::min(lineStart, readLen), 1);
+    }
+    if (!found)
+        return false;
+    entry._startTheta = theta;
+    entry._startRho = rho;
+
+    // Last point
+    found = false;
+    int fileEnd = fileLen;
+    while (!found && (fileEnd > 0) && (fileLen - fileEnd < SCAN_MAX_LEN))
+    {
+        int blockPos = std::max(0, fileEnd - SCAN_BUF_LEN);
+        int readLen = _fileManager.readFileBlock(rootFilename, blockPos, (uint8_t*)_scanBuf, fileEnd - blockPos);
+        if (readLen <= 0)
+            return false;
+
+        // The first line in the block may be partial (unless at the start of the file)
+        int blockStart = 0;
+        if (blockPos > 0)
+        {
+            const char* pNewline = (const char*)memchr(_scanBuf, '\n', readLen);
+            if (!pNewline)
+                return false;
+            blockStart = pNewline - _scanBuf + 1;
+        }
+        int lineEnd = readLen;
+        while (lineEnd >= blockStart)
+        {
+            int lineStart = lineEnd;
+            while ((lineStart > blockStart) && (_scanBuf[lineStart - 1] != '\n'))
+                lineStart--;
+            if (ThetaRhoTokenizer::parseLine(_scanBuf + lineStart, _scanBuf + lineEnd, interpolate, theta, rho))
+            {
+                found = true;
+                break;
+            }
+            lineEnd = lineStart - 1;
+        }
+        if (blockPos == 0)
+            break;
+        fileEnd = blockPos + blockStart;
+    }
+    if (!found)
+        return false;
+    entry._endTheta = theta;
+    entry._endRho = rho;
+    entry._known = true;
+    Log.verbose("%s%s start %F,%F end %F,%F\n", MODULE_PREFIX, rootFilename.c_str(),
+                entry._startTheta, entry._startRho, entry._endTheta, entry._endRho);
+    return true;
+}
+
+float PlaylistOptimiser::optimise(const std::vector<Entry>& entries, bool allowRotate, bool allowReverse,
+            std::vector<uint32_t>& order, std::vector<float>& rotations, std::vector<bool>& reversals)
+{
+    // Runs are ordered as nodes (entries start forwards)
+    int numEntries = entries.size();
+    std::vector<uint32_t> nodes(numEntries);
+    for (int entryIdx = 0; entryIdx < numEntries; entryIdx++)
+        nodes[entryIdx] = entryIdx * 2;
+
+    // Runs of entries between pinned entries (and those which aren't patterns, after which the
+    // position isn't known so is taken to be the centre)
+    float fromTheta = 0, fromRho = 0;
+    int runStart = 0;
+    while (runStart < numEntries)
+    {
+        const Entry& entry = entries[runStart];
+        if (!entry._known || entry._pinned)
+        {
+            fromTheta = entry._known ? entry._endTheta : 0;
+            fromRho = entry._known ? entry._endRho : 0;
+            runStart++;
+            continue;
+        }
+        int runEnd = runStart;
+        while ((runEnd < numEntries) && entries[runEnd]._known && !entries[runEnd]._pinned)
+            runEnd++;
+        Run run = { &entries, allowRotate, allowReverse, fromTheta, fromRho,
+                    ((runEnd < numEntries) && entries[runEnd]._known) ? &entries[runEnd] : NULL };
+
+        // Order the run - kept as it is unless that reduces the transit
+        int runLen = runEnd - runStart;
+        uint32_t* pRun = &nodes[runStart];
+        float origCost = runCost(run, pRun, runLen);
+        std::vector<uint32_t> origNodes(pRun, pRun + runLen);
+        if (runLen <= EXACT_MAX_ENTRIES)
+        {
+            solveExact(run, pRun, runLen);
+        }
+        else
+        {
+            solveNearest(run, pRun, runLen);
+            improveOrOpt(run, pRun, runLen);
+        }
+        if (runCost(run, pRun, runLen) >= origCost)
+            std::copy(origNodes.begin(), origNodes.end(), pRun);
+
+        nodeEnd(entries, nodes[runEnd - 1], fromTheta, fromRho);
+        runStart = runEnd;
+    }
+    order.resize(numEntries);
+    reversals.assign(numEntries, false);
+    for (int pos = 0; pos < numEntries; pos++)
+    {
+        order[pos] = nodes[pos] >> 1;
+        reversals[order[pos]] = nodes[pos] & 1;
+    }
+
+    // Each pattern is rotated to start at the angle the previous one ended
+    rotations.clear();
+    if (allowRotate)
+    {
+        rotations.resize(numEntries, 0);
+        bool hasPrev = false;
+        float prevEndAngle = 0;
+        for (int pos = 0; pos < numEntries; pos++)
+        {
+            if (!entries[order[pos]]._known)
+            {
+                hasPrev = false;
+                continue;
+            }
+            float startTheta, startRho, endTheta, endRho;
+            nodeStart(entries, nodes[pos], startTheta, startRho);
+            nodeEnd(entries, nodes[pos], endTheta, endRho);
+            float rotation = hasPrev ? remainderf(prevEndAngle - startTheta, 2 * M_PI) : 0;
+            rotations[order[pos]] = rotation;
+            prevEndAngle = remainderf(endTheta + rotation, 2 * M_PI);
+            hasPrev = true;
+        }
+    }
+    return pathCost(entries, order, allowRotate, &reversals);
+}
+
+float PlaylistOptimiser::pathCost(const std::vector<Entry>& entries, const std::vector<uint32_t>& order,
+            bool allowRotate, const std::vector<bool>* pReversals)
+{
+    float fromTheta = 0, fromRho = 0, totalCost = 0;
+    for (uint32_t entryIdx : order)
+    {
+        if (!entries[entryIdx]._known)
+        {
+            fromTheta = fromRho = 0;
+            continue;
+        }
+        uint32_t node = entryIdx * 2 + ((pReversals && (*pReversals)[entryIdx]) ? 1 : 0);
+        float startTheta, startRho;
+        nodeStart(entries, node, startTheta, startRho);
+        totalCost += transit(fromTheta, fromRho, startTheta, startRho, allowRotate);
+        nodeEnd(entries, node, fromTheta, fromRho);
+    }
+    return totalCost;
+}
+
+float PlaylistOptimiser::transit(float fromTheta, float fromRho, float toTheta, float toRho, bool allowRotate)
+{
+    if (allowRotate)
+        return fabsf(fromRho - toRho);
+    float chordSq = fromRho * fromRho + toRho * toRho - 2 * fromRho * toRho * cosf(fromTheta - toTheta);
+    return (chordSq > 0) ? sqrtf(chordSq) : 0;
+}
+
+float PlaylistOptimiser::runEdge(const Run& run, int fromNode, int toNode)
+{
+    float fromTheta = run._fromTheta;
+    float fromRho = run._fromRho;
+    if (fromNode >= 0)
+        nodeEnd(*run._pEntries, fromNode, fromTheta, fromRho);
+    if (toNode < 0)
+        return run._pTo ? transit(fromTheta, fromRho, run._pTo->_startTheta, run._pTo->_startRho, run._allowRotate) : 0;
+    float toTheta, toRho;
+    nodeStart(*run._pEntries, toNode, toTheta, toRho);
+    return transit(fromTheta, fromRho, toTheta, toRho, run._allowRotate);
+}
+
+float PlaylistOptimiser::runCost(const Run& run, const uint32_t* pNodes, int numEntries)
+{
+    float totalCost = 0;
+    int fromNode = -1;
+    for (int pos = 0; pos < numEntries; pos++)
+    {
+        totalCost += runEdge(run, fromNode, pNodes[pos]);
+        fromNode = pNodes[pos];
+    }
+    return totalCost + runEdge(run, fromNode, -1);
+}
+
+// Exact order by dynamic programming over the subsets of entries visited (and the entry last
+// visited and its direction)
+void PlaylistOptimiser::solveExact(const Run& run, uint32_t* pNodes, int numEntries)
+{
+    if ((numEntries < 2) && !run._allowReverse)
+        return;
+    int numDirns = run._allowReverse ? 2 : 1;
+    int numSubsets = 1 << numEntries;
+    uint32_t fwdNodes[EXACT_MAX_ENTRIES];
+    for (int pos = 0; pos < numEntries; pos++)
+        fwdNodes[pos] = pNodes[pos] & ~1u;
+
+    // States are indexed by subset, last entry and its direction (the previous state is stored as
+    // the last entry * 2 + direction)
+    auto stateIdx = [numEntries, numDirns](int subset, int last, int dirn) {
+        return (subset * numEntries + last) * numDirns + dirn;
+    };
+    std::vector<float> costs(numSubsets * numEntries * numDirns, INFINITY);
+    std::vector<int8_t> prevs(numSubsets * numEntries * numDirns, -1);
+    for (int last = 0; last < numEntries; last++)
+        for (int dirn = 0; dirn < numDirns; dirn++)
+            costs[stateIdx(1 << last, last, dirn)] = runEdge(run, -1, fwdNodes[last] | dirn);
+    for (int subset = 1; subset < numSubsets; subset++)
+    {
+        for (int last = 0; last < numEntries; last++)
+        {
+            if (!(subset & (1 << last)))
+                continue;
+            for (int dirn = 0; dirn < numDirns; dirn++)
+            {
+                float cost = costs[stateIdx(subset, last, dirn)];
+                if (cost == INFINITY)
+                    continue;
+                for (int next = 0; next < numEntries; next++)
+                {
+                    if (subset & (1 << next))
+                        continue;
+                    for (int nextDirn = 0; nextDirn < numDirns; nextDirn++)
+                    {
+                        int nextIdx = stateIdx(subset | (1 << next), next, nextDirn);
+                        float nextCost = cost + runEdge(run, fwdNodes[last] | dirn, fwdNodes[next] | nextDirn);
+                        if (nextCost < costs[nextIdx])
+                        {
+                            costs[nextIdx] = nextCost;
+                            prevs[nextIdx] = last * 2 + dirn;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // Best complete order (including the transit to the end of the run)
+    int subset = numSubsets - 1;
+    int last = 0, lastDirn = 0;
+    float bestCost = INFINITY;
+    for (int entry = 0; entry < numEntries; entry++)
+    {
+        for (int dirn = 0; dirn < numDirns; dirn++)
+        {
+            float cost = costs[stateIdx(subset, entry, dirn)] + runEdge(run, fwdNodes[entry] | dirn, -1);
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                last = entry;
+                lastDirn = dirn;
+            }
+        }
+    }
+    for (int pos = numEntries - 1; pos >= 0; pos--)
+    {
+        pNodes[pos] = fwdNodes[last] | lastDirn;
+        int prev = prevs[stateIdx(subset, last, lastDirn)];
+        subset &= ~(1 << last);
+        last = prev >> 1;
+        lastDirn = prev & 1;
+    }
+}
+
+// Nearest neighbour - nodes are sorted by start rho and as the transit is at least the change
+// in rho the search outwards from the current rho stops when the change exceeds the best found
+// Nodes used (both directions of an entry) are skipped by finding the next unused node in each
+// direction (with path compression so each search is close to constant time)
+void PlaylistOptimiser::solveNearest(const Run& run, uint32_t* pNodes, int numEntries)
+{
+    const std::vector<Entry>& entries = *run._pEntries;
+    int numDirns = run._allowReverse ? 2 : 1;
+    int numCands = numEntries * numDirns;
+    std::vector<uint32_t> candNodes(numCands);
+    std::vector<float> startRho(numCands);
+    for (int cand = 0; cand < numCands; cand++)
+    {
+        candNodes[cand] = (pNodes[cand / numDirns] & ~1u) | (cand % numDirns);
+        float startTheta;
+        nodeStart(entries, candNodes[cand], startTheta, startRho[cand]);
+    }
+    std::vector<int> sortedIdx(numCands);
+    for (int idx = 0; idx < numCands; idx++)
+        sortedIdx[idx] = idx;
+    std::sort(sortedIdx.begin(), sortedIdx.end(), [&startRho](int a, int b) {
+        return startRho[a] < startRho[b];
+    });
+
+    // Candidate at each sorted position and the sorted position of each candidate
+    std::vector<uint32_t> sortedNodes(numCands);
+    std::vector<float> sortedRho(numCands);
+    std::vector<int> candSortedPos(numCands);
+    for (int idx = 0; idx < numCands; idx++)
+    {
+        sortedNodes[idx] = candNodes[sortedIdx[idx]];
+        sortedRho[idx] = startRho[sortedIdx[idx]];
+        candSortedPos[sortedIdx[idx]] = idx;
+    }
+
+    // Next unused at or above an index (numCands if none) and at or below (offset by 1, 0 if none)
+    std::vector<int> nextUnused(numCands + 1), prevUnused(numCands + 1);
+    for (int idx = 0; idx <= numCands; idx++)
+        nextUnused[idx] = prevUnused[idx] = idx;
+    auto findUnused = [](std::vector<int>& links, int idx) {
+        int root = idx;
+        while (links[root] != root)
+            root = links[root];
+        while (links[idx] != root)
+        {
+            int next = links[idx];
+            links[idx] = root;
+            idx = next;
+        }
+        return root;
+    };
+
+    float curTheta = run._fromTheta;
+    float curRho = run._fromRho;
+    for (int pos = 0; pos < numEntries; pos++)
+    {
+        int startIdx = std::lower_bound(sortedRho.begin(), sortedRho.end(), curRho) - sortedRho.begin();
+        int upIdx = findUnused(nextUnused, startIdx);
+        int downIdx = findUnused(prevUnused, startIdx) - 1;
+        float bestCost = INFINITY;
+        int bestIdx = -1;
+        while (true)
+        {
+            float upDist = (upIdx < numCands) ? sortedRho[upIdx] - curRho : INFINITY;
+            float downDist = (downIdx >= 0) ? curRho - sortedRho[downIdx] : INFINITY;
+            int candIdx = 0;
+            if ((upDist <= downDist) && (upDist < bestCost))
+            {
+                candIdx = upIdx;
+                upIdx = findUnused(nextUnused, upIdx + 1);
+            }
+            else if (downDist < bestCost)
+            {
+                candIdx = downIdx;
+                downIdx = findUnused(prevUnused, downIdx) - 1;
+            }
+            else
+            {
+                break;
+            }
+            float candTheta, candRho;
+            nodeStart(entries, sortedNodes[candIdx], candTheta, candRho);
+            float cost = transit(curTheta, curRho, candTheta, candRho, run._allowRotate);
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestIdx = candIdx;
+            }
+        }
+
+        // Use (in both directions)
+        uint32_t node = sortedNodes[bestIdx];
+        pNodes[pos] = node;
+        int cand = sortedIdx[bestIdx] - sortedIdx[bestIdx] % numDirns;
+        for (int dirn = 0; dirn < numDirns; dirn++)
+        {
+            int usedIdx = candSortedPos[cand + dirn];
+            nextUnused[usedIdx] = usedIdx + 1;
+            prevUnused[usedIdx + 1] = usedIdx;
+        }
+        nodeEnd(entries, node, curTheta, curRho);
+    }
+}
+
+// Or-opt - each node is moved to the best place within a window either side (or reversed in
+// place) if that reduces the transit
+void PlaylistOptimiser::improveOrOpt(const Run& run, uint32_t* pNodes, int numEntries)
+{
+    int numDirns = run._allowReverse ? 2 : 1;
+    for (int pass = 0; pass < OR_OPT_MAX_PASSES; pass++)
+    {
+        bool improved = false;
+        for (int pos = 0; pos < numEntries; pos++)
+        {
+            int node = pNodes[pos];
+            int before = (pos > 0) ? pNodes[pos - 1] : -1;
+            int after = (pos < numEntries - 1) ? pNodes[pos + 1] : -1;
+            float removeGain = runEdge(run, before, node) + runEdge(run, node, after) - runEdge(run, before, after);
+
+            // Insert before the node at insertPos (numEntries for the end) - pos itself is the
+            // same place so only the other direction is tried there
+            float bestDelta = -1e-6f;
+            int bestInsertPos = -1;
+            int bestNode = node;
+            int insertEnd = std::min(numEntries, pos + OR_OPT_WINDOW + 1);
+            for (int insertPos = std::max(0, pos - OR_OPT_WINDOW); insertPos <= insertEnd; insertPos++)
+            {
+                if (insertPos == pos + 1)
+                    continue;
+                int prev = (insertPos == pos) ? before : ((insertPos > 0) ? pNodes[insertPos - 1] : -1);
+                int next = (insertPos == pos) ? after : ((insertPos < numEntries) ? pNodes[insertPos] : -1);
+                for (int dirn = 0; dirn < numDirns; dirn++)
+                {
+                    int candNode = (node & ~1) | dirn;
+                    if ((insertPos == pos) && (candNode == node))
+                        continue;
+                    float delta = runEdge(run, prev, candNode) + runEdge(run, candNode, next) - runEdge(run, prev, next) - removeGain;
+                    if (delta < bestDelta)
+                    {
+                        bestDelta = delta;
+                        bestInsertPos = insertPos;
+                        bestNode = candNode;
+                    }
+                }
+            }
+            if (bestInsertPos < 0)
+                continue;
+            pNodes[pos] = bestNode;
+            if (bestInsertPos < pos)
+                std::rotate(pNodes + bestInsertPos, pNodes + pos, pNodes + pos + 1);
+            else if (bestInsertPos > pos)
+                std::rotate(pNodes + pos, pNodes + pos + 1, pNodes + bestInsertPos);
+            improved = true;
+        }
+        if (!improved)
+            break;
+    }
+}
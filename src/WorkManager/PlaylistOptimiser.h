@@ -0,0 +1,111 @@
+// RBotFirmware
+// Rob Dobson 2016-2018
+
+#pragma once
+
+#include <Arduino.h>
+#include <time.h>
+#include <vector>
+
+class FileManager;
+
+// Playlist optimiser - orders the patterns of a playlist to reduce the transit moves between
+// them (which take time and scar the previous pattern) - a transit is the straight move from
+// where a pattern ends to where the next starts unless patterns can be rotated, then each
+// pattern is rotated to start at the angle the previous one ended and only the change in rho
+// remains - patterns can also be played reversed (from their end to their start) where that
+// shortens the transits
+// Entries which are pinned (or aren't theta-rho patterns) keep their positions and the entries
+// between them are ordered - runs of up to EXACT_MAX_ENTRIES are solved exactly and longer runs
+// are ordered nearest neighbour first then improved by moving single entries (or-opt)
+// The start and end of each pattern are found by scanning the first and last points of its file
+// and cached by file path and modification time
+class PlaylistOptimiser
+{
+public:
+    static constexpr int CACHE_ENTRIES = 64;
+    static constexpr int SCAN_BUF_LEN = 256;
+    static constexpr int SCAN_MAX_LEN = 4096;
+    static constexpr int EXACT_MAX_ENTRIES = 8;
+    static constexpr int OR_OPT_WINDOW = 32;
+    static constexpr int OR_OPT_MAX_PASSES = 4;
+
+    // Pattern ends (theta in radians, rho 0..1) - known is false for entries which aren't patterns
+    struct Entry
+    {
+        float _startTheta;
+        float _startRho;
+        float _endTheta;
+        float _endRho;
+        bool _known;
+        bool _pinned;
+    };
+
+private:
+    struct CachedEnds
+    {
+        String _rootFilename;
+        time_t _modTime;
+        Entry _ends;
+        uint32_t _lastUsedMs;
+    };
+
+    FileManager& _fileManager;
+    CachedEnds _cache[CACHE_ENTRIES];
+    char _scanBuf[SCAN_BUF_LEN];
+
+public:
+    PlaylistOptimiser(FileManager& fileManager);
+
+    // Get the start and end of a theta-rho file - false if the file has no points
+    bool getEnds(const String& fileName, Entry& entry);
+
+    // Order entries - order is set to the entry indices in play order, reversals to whether each
+    // entry is played reversed (all false unless reversing is allowed) and, if rotation is
+    // allowed, rotations to the angle (radians) to rotate each entry by (applied after reversing)
+    // - returns the total transit
+    static float optimise(const std::vector<Entry>& entries, bool allowRotate, bool allowReverse,
+                std::vector<uint32_t>& order, std::vector<float>& rotations, std::vector<bool>& reversals);
+
+    // Total transit for entries played in an order (from the centre) and optionally reversed
+    static float pathCost(const std::vector<Entry>& entries, const std::vector<uint32_t>& order,
+                bool allowRotate, const std::vector<bool>* pReversals = NULL);
+
+private:
+    bool scanEnds(const String& rootFilename, int fileLen, Entry& entry);
+
+    // Transit from a point to a point where a pattern starts
+    static float transit(float fromTheta, float fromRho, float toTheta, float toRho, bool allowRotate);
+
+    // While ordering, entries are nodes - an entry played in a direction (the entry index * 2,
+    // plus 1 if reversed)
+    static void nodeStart(const std::vector<Entry>& entries, uint32_t node, float& theta, float& rho)
+    {
+        const Entry& entry = entries[node >> 1];
+        theta = (node & 1) ? entry._endTheta : entry._startTheta;
+        rho = (node & 1) ? entry._endRho : entry._startRho;
+    }
+    static void nodeEnd(const std::vector<Entry>& entries, uint32_t node, float& theta, float& rho)
+    {
+        nodeStart(entries, node ^ 1, theta, rho);
+    }
+
+    // Run of nodes (nodes[runStart] to nodes[runEnd - 1]) from a point and optionally to the
+    // start of an entry
+    struct Run
+    {
+        const std::vector<Entry>* _pEntries;
+        bool _allowRotate;
+        bool _allowReverse;
+        float _fromTheta;
+        float _fromRho;
+        const Entry* _pTo;
+    };
+    static void solveExact(const Run& run, uint32_t* pNodes, int numEntries);
+    static void solveNearest(const Run& run, uint32_t* pNodes, int numEntries);
+    static void improveOrOpt(const Run& run, uint32_t* pNodes, int numEntries);
+    static float runCost(const Run& run, const uint32_t* pNodes, int numEntries);
+    // Transit from the end of a node (or the start of the run if -1) to the start of a node (or
+    // the end of the run if -1)
+    static float runEdge(const Run& run, int fromNode, int toNode);
+};
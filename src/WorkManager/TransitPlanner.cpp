@@ -0,0 +1,338 @@
+// RBotFirmware
+// Rob Dobson 2016-2018
+
+#include "TransitPlanner.h"
+#include <ArduinoLog.h>
+
+static const char* MODULE_PREFIX = "TransitPlanner: ";
+
+// Waypoints closer than this to the previous one are dropped
+static constexpr float MIN_WAYPOINT_SEP_MM = 0.01f;
+
+TransitPlanner::TransitPlanner()
+{
+    _limits = Limits{0, 0, 0, 0, 0, 0};
+    _disturbSPerMM = 0;
+    _isValid = false;
+}
+
+bool TransitPlanner::setLimits(const Limits& limits, float disturbSPerMM)
+{
+    _limits = limits;
+    _disturbSPerMM = disturbSPerMM > 0 ? disturbSPerMM : 0;
+    _isValid = (limits._bedRadiusMM > 0) && (limits._maxSpeedMMps > 0) && (limits._maxAccMMps2 > 0) &&
+                (limits._thetaMaxDegps > 0) && (limits._rhoMaxMMps > 0);
+    return _isValid;
+}
+
+const char* TransitPlanner::getTypeName(TransitType type)
+{
+    switch (type)
+    {
+        case TRANSIT_STRAIGHT: return "straight";
+        case TRANSIT_RHO_FIRST: return "rhoFirst";
+        case TRANSIT_THETA_FIRST: return "thetaFirst";
+        case TRANSIT_SPIRAL: return "spiral";
+        default: return "unknown";
+    }
+}
+
+void TransitPlanner::plan(float fromX, float fromY, float fromTheta, float toX, float toY, Plan& plan)
+{
+    buildPlan(TRANSIT_STRAIGHT, fromX, fromY, fromTheta, toX, toY, plan);
+    if (!_isValid)
+        return;
+
+    // Choose the lowest cost (the straight line unless another is clearly better)
+    float straightTimeS = plan._timeS;
+    float straightLengthMM = plan._lengthMM;
+    float bestCost = (plan._timeS + _disturbSPerMM * plan._lengthMM) * (1 - MIN_IMPROVEMENT);
+    Plan candidate;
+    for (int typeIdx = TRANSIT_STRAIGHT + 1; typeIdx < TRANSIT_NUM_TYPES; typeIdx++)
+    {
+        buildPlan(TransitType(typeIdx), fromX, fromY, fromTheta, toX, toY, candidate);
+        float cost = candidate._timeS + _disturbSPerMM * candidate._lengthMM;
+        if (cost < bestCost)
+        {
+            bestCost = cost;
+            plan = candidate;
+        }
+    }
+    Log.verbose("%splan %s %Fs %Fmm (straight %Fs %Fmm)\n", MODULE_PREFIX, getTypeName(plan._type),
+                plan._timeS, plan._lengthMM, straightTimeS, straightLengthMM);
+}
+
+void TransitPlanner::buildPlan(TransitType type, float fromX, float fromY, float fromTheta, float toX, float toY,
+            Plan& plan)
+{
+    plan._type = type;
+    plan._timeS = 0;
+    plan._lengthMM = 0;
+    plan._numWaypoints = 0;
+
+    // Polar ends - theta is kept at the centre
+    float radiusMM = _limits._bedRadiusMM;
+    if (!isNearCentre(fromX, fromY))
+        fromTheta = atan2f(fromY, fromX);
+    float toTheta = isNearCentre(toX, toY) ? fromTheta : atan2f(toY, toX);
+    float fromRho = radiusMM > 0 ? sqrtf(fromX * fromX + fromY * fromY) / radiusMM : 0;
+    float toRho = radiusMM > 0 ? sqrtf(toX * toX + toY * toY) / radiusMM : 0;
+
+    // Intermediate waypoints
+    if (radiusMM > 0)
+    {
+        switch (type)
+        {
+            case TRANSIT_RHO_FIRST:
+                addPolarWaypoint(plan, fromTheta, toRho, true);
+                addArc(plan, fromTheta, toTheta, toRho);
+                break;
+            case TRANSIT_THETA_FIRST:
+                addArc(plan, fromTheta, toTheta, fromRho);
+                break;
+            case TRANSIT_SPIRAL:
+                addSpiral(plan, fromTheta, fromRho, toTheta, toRho);
+                break;
+            default:
+                break;
+        }
+    }
+
+    // Drop waypoints which don't move (the last is replaced by the exact end)
+    int numWaypoints = 0;
+    float prevX = fromX, prevY = fromY;
+    for (int wpIdx = 0; wpIdx < plan._numWaypoints; wpIdx++)
+    {
+        Waypoint& waypoint = plan._waypoints[wpIdx];
+        if ((fabsf(waypoint._x - prevX) < MIN_WAYPOINT_SEP_MM) && (fabsf(waypoint._y - prevY) < MIN_WAYPOINT_SEP_MM))
+            continue;
+        if ((fabsf(waypoint._x - toX) < MIN_WAYPOINT_SEP_MM) && (fabsf(waypoint._y - toY) < MIN_WAYPOINT_SEP_MM))
+            break;
+        plan._waypoints[numWaypoints++] = waypoint;
+        prevX = waypoint._x;
+        prevY = waypoint._y;
+    }
+    plan._waypoints[numWaypoints]._x = toX;
+    plan._waypoints[numWaypoints]._y = toY;
+    plan._waypoints[numWaypoints]._direct = type != TRANSIT_STRAIGHT;
+    plan._numWaypoints = numWaypoints + 1;
+
+    // Estimate
+    if (_isValid)
+        estimate(fromX, fromY, fromTheta, plan);
+}
+
+void TransitPlanner::addPolarWaypoint(Plan& plan, float theta, float rho, bool direct)
+{
+    // Space is left for the end
+    if (plan._numWaypoints >= MAX_WAYPOINTS - 1)
+        return;
+    Waypoint& waypoint = plan._waypoints[plan._numWaypoints++];
+    waypoint._x = rho * _limits._bedRadiusMM * cosf(theta);
+    waypoint._y = rho * _limits._bedRadiusMM * sinf(theta);
+    waypoint._direct = direct;
+}
+
+// Arc at constant rho (including its end) in blocks of up to MAX_BLOCK_ANGLE
+void TransitPlanner::addArc(Plan& plan, float fromTheta, float toTheta, float rho)
+{
+    float rotation = minRotation(toTheta - fromTheta);
+    if (rho * _limits._bedRadiusMM * fabsf(rotation) < MIN_ARC_MM)
+        return;
+    int numBlocks = int(ceilf(fabsf(rotation) / MAX_BLOCK_ANGLE));
+    for (int blockIdx = 1; blockIdx <= numBlocks; blockIdx++)
+        addPolarWaypoint(plan, fromTheta + rotation * blockIdx / numBlocks, rho, true);
+}
+
+// Spiral (linear in theta and rho) - the end isn't added
+void TransitPlanner::addSpiral(Plan& plan, float fromTheta, float fromRho, float toTheta, float toRho)
+{
+    float rotation = minRotation(toTheta - fromTheta);
+    int numBlocks = int(ceilf(fabsf(rotation) / MAX_BLOCK_ANGLE));
+    for (int blockIdx = 1; blockIdx < numBlocks; blockIdx++)
+    {
+        float frac = float(blockIdx) / numBlocks;
+        addPolarWaypoint(plan, fromTheta + rotation * frac, fromRho + (toRho - fromRho) * frac, true);
+    }
+}
+
+// Estimate the time as the motion planner would plan the blocks - speeds are limited by the
+// feedrate, junction deviation (between blocks) and acceleration (forward and backward passes
+// from rest at both ends) and then, as blocks are executed, by the actuator rates
+void TransitPlanner::estimate(float fromX, float fromY, float fromTheta, Plan& plan)
+{
+    float curTheta = fromTheta;
+    float curRho = sqrtf(fromX * fromX + fromY * fromY) / _limits._bedRadiusMM;
+
+    // Blocks - direct moves are a single block and straight lines are split
+    int numBlocks = 0;
+    float lengthMM = 0;
+    float prevX = fromX, prevY = fromY;
+    float prevUnitX = 0, prevUnitY = 0;
+    for (int wpIdx = 0; wpIdx < plan._numWaypoints; wpIdx++)
+    {
+        const Waypoint& waypoint = plan._waypoints[wpIdx];
+        if (waypoint._direct)
+        {
+            lengthMM += directBlockLength(prevX, prevY, waypoint._x, waypoint._y);
+            addEstBlock(numBlocks, prevX, prevY, waypoint._x, waypoint._y, curTheta, curRho, prevUnitX, prevUnitY);
+        }
+        else
+        {
+            float dx = waypoint._x - prevX;
+            float dy = waypoint._y - prevY;
+            float lineMM = sqrtf(dx * dx + dy * dy);
+            lengthMM += lineMM;
+            int numSplit = int(ceilf(lineMM / STRAIGHT_BLOCK_MM));
+            if (numSplit > MAX_STRAIGHT_BLOCKS)
+                numSplit = MAX_STRAIGHT_BLOCKS;
+            float blockX = prevX, blockY = prevY;
+            for (int splitIdx = 1; splitIdx <= numSplit; splitIdx++)
+            {
+                float nextX = prevX + dx * splitIdx / numSplit;
+                float nextY = prevY + dy * splitIdx / numSplit;
+                if (!addEstBlock(numBlocks, blockX, blockY, nextX, nextY, curTheta, curRho, prevUnitX, prevUnitY))
+                    break;
+                blockX = nextX;
+                blockY = nextY;
+            }
+        }
+        prevX = waypoint._x;
+        prevY = waypoint._y;
+    }
+    plan._lengthMM = lengthMM;
+
+    // Backward then forward passes on the entry speeds
+    float accMMps2 = _limits._maxAccMMps2;
+    float exitMMps = 0;
+    for (int blockIdx = numBlocks - 1; blockIdx >= 0; blockIdx--)
+    {
+        EstBlock& block = _estBlocks[blockIdx];
+        block._entryMaxMMps = fminf(block._entryMaxMMps, sqrtf(exitMMps * exitMMps + 2 * accMMps2 * block._lenMM));
+        exitMMps = block._entryMaxMMps;
+    }
+    float timeS = 0;
+    for (int blockIdx = 0; blockIdx < numBlocks; blockIdx++)
+    {
+        EstBlock& block = _estBlocks[blockIdx];
+        float entryMMps = block._entryMaxMMps;
+        float nextEntryMMps = blockIdx + 1 < numBlocks ? _estBlocks[blockIdx + 1]._entryMaxMMps : 0;
+        nextEntryMMps = fminf(nextEntryMMps, sqrtf(entryMMps * entryMMps + 2 * accMMps2 * block._lenMM));
+        if (blockIdx + 1 < numBlocks)
+            _estBlocks[blockIdx + 1]._entryMaxMMps = nextEntryMMps;
+        timeS += blockTime(block._lenMM, fminf(entryMMps, block._maxSpeedMMps), fminf(nextEntryMMps, block._maxSpeedMMps),
+                    block._maxSpeedMMps, accMMps2);
+    }
+    plan._timeS = timeS;
+}
+
+// Add a block to the estimate - the actuator moves are found as the kinematics would (shorter
+// way round and theta kept at the centre) - false if there is no space
+bool TransitPlanner::addEstBlock(int& numBlocks, float x0, float y0, float x1, float y1, float& curTheta,
+            float& curRho, float& prevUnitX, float& prevUnitY)
+{
+    if (numBlocks >= MAX_EST_BLOCKS)
+        return false;
+
+    // Blocks which don't move are ignored by the planner
+    float dx = x1 - x0;
+    float dy = y1 - y0;
+    float lenMM = sqrtf(dx * dx + dy * dy);
+    if (lenMM < MIN_WAYPOINT_SEP_MM)
+        return true;
+
+    // Actuator moves
+    float rotation = 0;
+    float newRho = 0;
+    if (!isNearCentre(x1, y1))
+    {
+        rotation = minRotation(atan2f(y1, x1) - curTheta);
+        newRho = sqrtf(x1 * x1 + y1 * y1) / _limits._bedRadiusMM;
+    }
+    float rotationDegs = fabsf(rotation) * float(180 / M_PI);
+    float rhoActuatorMM = fabsf((newRho - curRho) * _limits._bedRadiusMM +
+                rotation * float(180 / M_PI) * _limits._rhoMMPerDegTheta);
+    curTheta += rotation;
+    curRho = newRho;
+
+    // Cruise speed
+    float maxSpeedMMps = _limits._maxSpeedMMps;
+    if (rotationDegs > 0)
+        maxSpeedMMps = fminf(maxSpeedMMps, lenMM * _limits._thetaMaxDegps / rotationDegs);
+    if (rhoActuatorMM > 0)
+        maxSpeedMMps = fminf(maxSpeedMMps, lenMM * _limits._rhoMaxMMps / rhoActuatorMM);
+
+    // Junction speed (as the motion planner - from the feedrate as the actuator rates are only
+    // applied when the block is executed)
+    float unitX = dx / lenMM;
+    float unitY = dy / lenMM;
+    float entryMaxMMps = 0;
+    if (numBlocks > 0)
+    {
+        float cosTheta = -prevUnitX * unitX - prevUnitY * unitY;
+        if (cosTheta < 0.95f)
+        {
+            entryMaxMMps = _limits._maxSpeedMMps;
+            if (cosTheta > -0.95f)
+            {
+                float sinThetaD2 = sqrtf(0.5f * (1.0f - cosTheta));
+                entryMaxMMps = fminf(entryMaxMMps, sqrtf(_limits._maxAccMMps2 * JUNCTION_DEVIATION_MM * sinThetaD2 /
+                            (1.0f - sinThetaD2)));
+            }
+        }
+    }
+    prevUnitX = unitX;
+    prevUnitY = unitY;
+
+    EstBlock& block = _estBlocks[numBlocks++];
+    block._lenMM = lenMM;
+    block._maxSpeedMMps = maxSpeedMMps;
+    block._entryMaxMMps = entryMaxMMps;
+    return true;
+}
+
+// Length of a direct block (which follows the spiral between its ends)
+float TransitPlanner::directBlockLength(float x0, float y0, float x1, float y1)
+{
+    float radiusMM = _limits._bedRadiusMM;
+    float theta1 = atan2f(y1, x1);
+    float theta0 = isNearCentre(x0, y0) ? theta1 : atan2f(y0, x0);
+    float rotation = isNearCentre(x1, y1) ? 0 : minRotation(theta1 - theta0);
+    float rho0 = sqrtf(x0 * x0 + y0 * y0) / radiusMM;
+    float rho1 = sqrtf(x1 * x1 + y1 * y1) / radiusMM;
+    float lengthMM = 0;
+    float prevX = x0, prevY = y0;
+    for (int sampleIdx = 1; sampleIdx <= LENGTH_SAMPLES_PER_BLOCK; sampleIdx++)
+    {
+        float frac = float(sampleIdx) / LENGTH_SAMPLES_PER_BLOCK;
+        float rho = (rho0 + (rho1 - rho0) * frac) * radiusMM;
+        float x = rho * cosf(theta0 + rotation * frac);
+        float y = rho * sinf(theta0 + rotation * frac);
+        lengthMM += sqrtf((x - prevX) * (x - prevX) + (y - prevY) * (y - prevY));
+        prevX = x;
+        prevY = y;
+    }
+    return lengthMM;
+}
+
+// Time for a block with a trapezoidal (or triangular) speed profile
+float TransitPlanner::blockTime(float lenMM, float entryMMps, float exitMMps, float maxMMps, float accMMps2)
+{
+    float accelDistMM = (maxMMps * maxMMps - entryMMps * entryMMps) / (2 * accMMps2);
+    float decelDistMM = (maxMMps * maxMMps - exitMMps * exitMMps) / (2 * accMMps2);
+    if (accelDistMM + decelDistMM <= lenMM)
+        return (maxMMps - entryMMps) / accMMps2 + (maxMMps - exitMMps) / accMMps2 +
+                    (lenMM - accelDistMM - decelDistMM) / maxMMps;
+    float peakMMps = sqrtf((2 * accMMps2 * lenMM + entryMMps * entryMMps + exitMMps * exitMMps) / 2);
+    peakMMps = fmaxf(peakMMps, fmaxf(entryMMps, exitMMps));
+    return (peakMMps - entryMMps) / accMMps2 + (peakMMps - exitMMps) / accMMps2;
+}
+
+// Rotation in the range -pi < rotation <= pi (the shorter way round)
+float TransitPlanner::minRotation(float angle)
+{
+    angle = remainderf(angle, float(2 * M_PI));
+    if (angle <= -float(M_PI))
+        angle += float(2 * M_PI);
+    return angle;
+}
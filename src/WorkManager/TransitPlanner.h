@@ -0,0 +1,130 @@
+// RBotFirmware
+// Rob Dobson 2016-2018
+
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+
+// Transit planner - plans the move from where the ball is to the start of a pattern on a polar
+// (rotary) table - the candidates are a straight line (split into short blocks by the motion
+// helper), rho-first (radial move then an arc), theta-first (arc then radial move) and a spiral
+// (linear in theta and rho) - arcs, radial moves and spirals are emitted as a few direct
+// (unsplit) blocks which are linear in actuator space so follow the polar path
+// Each candidate is timed as the motion planner would plan it - the feedrate and acceleration
+// are along the straight line between block ends, the speed of each block is limited so that
+// neither actuator exceeds its max rate and the speed at junctions is limited by the junction
+// deviation - the cost of a candidate is its time plus an optional weight per mm it travels
+// (the ball erases the drawing it passes over)
+class TransitPlanner
+{
+public:
+    enum TransitType
+    {
+        TRANSIT_STRAIGHT,
+        TRANSIT_RHO_FIRST,
+        TRANSIT_THETA_FIRST,
+        TRANSIT_SPIRAL,
+        TRANSIT_NUM_TYPES
+    };
+
+    static constexpr int MAX_WAYPOINTS = 12;
+    // Max rotation of a direct block (the robot takes the shorter way round to a point)
+    static constexpr float MAX_BLOCK_ANGLE = float(M_PI / 4);
+    // Arcs shorter than this are left to the radial move
+    static constexpr float MIN_ARC_MM = 1.0f;
+    // Points this close to the centre (on both axes) keep the current theta (as the kinematics)
+    static constexpr float NEAR_CENTRE_MM = 1.0f;
+    // Straight lines are estimated in blocks of this length (up to a max number of blocks)
+    static constexpr float STRAIGHT_BLOCK_MM = 1.0f;
+    static constexpr int MAX_STRAIGHT_BLOCKS = 96;
+    static constexpr int MAX_EST_BLOCKS = MAX_STRAIGHT_BLOCKS + MAX_WAYPOINTS;
+    // Samples of each direct block used for its length
+    static constexpr int LENGTH_SAMPLES_PER_BLOCK = 8;
+    // Other candidates replace the straight line only if they reduce its cost by this fraction
+    // (estimates are within a few percent of the motion planner)
+    static constexpr float MIN_IMPROVEMENT = 0.03f;
+    // Motion planner junction deviation (default)
+    static constexpr float JUNCTION_DEVIATION_MM = 0.05f;
+
+    // Limits (from the robot attributes) - the feedrate and acceleration are along the line
+    // between block ends and the rho actuator moves as theta rotates (as well as for rho)
+    struct Limits
+    {
+        float _bedRadiusMM;
+        float _maxSpeedMMps;
+        float _maxAccMMps2;
+        float _thetaMaxDegps;
+        float _rhoMaxMMps;
+        float _rhoMMPerDegTheta;
+    };
+
+    // Point (mm from the centre) - direct if the move to it isn't split
+    struct Waypoint
+    {
+        float _x;
+        float _y;
+        bool _direct;
+    };
+
+    struct Plan
+    {
+        TransitType _type;
+        float _timeS;
+        float _lengthMM;
+        int _numWaypoints;
+        Waypoint _waypoints[MAX_WAYPOINTS];
+    };
+
+private:
+    Limits _limits;
+    float _disturbSPerMM;
+    bool _isValid;
+
+    // Blocks of the candidate being estimated
+    struct EstBlock
+    {
+        float _lenMM;
+        float _maxSpeedMMps;
+        float _entryMaxMMps;
+    };
+    EstBlock _estBlocks[MAX_EST_BLOCKS];
+
+public:
+    TransitPlanner();
+
+    // Set limits - disturbSPerMM is the time (secs) a candidate's cost is increased by for each
+    // mm it travels - false if the limits aren't usable
+    bool setLimits(const Limits& limits, float disturbSPerMM);
+    bool isValid() const
+    {
+        return _isValid;
+    }
+
+    // Plan a transit between points (mm from the centre) - fromTheta (radians) is the angle of
+    // the rotary axis which is kept when at the centre - the lowest cost candidate is chosen (a
+    // straight line if the limits aren't valid)
+    void plan(float fromX, float fromY, float fromTheta, float toX, float toY, Plan& plan);
+
+    // Build and estimate a single candidate
+    void buildPlan(TransitType type, float fromX, float fromY, float fromTheta, float toX, float toY,
+                Plan& plan);
+
+    static const char* getTypeName(TransitType type);
+
+    static bool isNearCentre(float x, float y)
+    {
+        return (fabsf(x) < NEAR_CENTRE_MM) && (fabsf(y) < NEAR_CENTRE_MM);
+    }
+
+private:
+    void addPolarWaypoint(Plan& plan, float theta, float rho, bool direct);
+    void addArc(Plan& plan, float fromTheta, float toTheta, float rho);
+    void addSpiral(Plan& plan, float fromTheta, float fromRho, float toTheta, float toRho);
+    void estimate(float fromX, float fromY, float fromTheta, Plan& plan);
+    bool addEstBlock(int& numBlocks, float x0, float y0, float x1, float y1, float& curTheta,
+                float& curRho, float& prevUnitX, float& prevUnitY);
+    float directBlockLength(float x0, float y0, float x1, float y1);
+    static float blockTime(float lenMM, float entryMMps, float exitMMps, float maxMMps, float accMMps2);
+    static float minRotation(float angle);
+};
@@ -3,34 +3,182 @@
 
 #pragma once
 
+#include <Arduino.h>
+
+// Work item - a command string with a type tag
+// Strings up to INLINE_STR_MAXLEN are held in the item itself so that items in the work
+// queue (which are preallocated) can be set and moved without heap allocation - longer
+// strings (rare - e.g. lists of startup commands) are held on the heap
 class WorkItem
 {
+public:
+    enum WorkItemType : uint8_t
+    {
+        TYPE_UNKNOWN,
+        TYPE_GCODE,
+        TYPE_POLAR_MOVE,
+        TYPE_FILE,
+        TYPE_SEQUENCE,
+        TYPE_CONTROL
+    };
+    static constexpr unsigned int INLINE_STR_MAXLEN = 95;
+
 private:
-    String _str;
+    char _inlineStr[INLINE_STR_MAXLEN + 1];
+    char* _pHeapStr;
+    // Length of string the heap string can hold
+    unsigned int _heapStrMaxLen;
+    unsigned int _strLen;
+    WorkItemType _type;
 
 public:
     WorkItem()
     {
-        _str = "";
+        _inlineStr[0] = 0;
+        _pHeapStr = NULL;
+        _heapStrMaxLen = 0;
+        _strLen = 0;
+        _type = TYPE_UNKNOWN;
+    }
+
+    WorkItem(const char* pCmdStr) : WorkItem()
+    {
+        set(pCmdStr, strlen(pCmdStr));
+    }
+
+    WorkItem(const String& cmdStr) : WorkItem()
+    {
+        set(cmdStr.c_str(), cmdStr.length());
+    }
+
+    WorkItem(const WorkItem& other) : WorkItem()
+    {
+        set(other.getCString(), other._strLen, other._type);
+    }
+
+    WorkItem(WorkItem&& other) : WorkItem()
+    {
+        moveFrom(other);
+    }
+
+    ~WorkItem()
+    {
+        delete[] _pHeapStr;
+    }
+
+    WorkItem& operator=(const WorkItem& other)
+    {
+        if (this != &other)
+            set(other.getCString(), other._strLen, other._type);
+        return *this;
     }
 
-    WorkItem(const char* pCmdStr)
+    WorkItem& operator=(WorkItem&& other)
     {
-        _str = pCmdStr;
+        if (this != &other)
+            moveFrom(other);
+        return *this;
     }
 
-    WorkItem(const String& cmdStr)
+    // Set in place - the type is found from the string if not specified
+    void set(const char* pStr, unsigned int strLen, WorkItemType type = TYPE_UNKNOWN)
     {
-        _str = cmdStr;
+        char* pDest = _inlineStr;
+        if (strLen > INLINE_STR_MAXLEN)
+        {
+            // Reuse any heap string which is long enough
+            if (!_pHeapStr || (_heapStrMaxLen < strLen))
+            {
+                delete[] _pHeapStr;
+                _pHeapStr = new char[strLen + 1];
+                _heapStrMaxLen = strLen;
+            }
+            pDest = _pHeapStr;
+        }
+        else
+        {
+            delete[] _pHeapStr;
+            _pHeapStr = NULL;
+            _heapStrMaxLen = 0;
+        }
+        memcpy(pDest, pStr, strLen);
+        pDest[strLen] = 0;
+        _strLen = strLen;
+        _type = (type == TYPE_UNKNOWN) ? getTypeFromStr(pDest) : type;
     }
 
-    const char* getCString()
+    void clear()
     {
-        return _str.c_str();
+        delete[] _pHeapStr;
+        _pHeapStr = NULL;
+        _heapStrMaxLen = 0;
+        _inlineStr[0] = 0;
+        _strLen = 0;
+        _type = TYPE_UNKNOWN;
     }
 
-    const String& getString()
+    const char* getCString() const
+    {
+        return _pHeapStr ? _pHeapStr : _inlineStr;
+    }
+
+    String getString() const
+    {
+        return String(getCString());
+    }
+
+    unsigned int length() const
+    {
+        return _strLen;
+    }
+
+    WorkItemType getType() const
+    {
+        return _type;
+    }
+
+    void setType(WorkItemType type)
+    {
+        _type = type;
+    }
+
+    // Check if the string (ignoring leading whitespace) starts with a prefix
+    bool startsWith(const char* pPrefix) const
+    {
+        const char* pStr = getCString();
+        while (isspace((unsigned char)*pStr))
+            pStr++;
+        return strncmp(pStr, pPrefix, strlen(pPrefix)) == 0;
+    }
+
+    // Type of commands which can be identified from the string alone (files and sequences
+    // need the file system so are left as unknown)
+    static WorkItemType getTypeFromStr(const char* pStr)
+    {
+        while (isspace((unsigned char)*pStr))
+            pStr++;
+        if (strncmp(pStr, "_THRLINE", 8) == 0)
+            return TYPE_POLAR_MOVE;
+        int firstCh = toupper((unsigned char)pStr[0]);
+        if (((firstCh == 'G') || (firstCh == 'M')) && isdigit((unsigned char)pStr[1]))
+            return TYPE_GCODE;
+        return TYPE_UNKNOWN;
+    }
+
+private:
+    void moveFrom(WorkItem& other)
     {
-        return _str;
+        delete[] _pHeapStr;
+        _pHeapStr = other._pHeapStr;
+        _heapStrMaxLen = other._heapStrMaxLen;
+        if (!_pHeapStr)
+            memcpy(_inlineStr, other._inlineStr, other._strLen + 1);
+        _strLen = other._strLen;
+        _type = other._type;
+        other._pHeapStr = NULL;
+        other._heapStrMaxLen = 0;
+        other._inlineStr[0] = 0;
+        other._strLen = 0;
+        other._type = TYPE_UNKNOWN;
     }
 };
@@ -4,20 +4,28 @@
 #pragma once
 
 #include "WorkItem.h"
-#include <queue>
+#include <vector>
 #include "RdJson.h"
+#include "RobotMotion/MotionControl/MotionRingBuffer.h"
 
+// Work item queue - a ring of preallocated items which are set in place when added and
+// moved out when got so no allocation is needed per item
 class WorkItemQueue
 {
 private:
-    std::queue<WorkItem> _workItemQueue;
+    // The ring keeps one slot free so has one more slot than the max length
+    std::vector<WorkItem> _workItems;
+    MotionRingBufferPosn _workItemPosn;
     unsigned int _workItemQueueMaxLen;
     static const unsigned int _workItemQueueMaxLenDefault = 50;
+    // Count of items removed (got or cleared) - wraps
+    uint32_t _numRemoved;
 
 public:
-    WorkItemQueue()
+    WorkItemQueue() : _workItemPosn(0)
     {
-        _workItemQueueMaxLen = _workItemQueueMaxLenDefault;
+        _numRemoved = 0;
+        setMaxLen(_workItemQueueMaxLenDefault);
     }
 
     ~WorkItemQueue()
@@ -30,96 +38,126 @@ public:
         String queueCfg = RdJson::getString(queueName, "{}", configStr);
 
 //        Log.notice("Configuring WorkItemQueue from %s\n", configStr);
-        _workItemQueueMaxLen = (int) RdJson::getLong("maxLen",
-                                            _workItemQueueMaxLenDefault, queueCfg.c_str());
-        clear();
+        setMaxLen((int) RdJson::getLong("maxLen", _workItemQueueMaxLenDefault, queueCfg.c_str()));
 //        Log.notice("MaxLen %d\n", _workItemQueueMaxLen);
     }
 
     // Check if queue full
     bool isFull()
     {
-        return (_workItemQueue.size() >= _workItemQueueMaxLen);
+        return !_workItemPosn.canPut();
     }
 
     // Check if queue empty
     bool isEmpty()
     {
-        return (_workItemQueue.size() == 0);
+        return !_workItemPosn.canGet();
     }
 
     // Clear the queue
     void clear()
     {
-        // Log.notice("Clearing Command Queue size %d max %d\n", _workItemQueue.size(), _workItemQueueMaxLen);
-        while(!_workItemQueue.empty()) 
-            _workItemQueue.pop();
-        // Log.notice("Cleared Command Queue size %d max %d\n", _workItemQueue.size(), _workItemQueueMaxLen);
+        // Log.notice("Clearing Command Queue size %d max %d\n", size(), _workItemQueueMaxLen);
+        while (_workItemPosn.canGet())
+        {
+            _workItems[_workItemPosn._getPos].clear();
+            _workItemPosn.hasGot();
+            _numRemoved++;
+        }
+        _workItemPosn.clear();
     }
 
-    // Add to queue
-    bool add(const char* pWorkItemStr)
+    // Add to queue (set in place from a string which need not be terminated) - returns the
+    // queued item (so that it can be classified in place) or NULL if the queue is full
+    WorkItem* add(const char* pWorkItemStr, unsigned int strLen, WorkItem::WorkItemType type = WorkItem::TYPE_UNKNOWN)
     {
         // Check if queue is full
-        if (_workItemQueue.size() >= _workItemQueueMaxLen)
+        if (!_workItemPosn.canPut())
         {
-        //    Log.notice("Command Queue FULL size %d max %d\n", _workItemQueue.size(), _workItemQueueMaxLen);
-            return false;
+        //    Log.notice("Command Queue FULL size %d max %d\n", size(), _workItemQueueMaxLen);
+            return NULL;
         }
 
         // Queue up the item
-        _workItemQueue.push(WorkItem(pWorkItemStr));
-        return true;
+        WorkItem* pWorkItem = &_workItems[_workItemPosn._putPos];
+        pWorkItem->set(pWorkItemStr, strLen, type);
+        _workItemPosn.hasPut();
+        return pWorkItem;
     }
 
-    // Peek the queue
-    bool peek(WorkItem& workItem)
+    // Add to queue (moved in)
+    bool add(WorkItem&& workItem)
     {
-        // Check if queue is empty
-        if (_workItemQueue.empty())
-        {
+        if (!_workItemPosn.canPut())
             return false;
-        }
-
-        // read the item
-        workItem = _workItemQueue.front();
+        _workItems[_workItemPosn._putPos] = std::move(workItem);
+        _workItemPosn.hasPut();
         return true;
     }
 
-    // Get from queue
-    bool get(WorkItem& workItem)
+    // Peek the queue - the item remains valid until got or the queue is cleared
+    WorkItem* peek()
     {
         // Check if queue is empty
-        if (_workItemQueue.empty())
+        if (!_workItemPosn.canGet())
         {
-            return false;
+            return NULL;
         }
-
-        // read the item and remove
-        workItem = _workItemQueue.front();
-        _workItemQueue.pop();
-        return true;
+        return &_workItems[_workItemPosn._getPos];
     }
 
-    // Get from queue
-    bool get(String& workItemStr)
+    // Get from queue (moved out)
+    bool get(WorkItem& workItem)
     {
         // Check if queue is empty
-        if (_workItemQueue.empty())
+        if (!_workItemPosn.canGet())
         {
             return false;
         }
 
         // read the item and remove
-        workItemStr = _workItemQueue.front().getString();
-        _workItemQueue.pop();
+        workItem = std::move(_workItems[_workItemPosn._getPos]);
+        _workItemPosn.hasGot();
+        _numRemoved++;
         return true;
     }
 
     // Get size
     int size()
     {
-        return _workItemQueue.size();
+        return _workItemPosn.count();
     }
 
+    int maxLen()
+    {
+        return _workItemQueueMaxLen;
+    }
+
+    int freeSlots()
+    {
+        return _workItemQueueMaxLen - size();
+    }
+
+    // Items removed since start - an item added when this plus the size is N has been
+    // removed once this reaches N
+    uint32_t getNumRemoved()
+    {
+        return _numRemoved;
+    }
+
+private:
+    void setMaxLen(unsigned int maxLen)
+    {
+        clear();
+        if (maxLen == 0)
+            maxLen = _workItemQueueMaxLenDefault;
+        _workItemQueueMaxLen = maxLen;
+        if (_workItems.size() != maxLen + 1)
+        {
+            _workItems.clear();
+            _workItems.resize(maxLen + 1);
+            _workItems.shrink_to_fit();
+        }
+        _workItemPosn.init(maxLen + 1);
+    }
 };
@@ -21,8 +21,11 @@ WorkManager::WorkManager(ConfigBase &mainConfig, ConfigBase &robotConfig, RobotC
       _restAPISystem(restAPISystem),
       _fileManager(fileManager),
       _evaluatorSequences(fileManager, *this),
-      _evaluatorFiles(fileManager, *this),
-      _evaluatorThetaRhoLine(*this) {
+      _evaluatorFiles(fileManager, *this, _evaluatorThetaRhoLine),
+      _evaluatorThetaRhoLine(*this),
+      _patternEstimator(fileManager, _evaluatorThetaRhoLine) {
+    _patternStartMs = 0;
+    _serviceTask.store(NULL, std::memory_order_relaxed);
     _statusReportLastCheck = 0;
     _statusLastHashVal = 0;
 #ifdef DEBUG_WORK_ITEM_SERVICE
@@ -44,6 +47,9 @@ void WorkManager::queryStatus(String &respStr) {
     String healthStrRobot = cmdArgs.toJSON(false);
     if ((innerJsonStr.length() > 0) && (healthStrRobot.length() > 0)) innerJsonStr += ",";
     innerJsonStr += healthStrRobot;
+    // Motion stats for the current pattern
+    innerJsonStr += ",\"motionStats\":" + _robotController.getMotionStats();
+    innerJsonStr += ",\"plannerStats\":" + _robotController.getPlannerStats();
 
     // Time of Day
     String timeJsonStr;
@@ -79,16 +85,33 @@ void WorkManager::queryStatus(String &respStr) {
         innerJsonStr += ",\"file\": \"";
         innerJsonStr += _evaluatorFiles.fileName();
 
-        if (_evaluatorThetaRhoLine.isBusy()) {
-            innerJsonStr += "\",\"filePos\": ";
-            innerJsonStr += String((_evaluatorFiles.getCurrentFilePosition()) - ((1 - _evaluatorThetaRhoLine.getLineProgress()) * _evaluatorFiles.getCurrentLineLength()));
-        } else {
-            innerJsonStr += "\",\"filePos\": ";
-            innerJsonStr += String(_evaluatorFiles.getCurrentFilePosition());
-        }
+        int filePos = _evaluatorFiles.getMotionFilePosition(_robotController.getLastCompletedNumberedCmdIdx());
+        innerJsonStr += "\",\"filePos\": ";
+        innerJsonStr += String(filePos);
 
         innerJsonStr += ",\"fileLen\": ";
         innerJsonStr += String(_evaluatorFiles.getTotalFileLength());
+
+        // Duration estimate (once made), elapsed and remaining times and ETA
+        innerJsonStr += ",\"elapsedS\": ";
+        innerJsonStr += String((millis() - _patternStartMs) / 1000);
+        float durationS = 0, remainingS = 0;
+        if (_patternEstimator.getEstimate(filePos, durationS, remainingS)) {
+            innerJsonStr += ",\"durationS\": ";
+            innerJsonStr += String(int(durationS));
+            innerJsonStr += ",\"remainingS\": ";
+            innerJsonStr += String(int(remainingS));
+            time_t etaTime = 0;
+            time(&etaTime);
+            etaTime += time_t(remainingS);
+            struct tm etaInfo;
+            if (getLocalTime(&timeinfo, 0) && localtime_r(&etaTime, &etaInfo)) {
+                strftime(localTimeString, MAX_LOCAL_TIME_STR_LEN, "%H:%M:%S", &etaInfo);
+                innerJsonStr += ",\"eta\": \"";
+                innerJsonStr += localTimeString;
+                innerJsonStr += "\"";
+            }
+        }
     }
 
     // System information
@@ -99,6 +122,10 @@ bool WorkManager::canAcceptWorkItem() { return !_workItemQueue.isFull(); }
 
 bool WorkManager::queueIsEmpty() { return _workItemQueue.isEmpty(); }
 
+int WorkManager::queueSize() { return _workItemQueue.size(); }
+
+uint32_t WorkManager::queueNumRemoved() { return _workItemQueue.getNumRemoved(); }
+
 void WorkManager::getRobotConfig(String &respStr) { respStr = _robotConfig.getConfigString(); }
 
 void WorkManager::getLedStripConfig(String &respStr) { respStr = _ledStrip.getCurrentConfigStr(); }
@@ -130,73 +157,93 @@ bool WorkManager::setRobotConfig(const uint8_t *pData, int len) {
     return true;
 }
 
-void WorkManager::processSingle(const char *pCmdStr, String &retStr) {
+void WorkManager::processSingle(const char *pCmdStr, unsigned int cmdLen, String &retStr) {
     const char *okRslt = "{\"rslt\":\"ok\"}";
     retStr = "{\"rslt\":\"none\"}";
 
     // Check if this is an immediate command
-    if (strcasecmp(pCmdStr, "pause") == 0) {
+    const char *pArg = NULL;
+    unsigned int argLen = 0;
+    if (isCmd(pCmdStr, cmdLen, "pause")) {
         _robotController.pause(true);
         retStr = okRslt;
-    } else if (strcasecmp(pCmdStr, "sleep") == 0) {
+    } else if (isCmd(pCmdStr, cmdLen, "sleep")) {
         _robotController.pause(true);
         _ledStrip.setSleepMode(true);
         retStr = okRslt;
-    } else if (strcasecmp(pCmdStr, "resume") == 0) {
+    } else if (isCmd(pCmdStr, cmdLen, "resume")) {
         _robotController.pause(false);
         _ledStrip.setSleepMode(false);
         retStr = okRslt;
-    } else if (strcasecmp(pCmdStr, "playpause") == 0) {
+    } else if (isCmd(pCmdStr, cmdLen, "playpause")) {
         // Toggle pause state
         _robotController.pause(!_robotController.isPaused());
         retStr = okRslt;
-    } else if (strcasecmp(pCmdStr, "stop") == 0) {
+    } else if (isCmd(pCmdStr, cmdLen, "stop")) {
         _robotController.stop();
         _workItemQueue.clear();
         evaluatorsStop();
         retStr = okRslt;
-    } else if (strcasecmp(pCmdStr, "seq_next") == 0) {
+    } else if (isCmd(pCmdStr, cmdLen, "steptrace_start")) {
+        retStr = _robotController.stepTraceStart(_fileManager) ? okRslt : "{\"rslt\":\"fail\"}";
+    } else if (isCmd(pCmdStr, cmdLen, "steptrace_stop")) {
+        _robotController.stepTraceStop();
+        retStr = okRslt;
+    } else if (isCmd(pCmdStr, cmdLen, "steptrace_status")) {
+        retStr = "{\"rslt\":\"ok\",\"stepTrace\":" + _robotController.getStepTraceStatus() + "}";
+    } else if (isCmdWithArg(pCmdStr, cmdLen, "motion_isrstats", pArg, argLen)) {
+        // motion_isrstats/reset returns the stats then clears them
+        bool reset = (argLen == 5) && (strncasecmp(pArg, "reset", argLen) == 0);
+        retStr = "{\"rslt\":\"ok\",\"isrStats\":" + _robotController.getIsrStats(reset) + "}";
+    } else if (isCmdWithArg(pCmdStr, cmdLen, "motion_pipeline", pArg, argLen)) {
+        // Taken here as the planner changes blocks in place in this task - motion_pipeline/N
+        // limits the snapshot to the first N blocks
+        unsigned int maxBlocks = (argLen != 0) ? strtoul(pArg, NULL, 10) : PIPELINE_SNAPSHOT_MAX_BLOCKS;
+        retStr = "{\"rslt\":\"ok\",\"pipeline\":" + _robotController.getPipelineSnapshot(maxBlocks) + "}";
+    } else if (isCmd(pCmdStr, cmdLen, "seq_next")) {
         if (_evaluatorSequences.isBusy()) {
+            _evaluatorSequences.loadNext();
             _robotController.stop();
             _evaluatorThetaRhoLine.stop();
             _evaluatorFiles.stop();
             _workItemQueue.clear();
             retStr = okRslt;
         }
-    } else if (strcasecmp(pCmdStr, "seq_prev") == 0) {
+    } else if (isCmd(pCmdStr, cmdLen, "seq_prev")) {
         if (_evaluatorSequences.isBusy()) {
+            _evaluatorSequences.loadPrevious();
             _robotController.stop();
             _evaluatorThetaRhoLine.stop();
             _evaluatorFiles.stop();
             _workItemQueue.clear();
-            _evaluatorSequences.loadPrevious();
             retStr = okRslt;
         }
-    } else if (strcasecmp(pCmdStr, "seq_shuffle_on") == 0) {
+    } else if (isCmd(pCmdStr, cmdLen, "seq_shuffle_on")) {
         if (_evaluatorSequences.isBusy()) {
             _evaluatorSequences.setShuffle(true);
             retStr = okRslt;
         }
-    } else if (strcasecmp(pCmdStr, "seq_shuffle_off") == 0) {
+    } else if (isCmd(pCmdStr, cmdLen, "seq_shuffle_off")) {
         if (_evaluatorSequences.isBusy()) {
             _evaluatorSequences.setShuffle(false);
             retStr = okRslt;
         }
-    } else if (strcasecmp(pCmdStr, "seq_repeat_on") == 0) {
+    } else if (isCmd(pCmdStr, cmdLen, "seq_repeat_on")) {
         if (_evaluatorSequences.isBusy()) {
             _evaluatorSequences.setRepeatMode(true);
             retStr = okRslt;
         }
-    } else if (strcasecmp(pCmdStr, "seq_repeat_off") == 0) {
+    } else if (isCmd(pCmdStr, cmdLen, "seq_repeat_off")) {
         if (_evaluatorSequences.isBusy()) {
             _evaluatorSequences.setRepeatMode(false);
             retStr = okRslt;
         }
     } else {
-        // Send the line to the workflow manager
-        if (strlen(pCmdStr) != 0) {
-            bool rslt = _workItemQueue.add(pCmdStr);
-            if (!rslt) {
+        // Send the line to the workflow manager (set in place in the queue)
+        if (cmdLen != 0) {
+            WorkItem *pWorkItem = _workItemQueue.add(pCmdStr, cmdLen);
+            if (pWorkItem) classifyWorkItem(*pWorkItem);
+            if (!pWorkItem) {
                 retStr = "{\"rslt\":\"busy\"}";
                 Log.verbose("%sprocessSingle failed to add\n", MODULE_PREFIX);
             } else {
@@ -207,93 +254,229 @@ void WorkManager::processSingle(const char *pCmdStr, String &retStr) {
     // Log.verbose("%sprocSingle rslt %s\n", MODULE_PREFIX, retStr.c_str());
 }
 
-void WorkManager::addWorkItem(WorkItem &workItem, String &retStr, int cmdIdx) {
-    // Handle the case of a single string
-    if (strstr(workItem.getCString(), ";") == NULL) {
-        return processSingle(workItem.getCString(), retStr);
+void WorkManager::postCommand(const char *pCmdStr, String &retStr) {
+    // Waiting on the service task would deadlock (e.g. the command scheduler runs in the same
+    // loop) so commands from it are handled in place once the ingress has been drained
+    if (xTaskGetCurrentTaskHandle() == _serviceTask.load(std::memory_order_relaxed)) {
+        ingressService();
+        if (!_commandIngress.peek()) {
+            addCommand(pCmdStr, strlen(pCmdStr), retStr, -1);
+            return;
+        }
+        retStr = _commandIngress.post(pCmdStr) ? "{\"rslt\":\"pending\"}" : "{\"rslt\":\"busy\"}";
+        return;
+    }
+    uint32_t ticket = 0;
+    if (!_commandIngress.post(pCmdStr, &ticket)) {
+        retStr = "{\"rslt\":\"busy\"}";
+        return;
+    }
+    if (!_commandIngress.waitResult(ticket, retStr, INGRESS_RSLT_TIMEOUT_MS)) retStr = "{\"rslt\":\"pending\"}";
+}
+
+// Commands handled immediately by processSingle (not queued)
+bool WorkManager::isImmediateCmd(const char *pCmdStr, unsigned int cmdLen) {
+    static const char *IMMEDIATE_CMDS[] = {"pause", "sleep", "resume", "playpause", "stop", "steptrace_start", "steptrace_stop",
+                                           "steptrace_status", "seq_next", "seq_prev", "seq_shuffle_on", "seq_shuffle_off",
+                                           "seq_repeat_on", "seq_repeat_off"};
+    for (const char *pImmCmd : IMMEDIATE_CMDS) {
+        if (isCmd(pCmdStr, cmdLen, pImmCmd)) return true;
     }
+    const char *pArg = NULL;
+    unsigned int argLen = 0;
+    return isCmdWithArg(pCmdStr, cmdLen, "motion_isrstats", pArg, argLen) ||
+           isCmdWithArg(pCmdStr, cmdLen, "motion_pipeline", pArg, argLen);
+}
 
-    // Handle multiple commands (semicolon delimited)
-    const int MAX_TEMP_CMD_STR_LEN = 1000;
-    const char *pCurStr = workItem.getCString();
-    const char *pCurStrEnd = pCurStr;
-    int curCmdIdx = 0;
-    while (true) {
-        // Find line end
-        if ((*pCurStrEnd == ';') || (*pCurStrEnd == '\0')) {
-            // Extract the line
-            int stLen = pCurStrEnd - pCurStr;
-            if ((stLen == 0) || (stLen > MAX_TEMP_CMD_STR_LEN)) break;
-
-            // Alloc
-            char *pCurCmd = new char[stLen + 1];
-            if (!pCurCmd) break;
-            for (int i = 0; i < stLen; i++) pCurCmd[i] = *pCurStr++;
-            pCurCmd[stLen] = 0;
-
-            // process
-            if (cmdIdx == -1 || cmdIdx == curCmdIdx) {
-                processSingle(pCurCmd, retStr);
-            }
-            delete[] pCurCmd;
+bool WorkManager::isCmd(const char *pCmdStr, unsigned int cmdLen, const char *pName) {
+    return (strlen(pName) == cmdLen) && (strncasecmp(pCmdStr, pName, cmdLen) == 0);
+}
 
-            // Move on
-            curCmdIdx++;
-            if (*pCurStrEnd == '\0') break;
-            pCurStr = pCurStrEnd + 1;
+bool WorkManager::isCmdWithArg(const char *pCmdStr, unsigned int cmdLen, const char *pName, const char *&pArg,
+                               unsigned int &argLen) {
+    unsigned int nameLen = strlen(pName);
+    if ((cmdLen < nameLen) || (strncasecmp(pCmdStr, pName, nameLen) != 0)) return false;
+    if ((cmdLen > nameLen) && (pCmdStr[nameLen] != '/')) return false;
+    pArg = (cmdLen > nameLen) ? pCmdStr + nameLen + 1 : pCmdStr + cmdLen;
+    argLen = cmdLen - (pArg - pCmdStr);
+    return true;
+}
+
+bool WorkManager::nextCmdPiece(const char *&pPos, const char *pEnd, const char *&pPiece, unsigned int &pieceLen) {
+    while (pPos < pEnd) {
+        // Find the end of the piece and move past it
+        const char *pPieceEnd = (const char *)memchr(pPos, ';', pEnd - pPos);
+        if (!pPieceEnd) pPieceEnd = pEnd;
+        pPiece = pPos;
+        pPos = (pPieceEnd < pEnd) ? pPieceEnd + 1 : pEnd;
+
+        // Trim - empty pieces are skipped
+        while ((pPiece < pPieceEnd) && isspace((unsigned char)*pPiece)) pPiece++;
+        while ((pPieceEnd > pPiece) && isspace((unsigned char)*(pPieceEnd - 1))) pPieceEnd--;
+        pieceLen = pPieceEnd - pPiece;
+        if (pieceLen != 0) return true;
+    }
+    return false;
+}
+
+int WorkManager::queueSlotsNeeded(const char *pCmdStr, unsigned int cmdLen, int cmdIdx, bool &clearsQueue) {
+    clearsQueue = false;
+    int slotsNeeded = 0;
+    const char *pPos = pCmdStr;
+    const char *pPiece = NULL;
+    unsigned int pieceLen = 0;
+    for (int pieceIdx = 0; nextCmdPiece(pPos, pCmdStr + cmdLen, pPiece, pieceLen); pieceIdx++) {
+        if ((cmdIdx != -1) && (pieceIdx != cmdIdx)) continue;
+        if (isCmd(pPiece, pieceLen, "stop")) {
+            clearsQueue = true;
+            slotsNeeded = 0;
+        } else if (!isImmediateCmd(pPiece, pieceLen)) {
+            slotsNeeded++;
         }
-        pCurStrEnd++;
     }
+    return slotsNeeded;
 }
 
-bool WorkManager::canBeProcessed(WorkItem &workItem) {
-    // See if it is a theta-rho evaluator work item
-    if (_evaluatorThetaRhoLine.isValid(workItem)) return !_evaluatorThetaRhoLine.isBusy();
+bool WorkManager::hasQueueSpaceFor(const char *pCmdStr, unsigned int cmdLen, int cmdIdx) {
+    bool clearsQueue = false;
+    int slotsNeeded = queueSlotsNeeded(pCmdStr, cmdLen, cmdIdx, clearsQueue);
+    return slotsNeeded <= (clearsQueue ? _workItemQueue.maxLen() : _workItemQueue.freeSlots());
+}
 
-    // See if it is a file to process
-    if (_evaluatorFiles.isValid(workItem)) return !_evaluatorFiles.isBusy();
+void WorkManager::ingressService() {
+    // Drain in order - commands are processed in place in the ingress and are held until all of
+    // their pieces can be queued (unless they could never fit) but immediate commands (such as
+    // stop) need no space so are never held up behind them
+    const char *pCmdStr = NULL;
+    while ((pCmdStr = _commandIngress.peek()) != NULL) {
+        unsigned int cmdLen = strlen(pCmdStr);
+        bool clearsQueue = false;
+        int slotsNeeded = queueSlotsNeeded(pCmdStr, cmdLen, -1, clearsQueue);
+        int slotsAvailable = clearsQueue ? _workItemQueue.maxLen() : _workItemQueue.freeSlots();
+        if ((slotsNeeded > slotsAvailable) && (slotsNeeded <= _workItemQueue.maxLen())) break;
+        String retStr;
+        addCommand(pCmdStr, cmdLen, retStr, -1);
+        _commandIngress.pop(retStr);
+    }
+}
 
-    // See if it is command sequence
-    if (_evaluatorSequences.isValid(workItem)) return !_evaluatorSequences.isBusy();
+void WorkManager::addWorkItem(WorkItem &workItem, String &retStr, int cmdIdx) {
+    addCommand(workItem.getCString(), workItem.length(), retStr, cmdIdx);
+}
 
-    // Assume it is gcode
-    return _robotController.canAcceptCommand();
+void WorkManager::addCommand(const char *pCmdStr, unsigned int cmdLen, String &retStr, int cmdIdx) {
+    // Commands (semicolon delimited) are handled as views of the string - all pieces are queued or
+    // none are - the index only selects a piece if there is more than one
+    if (!memchr(pCmdStr, ';', cmdLen)) cmdIdx = -1;
+    if (!hasQueueSpaceFor(pCmdStr, cmdLen, cmdIdx)) {
+        retStr = "{\"rslt\":\"busy\"}";
+        Log.verbose("%saddCommand no space for all pieces\n", MODULE_PREFIX);
+        return;
+    }
+    retStr = "{\"rslt\":\"none\"}";
+    const char *pPos = pCmdStr;
+    const char *pPiece = NULL;
+    unsigned int pieceLen = 0;
+    for (int pieceIdx = 0; nextCmdPiece(pPos, pCmdStr + cmdLen, pPiece, pieceLen); pieceIdx++) {
+        if ((cmdIdx == -1) || (cmdIdx == pieceIdx)) processSingle(pPiece, pieceLen, retStr);
+    }
 }
 
-bool WorkManager::execWorkItem(WorkItem &workItem) {
-    // See if the command is a pattern generator
-    bool handledOk = false;
+// Classify a work item when it is queued so that dispatch doesn't need to check each evaluator
+// (or the file system) every time the queue is serviced
+void WorkManager::classifyWorkItem(WorkItem &workItem) {
+    // Theta-rho lines are identified from the string alone
+    if (workItem.getType() == WorkItem::TYPE_POLAR_MOVE) return;
 
-    // See if it is a theta-rho line
-    if (_evaluatorThetaRhoLine.isValid(workItem)) {
-        handledOk = _evaluatorThetaRhoLine.execWorkItem(workItem);
-        if (handledOk) return handledOk;
-    }
-    // See if it is a file to process
+    // Files and sequences (checked before gcode as file names may look like gcode)
     if (_evaluatorFiles.isValid(workItem)) {
-        handledOk = _evaluatorFiles.execWorkItem(workItem);
-        if (handledOk) return handledOk;
+        workItem.setType(WorkItem::TYPE_FILE);
+        // Files queued behind moves (e.g. the next pattern of a sequence) are opened ahead
+        _evaluatorFiles.prefetch(workItem);
+        return;
     }
-    // See if it is a command sequence
     if (_evaluatorSequences.isValid(workItem)) {
-        handledOk = _evaluatorSequences.execWorkItem(workItem);
-        if (handledOk) return handledOk;
+        workItem.setType(WorkItem::TYPE_SEQUENCE);
+        return;
+    }
+
+    // Anything else is handled as gcode - moves other than the theta-rho evaluator's own make
+    // its last point unknown
+    workItem.setType(WorkItem::TYPE_GCODE);
+    _evaluatorThetaRhoLine.workItemQueued(workItem);
+}
+
+bool WorkManager::canBeProcessed(WorkItem &workItem) {
+    switch (workItem.getType()) {
+        case WorkItem::TYPE_POLAR_MOVE:
+            return !_evaluatorThetaRhoLine.isBusy();
+        case WorkItem::TYPE_FILE:
+            return !_evaluatorFiles.isBusy();
+        case WorkItem::TYPE_SEQUENCE:
+            return !_evaluatorSequences.isBusy();
+        default:
+            // Some commands (e.g. M400) wait for motion to complete
+            if (EvaluatorGCode::waitsForMotion(workItem))
+                return _robotController.isMotionComplete();
+            return _robotController.canAcceptCommand();
+    }
+}
+
+bool WorkManager::execWorkItem(WorkItem &workItem) {
+    // Dispatch on the type found when the item was queued
+    switch (workItem.getType()) {
+        case WorkItem::TYPE_POLAR_MOVE:
+            return _evaluatorThetaRhoLine.execWorkItem(workItem);
+        case WorkItem::TYPE_FILE:
+            if (!_evaluatorFiles.execWorkItem(workItem)) return false;
+            // Motion stats are per pattern - the previous pattern's moves may still be running
+            // so the stats are reset when this file's first numbered move starts
+            {
+                int cmdIdxFirst = RobotConsts::NUMBERED_COMMAND_NONE;
+                int cmdIdxLast = RobotConsts::NUMBERED_COMMAND_NONE;
+                _evaluatorFiles.getNumberedCmdIdxRange(cmdIdxFirst, cmdIdxLast);
+                _robotController.resetMotionStats(cmdIdxFirst, cmdIdxLast);
+            }
+            // Estimate the pattern duration - theta-rho files use the status the file evaluator has
+            // (which may have been prefetched) rather than going to the file system again at the
+            // pattern boundary
+            _patternStartMs = millis();
+            {
+                String robotConfigStr = RdJson::getString("/robotConfig", "", _robotConfig.getConfigCStrPtr());
+                String rootFilename;
+                int fileLen = 0;
+                time_t modTime = 0;
+                if (_evaluatorFiles.getThetaRhoFileStatus(rootFilename, fileLen, modTime))
+                    _patternEstimator.requestEstimate(_evaluatorFiles.fileName(), rootFilename, fileLen, modTime,
+                                robotConfigStr);
+                else
+                    _patternEstimator.requestEstimate(_evaluatorFiles.fileName(), robotConfigStr);
+            }
+            return true;
+        case WorkItem::TYPE_SEQUENCE:
+            return _evaluatorSequences.execWorkItem(workItem);
+        default:
+            // Not handled - gcode
+            return false;
     }
-    // Not handled
-    return false;
 }
 
 void WorkManager::service() {
+    // Commands from other tasks
+    _serviceTask.store(xTaskGetCurrentTaskHandle(), std::memory_order_relaxed);
+    ingressService();
+
     // Pump the workflow here
     // Check if the RobotController can accept more
     if (_robotController.canAcceptCommand()) {
-        // Peek at next work item
-        WorkItem workItem;
-        bool rslt = _workItemQueue.peek(workItem);
-        if (rslt) {
+        // Peek at next work item (in place)
+        WorkItem *pNextItem = _workItemQueue.peek();
+        if (pNextItem) {
             // Check if this work item can be processed
-            if (canBeProcessed(workItem)) {
-                rslt = _workItemQueue.get(workItem);
+            if (canBeProcessed(*pNextItem)) {
+                // Move out of the queue (items added while executing may reuse the slot)
+                WorkItem workItem;
+                bool rslt = _workItemQueue.get(workItem);
                 if (rslt) {
                     // Check for extended commands
                     rslt = execWorkItem(workItem);
@@ -307,6 +490,10 @@ void WorkManager::service() {
 
     // Service evaluators
     evaluatorsService();
+    _patternEstimator.service();
+
+    // Let motion stats know whether motion is expected
+    _robotController.setMotionWorkPending(!_workItemQueue.isEmpty() || evaluatorsBusy(true));
 }
 
 void WorkManager::reconfigure() {
@@ -335,6 +522,9 @@ void WorkManager::reconfigure() {
         esp_restart();
     }
 
+    // Estimates depend on the config
+    _patternEstimator.clear();
+
     // Init robot controller and workflow manager
     _robotController.init(robotConfigStr.c_str());
     _workItemQueue.init(robotConfigStr.c_str(), "workItemQueue");
@@ -385,8 +575,8 @@ bool WorkManager::evaluatorsBusy(bool includeFileEvaluator) {
     if (includeFileEvaluator)
         if (_evaluatorFiles.isBusy()) return true;
     // Note that evaluatorSequences is not included here. That's because sequences operate
-    // at a higher level than other evaluators and only gets services when the workitem
-    // queue is completely empty and nothing else is busy
+    // at a higher level than other evaluators and only get serviced when nothing else is busy
+    // (the next line is then queued behind the previous pattern's final moves)
     return false;
 }
 
@@ -431,5 +621,9 @@ bool WorkManager::checkStatusChanged() {
 String WorkManager::getDebugStr() {
     String returnStr = (_workItemQueue.isFull() ? " QFULL:" : " QOK:");
     returnStr += _workItemQueue.size();
+    returnStr += _commandIngress.getDebugStr();
+    int fileInfoHits = 0, fileInfoMisses = 0;
+    _fileManager.getFileInfoCacheStats(fileInfoHits, fileInfoMisses);
+    returnStr += " FI:" + String(fileInfoHits) + "/" + String(fileInfoMisses);
     return returnStr;
 }
@@ -6,11 +6,14 @@
 // #define DEBUG_WORK_ITEM_SERVICE 1
 
 #include <Arduino.h>
+#include <atomic>
 
 #include "Evaluators/EvaluatorFiles.h"
 #include "Evaluators/EvaluatorSequences.h"
 #include "Evaluators/EvaluatorThetaRhoLine.h"
+#include "CommandIngress.h"
 #include "LedStrip.h"
+#include "PatternEstimator.h"
 #include "RobotCommandArgs.h"
 #include "WorkItemQueue.h"
 #include "WireGuardManager.h"
@@ -28,6 +31,12 @@ class WorkManager {
     RobotController& _robotController;
     LedStrip& _ledStrip;
     WorkItemQueue _workItemQueue;
+    CommandIngress _commandIngress;
+    // Task which services the work manager (set in service and read by posting tasks)
+    std::atomic<TaskHandle_t> _serviceTask;
+
+    // Blocks in a motion pipeline snapshot if not given
+    static const unsigned int PIPELINE_SNAPSHOT_MAX_BLOCKS = 100;
     RestAPISystem& _restAPISystem;
     FileManager& _fileManager;
     WireGuardManager& _wireGuardManager;
@@ -37,6 +46,10 @@ class WorkManager {
     EvaluatorFiles _evaluatorFiles;
     EvaluatorThetaRhoLine _evaluatorThetaRhoLine;
 
+    // Pattern duration estimates and start time of the current pattern
+    PatternEstimator _patternEstimator;
+    unsigned long _patternStartMs;
+
     // Status updates
     RobotCommandArgs _statusLastCmdArgs;
     unsigned long _statusLastHashVal;
@@ -54,6 +67,10 @@ class WorkManager {
 #endif
 
    public:
+    // Time other tasks wait for posted results - kept short as REST handlers wait on the
+    // AsyncTCP task (a command not handled by then still runs and its result is pending)
+    static const uint32_t INGRESS_RSLT_TIMEOUT_MS = 30;
+
     WorkManager(ConfigBase& mainConfig, ConfigBase& robotConfig, RobotController& robotController, LedStrip& ledStrip, WireGuardManager &wireGuardManager, RestAPISystem& restAPISystem,
                 FileManager& fileManager);
 
@@ -62,6 +79,8 @@ class WorkManager {
 
     // Queue info
     bool queueIsEmpty();
+    int queueSize();
+    uint32_t queueNumRemoved();
 
     // Call frequently to pump the queue
     void service();
@@ -84,6 +103,10 @@ class WorkManager {
     // Add a work item to the queue
     void addWorkItem(WorkItem& workItem, String& retStr, int cmdIdx = -1);
 
+    // Post a command from any task and wait for the result - it is handled (as by addWorkItem)
+    // in service - the result is pending if it isn't handled within the timeout
+    void postCommand(const char* pCmdStr, String& retStr);
+
     // Check status changed
     bool checkStatusChanged();
 
@@ -91,11 +114,34 @@ class WorkManager {
     String getDebugStr();
 
    private:
+    // Set the type of a work item (and so the evaluator which handles it) when it is queued
+    void classifyWorkItem(WorkItem& workItem);
+
     // Execute an item of work
     bool execWorkItem(WorkItem& workItem);
 
-    // Process a single
-    void processSingle(const char* pCmdStr, String& retStr);
+    // Add a command - pieces separated by ';' (only the cmdIdx'th if not -1 and there is more
+    // than one piece) are queued together or not at all
+    void addCommand(const char* pCmdStr, unsigned int cmdLen, String& retStr, int cmdIdx);
+
+    // Process a single command (not terminated)
+    void processSingle(const char* pCmdStr, unsigned int cmdLen, String& retStr);
+
+    // Queue slots needed for the pieces of a command - a stop clears the queue so pieces before
+    // it don't need slots
+    int queueSlotsNeeded(const char* pCmdStr, unsigned int cmdLen, int cmdIdx, bool& clearsQueue);
+    bool hasQueueSpaceFor(const char* pCmdStr, unsigned int cmdLen, int cmdIdx);
+
+    // Next piece of a command (trimmed and not empty) - false when there are no more
+    static bool nextCmdPiece(const char*& pPos, const char* pEnd, const char*& pPiece, unsigned int& pieceLen);
+    static bool isCmd(const char* pCmdStr, unsigned int cmdLen, const char* pName);
+    // Command with an optional argument after a / (e.g. motion_pipeline/20)
+    static bool isCmdWithArg(const char* pCmdStr, unsigned int cmdLen, const char* pName, const char*& pArg,
+                             unsigned int& argLen);
+
+    // Handle commands posted from other tasks
+    void ingressService();
+    static bool isImmediateCmd(const char* pCmdStr, unsigned int cmdLen);
 
     // Stop Evaluators
     void evaluatorsStop();
@@ -0,0 +1,138 @@
+// RBotFirmware
+// Rob Dobson 2016-2018
+
+// Host stand-in for the parts of the ESP32 Arduino core used by the firmware (native test
+// builds) - time is the host clock, pins do nothing, timers only keep the ISR attached (which
+// tests can call) and tasks can't be created so code which needs a task must use its dry-run
+// path
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <math.h>
+#include <time.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include "WString.h"
+#include "freertos/FreeRTOS.h"
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+
+using std::max;
+using std::min;
+
+typedef uint8_t byte;
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+// Time
+inline unsigned long micros()
+{
+    static const auto startTime = std::chrono::steady_clock::now();
+    return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now() - startTime)
+        .count();
+}
+inline unsigned long millis()
+{
+    return micros() / 1000;
+}
+inline void delay(unsigned long ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+inline void delayMicroseconds(unsigned int us)
+{
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+inline void yield()
+{
+    std::this_thread::yield();
+}
+inline bool getLocalTime(struct tm* pTimeInfo, uint32_t ms = 5000)
+{
+    return false;
+}
+
+// Pins
+#define LOW 0
+#define HIGH 1
+#define INPUT 0x01
+#define OUTPUT 0x02
+#define PULLUP 0x04
+#define INPUT_PULLUP 0x05
+#define PULLDOWN 0x08
+#define INPUT_PULLDOWN 0x09
+static const uint8_t DAC1 = 25;
+static const uint8_t DAC2 = 26;
+static const uint8_t SCL = 22;
+static const uint8_t SDA = 21;
+static const uint8_t RX = 3;
+static const uint8_t TX = 1;
+static const uint8_t MISO = 19;
+static const uint8_t MOSI = 23;
+static const uint8_t SCK = 18;
+inline void pinMode(uint8_t pin, uint8_t mode)
+{
+}
+inline void digitalWrite(uint8_t pin, uint8_t val)
+{
+}
+inline int digitalRead(uint8_t pin)
+{
+    return LOW;
+}
+
+// Timers
+struct hw_timer_t
+{
+};
+inline hw_timer_t* timerBegin(uint8_t num, uint16_t divider, bool countUp)
+{
+    static hw_timer_t timer;
+    return &timer;
+}
+// The ISR attached to the timer - tests call this to run the ISR in simulated time
+inline void (*hostTimerIsr)(void) = NULL;
+inline void timerAttachInterrupt(hw_timer_t* pTimer, void (*fn)(void), bool edge)
+{
+    hostTimerIsr = fn;
+}
+inline void timerAlarmWrite(hw_timer_t* pTimer, uint64_t alarmValue, bool autoreload)
+{
+}
+inline void timerAlarmEnable(hw_timer_t* pTimer)
+{
+}
+inline void timerAlarmDisable(hw_timer_t* pTimer)
+{
+}
+typedef struct esp_timer* esp_timer_handle_t;
+
+// System
+inline uint32_t getCpuFrequencyMhz()
+{
+    return 240;
+}
+inline void esp_restart()
+{
+    exit(0);
+}
+class EspClass
+{
+public:
+    uint32_t getFreeHeap()
+    {
+        return 0;
+    }
+};
+inline EspClass ESP;
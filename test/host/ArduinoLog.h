@@ -0,0 +1,38 @@
+// RBotFirmware
+// Rob Dobson 2016-2018
+
+// Host stand-in for ArduinoLog (native test builds) - messages are discarded
+
+#pragma once
+
+#include <Arduino.h>
+
+#define LOG_LEVEL_SILENT 0
+#define LOG_LEVEL_FATAL 1
+#define LOG_LEVEL_ERROR 2
+#define LOG_LEVEL_WARNING 3
+#define LOG_LEVEL_NOTICE 4
+#define LOG_LEVEL_INFO 4
+#define LOG_LEVEL_TRACE 5
+#define LOG_LEVEL_VERBOSE 6
+
+class Logging
+{
+public:
+    template <class... Args> void begin(Args... args) {}
+    template <class... Args> void fatal(const char* pFormat, Args... args) {}
+    template <class... Args> void error(const char* pFormat, Args... args) {}
+    template <class... Args> void errorln(const char* pFormat, Args... args) {}
+    template <class... Args> void warning(const char* pFormat, Args... args) {}
+    template <class... Args> void warningln(const char* pFormat, Args... args) {}
+    template <class... Args> void notice(const char* pFormat, Args... args) {}
+    template <class... Args> void noticeln(const char* pFormat, Args... args) {}
+    template <class... Args> void info(const char* pFormat, Args... args) {}
+    template <class... Args> void infoln(const char* pFormat, Args... args) {}
+    template <class... Args> void trace(const char* pFormat, Args... args) {}
+    template <class... Args> void traceln(const char* pFormat, Args... args) {}
+    template <class... Args> void verbose(const char* pFormat, Args... args) {}
+    template <class... Args> void verboseln(const char* pFormat, Args... args) {}
+};
+
+inline Logging Log;
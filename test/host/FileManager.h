@@ -0,0 +1,343 @@
+// RBotFirmware
+// Rob Dobson 2016-2018
+
+// Host stand-in for FileManager (native test builds) - the spiffs and sd file systems are
+// folders under a host directory - file info lookups are cached (and invalidated when files are
+// changed) as on the device, stat calls are counted and a simulated access time can be added
+// for each stat and block read (simulations run the ISR for it as the main loop would be blocked)
+
+#pragma once
+
+#include <Arduino.h>
+#include <sys/stat.h>
+#include "ConfigBase.h"
+
+class FileManager
+{
+private:
+    String _hostRoot;
+    FILE* _pChunkedFile;
+    uint8_t _chunkedFileBuffer[1000];
+    String _chunkedFilename;
+    int _chunkedFileLen;
+    int _chunkedFilePos;
+    FILE* _pUploadFile;
+
+    // Cached results of file info lookups (as lib/RdFileManager)
+    static const int FILE_INFO_CACHE_ENTRIES = 8;
+    struct FileInfoCacheEntry
+    {
+        String _rootFilename;
+        bool _exists;
+        int _fileLength;
+        uint32_t _lastUsedMs;
+    };
+    FileInfoCacheEntry _fileInfoCache[FILE_INFO_CACHE_ENTRIES];
+    int _fileInfoCacheHits;
+    int _fileInfoCacheMisses;
+    int _numStatCalls;
+
+    // Simulated access time per stat and per block read and the total not yet taken
+    uint32_t _simStatMs;
+    uint32_t _simReadMs;
+    uint32_t _simAccessMs;
+
+public:
+    FileManager()
+    {
+        _hostRoot = "/tmp";
+        _pChunkedFile = NULL;
+        _chunkedFileLen = 0;
+        _chunkedFilePos = 0;
+        _pUploadFile = NULL;
+        _fileInfoCacheHits = 0;
+        _fileInfoCacheMisses = 0;
+        _numStatCalls = 0;
+        _simStatMs = 0;
+        _simReadMs = 0;
+        _simAccessMs = 0;
+        _sdIsOk = true;
+    }
+    ~FileManager()
+    {
+        if (_pChunkedFile)
+            fclose(_pChunkedFile);
+        if (_pUploadFile)
+            fclose(_pUploadFile);
+    }
+
+    // Host folder which contains the spiffs and sd folders
+    void setHostRoot(const char* pHostRoot)
+    {
+        _hostRoot = pHostRoot;
+        mkdir(_hostRoot.c_str(), 0755);
+        mkdir((_hostRoot + "/spiffs").c_str(), 0755);
+        mkdir((_hostRoot + "/sd").c_str(), 0755);
+    }
+
+    void setup(ConfigBase& config, const char* pConfigPath = NULL)
+    {
+    }
+
+    bool _sdIsOk;
+
+    String getFileContents(const String& fileSystemStr, const String& filename, int maxLen = 0)
+    {
+        String rootFilename = getFilePath(fileSystemStr, filename);
+        FILE* pFile = fopen(rootFilename.c_str(), "rb");
+        if (!pFile)
+            return "";
+        String contents;
+        char buf[256];
+        int readLen = 0;
+        while ((readLen = fread(buf, 1, sizeof(buf), pFile)) > 0)
+            contents.concat(buf, readLen);
+        fclose(pFile);
+        if ((maxLen > 0) && (int(contents.length()) > maxLen))
+            return contents.substring(0, maxLen);
+        return contents;
+    }
+
+    bool setFileContents(const String& fileSystemStr, const String& filename, String& fileContents)
+    {
+        FILE* pFile = fopen(getFilePath(fileSystemStr, filename).c_str(), "wb");
+        if (!pFile)
+            return false;
+        bool writtenOk = fwrite(fileContents.c_str(), 1, fileContents.length(), pFile) == fileContents.length();
+        fclose(pFile);
+        invalidateFileCaches();
+        return writtenOk;
+    }
+
+    // Upload blocks are written to a temporary file which replaces the file after the last block
+    void uploadAPIBlockHandler(const char* fileSystem, const String& req, const String& filename, int fileLength,
+                size_t index, uint8_t* data, size_t len, bool finalBlock)
+    {
+        String tmpRootFilename = getFilePath(fileSystem, "__tmp__");
+        if (index == 0)
+        {
+            if (_pUploadFile)
+                fclose(_pUploadFile);
+            _pUploadFile = fopen(tmpRootFilename.c_str(), "wb");
+        }
+        if (!_pUploadFile)
+            return;
+        fwrite(data, 1, len, _pUploadFile);
+        if (finalBlock)
+        {
+            fclose(_pUploadFile);
+            _pUploadFile = NULL;
+            rename(tmpRootFilename.c_str(), getFilePath(fileSystem, filename).c_str());
+            invalidateFileCaches();
+        }
+    }
+    void uploadAPIBlocksComplete()
+    {
+        invalidateFileCaches();
+    }
+
+    bool deleteFile(const String& fileSystemStr, const String& filename)
+    {
+        remove(getFilePath(fileSystemStr, filename).c_str());
+        invalidateFileCaches();
+        return true;
+    }
+
+    // Test file exists and get info - results are cached until files are changed
+    bool getFileInfo(const String& fileSystemStr, const String& filename, int& fileLength)
+    {
+        String rootFilename = getFilePath(fileSystemStr, filename);
+        FileInfoCacheEntry* pEntry = NULL;
+        for (int i = 0; i < FILE_INFO_CACHE_ENTRIES; i++)
+        {
+            if (_fileInfoCache[i]._rootFilename.equals(rootFilename))
+            {
+                pEntry = &_fileInfoCache[i];
+                break;
+            }
+        }
+        if (pEntry)
+        {
+            _fileInfoCacheHits++;
+            pEntry->_lastUsedMs = millis();
+            if (pEntry->_exists)
+                fileLength = pEntry->_fileLength;
+            return pEntry->_exists;
+        }
+
+        // Replace the least recently used (or an empty) cache entry
+        _fileInfoCacheMisses++;
+        struct stat st;
+        bool exists = statFile(rootFilename, st);
+        pEntry = &_fileInfoCache[0];
+        for (int i = 0; i < FILE_INFO_CACHE_ENTRIES; i++)
+        {
+            if (_fileInfoCache[i]._rootFilename.length() == 0)
+            {
+                pEntry = &_fileInfoCache[i];
+                break;
+            }
+            if (millis() - _fileInfoCache[i]._lastUsedMs > millis() - pEntry->_lastUsedMs)
+                pEntry = &_fileInfoCache[i];
+        }
+        pEntry->_rootFilename = rootFilename;
+        pEntry->_exists = exists;
+        pEntry->_fileLength = exists ? st.st_size : 0;
+        pEntry->_lastUsedMs = millis();
+        if (exists)
+            fileLength = st.st_size;
+        return exists;
+    }
+
+    void getFileInfoCacheStats(int& hits, int& misses)
+    {
+        hits = _fileInfoCacheHits;
+        misses = _fileInfoCacheMisses;
+    }
+
+    // Calls to stat (file info cache misses and file status)
+    int getNumStatCalls()
+    {
+        return _numStatCalls;
+    }
+
+    // Simulated access time - the total since the last call is returned
+    void setSimAccessMs(uint32_t statMs, uint32_t readMs)
+    {
+        _simStatMs = statMs;
+        _simReadMs = readMs;
+    }
+    uint32_t takeSimAccessMs()
+    {
+        uint32_t accessMs = _simAccessMs;
+        _simAccessMs = 0;
+        return accessMs;
+    }
+
+    bool getFileStatus(const String& fileSystemStr, const String& filename, String& rootFilename,
+                int& fileLength, time_t& modTime)
+    {
+        struct stat st;
+        rootFilename = getFilePath(fileSystemStr, filename);
+        if (!statFile(rootFilename, st))
+            return false;
+        fileLength = st.st_size;
+        modTime = st.st_mtime;
+        return true;
+    }
+
+    int readFileBlock(const String& rootFilename, int filePos, uint8_t* pBuf, int maxLen)
+    {
+        _simAccessMs += _simReadMs;
+        FILE* pFile = fopen(rootFilename.c_str(), "rb");
+        if (!pFile)
+            return -1;
+        if ((filePos != 0) && (fseek(pFile, filePos, SEEK_SET) != 0))
+        {
+            fclose(pFile);
+            return -1;
+        }
+        int readLen = fread(pBuf, 1, maxLen, pFile);
+        fclose(pFile);
+        return readLen;
+    }
+
+    FILE* writeFileOpen(const String& fileSystemStr, const String& filename)
+    {
+        FILE* pFile = fopen(getFilePath(fileSystemStr, filename).c_str(), "wb");
+        invalidateFileCaches();
+        return pFile;
+    }
+
+    bool writeFileBlock(FILE* pFile, const uint8_t* pBuf, int len)
+    {
+        return pFile && (fwrite(pBuf, 1, len, pFile) == size_t(len));
+    }
+
+    void writeFileClose(FILE* pFile)
+    {
+        if (pFile)
+            fclose(pFile);
+        invalidateFileCaches();
+    }
+
+    bool chunkedFileStart(const String& fileSystemStr, const String& filename, bool readByLine)
+    {
+        if (_pChunkedFile)
+            fclose(_pChunkedFile);
+        _chunkedFilename = filename;
+        _chunkedFilePos = 0;
+        _pChunkedFile = fopen(getFilePath(fileSystemStr, filename).c_str(), "rb");
+        if (!_pChunkedFile)
+            return false;
+        fseek(_pChunkedFile, 0, SEEK_END);
+        _chunkedFileLen = ftell(_pChunkedFile);
+        fseek(_pChunkedFile, 0, SEEK_SET);
+        return true;
+    }
+
+    uint8_t* chunkFileNext(String& filename, int& fileLen, int& chunkPos, int& chunkLen, bool& finalChunk)
+    {
+        filename = _chunkedFilename;
+        fileLen = _chunkedFileLen;
+        chunkPos = _chunkedFilePos;
+        chunkLen = 0;
+        finalChunk = true;
+        if (!_pChunkedFile)
+            return NULL;
+        chunkLen = fread(_chunkedFileBuffer, 1, sizeof(_chunkedFileBuffer), _pChunkedFile);
+        _chunkedFilePos += chunkLen;
+        finalChunk = _chunkedFilePos >= _chunkedFileLen;
+        if (finalChunk)
+        {
+            fclose(_pChunkedFile);
+            _pChunkedFile = NULL;
+        }
+        return _chunkedFileBuffer;
+    }
+
+    static String getFileExtension(String& fileName)
+    {
+        int dotPos = fileName.lastIndexOf('.');
+        if (dotPos < 0)
+            return "";
+        return fileName.substring(dotPos + 1);
+    }
+
+    static bool hasFileExtension(const char* pFileName, unsigned int nameLen, const char* pExtn)
+    {
+        unsigned int dotPos = nameLen;
+        while ((dotPos > 0) && (pFileName[dotPos - 1] != '.'))
+            dotPos--;
+        if (dotPos == 0)
+            return false;
+        unsigned int extnLen = nameLen - dotPos;
+        return (extnLen == strlen(pExtn)) && (strncasecmp(pFileName + dotPos, pExtn, extnLen) == 0);
+    }
+
+private:
+    bool statFile(const String& rootFilename, struct stat& st)
+    {
+        _numStatCalls++;
+        _simAccessMs += _simStatMs;
+        return (stat(rootFilename.c_str(), &st) == 0) && S_ISREG(st.st_mode);
+    }
+
+    void invalidateFileCaches()
+    {
+        for (int i = 0; i < FILE_INFO_CACHE_ENTRIES; i++)
+            _fileInfoCache[i]._rootFilename = "";
+    }
+
+    String getFilePath(const String& fileSystemStr, const String& filename)
+    {
+        String nameOfFS = fileSystemStr;
+        nameOfFS.trim();
+        nameOfFS.toLowerCase();
+        if (nameOfFS.length() == 0)
+            nameOfFS = "spiffs";
+        if ((filename.indexOf("spiffs/") >= 0) || (filename.indexOf("sd/") >= 0))
+            return _hostRoot + (filename.startsWith("/") ? filename : ("/" + filename));
+        return _hostRoot + (filename.startsWith("/") ? "/" + nameOfFS + filename : ("/" + nameOfFS + "/" + filename));
+    }
+};
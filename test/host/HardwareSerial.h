@@ -0,0 +1,21 @@
+// RBotFirmware
+// Rob Dobson 2016-2018
+
+// Host stand-in for HardwareSerial (native test builds)
+
+#pragma once
+
+#include <Arduino.h>
+
+#define SERIAL_8N1 0x800001c
+
+class HardwareSerial
+{
+public:
+    HardwareSerial(int uartNum)
+    {
+    }
+    void begin(unsigned long baud, uint32_t config = SERIAL_8N1, int8_t rxPin = -1, int8_t txPin = -1)
+    {
+    }
+};
@@ -0,0 +1,23 @@
+// RBotFirmware
+// Rob Dobson 2016-2018
+
+// Host stand-in for LedStrip (native test builds)
+
+#pragma once
+
+#include <Arduino.h>
+
+class LedStrip
+{
+public:
+    void updateLedFromConfig(const char* pLedJson)
+    {
+    }
+    String getCurrentConfigStr()
+    {
+        return "{}";
+    }
+    void setSleepMode(int sleep)
+    {
+    }
+};
@@ -0,0 +1,40 @@
+// RBotFirmware
+// Rob Dobson 2016-2018
+
+// Host stand-in for Preferences (native test builds) - values are kept in memory
+
+#pragma once
+
+#include <Arduino.h>
+#include <map>
+#include <string>
+
+class Preferences
+{
+private:
+    std::map<std::string, String> _values;
+
+public:
+    bool begin(const char* pName, bool readOnly = false)
+    {
+        return true;
+    }
+    void end()
+    {
+    }
+    bool clear()
+    {
+        _values.clear();
+        return true;
+    }
+    String getString(const char* pKey, String defaultValue = String())
+    {
+        auto it = _values.find(pKey);
+        return (it == _values.end()) ? defaultValue : it->second;
+    }
+    size_t putString(const char* pKey, String value)
+    {
+        _values[pKey] = value;
+        return value.length();
+    }
+};
@@ -0,0 +1,21 @@
+// RBotFirmware
+// Rob Dobson 2016-2018
+
+// Host stand-in for RestAPISystem (native test builds)
+
+#pragma once
+
+#include <Arduino.h>
+
+class RestAPISystem
+{
+public:
+    static int reportHealth(int bitPosStart, unsigned long* pOutHash, String* pOutStr)
+    {
+        if (pOutHash)
+            *pOutHash = 0;
+        if (pOutStr)
+            *pOutStr = "";
+        return 0;
+    }
+};
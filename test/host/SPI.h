@@ -0,0 +1,8 @@
+// RBotFirmware
+// Rob Dobson 2016-2018
+
+// Host stand-in for SPI (native test builds) - nothing is used on the host
+
+#pragma once
+
+#include <Arduino.h>
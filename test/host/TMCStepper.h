@@ -0,0 +1,84 @@
+// RBotFirmware
+// Rob Dobson 2016-2018
+
+// Host stand-in for TMCStepper (native test builds) - drivers record the microstep setting and
+// report a microstep counter (MSCNT) which tests can set - drivers are listed in creation order
+
+#pragma once
+
+#include <Arduino.h>
+#include <HardwareSerial.h>
+#include <vector>
+
+class TMC2208Stepper
+{
+public:
+    uint16_t _microsteps;
+    uint16_t _mscnt;
+
+    TMC2208Stepper(HardwareSerial* pSerial, float rSense)
+    {
+        _microsteps = 256;
+        _mscnt = 0;
+        getDrivers().push_back(this);
+    }
+    virtual ~TMC2208Stepper()
+    {
+        std::vector<TMC2208Stepper*>& drivers = getDrivers();
+        for (auto it = drivers.begin(); it != drivers.end(); it++)
+        {
+            if (*it == this)
+            {
+                drivers.erase(it);
+                break;
+            }
+        }
+    }
+    static std::vector<TMC2208Stepper*>& getDrivers()
+    {
+        static std::vector<TMC2208Stepper*> drivers;
+        return drivers;
+    }
+
+    void begin()
+    {
+    }
+    void reset()
+    {
+    }
+    void toff(uint8_t val)
+    {
+    }
+    void rms_current(uint16_t mA)
+    {
+    }
+    void microsteps(uint16_t ms)
+    {
+        _microsteps = ms;
+    }
+    uint16_t microsteps()
+    {
+        return _microsteps;
+    }
+    void intpol(bool val)
+    {
+    }
+    void pwm_autoscale(bool val)
+    {
+    }
+    void en_spreadCycle(bool val)
+    {
+    }
+    uint16_t MSCNT()
+    {
+        return _mscnt;
+    }
+};
+
+class TMC2209Stepper : public TMC2208Stepper
+{
+public:
+    TMC2209Stepper(HardwareSerial* pSerial, float rSense, uint8_t addr) : TMC2208Stepper(pSerial, rSense)
+    {
+    }
+};
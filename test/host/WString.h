@@ -0,0 +1,386 @@
+// RBotFirmware
+// Rob Dobson 2016-2018
+
+// Host stand-in for the Arduino String class (native test builds)
+
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <algorithm>
+#include <string>
+
+class String
+{
+private:
+    std::string _str;
+
+    static std::string fromLong(long long val, int base)
+    {
+        if (base == 10)
+            return std::to_string(val);
+        return fromULong(val < 0 ? (unsigned long long)(-val) : (unsigned long long)val, base);
+    }
+    static std::string fromULong(unsigned long long val, int base)
+    {
+        if (base == 10)
+            return std::to_string(val);
+        std::string digits;
+        do
+        {
+            digits.insert(digits.begin(), "0123456789abcdefghijklmnopqrstuvwxyz"[val % base]);
+            val /= base;
+        } while (val != 0);
+        return digits;
+    }
+    static std::string fromDouble(double val, int decimalPlaces)
+    {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%.*f", decimalPlaces, val);
+        return buf;
+    }
+
+public:
+    String(const char* pStr = "")
+    {
+        if (pStr)
+            _str = pStr;
+    }
+    String(const std::string& str) : _str(str)
+    {
+    }
+    explicit String(char c) : _str(1, c)
+    {
+    }
+    explicit String(unsigned char val, unsigned char base = 10) : _str(fromULong(val, base))
+    {
+    }
+    explicit String(int val, unsigned char base = 10) : _str(fromLong(val, base))
+    {
+    }
+    explicit String(unsigned int val, unsigned char base = 10) : _str(fromULong(val, base))
+    {
+    }
+    explicit String(long val, unsigned char base = 10) : _str(fromLong(val, base))
+    {
+    }
+    explicit String(unsigned long val, unsigned char base = 10) : _str(fromULong(val, base))
+    {
+    }
+    explicit String(long long val, unsigned char base = 10) : _str(fromLong(val, base))
+    {
+    }
+    explicit String(unsigned long long val, unsigned char base = 10) : _str(fromULong(val, base))
+    {
+    }
+    explicit String(float val, unsigned char decimalPlaces = 2) : _str(fromDouble(val, decimalPlaces))
+    {
+    }
+    explicit String(double val, unsigned char decimalPlaces = 2) : _str(fromDouble(val, decimalPlaces))
+    {
+    }
+
+    unsigned int length() const
+    {
+        return _str.length();
+    }
+    bool isEmpty() const
+    {
+        return _str.empty();
+    }
+    const char* c_str() const
+    {
+        return _str.c_str();
+    }
+    bool reserve(unsigned int size)
+    {
+        _str.reserve(size);
+        return true;
+    }
+
+    // Concatenation
+    bool concat(const String& str)
+    {
+        _str += str._str;
+        return true;
+    }
+    bool concat(const char* pStr)
+    {
+        if (!pStr)
+            return false;
+        _str += pStr;
+        return true;
+    }
+    bool concat(const char* pStr, unsigned int len)
+    {
+        if (!pStr)
+            return false;
+        _str.append(pStr, len);
+        return true;
+    }
+    bool concat(char c)
+    {
+        _str += c;
+        return true;
+    }
+    bool concat(unsigned char val)
+    {
+        return concat(String(val));
+    }
+    bool concat(int val)
+    {
+        return concat(String(val));
+    }
+    bool concat(unsigned int val)
+    {
+        return concat(String(val));
+    }
+    bool concat(long val)
+    {
+        return concat(String(val));
+    }
+    bool concat(unsigned long val)
+    {
+        return concat(String(val));
+    }
+    bool concat(long long val)
+    {
+        return concat(String(val));
+    }
+    bool concat(unsigned long long val)
+    {
+        return concat(String(val));
+    }
+    bool concat(float val)
+    {
+        return concat(String(val));
+    }
+    bool concat(double val)
+    {
+        return concat(String(val));
+    }
+    template <typename T>
+    String& operator+=(const T& val)
+    {
+        concat(val);
+        return *this;
+    }
+
+    // Comparison
+    int compareTo(const String& str) const
+    {
+        return _str.compare(str._str);
+    }
+    bool equals(const String& str) const
+    {
+        return _str == str._str;
+    }
+    bool equals(const char* pStr) const
+    {
+        return _str == (pStr ? pStr : "");
+    }
+    bool equalsIgnoreCase(const String& str) const
+    {
+        return strcasecmp(_str.c_str(), str._str.c_str()) == 0;
+    }
+    bool operator==(const String& str) const
+    {
+        return equals(str);
+    }
+    bool operator==(const char* pStr) const
+    {
+        return equals(pStr);
+    }
+    bool operator!=(const String& str) const
+    {
+        return !equals(str);
+    }
+    bool operator!=(const char* pStr) const
+    {
+        return !equals(pStr);
+    }
+    bool operator<(const String& str) const
+    {
+        return compareTo(str) < 0;
+    }
+    bool operator>(const String& str) const
+    {
+        return compareTo(str) > 0;
+    }
+    bool startsWith(const String& prefix, unsigned int offset = 0) const
+    {
+        return (offset <= _str.length()) && (_str.compare(offset, prefix._str.length(), prefix._str) == 0);
+    }
+    bool endsWith(const String& suffix) const
+    {
+        return (suffix._str.length() <= _str.length()) &&
+               (_str.compare(_str.length() - suffix._str.length(), suffix._str.length(), suffix._str) == 0);
+    }
+
+    // Characters
+    char charAt(unsigned int index) const
+    {
+        return index < _str.length() ? _str[index] : 0;
+    }
+    void setCharAt(unsigned int index, char c)
+    {
+        if (index < _str.length())
+            _str[index] = c;
+    }
+    char operator[](unsigned int index) const
+    {
+        return charAt(index);
+    }
+    char& operator[](unsigned int index)
+    {
+        return _str[index];
+    }
+    void getBytes(unsigned char* pBuf, unsigned int bufSize, unsigned int index = 0) const
+    {
+        toCharArray((char*)pBuf, bufSize, index);
+    }
+    void toCharArray(char* pBuf, unsigned int bufSize, unsigned int index = 0) const
+    {
+        if (!pBuf || (bufSize == 0))
+            return;
+        if (index >= _str.length())
+        {
+            pBuf[0] = 0;
+            return;
+        }
+        unsigned int len = std::min<unsigned int>(bufSize - 1, _str.length() - index);
+        memcpy(pBuf, _str.c_str() + index, len);
+        pBuf[len] = 0;
+    }
+
+    // Search
+    int indexOf(char c, unsigned int fromIndex = 0) const
+    {
+        size_t pos = _str.find(c, fromIndex);
+        return pos == std::string::npos ? -1 : int(pos);
+    }
+    int indexOf(const String& str, unsigned int fromIndex = 0) const
+    {
+        size_t pos = _str.find(str._str, fromIndex);
+        return pos == std::string::npos ? -1 : int(pos);
+    }
+    int lastIndexOf(char c) const
+    {
+        size_t pos = _str.rfind(c);
+        return pos == std::string::npos ? -1 : int(pos);
+    }
+    int lastIndexOf(char c, unsigned int fromIndex) const
+    {
+        size_t pos = _str.rfind(c, fromIndex);
+        return pos == std::string::npos ? -1 : int(pos);
+    }
+    int lastIndexOf(const String& str) const
+    {
+        size_t pos = _str.rfind(str._str);
+        return pos == std::string::npos ? -1 : int(pos);
+    }
+    int lastIndexOf(const String& str, unsigned int fromIndex) const
+    {
+        size_t pos = _str.rfind(str._str, fromIndex);
+        return pos == std::string::npos ? -1 : int(pos);
+    }
+    String substring(unsigned int beginIndex) const
+    {
+        return substring(beginIndex, _str.length());
+    }
+    String substring(unsigned int beginIndex, unsigned int endIndex) const
+    {
+        if (beginIndex > endIndex)
+            std::swap(beginIndex, endIndex);
+        if (beginIndex >= _str.length())
+            return String();
+        return String(_str.substr(beginIndex, std::min<unsigned int>(endIndex, _str.length()) - beginIndex));
+    }
+
+    // Modification
+    void replace(char find, char replaceWith)
+    {
+        for (char& c : _str)
+            if (c == find)
+                c = replaceWith;
+    }
+    void replace(const String& find, const String& replaceWith)
+    {
+        if (find._str.empty())
+            return;
+        size_t pos = 0;
+        while ((pos = _str.find(find._str, pos)) != std::string::npos)
+        {
+            _str.replace(pos, find._str.length(), replaceWith._str);
+            pos += replaceWith._str.length();
+        }
+    }
+    void remove(unsigned int index)
+    {
+        if (index < _str.length())
+            _str.erase(index);
+    }
+    void remove(unsigned int index, unsigned int count)
+    {
+        if (index < _str.length())
+            _str.erase(index, count);
+    }
+    void toLowerCase()
+    {
+        for (char& c : _str)
+            c = tolower((unsigned char)c);
+    }
+    void toUpperCase()
+    {
+        for (char& c : _str)
+            c = toupper((unsigned char)c);
+    }
+    void trim()
+    {
+        size_t first = _str.find_first_not_of(" \t\r\n\f\v");
+        if (first == std::string::npos)
+        {
+            _str.clear();
+            return;
+        }
+        size_t last = _str.find_last_not_of(" \t\r\n\f\v");
+        _str = _str.substr(first, last - first + 1);
+    }
+
+    // Conversion
+    long toInt() const
+    {
+        return atol(_str.c_str());
+    }
+    float toFloat() const
+    {
+        return float(atof(_str.c_str()));
+    }
+    double toDouble() const
+    {
+        return atof(_str.c_str());
+    }
+};
+
+template <typename T>
+inline String operator+(const String& lhs, const T& rhs)
+{
+    String result(lhs);
+    result += rhs;
+    return result;
+}
+inline String operator+(const char* lhs, const String& rhs)
+{
+    String result(lhs);
+    result += rhs;
+    return result;
+}
+inline String operator+(char lhs, const String& rhs)
+{
+    String result(lhs);
+    result += rhs;
+    return result;
+}
@@ -0,0 +1,17 @@
+// RBotFirmware
+// Rob Dobson 2016-2018
+
+// Host stand-in for WireGuardManager (native test builds)
+
+#pragma once
+
+#include <Arduino.h>
+
+class WireGuardManager
+{
+public:
+    bool isConnected()
+    {
+        return false;
+    }
+};
@@ -0,0 +1,92 @@
+// RBotFirmware
+// Rob Dobson 2016-2018
+
+// Host stand-in for the FreeRTOS calls used by the firmware (native test builds) - mutexes are
+// real, ticks are milliseconds and task creation always fails
+
+#pragma once
+
+#include <stdint.h>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdFAIL 0
+#define pdPASS 1
+#define portMAX_DELAY 0xffffffffUL
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) (TickType_t(ms))
+#define tskIDLE_PRIORITY 0
+
+// Mutexes
+typedef std::timed_mutex* SemaphoreHandle_t;
+inline SemaphoreHandle_t xSemaphoreCreateMutex()
+{
+    return new std::timed_mutex();
+}
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t mutex, TickType_t ticksToWait)
+{
+    if (ticksToWait == portMAX_DELAY)
+    {
+        mutex->lock();
+        return pdTRUE;
+    }
+    return mutex->try_lock_for(std::chrono::milliseconds(ticksToWait)) ? pdTRUE : pdFALSE;
+}
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t mutex)
+{
+    mutex->unlock();
+    return pdTRUE;
+}
+inline void vSemaphoreDelete(SemaphoreHandle_t mutex)
+{
+    delete mutex;
+}
+
+// Critical sections
+struct portMUX_TYPE
+{
+    std::mutex _mutex;
+};
+#define portMUX_INITIALIZER_UNLOCKED {}
+inline void portENTER_CRITICAL(portMUX_TYPE* pMux)
+{
+    pMux->_mutex.lock();
+}
+inline void portEXIT_CRITICAL(portMUX_TYPE* pMux)
+{
+    pMux->_mutex.unlock();
+}
+#define portENTER_CRITICAL_ISR portENTER_CRITICAL
+#define portEXIT_CRITICAL_ISR portEXIT_CRITICAL
+
+// Tasks
+typedef void* TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+inline BaseType_t xTaskCreate(TaskFunction_t fn, const char* pName, uint32_t stackDepth, void* pParams,
+                              UBaseType_t priority, TaskHandle_t* pHandle)
+{
+    return pdFAIL;
+}
+inline BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char* pName, uint32_t stackDepth, void* pParams,
+                                          UBaseType_t priority, TaskHandle_t* pHandle, BaseType_t coreId)
+{
+    return pdFAIL;
+}
+inline TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+    static thread_local char task;
+    return &task;
+}
+inline void vTaskDelete(TaskHandle_t task)
+{
+}
+inline void vTaskDelay(TickType_t ticks)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
@@ -0,0 +1,13 @@
+// RBotFirmware
+// Rob Dobson 2016-2018
+
+// Host stand-in for the Xtensa cycle counter (native test builds) - counts at the CPU clock
+// (240MHz) from the host clock unless a test holds it at a fixed count (to time simulated ISRs)
+
+#pragma once
+
+#include <Arduino.h>
+
+inline int64_t hostFixedCycleCount = -1;
+
+#define XTHAL_GET_CCOUNT() (hostFixedCycleCount >= 0 ? uint32_t(hostFixedCycleCount) : uint32_t(micros() * 240))
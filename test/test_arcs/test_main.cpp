@@ -0,0 +1,372 @@
+// RBotFirmware
+// Rob Dobson 2016-2018
+
+// Arcs (G2/G3) - R with a value (the radius, negative for more than 180 degrees) against a
+// bare R (relative motion), the I/J and R forms, full circles, the distance of the split-up
+// blocks from the true arc (within arcChordTolMM), block positions which are re-anchored every
+// ARC_EXACT_POSITION_BLOCKS blocks and an exact end, the junction speed within an arc (limited
+// by the centripetal acceleration whatever the split) and the size and block count of a
+// circle as one G2 against G1 segments
+// Blocks are recorded as they are passed to the planner of a dry-run motion helper
+
+#include <Arduino.h>
+#include <unity.h>
+#include <stdio.h>
+#include <vector>
+#include "RdJson.h"
+#include "RobotConfigurations.h"
+#include "RobotMotion/Robots/RobotSandTableRotary.h"
+#include "WorkManager/Evaluators/EvaluatorGCode.h"
+#include "MoveCmd.h"
+
+struct RecordedBlock
+{
+    double _x;
+    double _y;
+    bool _arcJunction;
+    float _maxEntrySpeedMMps;
+};
+
+// Dry-run motion helper which records the blocks it plans (blocks are added one at a time)
+class ArcRecorder : public MotionHelperSandTableRotary
+{
+public:
+    std::vector<RecordedBlock> _blocks;
+    float _centreX;
+    float _centreY;
+    float _maxAccMMps2;
+
+    ArcRecorder(const char* pGeomSettings)
+    {
+        setDryRun();
+        String robotConfigStr = RdJson::getString("robotConfig", "", RobotConfigurations::getConfig("TranquilSmall"));
+        robotConfigStr.replace("\"blockDistanceMM\":1", pGeomSettings);
+        configure(robotConfigStr.c_str());
+        String robotAttributes;
+        getRobotAttributes(robotAttributes);
+        const char* pAttrs = robotAttributes.c_str();
+        _centreX = float(RdJson::getDouble("sizeX", 0, pAttrs) / 2 - RdJson::getDouble("originX", 0, pAttrs));
+        _centreY = float(RdJson::getDouble("sizeY", 0, pAttrs) / 2 - RdJson::getDouble("originY", 0, pAttrs));
+        _maxAccMMps2 = float(RdJson::getDouble("maxAccMMps2", 0, pAttrs));
+    }
+
+    // G-code with X, Y, I and J in mm from the bed centre (absolute positions are offset)
+    bool run(const char* pFormat, float x, float y, float arg1 = 0, float arg2 = 0)
+    {
+        char cmdStr[100];
+        snprintf(cmdStr, sizeof(cmdStr), pFormat, x, y, arg1, arg2);
+        MoveCmd moveCmd;
+        TEST_ASSERT_TRUE(EvaluatorGCode::getMoveCmd(cmdStr, moveCmd));
+        if (moveCmd._moveType != RobotMoveTypeArg_Relative)
+        {
+            moveCmd._ptMM[0] += _centreX;
+            moveCmd._ptMM[1] += _centreY;
+        }
+        while (!canAccept())
+            dryRunService(false);
+        return moveTo(moveCmd);
+    }
+
+    float finish()
+    {
+        float durationS = 0;
+        for (int serviceIdx = 0; (serviceIdx < 100000) && !(canAccept() && isIdle()); serviceIdx++)
+            durationS += dryRunService(true);
+        TEST_ASSERT_TRUE(isIdle());
+        return durationS;
+    }
+
+    // Move to a point (not recorded)
+    void startAt(float x, float y)
+    {
+        run("G1 X%f Y%f", x, y);
+        finish();
+        _blocks.clear();
+    }
+
+    double lastX()
+    {
+        return _lastCommandedAxisPos._axisPositionMM._pt[0] - _centreX;
+    }
+    double lastY()
+    {
+        return _lastCommandedAxisPos._axisPositionMM._pt[1] - _centreY;
+    }
+
+protected:
+    virtual void blocksToAddProcess() override
+    {
+        MotionHelper::blocksToAddProcess();
+    }
+    virtual bool addToPlanner(MoveCmd& moveCmd) override
+    {
+        if (!MotionHelperSandTableRotary::addToPlanner(moveCmd))
+            return false;
+        MotionBlock* pBlock = _motionPipeline.peekNthFromPut(0);
+        TEST_ASSERT_NOT_NULL(pBlock);
+        _blocks.push_back({moveCmd._ptMM[0] - _centreX, moveCmd._ptMM[1] - _centreY,
+                           moveCmd.getFlag(MoveCmd::FLAG_ARC_JUNCTION), pBlock->_maxEntrySpeedMMps});
+        return true;
+    }
+};
+
+// Checks blocks from a start point lie on an arc and are within the chord tolerance of it
+// Returns the angle swept (positive anticlockwise)
+static double checkOnArc(const std::vector<RecordedBlock>& blocks, double startX, double startY, double centreX,
+                         double centreY, double chordTolMM)
+{
+    double radius = hypot(startX - centreX, startY - centreY);
+    double prevX = startX, prevY = startY, sweep = 0;
+    for (const RecordedBlock& block : blocks)
+    {
+        TEST_ASSERT_DOUBLE_WITHIN(1e-3, radius, hypot(block._x - centreX, block._y - centreY));
+        double midDist = hypot((prevX + block._x) / 2 - centreX, (prevY + block._y) / 2 - centreY);
+        TEST_ASSERT_LESS_OR_EQUAL(chordTolMM + 1e-4, radius - midDist);
+        sweep += atan2((prevX - centreX) * (block._y - centreY) - (prevY - centreY) * (block._x - centreX),
+                       (prevX - centreX) * (block._x - centreX) + (prevY - centreY) * (block._y - centreY));
+        prevX = block._x;
+        prevY = block._y;
+    }
+    return sweep;
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+// R followed by a number is the radius - a bare R is relative motion
+void test_arc_parsing(void)
+{
+    MoveCmd moveCmd;
+    TEST_ASSERT_TRUE(EvaluatorGCode::getMoveCmd("G2 X10 Y5 R20", moveCmd));
+    TEST_ASSERT_TRUE(moveCmd.getFlag(MoveCmd::FLAG_ARC));
+    TEST_ASSERT_TRUE(moveCmd.getFlag(MoveCmd::FLAG_ARC_CW));
+    TEST_ASSERT_EQUAL_FLOAT(20, moveCmd._arcRadius);
+    TEST_ASSERT_EQUAL(RobotMoveTypeArg_None, moveCmd._moveType);
+
+    TEST_ASSERT_TRUE(EvaluatorGCode::getMoveCmd("G3 X10 Y5 R-20.5", moveCmd));
+    TEST_ASSERT_TRUE(moveCmd.getFlag(MoveCmd::FLAG_ARC));
+    TEST_ASSERT_FALSE(moveCmd.getFlag(MoveCmd::FLAG_ARC_CW));
+    TEST_ASSERT_EQUAL_FLOAT(-20.5f, moveCmd._arcRadius);
+
+    TEST_ASSERT_TRUE(EvaluatorGCode::getMoveCmd("G2 X1 Y1 R.5", moveCmd));
+    TEST_ASSERT_EQUAL_FLOAT(0.5f, moveCmd._arcRadius);
+
+    TEST_ASSERT_TRUE(EvaluatorGCode::getMoveCmd("G2 X10 Y5 I3 J-4 R", moveCmd));
+    TEST_ASSERT_EQUAL_FLOAT(3, moveCmd._arcCentreOffset[0]);
+    TEST_ASSERT_EQUAL_FLOAT(-4, moveCmd._arcCentreOffset[1]);
+    TEST_ASSERT_EQUAL_FLOAT(0, moveCmd._arcRadius);
+    TEST_ASSERT_EQUAL(RobotMoveTypeArg_Relative, moveCmd._moveType);
+
+    TEST_ASSERT_TRUE(EvaluatorGCode::getMoveCmd("G1 R X5", moveCmd));
+    TEST_ASSERT_FALSE(moveCmd.getFlag(MoveCmd::FLAG_ARC));
+    TEST_ASSERT_EQUAL(RobotMoveTypeArg_Relative, moveCmd._moveType);
+    TEST_ASSERT_EQUAL_FLOAT(0, moveCmd._arcRadius);
+}
+
+// Quarter arcs in both directions with I/J, R and negative R (the long way round) and a relative arc
+void test_arc_forms(void)
+{
+    ArcRecorder rig("\"blockDistanceMM\":1");
+    const double chordTol = 0.02;
+
+    // I/J - clockwise and anticlockwise from (40,0) to (0,40) about (0,0)
+    rig.startAt(40, 0);
+    TEST_ASSERT_TRUE(rig.run("G3 X%f Y%f I%f J%f", 0, 40, -40, 0));
+    rig.finish();
+    TEST_ASSERT_DOUBLE_WITHIN(1e-4, M_PI / 2, checkOnArc(rig._blocks, 40, 0, 0, 0, chordTol));
+    rig.startAt(40, 0);
+    TEST_ASSERT_TRUE(rig.run("G2 X%f Y%f I%f J%f", 0, 40, -40, 0));
+    rig.finish();
+    TEST_ASSERT_DOUBLE_WITHIN(1e-4, -3 * M_PI / 2, checkOnArc(rig._blocks, 40, 0, 0, 0, chordTol));
+
+    // R - the centre is on the side giving the shorter arc (so is (0,0) anticlockwise and
+    // (40,40) clockwise) - negative R gives the longer arc
+    rig.startAt(40, 0);
+    TEST_ASSERT_TRUE(rig.run("G3 X%f Y%f R%f", 0, 40, 40));
+    rig.finish();
+    TEST_ASSERT_DOUBLE_WITHIN(1e-4, M_PI / 2, checkOnArc(rig._blocks, 40, 0, 0, 0, chordTol));
+    rig.startAt(40, 0);
+    TEST_ASSERT_TRUE(rig.run("G2 X%f Y%f R%f", 0, 40, 40));
+    rig.finish();
+    TEST_ASSERT_DOUBLE_WITHIN(1e-4, -M_PI / 2, checkOnArc(rig._blocks, 40, 0, 40, 40, chordTol));
+    rig.startAt(40, 0);
+    TEST_ASSERT_TRUE(rig.run("G3 X%f Y%f R%f", 0, 40, -40));
+    rig.finish();
+    TEST_ASSERT_DOUBLE_WITHIN(1e-4, 3 * M_PI / 2, checkOnArc(rig._blocks, 40, 0, 40, 40, chordTol));
+    rig.startAt(40, 0);
+    TEST_ASSERT_TRUE(rig.run("G2 X%f Y%f R%f", 0, 40, -40));
+    rig.finish();
+    TEST_ASSERT_DOUBLE_WITHIN(1e-4, -3 * M_PI / 2, checkOnArc(rig._blocks, 40, 0, 0, 0, chordTol));
+
+    // A half circle (the chord is the diameter) and a radius too small for the chord
+    rig.startAt(40, 0);
+    TEST_ASSERT_TRUE(rig.run("G3 X%f Y%f R%f", -40, 0, 40));
+    rig.finish();
+    TEST_ASSERT_DOUBLE_WITHIN(2e-3, M_PI, checkOnArc(rig._blocks, 40, 0, 0, 0, chordTol));
+    rig.startAt(40, 0);
+    TEST_ASSERT_FALSE(rig.run("G3 X%f Y%f R%f", -40, 0, 30));
+    TEST_ASSERT_EQUAL(0, rig._blocks.size());
+
+    // Relative (bare R) - X and Y are from the start
+    rig.startAt(10, 10);
+    TEST_ASSERT_TRUE(rig.run("G3 X%f Y%f I%f J%f R", -20, 20, -20, 0));
+    rig.finish();
+    TEST_ASSERT_DOUBLE_WITHIN(1e-4, M_PI / 2, checkOnArc(rig._blocks, 10, 10, -10, 10, chordTol));
+    TEST_ASSERT_DOUBLE_WITHIN(1e-4, -10, rig.lastX());
+    TEST_ASSERT_DOUBLE_WITHIN(1e-4, 30, rig.lastY());
+}
+
+// Full circles (end at the start) with I/J in both directions and the number of blocks from
+// the block distance or (when that is off) the chord tolerance - R can't give a full circle
+void test_full_circles(void)
+{
+    {
+        ArcRecorder rig("\"blockDistanceMM\":1");
+        for (const char* pCode : {"G2 X%f Y%f I%f J%f", "G3 X%f Y%f I%f J%f"})
+        {
+            rig.startAt(50, 10);
+            TEST_ASSERT_TRUE(rig.run(pCode, 50, 10, -50, -10));
+            rig.finish();
+            double sweep = checkOnArc(rig._blocks, 50, 10, 0, 0, 0.02);
+            TEST_ASSERT_DOUBLE_WITHIN(1e-4, 2 * M_PI, fabs(sweep));
+            TEST_ASSERT_EQUAL(pCode[1] == '2', sweep < 0);
+            TEST_ASSERT_EQUAL(int(ceil(2 * M_PI * hypot(50, 10))), rig._blocks.size());
+        }
+        rig.startAt(50, 10);
+        TEST_ASSERT_FALSE(rig.run("G2 X%f Y%f R%f", 50, 10, 20));
+    }
+    for (double chordTol : {0.5, 0.02, 0.002})
+    {
+        char settings[80];
+        snprintf(settings, sizeof(settings), "\"blockDistanceMM\":0,\"arcChordTolMM\":%g", chordTol);
+        ArcRecorder rig(settings);
+        rig.startAt(60, 0);
+        TEST_ASSERT_TRUE(rig.run("G3 X%f Y%f I%f J%f", 60, 0, -60, 0));
+        rig.finish();
+        TEST_ASSERT_DOUBLE_WITHIN(1e-4, 2 * M_PI, checkOnArc(rig._blocks, 60, 0, 0, 0, chordTol));
+        double maxChord = 2 * sqrt(chordTol * (2 * 60 - chordTol));
+        TEST_ASSERT_INT_WITHIN(1, int(ceil(2 * M_PI * 60 / maxChord)), rig._blocks.size());
+    }
+}
+
+// Blocks are rotated incrementally and re-anchored every ARC_EXACT_POSITION_BLOCKS blocks so
+// errors don't accumulate over a long arc - the last block ends exactly at the end point
+void test_arc_positions(void)
+{
+    ArcRecorder rig("\"blockDistanceMM\":0.25");
+    const double radius = 100;
+    rig.startAt(100, 0);
+    TEST_ASSERT_TRUE(rig.run("G3 X%f Y%f I%f J%f", 0, -100, -100, 0));
+    rig.finish();
+    int numBlocks = int(rig._blocks.size());
+    TEST_ASSERT_EQUAL(int(ceil(1.5 * M_PI * radius / 0.25)), numBlocks);
+    TEST_ASSERT_GREATER_THAN(ArcRecorder::ARC_EXACT_POSITION_BLOCKS * 100, numBlocks);
+    double maxErr = 0, maxAnchorErr = 0;
+    for (int blockIdx = 0; blockIdx < numBlocks - 1; blockIdx++)
+    {
+        double angle = 1.5 * M_PI * (blockIdx + 1) / numBlocks;
+        double err = hypot(rig._blocks[blockIdx]._x - radius * cos(angle), rig._blocks[blockIdx]._y - radius * sin(angle));
+        maxErr = std::max(maxErr, err);
+        if ((blockIdx + 1) % ArcRecorder::ARC_EXACT_POSITION_BLOCKS == 0)
+            maxAnchorErr = std::max(maxAnchorErr, err);
+    }
+    char msg[100];
+    snprintf(msg, sizeof(msg), "%d blocks, max error %.2e mm, at re-anchored blocks %.2e mm", numBlocks, maxErr, maxAnchorErr);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_LESS_THAN(5e-4, maxAnchorErr);
+    TEST_ASSERT_LESS_THAN(1e-3, maxErr);
+
+    // Exact end
+    TEST_ASSERT_EQUAL_FLOAT(rig._centreX, float(rig._blocks.back()._x + rig._centreX));
+    TEST_ASSERT_EQUAL_FLOAT(rig._centreY - 100, float(rig._blocks.back()._y + rig._centreY));
+    TEST_ASSERT_EQUAL_FLOAT(rig._centreX, float(rig.lastX() + rig._centreX));
+    TEST_ASSERT_EQUAL_FLOAT(rig._centreY - 100, float(rig.lastY() + rig._centreY));
+}
+
+// Junctions within an arc are limited by the centripetal acceleration (not the angle between
+// blocks) so the speed doesn't depend on how finely the arc is split - the first block of
+// the arc is a normal junction
+void test_arc_junction_speed(void)
+{
+    for (double radius : {2.0, 20.0})
+    {
+        std::vector<float> speeds;
+        for (double chordTol : {0.01, 0.001})
+        {
+            char settings[80];
+            snprintf(settings, sizeof(settings), "\"blockDistanceMM\":0,\"arcChordTolMM\":%g", chordTol);
+            ArcRecorder rig(settings);
+            rig.startAt(30 + radius, 0);
+            TEST_ASSERT_TRUE(rig.run("G3 X%f Y%f I%f J%f", 30 + radius, 0, -radius, 0));
+            TEST_ASSERT_FALSE(rig._blocks[0]._arcJunction);
+            float centripetalLimit = sqrtf(rig._maxAccMMps2 * float(radius));
+            for (size_t blockIdx = 1; blockIdx < rig._blocks.size(); blockIdx++)
+            {
+                TEST_ASSERT_TRUE(rig._blocks[blockIdx]._arcJunction);
+                TEST_ASSERT_LESS_OR_EQUAL(centripetalLimit * 1.0001f, rig._blocks[blockIdx]._maxEntrySpeedMMps);
+                TEST_ASSERT_EQUAL_FLOAT(rig._blocks[1]._maxEntrySpeedMMps, rig._blocks[blockIdx]._maxEntrySpeedMMps);
+            }
+            speeds.push_back(rig._blocks[1]._maxEntrySpeedMMps);
+            rig.finish();
+
+            // Bound reached on the small radius
+            if (radius < 5)
+                TEST_ASSERT_FLOAT_WITHIN(centripetalLimit * 1e-4f, centripetalLimit, speeds.back());
+        }
+        TEST_ASSERT_EQUAL_FLOAT(speeds[0], speeds[1]);
+    }
+}
+
+// A circle as one G2 against G1 segments (each within the chord tolerance) - file size, blocks
+// planned and dry-run time (reported only - junctions within the arc are limited by the
+// centripetal acceleration whereas the near-straight junctions between segments are not)
+void test_arc_vs_segments(void)
+{
+    const double radius = 50, chordTol = 0.02;
+    int numSegs = int(ceil(2 * M_PI * radius / (2 * sqrt(chordTol * (2 * radius - chordTol)))));
+    ArcRecorder rig("\"blockDistanceMM\":1");
+
+    rig.startAt(radius, 0);
+    std::vector<String> segLines;
+    int segBytes = 0;
+    for (int segIdx = 1; segIdx <= numSegs; segIdx++)
+    {
+        char line[60];
+        double angle = -2 * M_PI * segIdx / numSegs;
+        snprintf(line, sizeof(line), "G1 X%.3f Y%.3f\n", radius * cos(angle), radius * sin(angle));
+        segBytes += strlen(line);
+        TEST_ASSERT_TRUE(rig.run(line, 0, 0));
+    }
+    float segTimeS = rig.finish();
+    int segBlocks = int(rig._blocks.size());
+
+    rig.startAt(radius, 0);
+    const char* pArcLine = "G2 X50 Y0 I-50 J0\n";
+    TEST_ASSERT_TRUE(rig.run("G2 X%g Y%g I%g J%g\n", radius, 0, -radius, 0));
+    float arcTimeS = rig.finish();
+    int arcBlocks = int(rig._blocks.size());
+
+    char msg[200];
+    snprintf(msg, sizeof(msg), "circle r%.0f: G1 %d lines %d bytes %d blocks %.1fs, G2 %d bytes %d blocks %.1fs", radius,
+             numSegs, segBytes, segBlocks, segTimeS, int(strlen(pArcLine)), arcBlocks, arcTimeS);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_LESS_THAN(segBytes / 50, int(strlen(pArcLine)));
+    TEST_ASSERT_LESS_OR_EQUAL(segBlocks, arcBlocks);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_arc_parsing);
+    RUN_TEST(test_arc_forms);
+    RUN_TEST(test_full_circles);
+    RUN_TEST(test_arc_positions);
+    RUN_TEST(test_arc_junction_speed);
+    RUN_TEST(test_arc_vs_segments);
+    return UNITY_END();
+}
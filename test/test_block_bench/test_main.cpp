@@ -0,0 +1,261 @@
+// RBotFirmware
+// Rob Dobson 2016-2018
+
+// Cycles per block - a spiral and a star are split into blocks, converted to actuator
+// coordinates and planned by the runtime-dispatched MotionHelper (sand table kinematics through
+// function pointers and MAX_AXES planner loops) and by MotionHelperT (kinematics inlined and
+// batched, planner loops bounded by the two sand table axes) - both give the same blocks, step
+// positions and drawing time and the cycles per block (dry-run ramp timing excluded) are
+// reported for the whole chain and for the planner alone
+
+#include <Arduino.h>
+#include <unity.h>
+#include <stdio.h>
+#include <algorithm>
+#include <vector>
+#include "RobotMotion/Robots/RobotSandTableRotary.h"
+#include "MoveCmd.h"
+
+static const char* ROBOT_CONFIG =
+    "{\"robotGeom\":{\"model\":\"SandBotRotary\",\"blockDistanceMM\":1,\"pipelineLen\":100,\"junctionDeviation\":0.05,"
+    "\"axis0\":{\"maxSpeed\":15,\"maxAcc\":25,\"maxRPM\":4,\"stepsPerRot\":38400},"
+    "\"axis1\":{\"maxSpeed\":15,\"maxAcc\":25,\"maxRPM\":30,\"stepsPerRot\":3200,\"unitsPerRot\":40.5,\"maxVal\":145}}}";
+
+static const int NUM_RUNS = 7;
+
+static uint64_t hostCycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// Runtime form - block splitting, planning and the transforms of the MotionHelper base (the
+// sand table kinematics through the function pointers and MAX_AXES loops)
+class RuntimeMotionHelper : public MotionHelperSandTableRotary
+{
+protected:
+    virtual void blocksToAddProcess() override
+    {
+        MotionHelper::blocksToAddProcess();
+    }
+    virtual bool addToPlanner(MoveCmd& moveCmd) override
+    {
+        return MotionHelper::addToPlanner(moveCmd);
+    }
+    virtual bool ptToActuator(AxisFloats& targetPt, AxisFloats& outActuator, bool allowOutOfBounds) override
+    {
+        return MotionHelper::ptToActuator(targetPt, outActuator, allowOutOfBounds);
+    }
+    virtual void actuatorToPt(AxisInt32s& actuatorPos, AxisFloats& outPt) override
+    {
+        MotionHelper::actuatorToPt(actuatorPos, outPt);
+    }
+    virtual void correctStepOverflow() override
+    {
+        MotionHelper::correctStepOverflow();
+    }
+};
+
+// Counts the cycles spent adding moves and splitting them into planned blocks
+template <typename Helper>
+class BlockBench : public Helper
+{
+public:
+    uint64_t _cycles;
+    double _durationS;
+
+    BlockBench()
+    {
+        _cycles = 0;
+        _durationS = 0;
+        this->setDryRun();
+        this->configure(ROBOT_CONFIG);
+    }
+
+    void run(const std::vector<AxisFloats>& pts)
+    {
+        for (const AxisFloats& pt : pts)
+        {
+            while (!this->canAccept())
+                service(false);
+            MoveCmd moveCmd;
+            moveCmd.clear();
+            moveCmd.setAxisValMM(0, pt._pt[0]);
+            moveCmd.setAxisValMM(1, pt._pt[1]);
+            moveCmd.setFlag(MoveCmd::FLAG_MORE_MOVES_COMING, true);
+            uint64_t startCycles = hostCycles();
+            this->moveTo(moveCmd);
+            _cycles += hostCycles() - startCycles;
+        }
+        for (int serviceIdx = 0; (serviceIdx < 1000000) && !(this->canAccept() && this->isIdle()); serviceIdx++)
+            service(true);
+        TEST_ASSERT_TRUE(this->isIdle());
+    }
+
+    // Points (converted with the helper's kinematics) planned directly by the NumAxes form of the
+    // planner - only the planner is timed
+    template <int NumAxes>
+    void runPlanner(const std::vector<AxisFloats>& pts)
+    {
+        for (const AxisFloats& pt : pts)
+        {
+            while (!this->_motionPipeline.canAccept())
+                _durationS += this->_rampGenerator.dryRunExecute(false);
+            MoveCmd moveCmd;
+            moveCmd.clear();
+            moveCmd.setAxisValMM(0, pt._pt[0]);
+            moveCmd.setAxisValMM(1, pt._pt[1]);
+            moveCmd.setFlag(MoveCmd::FLAG_MORE_MOVES_COMING, true);
+            AxisFloats targetPt = pt, actuatorCoords;
+            TEST_ASSERT_TRUE(this->ptToActuator(targetPt, actuatorCoords, false));
+            uint64_t startCycles = hostCycles();
+            bool isPlanned = this->_motionPlanner.template moveTo<NumAxes>(moveCmd, actuatorCoords,
+                        this->_lastCommandedAxisPos, this->_axesParams, this->_motionPipeline);
+            _cycles += hostCycles() - startCycles;
+            if (!isPlanned)
+                continue;
+            this->_lastCommandedAxisPos._axisPositionMM = targetPt;
+            this->correctStepOverflow();
+        }
+        for (int serviceIdx = 0; (serviceIdx < 1000000) && !this->isIdle(); serviceIdx++)
+            _durationS += this->_rampGenerator.dryRunExecute(true);
+        TEST_ASSERT_TRUE(this->isIdle());
+    }
+
+    uint32_t numBlocks()
+    {
+        return this->_motionPlanner.getStatsBlocks();
+    }
+    AxisInt32s steps()
+    {
+        return this->_lastCommandedAxisPos._stepsFromHome;
+    }
+
+private:
+    void service(bool flush)
+    {
+        uint64_t startCycles = hostCycles();
+        this->blocksToAddProcess();
+        _cycles += hostCycles() - startCycles;
+        _durationS += this->_rampGenerator.dryRunExecute(flush && (this->_blocksToAddTotal == 0));
+    }
+};
+
+// Cycles per block, blocks, final steps and drawing time of a run
+struct BenchResult
+{
+    double _cyclesPerBlock;
+    uint32_t _numBlocks;
+    AxisInt32s _steps;
+    double _durationS;
+};
+
+template <typename Helper>
+static BenchResult runChain(const std::vector<AxisFloats>& pts)
+{
+    BlockBench<Helper> bench;
+    bench.run(pts);
+    TEST_ASSERT_GREATER_THAN(0, bench.numBlocks());
+    return {double(bench._cycles) / bench.numBlocks(), bench.numBlocks(), bench.steps(), bench._durationS};
+}
+
+template <int NumAxes>
+static BenchResult runPlanner(const std::vector<AxisFloats>& pts)
+{
+    BlockBench<MotionHelperSandTableRotary> bench;
+    bench.template runPlanner<NumAxes>(pts);
+    TEST_ASSERT_GREATER_THAN(0, bench.numBlocks());
+    return {double(bench._cycles) / bench.numBlocks(), bench.numBlocks(), bench.steps(), bench._durationS};
+}
+
+// Runs the two forms alternately (so both see the same machine load) - both give the same
+// blocks, positions and drawing time and the minimum cycles per block of each is reported
+static void compareForms(const char* pName, const std::vector<AxisFloats>& pts, const char* pNameA,
+            BenchResult (*runA)(const std::vector<AxisFloats>&), const char* pNameB,
+            BenchResult (*runB)(const std::vector<AxisFloats>&))
+{
+    double minCyclesA = 1e30, minCyclesB = 1e30;
+    for (int runIdx = 0; runIdx < NUM_RUNS; runIdx++)
+    {
+        BenchResult resultA = runA(pts);
+        BenchResult resultB = runB(pts);
+        TEST_ASSERT_EQUAL(resultA._numBlocks, resultB._numBlocks);
+        TEST_ASSERT_DOUBLE_WITHIN(resultA._durationS * 1e-6, resultA._durationS, resultB._durationS);
+        TEST_ASSERT_EQUAL(resultA._steps.getVal(0), resultB._steps.getVal(0));
+        TEST_ASSERT_EQUAL(resultA._steps.getVal(1), resultB._steps.getVal(1));
+        minCyclesA = std::min(minCyclesA, resultA._cyclesPerBlock);
+        minCyclesB = std::min(minCyclesB, resultB._cyclesPerBlock);
+        if (runIdx == NUM_RUNS - 1)
+        {
+            char msg[200];
+            snprintf(msg, sizeof(msg), "%-7s %6u blocks %7.1fs, %s %6.0f cycles per block, %s %6.0f (saves %.0f, %.1f%%)",
+                     pName, resultB._numBlocks, resultB._durationS, pNameA, minCyclesA, pNameB, minCyclesB,
+                     minCyclesA - minCyclesB, (minCyclesA - minCyclesB) * 100 / minCyclesA);
+            TEST_MESSAGE(msg);
+        }
+    }
+
+    // Only a gross regression fails (the saving is small against planning and host timing noise)
+    if (hostCycles() != 0)
+        TEST_ASSERT_LESS_THAN(minCyclesA * 1.25, minCyclesB);
+}
+
+static void makeSpiral(std::vector<AxisFloats>& pts)
+{
+    for (int ptIdx = 0; ptIdx < 3000; ptIdx++)
+    {
+        float theta = ptIdx * 0.05f;
+        float rho = 130.0f * ptIdx / 3000;
+        pts.push_back(AxisFloats(rho * cosf(theta), rho * sinf(theta)));
+    }
+}
+
+static void makeStar(std::vector<AxisFloats>& pts)
+{
+    for (int ptIdx = 0; ptIdx < 300; ptIdx++)
+    {
+        float theta = ptIdx * 2.5f;
+        float rho = (ptIdx & 1) ? 130.0f : 20.0f;
+        pts.push_back(AxisFloats(rho * cosf(theta), rho * sinf(theta)));
+    }
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_cycles_per_block(void)
+{
+    std::vector<AxisFloats> spiral, star;
+    makeSpiral(spiral);
+    makeStar(star);
+    compareForms("spiral", spiral, "runtime", runChain<RuntimeMotionHelper>, "MotionHelperT",
+                 runChain<MotionHelperSandTableRotary>);
+    compareForms("star", star, "runtime", runChain<RuntimeMotionHelper>, "MotionHelperT",
+                 runChain<MotionHelperSandTableRotary>);
+}
+
+// The planner alone - MAX_AXES loops (as the runtime form) against loops bounded by the two
+// sand table axes
+void test_planner_cycles_per_block(void)
+{
+    std::vector<AxisFloats> spiral;
+    makeSpiral(spiral);
+    compareForms("planner", spiral, "MAX_AXES", runPlanner<RobotConsts::MAX_AXES>, "NumAxes",
+                 runPlanner<RobotSandTableRotary::NUM_ROBOT_AXES>);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_cycles_per_block);
+    RUN_TEST(test_planner_cycles_per_block);
+    return UNITY_END();
+}
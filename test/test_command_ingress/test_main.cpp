@@ -0,0 +1,210 @@
+// RBotFirmware
+// Rob Dobson 2016-2018
+
+// CommandIngress - commands posted from several tasks get their own results back and slots
+// are freed whether or not the result is collected - the latency from posting to a command
+// being carried out by the work manager's service loop and the time the posting task waits
+// (bounded by INGRESS_RSLT_TIMEOUT_MS, also when the service loop is stalled)
+// Also run with the thread sanitizer (pio test -e native_tsan)
+
+#include <Arduino.h>
+#include <unity.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "ConfigBase.h"
+#include "RobotMotion/RobotController.h"
+#include "RestAPISystem.h"
+#include "WorkManager/WorkManager.h"
+#include "WorkManager/CommandIngress.h"
+
+static CommandIngress* pIngress = NULL;
+
+// Consumer - the result of each command is derived from the command
+static void drain(std::atomic<bool>& stop, std::atomic<int>& numDrained)
+{
+    while (!stop.load())
+    {
+        const char* pCmdStr = pIngress->peek();
+        if (!pCmdStr)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        String rsltStr = String("rslt ") + pCmdStr;
+        pIngress->pop(rsltStr);
+        numDrained++;
+    }
+}
+
+void setUp(void)
+{
+    pIngress = new CommandIngress();
+}
+
+void tearDown(void)
+{
+    delete pIngress;
+}
+
+void test_results_to_each_producer(void)
+{
+    std::atomic<bool> stop(false);
+    std::atomic<int> numDrained(0);
+    std::thread consumer(drain, std::ref(stop), std::ref(numDrained));
+    static const int NUM_PRODUCERS = 4;
+    static const int CMDS_PER_PRODUCER = 2000;
+    std::atomic<int> numMismatched(0), numFailed(0), numPosted(0);
+    std::vector<std::thread> producers;
+    for (int producerIdx = 0; producerIdx < NUM_PRODUCERS; producerIdx++)
+    {
+        producers.emplace_back([producerIdx, &numMismatched, &numFailed, &numPosted]() {
+            for (int cmdIdx = 0; cmdIdx < CMDS_PER_PRODUCER; cmdIdx++)
+            {
+                String cmdStr = "cmd " + String(producerIdx) + " " + String(cmdIdx);
+                // Every other producer doesn't collect results
+                if (producerIdx & 1)
+                {
+                    if (pIngress->post(cmdStr.c_str()))
+                        numPosted++;
+                    else
+                        std::this_thread::yield();
+                    continue;
+                }
+                uint32_t ticket = 0;
+                while (!pIngress->post(cmdStr.c_str(), &ticket))
+                    std::this_thread::yield();
+                numPosted++;
+                String rsltStr;
+                if (!pIngress->waitResult(ticket, rsltStr, 5000))
+                    numFailed++;
+                else if (rsltStr != "rslt " + cmdStr)
+                    numMismatched++;
+            }
+        });
+    }
+    for (std::thread& producer : producers)
+        producer.join();
+    while (numDrained.load() < numPosted.load())
+        std::this_thread::yield();
+    stop = true;
+    consumer.join();
+    TEST_ASSERT_EQUAL(0, numFailed.load());
+    TEST_ASSERT_EQUAL(0, numMismatched.load());
+    TEST_ASSERT_TRUE(numPosted.load() >= NUM_PRODUCERS / 2 * CMDS_PER_PRODUCER);
+}
+
+// A producer which gives up waiting doesn't get the result and the slot is freed when the
+// command is processed
+void test_abandoned_result(void)
+{
+    uint32_t ticket = 0;
+    TEST_ASSERT_TRUE(pIngress->post("slow", &ticket));
+    String rsltStr;
+    TEST_ASSERT_FALSE(pIngress->waitResult(ticket, rsltStr, 10));
+    TEST_ASSERT_EQUAL_STRING("slow", pIngress->peek());
+    pIngress->pop("done");
+    TEST_ASSERT_NULL(pIngress->peek());
+
+    // All slots can be used again (more than once around)
+    for (uint32_t cmdIdx = 0; cmdIdx < CommandIngress::NUM_SLOTS * 3; cmdIdx++)
+    {
+        TEST_ASSERT_TRUE(pIngress->post("next", &ticket));
+        TEST_ASSERT_NOT_NULL(pIngress->peek());
+        pIngress->pop(String(cmdIdx));
+        TEST_ASSERT_TRUE(pIngress->waitResult(ticket, rsltStr, 0));
+        TEST_ASSERT_EQUAL_STRING(String(cmdIdx).c_str(), rsltStr.c_str());
+    }
+
+    // Uncollected results hold their slots
+    for (uint32_t cmdIdx = 0; cmdIdx < CommandIngress::NUM_SLOTS; cmdIdx++)
+    {
+        TEST_ASSERT_TRUE(pIngress->post("held", &ticket));
+        pIngress->pop("rslt");
+    }
+    TEST_ASSERT_FALSE(pIngress->post("full"));
+    TEST_ASSERT_TRUE(pIngress->waitResult(ticket - CommandIngress::NUM_SLOTS + 1, rsltStr, 0));
+    TEST_ASSERT_TRUE(pIngress->post("fits"));
+}
+
+// Commands posted while the work manager's service loop runs in another task
+void test_post_to_execution_latency(void)
+{
+    ConfigBase mainConfig, robotConfig;
+    RobotController robotController;
+    LedStrip ledStrip;
+    WireGuardManager wireGuardManager;
+    RestAPISystem restAPISystem;
+    FileManager fileManager;
+    WorkManager workManager(mainConfig, robotConfig, robotController, ledStrip, wireGuardManager, restAPISystem,
+                            fileManager);
+    static const int SERVICE_LOOP_MS = 2;
+    static const int NUM_CMDS = 200;
+    // Waits are bounded by the timeout (with a margin for host scheduling and the sanitizer)
+    static const uint32_t WAIT_BOUND_US = WorkManager::INGRESS_RSLT_TIMEOUT_MS * 2000 + 20000;
+    std::atomic<bool> stop(false);
+    std::thread serviceLoop([&workManager, &stop]() {
+        while (!stop.load())
+        {
+            workManager.service();
+            delay(SERVICE_LOOP_MS);
+        }
+    });
+    int numPending = 0;
+    uint32_t waitMaxUs = 0;
+    uint64_t waitTotalUs = 0;
+    for (int cmdIdx = 0; cmdIdx < NUM_CMDS; cmdIdx++)
+    {
+        // Immediate command (no sequence is running so the result is none)
+        String rsltStr;
+        uint32_t startUs = micros();
+        workManager.postCommand("seq_shuffle_on", rsltStr);
+        uint32_t waitUs = micros() - startUs;
+        waitTotalUs += waitUs;
+        if (waitMaxUs < waitUs)
+            waitMaxUs = waitUs;
+        if (rsltStr == "{\"rslt\":\"pending\"}")
+            numPending++;
+        else
+            TEST_ASSERT_EQUAL_STRING("{\"rslt\":\"none\"}", rsltStr.c_str());
+    }
+    stop = true;
+    serviceLoop.join();
+
+    // Latency from posting to the command being carried out (ingress stats)
+    String debugStr = workManager.getDebugStr();
+    int latPos = debugStr.indexOf(" LAT:");
+    TEST_ASSERT_TRUE(latPos >= 0);
+    int latSepPos = debugStr.indexOf("/", latPos);
+    long latAvgUs = debugStr.substring(latPos + 5, latSepPos).toInt();
+    long latMaxUs = debugStr.substring(latSepPos + 1).toInt();
+    char msg[200];
+    snprintf(msg, sizeof(msg), "%d cmds (service loop %dms): post to execution avg %ldus max %ldus, wait avg %uus max %uus, %d pending",
+             NUM_CMDS, SERVICE_LOOP_MS, latAvgUs, latMaxUs, uint32_t(waitTotalUs / NUM_CMDS), waitMaxUs, numPending);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_TRUE(debugStr.indexOf(" IN:" + String(NUM_CMDS) + "/0 ") >= 0);
+    TEST_ASSERT_LESS_OR_EQUAL(NUM_CMDS / 20, numPending);
+    TEST_ASSERT_LESS_THAN(WAIT_BOUND_US, waitMaxUs);
+
+    // Stalled service loop - the posting task only waits for the timeout and the command is
+    // carried out when the service loop runs
+    String rsltStr;
+    uint32_t startUs = micros();
+    workManager.postCommand("G1 X1", rsltStr);
+    uint32_t waitUs = micros() - startUs;
+    TEST_ASSERT_EQUAL_STRING("{\"rslt\":\"pending\"}", rsltStr.c_str());
+    TEST_ASSERT_GREATER_OR_EQUAL(WorkManager::INGRESS_RSLT_TIMEOUT_MS * 1000, waitUs);
+    TEST_ASSERT_LESS_THAN(WAIT_BOUND_US, waitUs);
+    TEST_ASSERT_TRUE(workManager.queueIsEmpty());
+    workManager.service();
+    TEST_ASSERT_FALSE(workManager.queueIsEmpty());
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_results_to_each_producer);
+    RUN_TEST(test_abandoned_result);
+    RUN_TEST(test_post_to_execution_latency);
+    return UNITY_END();
+}
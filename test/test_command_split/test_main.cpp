@@ -0,0 +1,160 @@
+// RBotFirmware
+// Rob Dobson 2016-2018
+
+// Compound commands (pieces separated by ';') - all pieces are queued or none are (a stop clears
+// the queue so pieces before it need no space) and splitting doesn't allocate per piece
+
+#include <Arduino.h>
+#include <unity.h>
+#include <stdlib.h>
+#include <chrono>
+#include <new>
+#include "ConfigBase.h"
+#include "RobotMotion/RobotController.h"
+#include "RestAPISystem.h"
+#include "WorkManager/WorkManager.h"
+
+// Allocations made with new (which includes String)
+static int numAllocs = 0;
+
+void* operator new(size_t size)
+{
+    numAllocs++;
+    void* pMem = malloc(size ? size : 1);
+    if (!pMem)
+        throw std::bad_alloc();
+    return pMem;
+}
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+void operator delete[](void* p) noexcept
+{
+    free(p);
+}
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+void operator delete[](void* p, size_t) noexcept
+{
+    free(p);
+}
+
+static const int QUEUE_MAX_LEN = 50;
+
+static bool addCommand(WorkManager& workManager, const char* pCmdStr, int cmdIdx = -1)
+{
+    String retStr;
+    WorkItem workItem(pCmdStr);
+    workManager.addWorkItem(workItem, retStr, cmdIdx);
+    return retStr.indexOf("busy") < 0;
+}
+
+// Fill the queue leaving the number of slots given
+static void fillQueue(WorkManager& workManager, int freeSlots)
+{
+    while (workManager.queueSize() < QUEUE_MAX_LEN - freeSlots)
+        TEST_ASSERT_TRUE(addCommand(workManager, "G1 X1 Y1"));
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_partial_capacity(void)
+{
+    ConfigBase mainConfig, robotConfig;
+    RobotController robotController;
+    LedStrip ledStrip;
+    WireGuardManager wireGuardManager;
+    RestAPISystem restAPISystem;
+    FileManager fileManager;
+    WorkManager workManager(mainConfig, robotConfig, robotController, ledStrip, wireGuardManager, restAPISystem,
+                            fileManager);
+
+    // Room for two of three pieces - none are queued
+    fillQueue(workManager, 2);
+    TEST_ASSERT_FALSE(addCommand(workManager, "G1 X2;G1 X3;G1 X4"));
+    TEST_ASSERT_EQUAL(QUEUE_MAX_LEN - 2, workManager.queueSize());
+
+    // Empty pieces and whitespace don't need slots
+    TEST_ASSERT_TRUE(addCommand(workManager, " G1 X2 ;; G1 X3 ; "));
+    TEST_ASSERT_EQUAL(QUEUE_MAX_LEN, workManager.queueSize());
+
+    // Full - immediate commands need no slot but aren't handled if the rest can't be queued
+    TEST_ASSERT_FALSE(addCommand(workManager, "G1 X5"));
+    TEST_ASSERT_FALSE(addCommand(workManager, "seq_shuffle_on;G1 X5"));
+    TEST_ASSERT_TRUE(addCommand(workManager, "seq_shuffle_on"));
+    TEST_ASSERT_EQUAL(QUEUE_MAX_LEN, workManager.queueSize());
+
+    // The index selects one piece so only it needs a slot
+    TEST_ASSERT_TRUE(addCommand(workManager, "stop"));
+    fillQueue(workManager, 1);
+    TEST_ASSERT_FALSE(addCommand(workManager, "G1 X6;G1 X7"));
+    TEST_ASSERT_TRUE(addCommand(workManager, "G1 X6;G1 X7", 1));
+    TEST_ASSERT_EQUAL(QUEUE_MAX_LEN, workManager.queueSize());
+
+    // A stop clears the queue so only the pieces after it need slots (and must fit the queue)
+    TEST_ASSERT_TRUE(addCommand(workManager, "G1 X8;stop;G1 X9;G1 X10"));
+    TEST_ASSERT_EQUAL(2, workManager.queueSize());
+    String tooLong = "stop";
+    for (int i = 0; i <= QUEUE_MAX_LEN; i++)
+        tooLong += ";G1 X1";
+    TEST_ASSERT_FALSE(addCommand(workManager, tooLong.c_str()));
+    TEST_ASSERT_EQUAL(2, workManager.queueSize());
+}
+
+// Allocations when queueing don't depend on the number of pieces - reports the time per piece
+void test_split_allocations(void)
+{
+    ConfigBase mainConfig, robotConfig;
+    RobotController robotController;
+    LedStrip ledStrip;
+    WireGuardManager wireGuardManager;
+    RestAPISystem restAPISystem;
+    FileManager fileManager;
+    WorkManager workManager(mainConfig, robotConfig, robotController, ledStrip, wireGuardManager, restAPISystem,
+                            fileManager);
+
+    const char* cmds[] = {"stop;G1 X1 Y1", "stop;G1 X1 Y1;G1 X2 Y2;G1 X3 Y3;G1 X4 Y4;G1 X5 Y5;G1 X6 Y6;G1 X7 Y7"};
+    const int numPieces[] = {1, 7};
+    const int REPS = 10000;
+    int allocsPerCmd[2] = {0, 0};
+    char msg[200];
+    int msgLen = 0;
+    for (int cmdIdx = 0; cmdIdx < 2; cmdIdx++)
+    {
+        String retStr;
+        WorkItem workItem(cmds[cmdIdx]);
+        workManager.addWorkItem(workItem, retStr);
+        TEST_ASSERT_EQUAL(numPieces[cmdIdx], workManager.queueSize());
+        int allocsAtStart = numAllocs;
+        auto startTime = std::chrono::steady_clock::now();
+        for (int rep = 0; rep < REPS; rep++)
+            workManager.addWorkItem(workItem, retStr);
+        double elapsedUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - startTime).count();
+        allocsPerCmd[cmdIdx] = (numAllocs - allocsAtStart + REPS - 1) / REPS;
+        msgLen += snprintf(msg + msgLen, sizeof(msg) - msgLen, "%d pieces %d allocs %.3fus/piece  ", numPieces[cmdIdx],
+                           allocsPerCmd[cmdIdx], elapsedUs / REPS / numPieces[cmdIdx]);
+    }
+    TEST_ASSERT_EQUAL(allocsPerCmd[0], allocsPerCmd[1]);
+    TEST_MESSAGE(msg);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_partial_capacity);
+    RUN_TEST(test_split_allocations);
+    return UNITY_END();
+}
@@ -0,0 +1,176 @@
+// RBotFirmware
+// Rob Dobson 2016-2018
+
+// Work item dispatch - items are classified when queued and only file and sequence names are
+// looked up on the (host) file system, repeated lookups of the same name are served from the
+// file info cache until a file is uploaded or deleted - stat calls are counted by the host
+// FileManager and the time to queue (classify) each type of item is reported
+
+#include <Arduino.h>
+#include <unity.h>
+#include <stdio.h>
+#include <chrono>
+#include "ConfigBase.h"
+#include "RobotMotion/RobotController.h"
+#include "RestAPISystem.h"
+#include "WorkManager/WorkManager.h"
+
+static const char* HOST_ROOT = "/tmp/test_dispatch";
+
+struct StatCounts
+{
+    int _stats;
+    int _hits;
+    int _misses;
+};
+
+static StatCounts getStatCounts(FileManager& fileManager)
+{
+    StatCounts counts;
+    counts._stats = fileManager.getNumStatCalls();
+    fileManager.getFileInfoCacheStats(counts._hits, counts._misses);
+    return counts;
+}
+
+// Queue a command a number of times - returns the stat calls, hits and misses this caused
+static StatCounts queueItems(WorkManager& workManager, FileManager& fileManager, const char* pCmdStr, int numItems)
+{
+    StatCounts before = getStatCounts(fileManager);
+    for (int itemIdx = 0; itemIdx < numItems; itemIdx++)
+    {
+        String retStr;
+        WorkItem workItem(pCmdStr);
+        workManager.addWorkItem(workItem, retStr);
+        TEST_ASSERT_EQUAL_STRING_MESSAGE("{\"rslt\":\"ok\"}", retStr.c_str(), pCmdStr);
+    }
+    StatCounts after = getStatCounts(fileManager);
+    return {after._stats - before._stats, after._hits - before._hits, after._misses - before._misses};
+}
+
+static void assertCounts(int stats, int hits, int misses, const StatCounts& counts, const char* pMsg)
+{
+    TEST_ASSERT_EQUAL_MESSAGE(stats, counts._stats, pMsg);
+    TEST_ASSERT_EQUAL_MESSAGE(hits, counts._hits, pMsg);
+    TEST_ASSERT_EQUAL_MESSAGE(misses, counts._misses, pMsg);
+}
+
+static void clearQueue(WorkManager& workManager)
+{
+    String retStr;
+    WorkItem workItem("stop");
+    workManager.addWorkItem(workItem, retStr);
+    TEST_ASSERT_EQUAL(0, workManager.queueSize());
+}
+
+static void writeFile(FileManager& fileManager, const char* pFileName, const char* pContents)
+{
+    String contents = pContents;
+    TEST_ASSERT_TRUE(fileManager.setFileContents("", pFileName, contents));
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+// G-code and theta-rho lines never stat, a file is looked up once (each queued theta-rho file
+// is also prefetched which takes its status) and uploads and deletes invalidate the lookups
+void test_stat_counts(void)
+{
+    ConfigBase mainConfig, robotConfig;
+    RobotController robotController;
+    LedStrip ledStrip;
+    WireGuardManager wireGuardManager;
+    RestAPISystem restAPISystem;
+    FileManager fileManager;
+    fileManager.setHostRoot(HOST_ROOT);
+    WorkManager workManager(mainConfig, robotConfig, robotController, ledStrip, wireGuardManager, restAPISystem,
+                            fileManager);
+    writeFile(fileManager, "pattern.thr", "0 0\n1 1\n");
+    writeFile(fileManager, "list.seq", "pattern.thr\n");
+    fileManager.deleteFile("", "missing.thr");
+
+    assertCounts(0, 0, 0, queueItems(workManager, fileManager, "G1 X10 Y10 F3000", 20), "gcode");
+    assertCounts(0, 0, 0, queueItems(workManager, fileManager, "_THRLINE0/1.2345/0.5", 20), "thr lines");
+    assertCounts(0, 0, 0, queueItems(workManager, fileManager, "M17", 5), "M17");
+    clearQueue(workManager);
+
+    // File names are looked up once - theta-rho files are prefetched each time they are queued
+    assertCounts(1 + 5, 4, 1, queueItems(workManager, fileManager, "pattern.thr", 5), "file");
+    assertCounts(5, 5, 0, queueItems(workManager, fileManager, "pattern.thr REV R90", 5), "file options");
+    assertCounts(1, 2, 1, queueItems(workManager, fileManager, "missing.thr", 3), "missing file");
+    assertCounts(1, 1, 1, queueItems(workManager, fileManager, "list.seq", 2), "sequence");
+    assertCounts(0, 0, 0, queueItems(workManager, fileManager, "G1 X1", 10), "gcode with files cached");
+    clearQueue(workManager);
+
+    // Uploading a file invalidates the lookups (the missing file is now found)
+    const char* pUploaded = "0 0.5\n";
+    fileManager.uploadAPIBlockHandler("", "", "missing.thr", 3, 0, (uint8_t*)pUploaded, 3, false);
+    assertCounts(0, 1, 0, queueItems(workManager, fileManager, "missing.thr", 1), "upload in progress");
+    fileManager.uploadAPIBlockHandler("", "", "missing.thr", 3, 3, (uint8_t*)pUploaded + 3, 3, true);
+    fileManager.uploadAPIBlocksComplete();
+    assertCounts(1 + 2, 1, 1, queueItems(workManager, fileManager, "missing.thr", 2), "uploaded");
+    assertCounts(1 + 1, 0, 1, queueItems(workManager, fileManager, "pattern.thr", 1), "other file after upload");
+
+    // Deleting a file invalidates the lookups (the deleted file is no longer a file)
+    TEST_ASSERT_TRUE(fileManager.deleteFile("", "pattern.thr"));
+    assertCounts(1, 2, 1, queueItems(workManager, fileManager, "pattern.thr", 3), "deleted");
+    assertCounts(1 + 1, 0, 1, queueItems(workManager, fileManager, "missing.thr", 1), "other file after delete");
+    clearQueue(workManager);
+}
+
+// Time to queue (and so classify) each type of item - file lines are cached lookups (and a
+// prefetch of the first block)
+void test_queue_benchmark(void)
+{
+    ConfigBase mainConfig, robotConfig;
+    RobotController robotController;
+    LedStrip ledStrip;
+    WireGuardManager wireGuardManager;
+    RestAPISystem restAPISystem;
+    FileManager fileManager;
+    fileManager.setHostRoot(HOST_ROOT);
+    WorkManager workManager(mainConfig, robotConfig, robotController, ledStrip, wireGuardManager, restAPISystem,
+                            fileManager);
+    writeFile(fileManager, "pattern.thr", "0 0\n1 1\n");
+
+    static const int ITEMS_PER_FILL = 40;
+    static const int NUM_FILLS = 250;
+    const char* cmds[] = {"G1 X10 Y10 F3000", "_THRLINE0/1.2345/0.5", "pattern.thr"};
+    for (const char* pCmdStr : cmds)
+    {
+        StatCounts before = getStatCounts(fileManager);
+        double elapsedS = 0;
+        for (int fillIdx = 0; fillIdx < NUM_FILLS; fillIdx++)
+        {
+            auto startTime = std::chrono::steady_clock::now();
+            for (int itemIdx = 0; itemIdx < ITEMS_PER_FILL; itemIdx++)
+            {
+                String retStr;
+                WorkItem workItem(pCmdStr);
+                workManager.addWorkItem(workItem, retStr);
+            }
+            elapsedS += std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+            TEST_ASSERT_EQUAL(ITEMS_PER_FILL, workManager.queueSize());
+            clearQueue(workManager);
+        }
+        StatCounts after = getStatCounts(fileManager);
+        int numItems = ITEMS_PER_FILL * NUM_FILLS;
+        char msg[160];
+        snprintf(msg, sizeof(msg), "%-22s %6.0f ns per item, stat calls %d file info misses %d per %d items", pCmdStr,
+                 elapsedS * 1e9 / numItems, after._stats - before._stats, after._misses - before._misses, numItems);
+        TEST_MESSAGE(msg);
+        TEST_ASSERT_LESS_OR_EQUAL(1, after._misses - before._misses);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_stat_counts);
+    RUN_TEST(test_queue_benchmark);
+    return UNITY_END();
+}
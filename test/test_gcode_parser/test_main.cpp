@@ -0,0 +1,186 @@
+// RBotFirmware
+// Rob Dobson 2016-2018
+
+// GCodeParser - words, codes, comments, checksums, line numbers and random input
+
+#include <unity.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include "WorkManager/Evaluators/GCodeParser.h"
+
+static bool parse(const char* pLine, GCodeCommand& cmd)
+{
+    return GCodeParser::parse(pLine, pLine + strlen(pLine), cmd);
+}
+
+static std::string withChecksum(const std::string& line, uint8_t xorWith = 0)
+{
+    uint8_t checksum = 0;
+    for (char ch : line)
+        checksum ^= uint8_t(ch);
+    return line + "*" + std::to_string(checksum ^ xorWith);
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_words(void)
+{
+    GCodeCommand cmd;
+    TEST_ASSERT_TRUE(parse("G1 X10.5 Y-3.25 F3000", cmd));
+    TEST_ASSERT_EQUAL(1, cmd._numCodes);
+    TEST_ASSERT_EQUAL('G', cmd._codes[0]._letter);
+    TEST_ASSERT_EQUAL(1, cmd._codes[0]._num);
+    TEST_ASSERT_EQUAL_FLOAT(10.5f, cmd.getWord('X'));
+    TEST_ASSERT_EQUAL_FLOAT(-3.25f, cmd.getWord('Y'));
+    TEST_ASSERT_EQUAL_FLOAT(3000.0f, cmd.getWord('F'));
+    TEST_ASSERT_FALSE(cmd.hasWord('Z'));
+    TEST_ASSERT_EQUAL_FLOAT(7.0f, cmd.getWord('Z', 7.0f));
+    TEST_ASSERT_FALSE(cmd._hasLineNum);
+
+    // Lower case, no separators, leading point and no exponents (1E2 is X1 then E2)
+    TEST_ASSERT_TRUE(parse("g1x10y.5", cmd));
+    TEST_ASSERT_EQUAL('G', cmd._codes[0]._letter);
+    TEST_ASSERT_EQUAL_FLOAT(10.0f, cmd.getWord('X'));
+    TEST_ASSERT_EQUAL_FLOAT(0.5f, cmd.getWord('Y'));
+    TEST_ASSERT_TRUE(parse("G0 X1E2", cmd));
+    TEST_ASSERT_EQUAL_FLOAT(1.0f, cmd.getWord('X'));
+    TEST_ASSERT_EQUAL_FLOAT(2.0f, cmd.getWord('E'));
+
+    // Bare words
+    TEST_ASSERT_TRUE(parse("G1 R X5", cmd));
+    TEST_ASSERT_TRUE(cmd.hasBareWord('R'));
+    TEST_ASSERT_FALSE(cmd.hasWord('R'));
+    TEST_ASSERT_EQUAL_FLOAT(5.0f, cmd.getWord('X'));
+}
+
+void test_codes(void)
+{
+    GCodeCommand cmd;
+    TEST_ASSERT_TRUE(parse("G90 G0 X5 M400", cmd));
+    TEST_ASSERT_EQUAL(3, cmd._numCodes);
+    TEST_ASSERT_EQUAL(90, cmd._codes[0]._num);
+    TEST_ASSERT_EQUAL(0, cmd._codes[1]._num);
+    TEST_ASSERT_EQUAL('M', cmd._codes[2]._letter);
+    TEST_ASSERT_EQUAL(400, cmd._codes[2]._num);
+    TEST_ASSERT_TRUE(parse("G38.2 Z-1", cmd));
+    TEST_ASSERT_EQUAL(38, cmd._codes[0]._num);
+    TEST_ASSERT_EQUAL(2, cmd._codes[0]._subCode);
+
+    // Too many codes or out of range
+    TEST_ASSERT_FALSE(parse("G1 G1 G1 G1 G1", cmd));
+    TEST_ASSERT_FALSE(parse("G-1", cmd));
+    TEST_ASSERT_FALSE(parse("M70000", cmd));
+}
+
+void test_comments(void)
+{
+    GCodeCommand cmd;
+    TEST_ASSERT_TRUE(parse("G90 G0 X5 ; comment X99", cmd));
+    TEST_ASSERT_EQUAL_FLOAT(5.0f, cmd.getWord('X'));
+    TEST_ASSERT_TRUE(parse("G1 (move X99) X7", cmd));
+    TEST_ASSERT_EQUAL_FLOAT(7.0f, cmd.getWord('X'));
+    TEST_ASSERT_TRUE(parse("G1 X7 (unterminated Y9", cmd));
+    TEST_ASSERT_FALSE(cmd.hasWord('Y'));
+    TEST_ASSERT_TRUE(parse("; only a comment", cmd));
+    TEST_ASSERT_EQUAL(0, cmd._numCodes);
+}
+
+void test_checksum(void)
+{
+    GCodeCommand cmd;
+    std::string good = withChecksum("N12 G1 X1");
+    std::string bad = withChecksum("N12 G1 X1", 1);
+    TEST_ASSERT_TRUE(parse(good.c_str(), cmd));
+    TEST_ASSERT_TRUE(cmd._hasLineNum);
+    TEST_ASSERT_EQUAL(12, cmd._lineNum);
+    TEST_ASSERT_FALSE(parse(bad.c_str(), cmd));
+    TEST_ASSERT_FALSE(parse("N12 G1 X1*", cmd));
+}
+
+void test_line_numbers(void)
+{
+    GCodeCommand cmd;
+    TEST_ASSERT_TRUE(parse("  G0 X12.345 N1000123  ", cmd));
+    TEST_ASSERT_EQUAL(1000123, cmd._lineNum);
+    TEST_ASSERT_TRUE(parse("N2147483647 G0", cmd));
+    TEST_ASSERT_EQUAL(INT32_MAX, cmd._lineNum);
+    TEST_ASSERT_TRUE(parse("N-5 G0", cmd));
+    TEST_ASSERT_EQUAL(-5, cmd._lineNum);
+
+    // Out of range line numbers are malformed rather than wrapped
+    TEST_ASSERT_FALSE(parse("N2147483648 G0", cmd));
+    TEST_ASSERT_FALSE(parse("N-2147483649 G0", cmd));
+    TEST_ASSERT_FALSE(parse("N99999999999999999999 G0", cmd));
+}
+
+// Random bytes (including bytes with the top bit set) in exactly sized buffers
+void test_random_input(void)
+{
+    std::mt19937 rng(1);
+    const char chars[] = "GMNXYZFIJRSDE*;()0123456789.-+ \t\r\nabcxyz\x01\xff";
+    for (int trial = 0; trial < 200000; trial++)
+    {
+        int len = rng() % 40;
+        std::vector<char> buf(len + 1);
+        for (int idx = 0; idx < len; idx++)
+            buf[idx] = (rng() % 4 == 0) ? char(rng()) : chars[rng() % (sizeof(chars) - 1)];
+        GCodeCommand cmd;
+        if (GCodeParser::parse(buf.data(), buf.data() + len, cmd))
+        {
+            TEST_ASSERT_TRUE(cmd._numCodes <= GCodeCommand::MAX_CODES);
+            TEST_ASSERT_EQUAL(0, cmd._wordMask & ~0x3ffffffUL);
+        }
+    }
+}
+
+// Typical move lines - reports throughput
+void test_throughput(void)
+{
+    std::mt19937 rng(2);
+    std::uniform_real_distribution<double> coord(-200, 200);
+    std::vector<std::string> lines;
+    char buf[100];
+    for (int line = 0; line < 100000; line++)
+    {
+        snprintf(buf, sizeof(buf), "G1 X%0.3f Y%0.3f F%d", coord(rng), coord(rng), 1000 + line % 500);
+        lines.push_back(buf);
+    }
+    double sum = 0;
+    auto startTime = std::chrono::steady_clock::now();
+    for (int rep = 0; rep < 10; rep++)
+    {
+        for (const std::string& line : lines)
+        {
+            GCodeCommand cmd;
+            TEST_ASSERT_TRUE(GCodeParser::parse(line.c_str(), line.c_str() + line.size(), cmd));
+            sum += cmd.getWord('X');
+        }
+    }
+    double elapsedS = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    char msg[100];
+    snprintf(msg, sizeof(msg), "%.1f Mlines/s (%g)", lines.size() * 10 / elapsedS / 1e6, sum);
+    TEST_MESSAGE(msg);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_words);
+    RUN_TEST(test_codes);
+    RUN_TEST(test_comments);
+    RUN_TEST(test_checksum);
+    RUN_TEST(test_line_numbers);
+    RUN_TEST(test_random_input);
+    RUN_TEST(test_throughput);
+    return UNITY_END();
+}
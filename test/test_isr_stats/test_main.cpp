@@ -0,0 +1,140 @@
+// RBotFirmware
+// Rob Dobson 2016-2018
+
+// IsrStats - log2 bin boundaries (from 64 cycles), separation of the ISR paths (idle, new block
+// and step), max and overruns against the budget and the reset carried out on the ISR side
+// ISR durations are simulated by holding the host cycle counter at a fixed count
+
+#include <Arduino.h>
+#include <unity.h>
+#include <stdio.h>
+#include "RdJson.h"
+#include "RobotMotion/MotionControl/RampGenerator/IsrStats.h"
+
+static const int64_t CYCLE_COUNT_AT_EXIT = 1000000000;
+
+// Record an ISR which took the cycles given
+static void recordIsr(IsrStats& stats, IsrStats::IsrPath path, uint32_t cycles)
+{
+    hostFixedCycleCount = CYCLE_COUNT_AT_EXIT;
+    stats.record(path, uint32_t(CYCLE_COUNT_AT_EXIT - cycles));
+    hostFixedCycleCount = -1;
+}
+
+static long getStat(IsrStats& stats, const char* pPath)
+{
+    String json = stats.getJSON();
+    return RdJson::getLong(pPath, -1, json.c_str());
+}
+
+static long getBin(IsrStats& stats, const char* pPathName, int binIdx)
+{
+    char path[40];
+    snprintf(path, sizeof(path), "%s/bins[%d]", pPathName, binIdx);
+    return getStat(stats, path);
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_bin_boundaries(void)
+{
+    TEST_ASSERT_EQUAL(0, IsrStats::binIndex(0));
+    TEST_ASSERT_EQUAL(0, IsrStats::binIndex(1));
+    TEST_ASSERT_EQUAL(0, IsrStats::binIndex(63));
+    TEST_ASSERT_EQUAL(1, IsrStats::binIndex(64));
+    TEST_ASSERT_EQUAL(1, IsrStats::binIndex(127));
+    TEST_ASSERT_EQUAL(2, IsrStats::binIndex(128));
+    for (int binIdx = 1; binIdx < IsrStats::NUM_BINS; binIdx++)
+    {
+        uint32_t lower = IsrStats::binLowerCycles(binIdx);
+        TEST_ASSERT_EQUAL(64u << (binIdx - 1), lower);
+        TEST_ASSERT_EQUAL(binIdx, IsrStats::binIndex(lower));
+        TEST_ASSERT_EQUAL(binIdx - 1, IsrStats::binIndex(lower - 1));
+    }
+    TEST_ASSERT_EQUAL(0, IsrStats::binLowerCycles(0));
+
+    // The last bin holds everything longer
+    TEST_ASSERT_EQUAL(IsrStats::NUM_BINS - 1, IsrStats::binIndex(IsrStats::binLowerCycles(IsrStats::NUM_BINS - 1) * 4));
+    TEST_ASSERT_EQUAL(IsrStats::NUM_BINS - 1, IsrStats::binIndex(0xffffffff));
+
+    // Reported lower bounds
+    IsrStats stats;
+    TEST_ASSERT_EQUAL(0, getStat(stats, "binLowerCycles[0]"));
+    TEST_ASSERT_EQUAL(64, getStat(stats, "binLowerCycles[1]"));
+    TEST_ASSERT_EQUAL(128, getStat(stats, "binLowerCycles[2]"));
+}
+
+// Each path has its own histogram, max and overruns - the budget is the ISR interval
+void test_paths_and_budget(void)
+{
+    IsrStats stats;
+    stats.setBudget(20, 240);
+    TEST_ASSERT_EQUAL(20, getStat(stats, "budgetUs"));
+
+    recordIsr(stats, IsrStats::PATH_IDLE, 40);
+    recordIsr(stats, IsrStats::PATH_IDLE, 50);
+    recordIsr(stats, IsrStats::PATH_NEW_BLOCK, 3000);
+    recordIsr(stats, IsrStats::PATH_NEW_BLOCK, 20 * 240 + 1);
+    recordIsr(stats, IsrStats::PATH_STEP, 200);
+    recordIsr(stats, IsrStats::PATH_STEP, 20 * 240);
+    recordIsr(stats, IsrStats::PATH_STEP, 100);
+
+    TEST_ASSERT_EQUAL(2, getStat(stats, "idle/count"));
+    TEST_ASSERT_EQUAL(2, getBin(stats, "idle", 0));
+    TEST_ASSERT_EQUAL(50, getStat(stats, "idle/maxCycles"));
+    TEST_ASSERT_EQUAL(0, getStat(stats, "idle/overruns"));
+
+    TEST_ASSERT_EQUAL(2, getStat(stats, "newBlock/count"));
+    TEST_ASSERT_EQUAL(1, getBin(stats, "newBlock", IsrStats::binIndex(3000)));
+    TEST_ASSERT_EQUAL(1, getBin(stats, "newBlock", IsrStats::binIndex(20 * 240 + 1)));
+    TEST_ASSERT_EQUAL(20 * 240 + 1, getStat(stats, "newBlock/maxCycles"));
+    TEST_ASSERT_EQUAL(1, getStat(stats, "newBlock/overruns"));
+
+    // Exactly the budget isn't an overrun
+    TEST_ASSERT_EQUAL(3, getStat(stats, "step/count"));
+    TEST_ASSERT_EQUAL(1, getBin(stats, "step", 1));
+    TEST_ASSERT_EQUAL(1, getBin(stats, "step", 2));
+    TEST_ASSERT_EQUAL(20 * 240, getStat(stats, "step/maxCycles"));
+    TEST_ASSERT_EQUAL(0, getStat(stats, "step/overruns"));
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 20.0f, float(RdJson::getDouble("step/maxUs", 0, stats.getJSON().c_str())));
+}
+
+// A reset is only carried out by the next ISR (so the ISR never sees partly cleared counts)
+void test_reset_from_isr(void)
+{
+    IsrStats stats;
+    stats.setBudget(20, 240);
+    for (int isrIdx = 0; isrIdx < 10; isrIdx++)
+        recordIsr(stats, IsrStats::PATH_STEP, 10000);
+    recordIsr(stats, IsrStats::PATH_IDLE, 30);
+    stats.reset();
+    TEST_ASSERT_EQUAL(10, getStat(stats, "step/count"));
+    TEST_ASSERT_EQUAL(10, getStat(stats, "step/overruns"));
+
+    recordIsr(stats, IsrStats::PATH_IDLE, 70);
+    TEST_ASSERT_EQUAL(0, getStat(stats, "step/count"));
+    TEST_ASSERT_EQUAL(0, getStat(stats, "step/maxCycles"));
+    TEST_ASSERT_EQUAL(0, getStat(stats, "step/overruns"));
+    TEST_ASSERT_EQUAL(1, getStat(stats, "idle/count"));
+    TEST_ASSERT_EQUAL(1, getBin(stats, "idle", 1));
+    TEST_ASSERT_EQUAL(70, getStat(stats, "idle/maxCycles"));
+
+    // Only once
+    recordIsr(stats, IsrStats::PATH_IDLE, 30);
+    TEST_ASSERT_EQUAL(2, getStat(stats, "idle/count"));
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_bin_boundaries);
+    RUN_TEST(test_paths_and_budget);
+    RUN_TEST(test_reset_from_isr);
+    return UNITY_END();
+}
@@ -0,0 +1,251 @@
+// RBotFirmware
+// Rob Dobson 2016-2018
+
+// Microstep switching - full-step phase learned from the driver microstep counter (MSCNT) and
+// the planner's step target rounding checked against a model of the drivers - every switch to
+// the reduced mode must happen with each driver on a full step (MSCNT 128 + 256k) and moves in
+// the reduced mode must be whole reduced-mode steps
+
+#include <unity.h>
+#include <random>
+#include <TMCStepper.h>
+#include "RobotMotion/MotionControl/Trinamics/TrinamicsController.h"
+#include "RobotMotion/MotionControl/MotionPlanner.h"
+#include "RobotMotion/MotionControl/MotionPipeline.h"
+#include "MoveCmd.h"
+
+static const int MICROSTEPS = 16;
+static const int MSCNT_PER_MICROSTEP = 256 / MICROSTEPS;
+static const float STEPS_PER_MM = 320;
+static const char* ROBOT_CONFIG_JSON =
+    "{\"axis0\":{\"maxSpeed\":100,\"maxAcc\":500,\"stepsPerRot\":3200,\"unitsPerRot\":10,\"maxRPM\":600},"
+    "\"axis1\":{\"maxSpeed\":100,\"maxAcc\":500,\"stepsPerRot\":3200,\"unitsPerRot\":10,\"maxRPM\":600},"
+    "\"motionController\":{\"chip\":\"TMC2209\",\"TX1\":\"17\",\"TX2\":\"16\",\"microsteps\":16,"
+    "\"highSpeedMicrosteps\":4,\"highSpeedStepRate\":8000}}";
+
+// Model of a driver - MSCNT moves with the step count in a direction which depends on wiring
+struct DriverModel
+{
+    TMC2208Stepper* _pDriver;
+    int _polarity;
+    int32_t _steps;
+
+    void move(int32_t steps)
+    {
+        _steps += steps;
+        _pDriver->_mscnt = uint16_t(((int32_t(_pDriver->_mscnt) + _polarity * steps * MSCNT_PER_MICROSTEP) % 1024 + 1024) % 1024);
+    }
+    bool isOnFullStep()
+    {
+        return (_pDriver->_mscnt % 256) == 128;
+    }
+};
+
+static std::mt19937 rng(1);
+static AxesParams* pAxesParams = NULL;
+static MotionPipeline* pPipeline = NULL;
+static TrinamicsController* pTrinamics = NULL;
+static DriverModel drivers[2];
+
+static void calibrate()
+{
+    AxisInt32s actuatorPos;
+    actuatorPos.set(drivers[0]._steps, drivers[1]._steps, 0);
+    pTrinamics->calibrateFullStepPhase(actuatorPos);
+}
+
+// Steps at the learned phase must be exactly the full step positions
+static void checkPhase(int axisIdx)
+{
+    int32_t phase = -1;
+    TEST_ASSERT_TRUE(pTrinamics->getFullStepPhase(axisIdx, phase));
+    DriverModel& driver = drivers[axisIdx];
+    int32_t offset = (((driver._steps - phase) % MICROSTEPS) + MICROSTEPS) % MICROSTEPS;
+    driver.move(-offset);
+    TEST_ASSERT_TRUE(driver.isOnFullStep());
+    driver.move(offset);
+}
+
+void setUp(void)
+{
+    pAxesParams = new AxesParams();
+    String axisJSON;
+    pAxesParams->configureAxis(ROBOT_CONFIG_JSON, 0, axisJSON);
+    pAxesParams->configureAxis(ROBOT_CONFIG_JSON, 1, axisJSON);
+    pPipeline = new MotionPipeline();
+    pPipeline->init(100);
+    pTrinamics = new TrinamicsController(*pAxesParams, *pPipeline);
+    pTrinamics->configure(ROBOT_CONFIG_JSON);
+    TEST_ASSERT_EQUAL(2, TMC2208Stepper::getDrivers().size());
+
+    // Drivers start at a random microstep with opposite MSCNT directions
+    for (int axisIdx = 0; axisIdx < 2; axisIdx++)
+    {
+        drivers[axisIdx]._pDriver = TMC2208Stepper::getDrivers()[axisIdx];
+        drivers[axisIdx]._polarity = axisIdx == 0 ? 1 : -1;
+        drivers[axisIdx]._steps = int32_t(rng() % 100000) - 50000;
+        drivers[axisIdx]._pDriver->_mscnt = uint16_t((rng() % 64) * MSCNT_PER_MICROSTEP);
+    }
+}
+
+void tearDown(void)
+{
+    delete pTrinamics;
+    delete pPipeline;
+    delete pAxesParams;
+}
+
+void test_phase_learned(void)
+{
+    TEST_ASSERT_TRUE(pTrinamics->isMicrostepSwitchEnabled());
+    TEST_ASSERT_EQUAL(2, pTrinamics->getHighSpeedMicrostepShift());
+
+    // One sample isn't enough to know the MSCNT direction
+    int32_t phase = -1;
+    calibrate();
+    TEST_ASSERT_FALSE(pTrinamics->getFullStepPhase(0, phase));
+    drivers[0].move(37);
+    drivers[1].move(-5);
+    calibrate();
+    checkPhase(0);
+    checkPhase(1);
+
+    // Later samples at other positions agree
+    for (int trial = 0; trial < 100; trial++)
+    {
+        drivers[0].move(int32_t(rng() % 2001) - 1000);
+        drivers[1].move(int32_t(rng() % 2001) - 1000);
+        calibrate();
+        checkPhase(0);
+        checkPhase(1);
+    }
+}
+
+void test_phase_relearned(void)
+{
+    calibrate();
+    drivers[0].move(100);
+    drivers[1].move(100);
+    calibrate();
+    checkPhase(0);
+
+    // Lost steps on axis 0 (MSCNT moves but the step count doesn't) are found by the next check
+    drivers[0]._pDriver->_mscnt = (drivers[0]._pDriver->_mscnt + 3 * MSCNT_PER_MICROSTEP) % 1024;
+    drivers[0].move(50);
+    drivers[1].move(50);
+    calibrate();
+    int32_t phase = -1;
+    TEST_ASSERT_FALSE(pTrinamics->getFullStepPhase(0, phase));
+    checkPhase(1);
+
+    // And the phase is learned again from the next two samples
+    drivers[0].move(-21);
+    calibrate();
+    checkPhase(0);
+
+    // A driver which isn't on a microstep (e.g. reset) is not used
+    drivers[1]._pDriver->_mscnt += 3;
+    calibrate();
+    TEST_ASSERT_FALSE(pTrinamics->getFullStepPhase(1, phase));
+}
+
+// Random moves through the planner (as MotionHelper adds them) with the drivers following each
+// block's microstep mode and steps
+void test_switch_continuity(void)
+{
+    calibrate();
+    drivers[0].move(1234);
+    drivers[1].move(-777);
+    calibrate();
+
+    MotionPlanner planner;
+    planner.configure(0.05f);
+    planner.configureMicrostepSwitch(pTrinamics->getHighSpeedMicrostepShift(), pTrinamics->getHighSpeedStepRatePerSec(),
+                                     pTrinamics->getMicrosteps(), pTrinamics->getNumMicrostepSwitchAxes());
+    for (int axisIdx = 0; axisIdx < 2; axisIdx++)
+    {
+        int32_t phase = -1;
+        TEST_ASSERT_TRUE(pTrinamics->getFullStepPhase(axisIdx, phase));
+        planner.setFullStepPhase(axisIdx, phase);
+    }
+    AxisPosition curPos;
+    curPos.clear();
+    for (int axisIdx = 0; axisIdx < 2; axisIdx++)
+    {
+        curPos._stepsFromHome.setVal(axisIdx, drivers[axisIdx]._steps);
+        curPos._axisPositionMM.setVal(axisIdx, drivers[axisIdx]._steps / STEPS_PER_MM);
+    }
+
+    uint8_t curShift = 0;
+    int numSwitches = 0;
+    int numReducedBlocks = 0;
+    std::uniform_real_distribution<float> coordDist(-100, 100);
+    std::uniform_real_distribution<float> feedrateDist(5, 100);
+    for (int moveIdx = 0; moveIdx < 5000; moveIdx++)
+    {
+        // Runs of small moves (as from a split line) and occasional jumps
+        MoveCmd moveCmd;
+        moveCmd.clear();
+        for (int axisIdx = 0; axisIdx < 2; axisIdx++)
+        {
+            float dest = (moveIdx % 20 == 0) ? coordDist(rng) : curPos._axisPositionMM.getVal(axisIdx) + coordDist(rng) / 50;
+            moveCmd._ptMM[axisIdx] = dest;
+        }
+        moveCmd._feedrate = feedrateDist(rng);
+        moveCmd.setFlag(MoveCmd::FLAG_FEEDRATE_VALID, true);
+        AxisFloats destActuator;
+        destActuator.set(moveCmd._ptMM[0] * STEPS_PER_MM, moveCmd._ptMM[1] * STEPS_PER_MM, 0);
+        if (planner.moveTo(moveCmd, destActuator, curPos, *pAxesParams, *pPipeline))
+        {
+            curPos._axisPositionMM.setVal(0, moveCmd._ptMM[0]);
+            curPos._axisPositionMM.setVal(1, moveCmd._ptMM[1]);
+        }
+
+        // Run the blocks
+        MotionBlock block;
+        while (pPipeline->get(block))
+        {
+            if (block._microstepShift != curShift)
+            {
+                if (block._microstepShift != 0)
+                {
+                    TEST_ASSERT_TRUE(drivers[0].isOnFullStep());
+                    TEST_ASSERT_TRUE(drivers[1].isOnFullStep());
+                }
+                TEST_ASSERT_TRUE(pTrinamics->setMicrostepShift(block._microstepShift));
+                TEST_ASSERT_EQUAL(MICROSTEPS >> block._microstepShift, drivers[0]._pDriver->microsteps());
+                curShift = block._microstepShift;
+                numSwitches++;
+            }
+            for (int axisIdx = 0; axisIdx < 2; axisIdx++)
+            {
+                int32_t steps = block.getStepsToTarget(axisIdx);
+                TEST_ASSERT_EQUAL(0, steps % (1 << curShift));
+                drivers[axisIdx].move(steps);
+            }
+            if (curShift != 0)
+                numReducedBlocks++;
+        }
+    }
+
+    // Planner and drivers agree on the position and the phase still checks out
+    TEST_ASSERT_EQUAL(curPos._stepsFromHome.getVal(0), drivers[0]._steps);
+    TEST_ASSERT_EQUAL(curPos._stepsFromHome.getVal(1), drivers[1]._steps);
+    calibrate();
+    checkPhase(0);
+    checkPhase(1);
+    TEST_ASSERT_TRUE(numSwitches > 10);
+    TEST_ASSERT_TRUE(numReducedBlocks > 100);
+    char msg[100];
+    snprintf(msg, sizeof(msg), "%d mode switches, %d blocks in reduced mode", numSwitches, numReducedBlocks);
+    TEST_MESSAGE(msg);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_phase_learned);
+    RUN_TEST(test_phase_relearned);
+    RUN_TEST(test_switch_continuity);
+    return UNITY_END();
+}
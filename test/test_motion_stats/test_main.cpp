@@ -0,0 +1,175 @@
+// RBotFirmware
+// Rob Dobson 2016-2018
+
+// MotionStats - pattern totals over long patterns, the reset on a new pattern's first move and
+// underruns from simulated empty and not-ready gaps (with work pending and idle)
+
+#include <Arduino.h>
+#include <unity.h>
+#include "RobotMotion/MotionControl/RampGenerator/MotionStats.h"
+
+static MotionBlock makeBlock(uint32_t distUM, uint32_t nominalTimeUS, int cmdIdx)
+{
+    MotionBlock block;
+    block.clear();
+    block._distUM = distUM;
+    block._nominalTimeUS = nominalTimeUS;
+    block.setNumberedCommandIndex(cmdIdx);
+    return block;
+}
+
+static float getStat(MotionStats& stats, const char* pName)
+{
+    String json = stats.getJSON();
+    String key = String("\"") + pName + "\":";
+    int pos = json.indexOf(key);
+    TEST_ASSERT_TRUE(pos >= 0);
+    return json.substring(pos + key.length()).toFloat();
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+// Three hours of 1mm blocks at 10mm/s (the time in uS would have wrapped after 71.6 minutes)
+void test_long_pattern(void)
+{
+    MotionStats stats;
+    MotionBlock block = makeBlock(1000, 100000, 0);
+    uint32_t numBlocks = 3 * 3600 * 10;
+    for (uint32_t blockIdx = 0; blockIdx < numBlocks; blockIdx++)
+        stats.blockStarted(&block, 10);
+    TEST_ASSERT_EQUAL(numBlocks, uint32_t(getStat(stats, "blocks")));
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 10.0f, getStat(stats, "plannedMMps"));
+
+    // Sub-millisecond blocks are carried over
+    MotionStats shortStats;
+    MotionBlock shortBlock = makeBlock(3, 333, 0);
+    for (int blockIdx = 0; blockIdx < 30000; blockIdx++)
+        shortStats.blockStarted(&shortBlock, 10);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 9.01f, getStat(shortStats, "plannedMMps"));
+}
+
+// Moves of the previous pattern still running when the next is started are not counted
+void test_reset_at_cmd_idx(void)
+{
+    MotionStats stats;
+    MotionBlock prevBlock = makeBlock(1000, 100000, 0);
+    MotionBlock prevNumbered = makeBlock(1000, 100000, 1000500);
+    for (int blockIdx = 0; blockIdx < 10; blockIdx++)
+        stats.blockStarted(&prevBlock, 10);
+    stats.resetAtCmdIdx(1002000, 1003000);
+    stats.blockStarted(&prevBlock, 10);
+    stats.blockStarted(&prevNumbered, 10);
+    TEST_ASSERT_EQUAL(12, int(getStat(stats, "blocks")));
+
+    // The new pattern's first numbered move resets the stats (and later ones don't)
+    MotionBlock newNumbered = makeBlock(2000, 100000, 1002010);
+    MotionBlock newBlock = makeBlock(2000, 100000, 0);
+    stats.blockStarted(&newNumbered, 10);
+    stats.blockStarted(&newBlock, 10);
+    stats.blockStarted(&newNumbered, 10);
+    TEST_ASSERT_EQUAL(3, int(getStat(stats, "blocks")));
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 6.0f, getStat(stats, "distMM"));
+
+    // An immediate reset replaces a pending one
+    stats.resetAtCmdIdx(1004000, 1005000);
+    stats.reset();
+    stats.blockStarted(&prevBlock, 10);
+    stats.blockStarted(&prevBlock, 10);
+    TEST_ASSERT_EQUAL(2, int(getStat(stats, "blocks")));
+}
+
+// Ticks of the ISR for a time
+static const uint32_t TICKS_PER_MS = MotionBlock::NS_IN_A_MS / MotionBlock::TICK_INTERVAL_NS;
+
+static void tickEmpty(MotionStats& stats, uint32_t ms)
+{
+    for (uint32_t tick = 0; tick < ms * TICKS_PER_MS; tick++)
+        stats.tickEmpty();
+}
+
+static void tickNotReady(MotionStats& stats, uint32_t ms)
+{
+    for (uint32_t tick = 0; tick < ms * TICKS_PER_MS; tick++)
+        stats.tickNotReady();
+}
+
+// Block of 1mm at 10mm/s executed at the nominal speed except for the ms given
+static void runBlock(MotionStats& stats, MotionBlock& block, uint32_t pipelineCount, uint32_t belowNominalMs = 0)
+{
+    stats.blockStarted(&block, pipelineCount);
+    for (uint32_t tick = 0; tick < 100 * TICKS_PER_MS; tick++)
+        stats.tickMoving(tick < belowNominalMs * TICKS_PER_MS);
+}
+
+// Gaps only count while work is pending and consecutive gaps (empty then not ready) are a single
+// underrun which ends when a block starts - gaps before the first block aren't underruns
+void test_underruns(void)
+{
+    MotionStats stats;
+    MotionBlock block = makeBlock(1000, 100000, 0);
+
+    // Idle before the pattern and waiting for the first block
+    tickEmpty(stats, 500);
+    stats.setWorkPending(true);
+    tickEmpty(stats, 20);
+    for (int blockIdx = 0; blockIdx < 10; blockIdx++)
+        runBlock(stats, block, 20 - blockIdx);
+    TEST_ASSERT_EQUAL(0, int(getStat(stats, "underruns")));
+    TEST_ASSERT_EQUAL(20, int(getStat(stats, "emptyMs")));
+    TEST_ASSERT_EQUAL(11, int(getStat(stats, "minPipeline")));
+
+    // Empty while reading the file then not ready while planning - one underrun
+    tickEmpty(stats, 30);
+    tickNotReady(stats, 15);
+    runBlock(stats, block, 1, 40);
+    TEST_ASSERT_EQUAL(1, int(getStat(stats, "underruns")));
+    TEST_ASSERT_EQUAL(50, int(getStat(stats, "emptyMs")));
+    TEST_ASSERT_EQUAL(15, int(getStat(stats, "notReadyMs")));
+    TEST_ASSERT_EQUAL(1, int(getStat(stats, "minPipeline")));
+
+    // Not ready on its own
+    tickNotReady(stats, 5);
+    runBlock(stats, block, 3);
+    TEST_ASSERT_EQUAL(2, int(getStat(stats, "underruns")));
+    TEST_ASSERT_EQUAL(20, int(getStat(stats, "notReadyMs")));
+
+    // Idle (nothing pending) between patterns isn't counted
+    stats.setWorkPending(false);
+    tickEmpty(stats, 1000);
+    tickNotReady(stats, 100);
+    runBlock(stats, block, 5);
+    TEST_ASSERT_EQUAL(2, int(getStat(stats, "underruns")));
+    TEST_ASSERT_EQUAL(50, int(getStat(stats, "emptyMs")));
+    TEST_ASSERT_EQUAL(20, int(getStat(stats, "notReadyMs")));
+
+    // Time below nominal is the gaps and the slow parts of blocks
+    TEST_ASSERT_EQUAL(50 + 20 + 40, int(getStat(stats, "belowNominalMs")));
+
+    // 13 blocks of 1mm at 10mm/s with 70ms of gaps
+    TEST_ASSERT_EQUAL(13, int(getStat(stats, "blocks")));
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 10.0f, getStat(stats, "plannedMMps"));
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 13 / 1.37f, getStat(stats, "achievedMMps"));
+
+    // A reset clears the underruns and the min pipeline (which is 0 until a block starts)
+    stats.reset();
+    stats.setWorkPending(true);
+    tickEmpty(stats, 10);
+    TEST_ASSERT_EQUAL(0, int(getStat(stats, "underruns")));
+    TEST_ASSERT_EQUAL(0, int(getStat(stats, "minPipeline")));
+    TEST_ASSERT_EQUAL(10, int(getStat(stats, "emptyMs")));
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_long_pattern);
+    RUN_TEST(test_reset_at_cmd_idx);
+    RUN_TEST(test_underruns);
+    return UNITY_END();
+}
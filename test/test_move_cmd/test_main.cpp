@@ -0,0 +1,216 @@
+// RBotFirmware
+// Rob Dobson 2016-2018
+
+// MoveCmd - conversion from RobotCommandArgs (homing moves) and bytes copied and cycles per
+// segment carrying a move from the evaluator through block splitting to the planner in the
+// RobotCommandArgs form used before MoveCmd and in the MoveCmd form - the command is set up
+// as the G-code evaluator does, copied to the blocks-to-add command, given each block's point
+// and read as the planner does (the kinematics and planning themselves are timed in
+// test_block_bench)
+
+#include <Arduino.h>
+#include <unity.h>
+#include <stdio.h>
+#include <algorithm>
+#include <type_traits>
+#include "MoveCmd.h"
+
+static const int NUM_MOVES = 2000;
+static const int NUM_RUNS = 9;
+
+static volatile float benchSink = 0;
+
+static uint64_t hostCycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// Bytes copied and cycles spent carrying the commands
+struct CarryResult
+{
+    uint64_t _bytesCopied;
+    uint64_t _cycles;
+    float _sum;
+};
+
+// Before - RobotCommandArgs set up by the evaluator, assigned to the blocks-to-add args (copy
+// clears then copies each member) and given each block's point
+static CarryResult carryArgs(int segmentsPerMove)
+{
+    CarryResult result = {0, 0, 0};
+    RobotCommandArgs blocksToAddArgs;
+    AxisFloats lastPos;
+    uint64_t startCycles = hostCycles();
+    for (int moveIdx = 0; moveIdx < NUM_MOVES; moveIdx++)
+    {
+        RobotCommandArgs args;
+        args.setAxisValMM(0, float(moveIdx % 97), true);
+        args.setAxisValMM(1, float(moveIdx % 89), true);
+        args.setFeedrate(3000);
+        args.setMoveRapid(false);
+        blocksToAddArgs = args;
+        result._bytesCopied += sizeof(RobotCommandArgs);
+        for (int segIdx = 0; segIdx < segmentsPerMove; segIdx++)
+        {
+            AxisFloats blockPt(float(moveIdx % 97) + segIdx * 0.1f, float(moveIdx % 89) - segIdx * 0.1f);
+            blocksToAddArgs.setPointMM(blockPt);
+            blocksToAddArgs.setMoreMovesComing(segIdx != segmentsPerMove - 1);
+            result._bytesCopied += sizeof(AxisFloats);
+
+            // Planner reads
+            for (int axisIdx = 0; axisIdx < RobotConsts::MAX_AXES; axisIdx++)
+                result._sum += blocksToAddArgs.getValNoCkMM(axisIdx);
+            result._sum += blocksToAddArgs.getMoreMovesComing() + blocksToAddArgs.getEndstopCheck().uintVal() +
+                           blocksToAddArgs.getNumberedCommandIndex();
+            if (blocksToAddArgs.isFeedrateValid())
+                result._sum += blocksToAddArgs.getFeedrate();
+            lastPos = blocksToAddArgs.getPointMM();
+            result._bytesCopied += sizeof(AxisFloats);
+        }
+    }
+    result._cycles = hostCycles() - startCycles;
+    result._sum += lastPos._pt[0];
+    return result;
+}
+
+// After - MoveCmd set up by the evaluator, assigned to the blocks-to-add command (plain copy)
+// and given each block's point
+static CarryResult carryMoveCmd(int segmentsPerMove)
+{
+    CarryResult result = {0, 0, 0};
+    MoveCmd blocksToAddMoveCmd;
+    blocksToAddMoveCmd.clear();
+    AxisFloats lastPos;
+    uint64_t startCycles = hostCycles();
+    for (int moveIdx = 0; moveIdx < NUM_MOVES; moveIdx++)
+    {
+        MoveCmd moveCmd;
+        moveCmd.clear();
+        moveCmd.setAxisValMM(0, float(moveIdx % 97));
+        moveCmd.setAxisValMM(1, float(moveIdx % 89));
+        moveCmd.setFeedrate(3000);
+        blocksToAddMoveCmd = moveCmd;
+        result._bytesCopied += sizeof(MoveCmd);
+        for (int segIdx = 0; segIdx < segmentsPerMove; segIdx++)
+        {
+            AxisFloats blockPt(float(moveIdx % 97) + segIdx * 0.1f, float(moveIdx % 89) - segIdx * 0.1f);
+            blocksToAddMoveCmd.setPointMM(blockPt);
+            blocksToAddMoveCmd.setFlag(MoveCmd::FLAG_MORE_MOVES_COMING, segIdx != segmentsPerMove - 1);
+            result._bytesCopied += sizeof(blocksToAddMoveCmd._ptMM) + sizeof(blocksToAddMoveCmd._validityFlags);
+
+            // Planner reads
+            for (int axisIdx = 0; axisIdx < RobotConsts::MAX_AXES; axisIdx++)
+                result._sum += blocksToAddMoveCmd._ptMM[axisIdx];
+            result._sum += blocksToAddMoveCmd.getFlag(MoveCmd::FLAG_MORE_MOVES_COMING) +
+                           blocksToAddMoveCmd.getEndstopCheck().uintVal() + blocksToAddMoveCmd._numberedCommandIndex;
+            if (blocksToAddMoveCmd.getFlag(MoveCmd::FLAG_FEEDRATE_VALID))
+                result._sum += blocksToAddMoveCmd._feedrate;
+            blocksToAddMoveCmd.getPointMM(lastPos);
+            result._bytesCopied += sizeof(AxisFloats);
+        }
+    }
+    result._cycles = hostCycles() - startCycles;
+    result._sum += lastPos._pt[0];
+    return result;
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+// Homing moves are converted from RobotCommandArgs
+void test_set_from_args(void)
+{
+    TEST_ASSERT_TRUE(std::is_trivially_copyable<MoveCmd>::value);
+    TEST_ASSERT_LESS_THAN(sizeof(RobotCommandArgs), sizeof(MoveCmd));
+
+    RobotCommandArgs args;
+    args.setAxisValMM(0, 12.5f, true);
+    args.setAxisValMM(2, -3.0f, true);
+    args.setFeedrate(25);
+    args.setNumberedCommandIndex(42);
+    args.setMoveType(RobotMoveTypeArg_Relative);
+    args.setTestAllEndStops();
+    args.setDontSplitMove();
+    args.setAllowOutOfBounds();
+    MoveCmd moveCmd;
+    moveCmd.setFromArgs(args);
+    TEST_ASSERT_FALSE(moveCmd.isStepwise());
+    TEST_ASSERT_TRUE(moveCmd.isValid(0));
+    TEST_ASSERT_FALSE(moveCmd.isValid(1));
+    TEST_ASSERT_TRUE(moveCmd.isValid(2));
+    TEST_ASSERT_EQUAL_FLOAT(12.5f, moveCmd._ptMM[0]);
+    TEST_ASSERT_EQUAL_FLOAT(-3.0f, moveCmd._ptMM[2]);
+    TEST_ASSERT_TRUE(moveCmd.getFlag(MoveCmd::FLAG_FEEDRATE_VALID));
+    TEST_ASSERT_EQUAL_FLOAT(25, moveCmd._feedrate);
+    TEST_ASSERT_EQUAL(42, moveCmd._numberedCommandIndex);
+    TEST_ASSERT_EQUAL(RobotMoveTypeArg_Relative, moveCmd._moveType);
+    TEST_ASSERT_EQUAL(args.getEndstopCheck().uintVal(), moveCmd.getEndstopCheck().uintVal());
+    TEST_ASSERT_TRUE(moveCmd.getFlag(MoveCmd::FLAG_DONT_SPLIT));
+    TEST_ASSERT_TRUE(moveCmd.getFlag(MoveCmd::FLAG_ALLOW_OUT_OF_BOUNDS));
+    TEST_ASSERT_FALSE(moveCmd.getFlag(MoveCmd::FLAG_MORE_MOVES_COMING));
+
+    // Stepwise
+    RobotCommandArgs stepArgs;
+    stepArgs.setAxisSteps(1, -2000, true);
+    moveCmd.setFromArgs(stepArgs);
+    TEST_ASSERT_TRUE(moveCmd.isStepwise());
+    TEST_ASSERT_TRUE(moveCmd.isValid(1));
+    TEST_ASSERT_EQUAL(-2000, moveCmd._ptSteps[1]);
+    TEST_ASSERT_FALSE(moveCmd.getFlag(MoveCmd::FLAG_FEEDRATE_VALID));
+    TEST_ASSERT_EQUAL(RobotConsts::NUMBERED_COMMAND_NONE, moveCmd._numberedCommandIndex);
+}
+
+// Bytes copied and cycles per segment for long moves split into 10 blocks and for short
+// (theta-rho) moves of one block - the two forms are run alternately and the minimum taken
+void test_carry_benchmark(void)
+{
+    const int segmentsPerMoveList[] = {10, 1};
+    for (int segmentsPerMove : segmentsPerMoveList)
+    {
+        double minCycles[2] = {1e30, 1e30};
+        uint64_t bytesCopied[2] = {0, 0};
+        for (int runIdx = 0; runIdx < NUM_RUNS; runIdx++)
+        {
+            CarryResult results[2] = {carryArgs(segmentsPerMove), carryMoveCmd(segmentsPerMove)};
+            TEST_ASSERT_EQUAL_FLOAT(results[0]._sum, results[1]._sum);
+            for (int formIdx = 0; formIdx < 2; formIdx++)
+            {
+                minCycles[formIdx] = std::min(minCycles[formIdx], double(results[formIdx]._cycles));
+                bytesCopied[formIdx] = results[formIdx]._bytesCopied;
+            }
+            benchSink = results[1]._sum;
+        }
+        int numSegments = NUM_MOVES * segmentsPerMove;
+        const char* formNames[] = {"RobotCommandArgs", "MoveCmd"};
+        for (int formIdx = 0; formIdx < 2; formIdx++)
+        {
+            char msg[160];
+            snprintf(msg, sizeof(msg), "%2d blocks/move %-16s %5.1f bytes copied/segment %6.1f cycles/segment",
+                     segmentsPerMove, formNames[formIdx], double(bytesCopied[formIdx]) / numSegments,
+                     minCycles[formIdx] / numSegments);
+            TEST_MESSAGE(msg);
+        }
+        TEST_ASSERT_LESS_THAN(bytesCopied[0], bytesCopied[1]);
+
+        // Only a gross regression fails (host timing is noisy)
+        if (hostCycles() != 0)
+            TEST_ASSERT_LESS_THAN(minCycles[0] * 1.25, minCycles[1]);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_set_from_args);
+    RUN_TEST(test_carry_benchmark);
+    return UNITY_END();
+}
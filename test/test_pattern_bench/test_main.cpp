@@ -0,0 +1,381 @@
+// RBotFirmware
+// Rob Dobson 2016-2018
+
+// Pattern replay benchmark - .thr and .gcode patterns are replayed through the theta-rho and
+// gcode evaluators, a dry-run motion helper (block splitting, kinematics and the planner) and
+// the dry-run ramp generator (block times from each block's acceleration profile)
+// Results for each pattern are JSON lines in the format of tools/pattern_bench.py (so host and
+// table runs can be compared with "pattern_bench.py compare"):
+//    motion  - blocks, distance (straight lines between move end points), drawing time, average
+//              speed and the speed at the requested feedrates (plannedMMps - feedrates apply to
+//              the primary axes so a rotary table's average speed can be higher)
+//    planner - planner stats (blocks, avgUs and maxUs per block), replay time per block for the
+//              whole chain, peak heap use and the settings used
+// Settings are environment variables - lists are comma separated and every combination is run:
+//    PATTERN_BENCH_DIR           directory of patterns (default built-in synthetic patterns)
+//    PATTERN_BENCH_CONFIGS       robot types (default TranquilSmall,TranquilLarge)
+//    PATTERN_BENCH_PIPELINE_LEN  pipelineLen (default from the robot type)
+//    PATTERN_BENCH_BLOCK_DIST_MM blockDistanceMM (default from the robot type)
+//    PATTERN_BENCH_JN_DEV        junctionDeviation (default from the robot type)
+//    PATTERN_BENCH_OUT           results file (JSON lines, appended - default printed)
+//    PATTERN_BENCH_LABEL         label for the results
+// e.g. PATTERN_BENCH_DIR=~/patterns PATTERN_BENCH_JN_DEV=0.02,0.05 pio test -e native -f test_pattern_bench
+
+#include <Arduino.h>
+#include <unity.h>
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "RdJson.h"
+#include "ConfigBase.h"
+#include "RobotConfigurations.h"
+#include "RobotMotion/RobotController.h"
+#include "RestAPISystem.h"
+#include "WorkManager/WorkManager.h"
+#include "WorkManager/Evaluators/EvaluatorFiles.h"
+#include "WorkManager/Evaluators/EvaluatorGCode.h"
+#include "WorkManager/Evaluators/EvaluatorThetaRhoLine.h"
+#include "WorkManager/Evaluators/ThetaRhoTokenizer.h"
+#include "MoveCmd.h"
+
+// Heap in use (everything allocated with new, which includes String) and its peak
+static std::atomic<int64_t> heapInUse(0);
+static std::atomic<int64_t> heapPeak(0);
+static const size_t HEAP_HEADER_LEN = 16;
+
+void* operator new(size_t size)
+{
+    uint8_t* pMem = (uint8_t*)malloc(size + HEAP_HEADER_LEN);
+    if (!pMem)
+        throw std::bad_alloc();
+    *(size_t*)pMem = size;
+    int64_t inUse = heapInUse += size;
+    int64_t peak = heapPeak.load();
+    while ((inUse > peak) && !heapPeak.compare_exchange_weak(peak, inUse))
+        ;
+    return pMem + HEAP_HEADER_LEN;
+}
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+void operator delete(void* p) noexcept
+{
+    if (!p)
+        return;
+    uint8_t* pMem = (uint8_t*)p - HEAP_HEADER_LEN;
+    heapInUse -= *(size_t*)pMem;
+    free(pMem);
+}
+void operator delete[](void* p) noexcept
+{
+    operator delete(p);
+}
+void operator delete(void* p, size_t) noexcept
+{
+    operator delete(p);
+}
+void operator delete[](void* p, size_t) noexcept
+{
+    operator delete(p);
+}
+
+struct Pattern
+{
+    std::string _name;
+    std::string _contents;
+    bool _isThetaRho;
+};
+
+struct BenchSettings
+{
+    String _robotType;
+    String _pipelineLen;
+    String _blockDistMM;
+    String _jnDev;
+};
+
+struct BenchResult
+{
+    uint32_t _blocks;
+    double _distMM;
+    double _drawS;
+    double _feedrateS;
+    double _replayUsPerBlock;
+    int64_t _peakHeap;
+    String _plannerJSON;
+};
+
+static std::vector<std::string> getList(const char* pEnvName, const char* pDefault)
+{
+    const char* pVal = getenv(pEnvName);
+    std::stringstream listStr((pVal && *pVal) ? pVal : pDefault);
+    std::vector<std::string> list;
+    std::string item;
+    while (std::getline(listStr, item, ','))
+        list.push_back(item);
+    if (list.empty())
+        list.push_back("");
+    return list;
+}
+
+// Set a value in the robot geometry (added if not present)
+static void setGeomValue(String& configStr, const char* pKey, const String& val)
+{
+    if (val.length() == 0)
+        return;
+    std::string config = configStr.c_str();
+    std::string geomKey = "\"robotGeom\":{";
+    size_t geomPos = config.find(geomKey);
+    TEST_ASSERT_TRUE(geomPos != std::string::npos);
+    geomPos += geomKey.length();
+    std::string key = std::string("\"") + pKey + "\":";
+    size_t keyPos = config.find(key, geomPos);
+    if (keyPos == std::string::npos)
+    {
+        config.insert(geomPos, key + val.c_str() + ",");
+    }
+    else
+    {
+        size_t valPos = keyPos + key.length();
+        size_t valEnd = config.find_first_of(",}", valPos);
+        config.replace(valPos, valEnd - valPos, val.c_str());
+    }
+    configStr = config.c_str();
+}
+
+static void addSyntheticPatterns(std::vector<Pattern>& patterns)
+{
+    // Spiral out and back in (interpolated) as a pattern generator would write it
+    std::string lines;
+    char buf[100];
+    for (int pt = 0; pt <= 4000; pt++)
+    {
+        double frac = pt / 4000.0;
+        snprintf(buf, sizeof(buf), "%.5f %.5f\n", frac * 60 * M_PI, 1 - fabs(1 - 2 * frac));
+        lines += buf;
+    }
+    patterns.push_back({"spiral.thr", lines, true});
+
+    // Many short lines without interpolation as exported by Sandify
+    lines = "# Made with Sandify\n";
+    for (int pt = 0; pt <= 6000; pt++)
+    {
+        snprintf(buf, sizeof(buf), "%.5f %.5f\n", pt * 0.02, 0.5 + 0.45 * sin(pt * 0.13));
+        lines += buf;
+    }
+    patterns.push_back({"sandify_wave.thr", lines, true});
+
+    // Star with varying feedrates
+    lines = "G90\n";
+    for (int pt = 0; pt <= 500; pt++)
+    {
+        double angle = pt * 0.8 * M_PI;
+        double radius = (pt % 2) ? 40 : 120;
+        snprintf(buf, sizeof(buf), "G1 X%.3f Y%.3f F%d\n", radius * cos(angle), radius * sin(angle), 5 + pt % 10);
+        lines += buf;
+    }
+    patterns.push_back({"star.gcode", lines, false});
+}
+
+static void addPatternFiles(const char* pDir, std::vector<Pattern>& patterns)
+{
+    std::vector<std::filesystem::path> paths;
+    for (const auto& entry : std::filesystem::directory_iterator(pDir))
+        paths.push_back(entry.path());
+    std::sort(paths.begin(), paths.end());
+    for (const auto& path : paths)
+    {
+        String fileName = path.filename().c_str();
+        int fileType = EvaluatorFiles::getFileTypeFromExtension(fileName);
+        if (fileType == EvaluatorFiles::FILE_TYPE_UNKNOWN)
+            continue;
+        std::ifstream file(path, std::ios::binary);
+        std::stringstream contents;
+        contents << file.rdbuf();
+        patterns.push_back({fileName.c_str(), contents.str(), fileType == EvaluatorFiles::FILE_TYPE_THETA_RHO});
+    }
+}
+
+// Add a move once the helper can accept it - blocks are executed as the pipeline fills
+static void addMove(MotionHelper& helper, MoveCmd& moveCmd, float maxSpeedMMps, double& curX, double& curY,
+                    BenchResult& result)
+{
+    while (!helper.canAccept())
+        result._drawS += helper.dryRunService(false);
+    helper.moveTo(moveCmd);
+
+    // Distance and time at the requested feedrate (as the planner limits it)
+    double x = moveCmd.isValid(0) ? moveCmd._ptMM[0] : curX;
+    double y = moveCmd.isValid(1) ? moveCmd._ptMM[1] : curY;
+    double dist = sqrt((x - curX) * (x - curX) + (y - curY) * (y - curY));
+    float feedrate = maxSpeedMMps;
+    if (moveCmd.getFlag(MoveCmd::FLAG_FEEDRATE_VALID) && (moveCmd._feedrate > 0) && (moveCmd._feedrate < feedrate))
+        feedrate = moveCmd._feedrate;
+    result._distMM += dist;
+    result._feedrateS += dist / feedrate;
+    curX = x;
+    curY = y;
+}
+
+// Replay a pattern as the file and theta-rho evaluators (and pattern estimator) do
+static void replayPattern(WorkManager& workManager, const String& configStr, const Pattern& pattern,
+                          BenchResult& result)
+{
+    result = BenchResult();
+    int64_t heapAtStart = heapInUse.load();
+    heapPeak = heapAtStart;
+    auto startTime = std::chrono::steady_clock::now();
+
+    MotionHelper* pHelper = RobotController::createDryRunMotionHelper(configStr.c_str());
+    TEST_ASSERT_NOT_NULL(pHelper);
+    String robotAttributes;
+    pHelper->getRobotAttributes(robotAttributes);
+    EvaluatorThetaRhoLine thrEvaluator(workManager);
+    String evaluatorConfig = RdJson::getString("evaluators", "{}", configStr.c_str());
+    thrEvaluator.setConfig(evaluatorConfig.c_str(), robotAttributes.c_str());
+    float maxSpeedMMps = float(RdJson::getDouble("robotGeom/axis0/maxSpeed", 100, configStr.c_str()));
+
+    bool interpolate = true;
+    bool firstValidLineProcessed = false;
+    double curX = 0, curY = 0;
+    const char* pPos = pattern._contents.c_str();
+    const char* pEnd = pPos + pattern._contents.size();
+    std::string line;
+    while (pPos < pEnd)
+    {
+        const char* pLineEnd = (const char*)memchr(pPos, '\n', pEnd - pPos);
+        if (!pLineEnd)
+            pLineEnd = pEnd;
+        MoveCmd moveCmd;
+        if (pattern._isThetaRho)
+        {
+            double theta = 0, rho = 0;
+            if (ThetaRhoTokenizer::parseLine(pPos, pLineEnd, interpolate, theta, rho))
+            {
+                thrEvaluator.addPolarPoint(theta, rho, interpolate, !firstValidLineProcessed);
+                firstValidLineProcessed = true;
+                double x, y;
+                while (thrEvaluator.getNextPoint(x, y))
+                {
+                    moveCmd.clear();
+                    moveCmd.setAxisValMM(0, x);
+                    moveCmd.setAxisValMM(1, y);
+                    moveCmd.setFlag(MoveCmd::FLAG_DONT_SPLIT, thrEvaluator.isDirectPoint());
+                    addMove(*pHelper, moveCmd, maxSpeedMMps, curX, curY, result);
+                }
+            }
+        }
+        else
+        {
+            line.assign(pPos, pLineEnd);
+            if (EvaluatorGCode::getMoveCmd(line.c_str(), moveCmd))
+                addMove(*pHelper, moveCmd, maxSpeedMMps, curX, curY, result);
+        }
+        pPos = pLineEnd + 1;
+    }
+
+    // Complete all motion
+    while (!(pHelper->canAccept() && pHelper->isIdle()))
+    {
+        float blocksTimeS = pHelper->dryRunService(true);
+        result._drawS += blocksTimeS;
+        if (blocksTimeS <= 0)
+            break;
+    }
+
+    double replayUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - startTime).count();
+    result._plannerJSON = pHelper->getPlannerStatsJSON();
+    result._blocks = uint32_t(RdJson::getLong("blocks", 0, result._plannerJSON.c_str()));
+    result._replayUsPerBlock = result._blocks ? replayUs / result._blocks : 0;
+    result._peakHeap = heapPeak.load() - heapAtStart;
+    delete pHelper;
+}
+
+static String formatResult(const Pattern& pattern, const BenchSettings& settings, const BenchResult& result)
+{
+    const char* pLabel = getenv("PATTERN_BENCH_LABEL");
+    String plannerJSON = result._plannerJSON.substring(0, result._plannerJSON.length() - 1);
+    return String("{\"pattern\":\"") + pattern._name.c_str() + "\",\"label\":\"" + (pLabel ? pLabel : "") +
+           "\",\"robotType\":\"" + settings._robotType + "\",\"host\":1" +
+           ",\"motion\":{\"blocks\":" + String(result._blocks) +
+           ",\"distMM\":" + String(result._distMM, 1) +
+           ",\"drawS\":" + String(result._drawS, 1) +
+           ",\"plannedMMps\":" + String(result._feedrateS > 0 ? result._distMM / result._feedrateS : 0, 2) +
+           ",\"achievedMMps\":" + String(result._drawS > 0 ? result._distMM / result._drawS : 0, 2) + "}" +
+           ",\"planner\":" + plannerJSON +
+           ",\"replayUs\":" + String(result._replayUsPerBlock, 2) +
+           ",\"peakHeap\":" + String(int(result._peakHeap)) + "}}";
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_pattern_bench(void)
+{
+    std::vector<Pattern> patterns;
+    const char* pDir = getenv("PATTERN_BENCH_DIR");
+    if (pDir && *pDir)
+        addPatternFiles(pDir, patterns);
+    else
+        addSyntheticPatterns(patterns);
+    TEST_ASSERT_TRUE(patterns.size() > 0);
+
+    // The theta-rho evaluator is constructed with a work manager (which it doesn't use here)
+    ConfigBase mainConfig, robotConfig;
+    RobotController robotController;
+    LedStrip ledStrip;
+    WireGuardManager wireGuardManager;
+    RestAPISystem restAPISystem;
+    FileManager fileManager;
+    WorkManager workManager(mainConfig, robotConfig, robotController, ledStrip, wireGuardManager, restAPISystem,
+                            fileManager);
+
+    const char* pOutFile = getenv("PATTERN_BENCH_OUT");
+    std::ofstream outFile;
+    if (pOutFile && *pOutFile)
+        outFile.open(pOutFile, std::ios::app);
+
+    for (const std::string& robotType : getList("PATTERN_BENCH_CONFIGS", "TranquilSmall,TranquilLarge"))
+    for (const std::string& pipelineLen : getList("PATTERN_BENCH_PIPELINE_LEN", ""))
+    for (const std::string& blockDistMM : getList("PATTERN_BENCH_BLOCK_DIST_MM", ""))
+    for (const std::string& jnDev : getList("PATTERN_BENCH_JN_DEV", ""))
+    {
+        BenchSettings settings = {robotType.c_str(), pipelineLen.c_str(), blockDistMM.c_str(), jnDev.c_str()};
+        String configStr = RdJson::getString("robotConfig", "", RobotConfigurations::getConfig(robotType.c_str()));
+        TEST_ASSERT_TRUE_MESSAGE(configStr.length() > 0, robotType.c_str());
+        setGeomValue(configStr, "pipelineLen", settings._pipelineLen);
+        setGeomValue(configStr, "blockDistanceMM", settings._blockDistMM);
+        setGeomValue(configStr, "junctionDeviation", settings._jnDev);
+        for (const Pattern& pattern : patterns)
+        {
+            BenchResult result;
+            replayPattern(workManager, configStr, pattern, result);
+            String resultStr = formatResult(pattern, settings, result);
+            if (outFile.is_open())
+                outFile << resultStr.c_str() << "\n";
+            else
+                TEST_MESSAGE(resultStr.c_str());
+            TEST_ASSERT_TRUE(result._blocks > 0);
+            TEST_ASSERT_TRUE(result._drawS > 0);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_pattern_bench);
+    return UNITY_END();
+}
@@ -0,0 +1,145 @@
+// RBotFirmware
+// Rob Dobson 2016-2018
+
+// Pattern duration estimates - block durations from the step profile (getBlockDurationS) against
+// trapezoid and triangle profiles worked out by hand, dry-run execution of the pipeline (blocks
+// only complete when the pipeline is full unless flushing) and a long radial move through the
+// dry-run motion helper against the trapezoid for the axis limits
+
+#include <Arduino.h>
+#include <unity.h>
+#include <stdio.h>
+#include "RdJson.h"
+#include "RobotConfigurations.h"
+#include "RobotMotion/RobotController.h"
+#include "RobotMotion/MotionControl/MotionPipeline.h"
+#include "RobotMotion/MotionControl/RampGenerator/RampGenerator.h"
+#include "MoveCmd.h"
+
+// Step rates are steps per TTICKS_VALUE ticks and acceleration is per ms
+static const float RATE_TO_STEPS_PER_SEC = MotionBlock::TICKS_PER_SEC / MotionBlock::TTICKS_VALUE;
+
+static void setupBlock(MotionBlock& block, int32_t numSteps, float initialRate, float maxRate, float finalRate,
+                       float acc, uint32_t stepsBeforeDecel)
+{
+    block.clear();
+    block._stepsTotalMaybeNeg[1] = -numSteps;
+    block._axisIdxWithMaxSteps = 1;
+    block._stepsBeforeDecel = stepsBeforeDecel;
+    block._microstepShift = 0;
+    block._initialStepRatePerTTicks = uint32_t(initialRate / RATE_TO_STEPS_PER_SEC);
+    block._maxStepRatePerTTicks = uint32_t(maxRate / RATE_TO_STEPS_PER_SEC);
+    block._finalStepRatePerTTicks = uint32_t(finalRate / RATE_TO_STEPS_PER_SEC);
+    block._accStepsPerTTicksPerMS = uint32_t(acc / RATE_TO_STEPS_PER_SEC / 1000);
+    block._canExecute = true;
+}
+
+// 2000 steps from 200 to 1000 steps/s at 2000 steps/s/s and back to 200 steps/s - 240 steps
+// (0.4s) each accelerating and decelerating and 1520 steps (1.52s) at 1000 steps/s
+static const float TRAPEZOID_S = 0.4f + 1.52f + 0.4f;
+static void setupTrapezoid(MotionBlock& block)
+{
+    setupBlock(block, 2000, 200, 1000, 200, 2000, 2000 - 240);
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_block_duration(void)
+{
+    MotionBlock block;
+    setupTrapezoid(block);
+    TEST_ASSERT_FLOAT_WITHIN(0.002f, TRAPEZOID_S, RampGenerator::getBlockDurationS(block));
+
+    // Triangle - 400 steps with deceleration from step 200 peaks at sqrt(100^2 + 2*2000*200) = 900
+    setupBlock(block, 400, 100, 1000, 100, 2000, 200);
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 2 * (900 - 100) / 2000.0f, RampGenerator::getBlockDurationS(block));
+
+    // Constant rate (entry at the max rate and no deceleration) and with microsteps doubled
+    // (each step pulse moves two microsteps)
+    setupBlock(block, 500, 1000, 1000, 1000, 2000, 500);
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 0.5f, RampGenerator::getBlockDurationS(block));
+    block._microstepShift = 1;
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 0.25f, RampGenerator::getBlockDurationS(block));
+
+    // Decelerating to a stop - the ISR holds the minimum step rate
+    setupBlock(block, 200, 1000, 1000, 0, 2000, 0);
+    float decelS = (1000 - sqrtf(1000 * 1000 - 2 * 2000 * 200)) / 2000;
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, decelS, RampGenerator::getBlockDurationS(block));
+}
+
+void test_dry_run_execute(void)
+{
+    // Three usable slots
+    MotionPipeline pipeline;
+    pipeline.init(4);
+    RampGenerator rampGenerator(&pipeline);
+    MotionBlock block;
+    setupTrapezoid(block);
+    for (int blockIdx = 0; blockIdx < 3; blockIdx++)
+        TEST_ASSERT_TRUE(pipeline.add(block));
+
+    // Full so the head block completes and the next is then executing (so isn't replanned)
+    TEST_ASSERT_FLOAT_WITHIN(0.002f, TRAPEZOID_S, rampGenerator.dryRunExecute(false));
+    TEST_ASSERT_EQUAL(2, pipeline.count());
+    TEST_ASSERT_TRUE(pipeline.peekGet()->_isExecuting);
+    TEST_ASSERT_EQUAL_FLOAT(0, rampGenerator.dryRunExecute(false));
+
+    // Blocks which can't execute yet stop a flush
+    pipeline.peekNthFromPut(0)->_canExecute = false;
+    TEST_ASSERT_FLOAT_WITHIN(0.002f, TRAPEZOID_S, rampGenerator.dryRunExecute(true));
+    TEST_ASSERT_EQUAL(1, pipeline.count());
+    pipeline.peekGet()->_canExecute = true;
+    TEST_ASSERT_FLOAT_WITHIN(0.002f, TRAPEZOID_S, rampGenerator.dryRunExecute(true));
+    TEST_ASSERT_EQUAL(0, pipeline.count());
+}
+
+// A radial move only moves the linear axis so takes the trapezoid time for its limits - the
+// move is split into more blocks than the pipeline holds so this also checks that flushing
+// doesn't stop the move where the pipeline ended
+void test_dry_run_move(void)
+{
+    String robotConfigStr = RdJson::getString("robotConfig", "", RobotConfigurations::getConfig("TranquilSmall"));
+    MotionHelper* pMotionHelper = RobotController::createDryRunMotionHelper(robotConfigStr.c_str());
+    TEST_ASSERT_NOT_NULL(pMotionHelper);
+    String axis1Str = RdJson::getString("robotGeom/axis1", "", robotConfigStr.c_str());
+    float maxSpeed = RdJson::getDouble("maxRPM", 0, axis1Str.c_str()) * RdJson::getDouble("unitsPerRot", 0, axis1Str.c_str()) / 60;
+    float maxAcc = RdJson::getDouble("maxAcc", 0, axis1Str.c_str());
+    TEST_ASSERT_TRUE((maxSpeed > 0) && (maxAcc > 0));
+
+    const float MOVE_DIST_MM = 140;
+    MoveCmd moveCmd;
+    moveCmd.clear();
+    moveCmd.setAxisValMM(0, MOVE_DIST_MM);
+    moveCmd.setAxisValMM(1, 0);
+    float durationS = 0;
+    while (!pMotionHelper->canAccept())
+        durationS += pMotionHelper->dryRunService(false);
+    pMotionHelper->moveTo(moveCmd);
+    for (int serviceIdx = 0; (serviceIdx < 10000) && !(pMotionHelper->canAccept() && pMotionHelper->isIdle()); serviceIdx++)
+        durationS += pMotionHelper->dryRunService(true);
+    TEST_ASSERT_TRUE(pMotionHelper->isIdle());
+    delete pMotionHelper;
+
+    // Accelerate to and decelerate from the max speed (the step rate limit) with the rest at
+    // the max speed
+    float trapezoidS = maxSpeed / maxAcc + MOVE_DIST_MM / maxSpeed;
+    char msg[100];
+    snprintf(msg, sizeof(msg), "%.0fmm radial move %.3fs (trapezoid %.3fs)", MOVE_DIST_MM, durationS, trapezoidS);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_FLOAT_WITHIN(trapezoidS * 0.01f, trapezoidS, durationS);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_block_duration);
+    RUN_TEST(test_dry_run_execute);
+    RUN_TEST(test_dry_run_move);
+    return UNITY_END();
+}
@@ -0,0 +1,400 @@
+// RBotFirmware
+// Rob Dobson 2016-2018
+
+// PlaylistOptimiser - orders (and reversals) against brute force on small playlists, pinned
+// entries, rotations, ends scanned from files and the heuristic on large playlists
+
+#include <Arduino.h>
+#include <unity.h>
+#include <sys/time.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include "FileManager.h"
+#include "WorkManager/PlaylistOptimiser.h"
+
+typedef PlaylistOptimiser::Entry Entry;
+
+static const char* TEST_ROOT = "/tmp/rbot_test_playlist_optimiser";
+static std::mt19937 rng(1234);
+
+static float randUnit()
+{
+    return std::uniform_real_distribution<float>(0, 1)(rng);
+}
+
+// Most patterns start and end at the centre or the edge
+static float randRho()
+{
+    float sel = randUnit();
+    return (sel < 0.4f) ? 0 : ((sel < 0.8f) ? 1 : randUnit());
+}
+
+static Entry randEntry()
+{
+    Entry entry;
+    entry._startTheta = randUnit() * 60 - 30;
+    entry._startRho = randRho();
+    entry._endTheta = randUnit() * 60 - 30;
+    entry._endRho = randRho();
+    entry._known = true;
+    entry._pinned = false;
+    return entry;
+}
+
+static std::vector<uint32_t> identityOrder(size_t numEntries)
+{
+    std::vector<uint32_t> order(numEntries);
+    for (size_t idx = 0; idx < numEntries; idx++)
+        order[idx] = idx;
+    return order;
+}
+
+// Every entry once and pinned (or unknown) entries in place
+static bool isValidOrder(const std::vector<Entry>& entries, const std::vector<uint32_t>& order)
+{
+    if (order.size() != entries.size())
+        return false;
+    std::vector<int> seen(entries.size(), 0);
+    for (uint32_t entryIdx : order)
+        if ((entryIdx >= entries.size()) || seen[entryIdx]++)
+            return false;
+    for (size_t pos = 0; pos < entries.size(); pos++)
+        if ((entries[pos]._pinned || !entries[pos]._known) && (order[pos] != pos))
+            return false;
+    return true;
+}
+
+// Lowest cost of an order over every combination of reversals of the entries which can move
+static float bestReversals(const std::vector<Entry>& entries, const std::vector<uint32_t>& order, bool allowRotate,
+                           bool allowReverse, const std::vector<uint32_t>& freeIdx)
+{
+    if (!allowReverse)
+        return PlaylistOptimiser::pathCost(entries, order, allowRotate);
+    float best = INFINITY;
+    std::vector<bool> reversals(entries.size(), false);
+    for (uint32_t mask = 0; mask < (1u << freeIdx.size()); mask++)
+    {
+        for (size_t k = 0; k < freeIdx.size(); k++)
+            reversals[freeIdx[k]] = mask & (1 << k);
+        best = std::min(best, PlaylistOptimiser::pathCost(entries, order, allowRotate, &reversals));
+    }
+    return best;
+}
+
+// Lowest cost over every order which keeps pinned and unknown entries in place
+static float bruteForce(const std::vector<Entry>& entries, bool allowRotate, bool allowReverse = false)
+{
+    std::vector<uint32_t> freePos, freeIdx;
+    for (size_t idx = 0; idx < entries.size(); idx++)
+    {
+        if (entries[idx]._known && !entries[idx]._pinned)
+        {
+            freePos.push_back(idx);
+            freeIdx.push_back(idx);
+        }
+    }
+    std::vector<uint32_t> order = identityOrder(entries.size());
+    std::vector<uint32_t> reversible = freeIdx;
+    float best = INFINITY;
+    do
+    {
+        for (size_t k = 0; k < freePos.size(); k++)
+            order[freePos[k]] = freeIdx[k];
+        best = std::min(best, bestReversals(entries, order, allowRotate, allowReverse, reversible));
+    } while (std::next_permutation(freeIdx.begin(), freeIdx.end()));
+    return best;
+}
+
+// Lowest cost with entries only moved within the runs between pinned (and unknown) entries
+static void bruteForceRuns(const std::vector<Entry>& entries, bool allowRotate, bool allowReverse,
+                           const std::vector<std::vector<uint32_t>>& runs, size_t runIdx,
+                           const std::vector<uint32_t>& freeIdx, std::vector<uint32_t>& order, float& best)
+{
+    if (runIdx == runs.size())
+    {
+        best = std::min(best, bestReversals(entries, order, allowRotate, allowReverse, freeIdx));
+        return;
+    }
+    std::vector<uint32_t> perm = runs[runIdx];
+    do
+    {
+        for (size_t k = 0; k < perm.size(); k++)
+            order[runs[runIdx][k]] = perm[k];
+        bruteForceRuns(entries, allowRotate, allowReverse, runs, runIdx + 1, freeIdx, order, best);
+    } while (std::next_permutation(perm.begin(), perm.end()));
+}
+
+static float bruteForceRuns(const std::vector<Entry>& entries, bool allowRotate, bool allowReverse)
+{
+    std::vector<std::vector<uint32_t>> runs;
+    std::vector<uint32_t> curRun, freeIdx;
+    for (size_t idx = 0; idx < entries.size(); idx++)
+    {
+        if (entries[idx]._known && !entries[idx]._pinned)
+        {
+            curRun.push_back(idx);
+            freeIdx.push_back(idx);
+            continue;
+        }
+        if (!curRun.empty())
+            runs.push_back(curRun);
+        curRun.clear();
+    }
+    if (!curRun.empty())
+        runs.push_back(curRun);
+    std::vector<uint32_t> order = identityOrder(entries.size());
+    float best = INFINITY;
+    bruteForceRuns(entries, allowRotate, allowReverse, runs, 0, freeIdx, order, best);
+    return best;
+}
+
+static void writeFile(const std::string& fileName, const std::string& contents)
+{
+    FILE* pFile = fopen((std::string(TEST_ROOT) + "/spiffs/" + fileName).c_str(), "wb");
+    fwrite(contents.data(), 1, contents.size(), pFile);
+    fclose(pFile);
+}
+
+static void setModTime(const std::string& fileName, time_t modTime)
+{
+    struct timeval times[2] = {{modTime, 0}, {modTime, 0}};
+    utimes((std::string(TEST_ROOT) + "/spiffs/" + fileName).c_str(), times);
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+// Playlists up to EXACT_MAX_ENTRIES are solved exactly (brute force over reversals is limited to
+// fewer entries)
+void test_exact_matches_brute_force(void)
+{
+    for (int trial = 0; trial < 1000; trial++)
+    {
+        bool allowRotate = trial & 1;
+        bool allowReverse = trial & 2;
+        int maxEntries = allowReverse ? 6 : PlaylistOptimiser::EXACT_MAX_ENTRIES;
+        int numEntries = 1 + trial % maxEntries;
+        std::vector<Entry> entries;
+        for (int idx = 0; idx < numEntries; idx++)
+            entries.push_back(randEntry());
+        std::vector<uint32_t> order;
+        std::vector<float> rotations;
+        std::vector<bool> reversals;
+        float cost = PlaylistOptimiser::optimise(entries, allowRotate, allowReverse, order, rotations, reversals);
+        TEST_ASSERT_TRUE(isValidOrder(entries, order));
+        TEST_ASSERT_EQUAL(numEntries, reversals.size());
+        if (!allowReverse)
+            TEST_ASSERT_TRUE(std::find(reversals.begin(), reversals.end(), true) == reversals.end());
+        TEST_ASSERT_FLOAT_WITHIN(1e-4f, PlaylistOptimiser::pathCost(entries, order, allowRotate, &reversals), cost);
+        TEST_ASSERT_FLOAT_WITHIN(1e-4f, bruteForce(entries, allowRotate, allowReverse), cost);
+    }
+}
+
+// Pinned and unknown entries stay in place and each run between them is solved exactly
+void test_pinned_entries_keep_position(void)
+{
+    for (int trial = 0; trial < 200; trial++)
+    {
+        bool allowRotate = trial & 1;
+        bool allowReverse = trial & 2;
+        std::vector<Entry> entries;
+        for (int idx = 0; idx < 11; idx++)
+            entries.push_back(randEntry());
+        entries[3]._pinned = true;
+        entries[7]._known = false;
+        std::vector<uint32_t> order;
+        std::vector<float> rotations;
+        std::vector<bool> reversals;
+        float cost = PlaylistOptimiser::optimise(entries, allowRotate, allowReverse, order, rotations, reversals);
+        TEST_ASSERT_TRUE(isValidOrder(entries, order));
+        TEST_ASSERT_FALSE(reversals[3] || reversals[7]);
+        TEST_ASSERT_FLOAT_WITHIN(1e-4f, bruteForceRuns(entries, allowRotate, allowReverse), cost);
+    }
+}
+
+// The optimised order is never worse than the original and never better than the optimum
+void test_heuristic_bounded(void)
+{
+    double ratioSum = 0;
+    int numTrials = 40;
+    for (int trial = 0; trial < numTrials; trial++)
+    {
+        bool allowRotate = trial & 1;
+        int numEntries = PlaylistOptimiser::EXACT_MAX_ENTRIES + 1;
+        std::vector<Entry> entries;
+        for (int idx = 0; idx < numEntries; idx++)
+            entries.push_back(randEntry());
+        std::vector<uint32_t> order;
+        std::vector<float> rotations;
+        std::vector<bool> reversals;
+        float cost = PlaylistOptimiser::optimise(entries, allowRotate, false, order, rotations, reversals);
+        TEST_ASSERT_TRUE(isValidOrder(entries, order));
+        float original = PlaylistOptimiser::pathCost(entries, identityOrder(numEntries), allowRotate);
+        float best = bruteForce(entries, allowRotate);
+        TEST_ASSERT_LESS_OR_EQUAL(original + 1e-4f, cost);
+        TEST_ASSERT_GREATER_OR_EQUAL(best - 1e-4f, cost);
+        if (best > 1e-3f)
+            ratioSum += cost / best;
+    }
+    char msg[100];
+    snprintf(msg, sizeof(msg), "heuristic/optimum with %d entries: mean %.3f",
+             PlaylistOptimiser::EXACT_MAX_ENTRIES + 1, ratioSum / numTrials);
+    TEST_MESSAGE(msg);
+}
+
+// Rotations start each pattern at the angle the previous one ended (from the end it is played
+// from if reversed)
+void test_rotations_join_patterns(void)
+{
+    for (int trial = 0; trial < 100; trial++)
+    {
+        bool allowReverse = trial & 1;
+        std::vector<Entry> entries;
+        for (int idx = 0; idx < 6 + trial % 20; idx++)
+            entries.push_back(randEntry());
+        std::vector<uint32_t> order;
+        std::vector<float> rotations;
+        std::vector<bool> reversals;
+        PlaylistOptimiser::optimise(entries, true, allowReverse, order, rotations, reversals);
+        TEST_ASSERT_EQUAL(entries.size(), rotations.size());
+        for (size_t pos = 1; pos < order.size(); pos++)
+        {
+            const Entry& prev = entries[order[pos - 1]];
+            const Entry& cur = entries[order[pos]];
+            float prevEnd = reversals[order[pos - 1]] ? prev._startTheta : prev._endTheta;
+            float curStart = reversals[order[pos]] ? cur._endTheta : cur._startTheta;
+            float gap = remainderf(curStart + rotations[order[pos]] - prevEnd - rotations[order[pos - 1]], 2 * M_PI);
+            TEST_ASSERT_FLOAT_WITHIN(1e-3f, 0, gap);
+        }
+    }
+}
+
+// Patterns which start and end at opposite edges are chained end to end when they can be
+// reversed - alternate patterns are reversed and the only transit is from the centre
+void test_reversal_chains_patterns(void)
+{
+    for (int allowRotate = 0; allowRotate < 2; allowRotate++)
+    {
+        for (int numEntries : {6, 40})
+        {
+            std::vector<Entry> entries;
+            for (int idx = 0; idx < numEntries; idx++)
+            {
+                Entry entry = { 0, 0, float(M_PI), 1, true, false };
+                entries.push_back(entry);
+            }
+            std::vector<uint32_t> order;
+            std::vector<float> rotations;
+            std::vector<bool> reversals;
+            float fwdCost = PlaylistOptimiser::optimise(entries, allowRotate, false, order, rotations, reversals);
+            float revCost = PlaylistOptimiser::optimise(entries, allowRotate, true, order, rotations, reversals);
+            TEST_ASSERT_FLOAT_WITHIN(1e-4f, numEntries - 1, fwdCost);
+            TEST_ASSERT_FLOAT_WITHIN(1e-4f, 0, revCost);
+            for (size_t pos = 0; pos < order.size(); pos++)
+                TEST_ASSERT_EQUAL(pos & 1, reversals[order[pos]]);
+        }
+    }
+}
+
+// Large playlists use the heuristic - reports the reduction and time taken
+void test_large_playlists(void)
+{
+    for (int numEntries : {100, 1000, 10000})
+    {
+        for (int mode = 0; mode < 4; mode++)
+        {
+            bool allowRotate = mode & 1;
+            bool allowReverse = mode & 2;
+            std::vector<Entry> entries;
+            for (int idx = 0; idx < numEntries; idx++)
+                entries.push_back(randEntry());
+            float original = PlaylistOptimiser::pathCost(entries, identityOrder(numEntries), allowRotate);
+            std::vector<uint32_t> order;
+            std::vector<float> rotations;
+            std::vector<bool> reversals;
+            auto startTime = std::chrono::steady_clock::now();
+            float cost = PlaylistOptimiser::optimise(entries, allowRotate, allowReverse, order, rotations, reversals);
+            double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+            TEST_ASSERT_TRUE(isValidOrder(entries, order));
+            TEST_ASSERT_LESS_THAN(original, cost);
+            int numReversed = std::count(reversals.begin(), reversals.end(), true);
+            char msg[120];
+            snprintf(msg, sizeof(msg), "%5d entries %s%s: transit %.1f -> %.1f in %.1fms (%d reversed)", numEntries,
+                     allowRotate ? "rotated" : "chord  ", allowReverse ? " reversible" : "           ", original, cost,
+                     elapsedMs, numReversed);
+            TEST_MESSAGE(msg);
+        }
+    }
+}
+
+// Ends are read from the first and last points (past headers and trailers) and cached
+void test_get_ends(void)
+{
+    FileManager fileManager;
+    fileManager.setHostRoot(TEST_ROOT);
+    PlaylistOptimiser optimiser(fileManager);
+    Entry entry;
+
+    std::string header;
+    for (int line = 0; line < 8; line++)
+        header += "# Sandify header line with enough text to span more than one read block\n";
+    writeFile("a.thr", header + "\r\n1.5 0.25\r\n2 0.5\r\n  3.25   1\r\n# trailer\r\n\r\n");
+    TEST_ASSERT_TRUE(optimiser.getEnds("a.thr", entry));
+    TEST_ASSERT_TRUE(entry._known);
+    TEST_ASSERT_EQUAL_FLOAT(1.5f, entry._startTheta);
+    TEST_ASSERT_EQUAL_FLOAT(0.25f, entry._startRho);
+    TEST_ASSERT_EQUAL_FLOAT(3.25f, entry._endTheta);
+    TEST_ASSERT_EQUAL_FLOAT(1.0f, entry._endRho);
+
+    // Long file with no final newline
+    std::string lines;
+    for (int line = 0; line < 2000; line++)
+    {
+        char buf[40];
+        snprintf(buf, sizeof(buf), "%d.5 %0.4f\n", line, (line % 100) / 100.0);
+        lines += buf;
+    }
+    writeFile("b.thr", lines + "-7 0");
+    TEST_ASSERT_TRUE(optimiser.getEnds("b.thr", entry));
+    TEST_ASSERT_EQUAL_FLOAT(0.5f, entry._startTheta);
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, entry._startRho);
+    TEST_ASSERT_EQUAL_FLOAT(-7.0f, entry._endTheta);
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, entry._endRho);
+
+    writeFile("c.thr", "# no points\n");
+    TEST_ASSERT_FALSE(optimiser.getEnds("c.thr", entry));
+    TEST_ASSERT_FALSE(optimiser.getEnds("missing.thr", entry));
+
+    // Cached by modification time
+    writeFile("d.thr", "0 0\n1 1\n");
+    setModTime("d.thr", 1000);
+    TEST_ASSERT_TRUE(optimiser.getEnds("d.thr", entry));
+    writeFile("d.thr", "0 1\n1 0\n");
+    setModTime("d.thr", 1000);
+    TEST_ASSERT_TRUE(optimiser.getEnds("d.thr", entry));
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, entry._startRho);
+    setModTime("d.thr", 2000);
+    TEST_ASSERT_TRUE(optimiser.getEnds("d.thr", entry));
+    TEST_ASSERT_EQUAL_FLOAT(1.0f, entry._startRho);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_exact_matches_brute_force);
+    RUN_TEST(test_pinned_entries_keep_position);
+    RUN_TEST(test_heuristic_bounded);
+    RUN_TEST(test_rotations_join_patterns);
+    RUN_TEST(test_reversal_chains_patterns);
+    RUN_TEST(test_large_playlists);
+    RUN_TEST(test_get_ends);
+    return UNITY_END();
+}
@@ -0,0 +1,485 @@
+// RBotFirmware
+// Rob Dobson 2016-2018
+
+// Sand table kinematics - each motion helper has its own kinematics constants so helpers with
+// different geometry (such as the pattern estimator's dry-run helper) don't affect each other,
+// the helper's transforms (using those constants) match the runtime forms, a full theta-rho
+// sweep against libm, batch conversion against per-point conversion and the time per call of
+// each form and points per second of batches
+
+#include <Arduino.h>
+#include <unity.h>
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "RobotMotion/Robots/RobotSandTableRotary.h"
+#include "MoveCmd.h"
+
+static const char* ROBOT_CONFIG_FINE =
+    "{\"robotGeom\":{\"model\":\"SandBotRotary\",\"blockDistanceMM\":1,"
+    "\"axis0\":{\"maxSpeed\":15,\"maxAcc\":25,\"maxRPM\":4,\"stepsPerRot\":38400},"
+    "\"axis1\":{\"maxSpeed\":15,\"maxAcc\":25,\"maxRPM\":30,\"stepsPerRot\":3200,\"unitsPerRot\":40.5,\"maxVal\":145}}}";
+static const char* ROBOT_CONFIG_COARSE =
+    "{\"robotGeom\":{\"model\":\"SandBotRotary\",\"blockDistanceMM\":1,"
+    "\"axis0\":{\"maxSpeed\":15,\"maxAcc\":25,\"maxRPM\":8,\"stepsPerRot\":19200},"
+    "\"axis1\":{\"maxSpeed\":15,\"maxAcc\":25,\"maxRPM\":30,\"stepsPerRot\":1600,\"unitsPerRot\":40.5,\"maxVal\":290}}}";
+
+// Dry-run helper with access to the commanded position
+class TestMotionHelper : public MotionHelperSandTableRotary
+{
+public:
+    TestMotionHelper(const char* pConfig)
+    {
+        setDryRun();
+        configure(pConfig);
+    }
+    AxisInt32s moveAndRun(float x, float y, bool split)
+    {
+        MoveCmd moveCmd;
+        moveCmd.clear();
+        moveCmd.setAxisValMM(0, x);
+        moveCmd.setAxisValMM(1, y);
+        moveCmd.setFlag(MoveCmd::FLAG_DONT_SPLIT, !split);
+        while (!canAccept())
+            dryRunService(false);
+        moveTo(moveCmd);
+        while (!canAccept())
+            dryRunService(false);
+        dryRunService(true);
+        return _lastCommandedAxisPos._stepsFromHome;
+    }
+
+    // Transforms using the helper's kinematics constants and the runtime (function pointer) forms
+    bool cachedPtToActuator(AxisFloats& pt, AxisFloats& actuator, AxisPosition& curPos)
+    {
+        AxisPosition savedPos = _lastCommandedAxisPos;
+        _lastCommandedAxisPos = curPos;
+        bool isValid = ptToActuator(pt, actuator, false);
+        _lastCommandedAxisPos = savedPos;
+        return isValid;
+    }
+    bool runtimePtToActuator(AxisFloats& pt, AxisFloats& actuator, AxisPosition& curPos)
+    {
+        return _ptToActuatorFn(pt, actuator, curPos, _axesParams, false);
+    }
+    void cachedActuatorToPt(AxisInt32s& actuator, AxisFloats& pt)
+    {
+        actuatorToPt(actuator, pt);
+    }
+    void runtimeActuatorToPt(AxisInt32s& actuator, AxisFloats& pt)
+    {
+        _actuatorToPtFn(actuator, pt, _lastCommandedAxisPos, _axesParams);
+    }
+    void cachedCorrectStepOverflow(AxisPosition& curPos)
+    {
+        AxisPosition savedPos = _lastCommandedAxisPos;
+        _lastCommandedAxisPos = curPos;
+        correctStepOverflow();
+        curPos = _lastCommandedAxisPos;
+        _lastCommandedAxisPos = savedPos;
+    }
+    void runtimeCorrectStepOverflow(AxisPosition& curPos)
+    {
+        _correctStepOverflowFn(curPos, _axesParams);
+    }
+    void cachedPtsToActuatorBatch(AxisFloats* pPts, AxisFloats* pActuator, bool* pValid, int numPts, AxisPosition& curPos)
+    {
+        ptsToActuatorBatch(pPts, pActuator, pValid, numPts, curPos, false);
+    }
+    static const int BATCH_MAX = KINEMATICS_BATCH_MAX;
+};
+
+// Geometry of ROBOT_CONFIG_FINE
+static const double FINE_THETA_STEPS_PER_ROT = 38400;
+static const double FINE_RHO_STEPS_PER_ROT = 3200;
+static const double FINE_RHO_STEPS_PER_MM = 3200 / 40.5;
+static const double FINE_MAX_RHO_MM = 145;
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_helpers_independent(void)
+{
+    TestMotionHelper fine(ROBOT_CONFIG_FINE);
+    TestMotionHelper coarse(ROBOT_CONFIG_COARSE);
+
+    // Quarter turn and 100mm out - rho also turns with theta (steps per rotation)
+    AxisInt32s fineSteps = fine.moveAndRun(0, 100, false);
+    TEST_ASSERT_EQUAL(9600, fineSteps.getVal(0));
+    TEST_ASSERT_EQUAL(800 + int32_t(roundf(100 * 3200 / 40.5f)), fineSteps.getVal(1));
+    AxisInt32s coarseSteps = coarse.moveAndRun(0, 100, false);
+    TEST_ASSERT_EQUAL(4800, coarseSteps.getVal(0));
+    TEST_ASSERT_EQUAL(400 + int32_t(roundf(100 * 1600 / 40.5f)), coarseSteps.getVal(1));
+
+    // Configuring another helper doesn't change this one
+    TestMotionHelper fine2(ROBOT_CONFIG_FINE);
+    TestMotionHelper coarse2(ROBOT_CONFIG_COARSE);
+    fineSteps = fine.moveAndRun(-100, 0, false);
+    TEST_ASSERT_EQUAL(19200, fineSteps.getVal(0));
+}
+
+// Split (batch converted) and single block moves end at the same position
+void test_split_matches_direct(void)
+{
+    TestMotionHelper split(ROBOT_CONFIG_FINE);
+    TestMotionHelper direct(ROBOT_CONFIG_FINE);
+    const float pts[][2] = {{50, 20}, {-30, 90}, {0, -140}, {10, 10}, {120, 60}};
+    for (auto& pt : pts)
+    {
+        AxisInt32s splitSteps = split.moveAndRun(pt[0], pt[1], true);
+        AxisInt32s directSteps = direct.moveAndRun(pt[0], pt[1], false);
+        TEST_ASSERT_INT32_WITHIN(2, directSteps.getVal(0), splitSteps.getVal(0));
+        TEST_ASSERT_INT32_WITHIN(2, directSteps.getVal(1), splitSteps.getVal(1));
+    }
+}
+
+// Helpers with different geometry planning at the same time (as the live and pattern
+// estimator helpers do) get the same results as when run alone
+void test_helpers_concurrent(void)
+{
+    const char* configs[] = {ROBOT_CONFIG_FINE, ROBOT_CONFIG_COARSE};
+    auto runMoves = [](const char* pConfig, std::vector<int32_t>& steps) {
+        TestMotionHelper helper(pConfig);
+        for (int moveIdx = 0; moveIdx < 100; moveIdx++)
+        {
+            float angle = moveIdx * 0.7f;
+            float dist = 10 + (moveIdx * 37) % 130;
+            AxisInt32s pos = helper.moveAndRun(dist * cosf(angle), dist * sinf(angle), true);
+            steps.push_back(pos.getVal(0));
+            steps.push_back(pos.getVal(1));
+        }
+    };
+    std::vector<int32_t> expected[2], results[2];
+    for (int cfgIdx = 0; cfgIdx < 2; cfgIdx++)
+        runMoves(configs[cfgIdx], expected[cfgIdx]);
+    std::thread threads[2];
+    for (int cfgIdx = 0; cfgIdx < 2; cfgIdx++)
+        threads[cfgIdx] = std::thread(runMoves, configs[cfgIdx], std::ref(results[cfgIdx]));
+    for (int cfgIdx = 0; cfgIdx < 2; cfgIdx++)
+    {
+        threads[cfgIdx].join();
+        TEST_ASSERT_TRUE(expected[cfgIdx] == results[cfgIdx]);
+    }
+}
+
+// Results of timed calls are kept so the calls aren't optimised away
+static volatile float benchSink = 0;
+
+static uint64_t hostCycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// The helper's transforms (cached constants) give the same results as the runtime forms
+void test_cached_matches_runtime(void)
+{
+    for (const char* pConfig : {ROBOT_CONFIG_FINE, ROBOT_CONFIG_COARSE})
+    {
+        TestMotionHelper helper(pConfig);
+        for (int ptIdx = 0; ptIdx < 500; ptIdx++)
+        {
+            AxisPosition curPos;
+            curPos._stepsFromHome.setVal(0, (ptIdx * 7919) % 80000 - 40000);
+            curPos._stepsFromHome.setVal(1, (ptIdx * 104729) % 20000 - 3000);
+            AxisFloats pt(140 * cosf(ptIdx * 0.37f) * (ptIdx % 11) / 10, 140 * sinf(ptIdx * 0.37f) * (ptIdx % 11) / 10);
+            AxisFloats cached, runtime;
+            TEST_ASSERT_EQUAL(helper.runtimePtToActuator(pt, runtime, curPos), helper.cachedPtToActuator(pt, cached, curPos));
+            TEST_ASSERT_EQUAL_FLOAT(runtime.getVal(0), cached.getVal(0));
+            TEST_ASSERT_EQUAL_FLOAT(runtime.getVal(1), cached.getVal(1));
+
+            AxisFloats cachedPt, runtimePt;
+            helper.cachedActuatorToPt(curPos._stepsFromHome, cachedPt);
+            helper.runtimeActuatorToPt(curPos._stepsFromHome, runtimePt);
+            TEST_ASSERT_EQUAL_FLOAT(runtimePt.getVal(0), cachedPt.getVal(0));
+            TEST_ASSERT_EQUAL_FLOAT(runtimePt.getVal(1), cachedPt.getVal(1));
+
+            AxisPosition cachedPos = curPos, runtimePos = curPos;
+            helper.cachedCorrectStepOverflow(cachedPos);
+            helper.runtimeCorrectStepOverflow(runtimePos);
+            TEST_ASSERT_EQUAL(runtimePos._stepsFromHome.getVal(0), cachedPos._stepsFromHome.getVal(0));
+            TEST_ASSERT_EQUAL(runtimePos._stepsFromHome.getVal(1), cachedPos._stepsFromHome.getVal(1));
+        }
+    }
+}
+
+// Every theta (avoiding exactly half a turn where either direction is minimal) and rho from
+// the home position against the same geometry in double precision with libm - steps are within
+// one of the exact value and points from steps within a rho step (the rho steps which
+// counteract theta are truncated to whole steps)
+void test_accuracy_sweep(void)
+{
+    TestMotionHelper helper(ROBOT_CONFIG_FINE);
+    AxisPosition homePos;
+    int maxThetaErr = 0, maxRhoErr = 0, numPts = 0;
+    double maxPtErrMM = 0;
+    for (double thetaDegs = -179.87; thetaDegs < 180; thetaDegs += 0.25)
+    {
+        for (double rho = 0.01; rho <= 1.0; rho += 0.01)
+        {
+            double x = rho * FINE_MAX_RHO_MM * cos(thetaDegs * M_PI / 180);
+            double y = rho * FINE_MAX_RHO_MM * sin(thetaDegs * M_PI / 180);
+            AxisFloats pt(x, y), actuator;
+            TEST_ASSERT_TRUE(helper.cachedPtToActuator(pt, actuator, homePos));
+
+            // Exact steps (rho counteracts theta)
+            double thetaExact = atan2(y, x) * 180 / M_PI;
+            long thetaSteps = lround(thetaExact * FINE_THETA_STEPS_PER_ROT / 360);
+            long rhoSteps = lround(thetaExact * FINE_RHO_STEPS_PER_ROT / 360 + hypot(x, y) * FINE_RHO_STEPS_PER_MM);
+            maxThetaErr = std::max(maxThetaErr, int(labs(long(actuator.getVal(0)) - thetaSteps)));
+            maxRhoErr = std::max(maxRhoErr, int(labs(long(actuator.getVal(1)) - rhoSteps)));
+
+            // Point from the steps
+            AxisInt32s steps(int32_t(actuator.getVal(0)), int32_t(actuator.getVal(1)), 0);
+            AxisFloats stepsPt;
+            helper.cachedActuatorToPt(steps, stepsPt);
+            double stepsTheta = steps.getVal(0) * 2 * M_PI / FINE_THETA_STEPS_PER_ROT;
+            double stepsRhoMM = (steps.getVal(1) - steps.getVal(0) * FINE_RHO_STEPS_PER_ROT / FINE_THETA_STEPS_PER_ROT) /
+                                FINE_RHO_STEPS_PER_MM;
+            maxPtErrMM = std::max(maxPtErrMM, hypot(stepsPt.getVal(0) - stepsRhoMM * cos(stepsTheta),
+                                                    stepsPt.getVal(1) - stepsRhoMM * sin(stepsTheta)));
+            numPts++;
+        }
+    }
+    char msg[200];
+    snprintf(msg, sizeof(msg), "%d points: max error theta %d rho %d steps, actuatorToPt %.2e mm", numPts, maxThetaErr,
+             maxRhoErr, maxPtErrMM);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_LESS_OR_EQUAL(1, maxThetaErr);
+    TEST_ASSERT_LESS_OR_EQUAL(1, maxRhoErr);
+    TEST_ASSERT_LESS_THAN(1.0 / FINE_RHO_STEPS_PER_MM, maxPtErrMM);
+}
+
+// Time per call of each form (host cycles from the time stamp counter where there is one)
+void test_call_benchmark(void)
+{
+    TestMotionHelper helper(ROBOT_CONFIG_FINE);
+    static const int NUM_PTS = 1024;
+    static const int NUM_REPEATS = 200;
+    std::vector<AxisFloats> pts(NUM_PTS);
+    std::vector<AxisInt32s> stepsList(NUM_PTS);
+    for (int ptIdx = 0; ptIdx < NUM_PTS; ptIdx++)
+    {
+        pts[ptIdx].set(140 * cosf(ptIdx * 0.37f) * (ptIdx % 11) / 10, 140 * sinf(ptIdx * 0.37f) * (ptIdx % 11) / 10);
+        stepsList[ptIdx] = AxisInt32s(ptIdx * 37 - 19000, ptIdx * 11, 0);
+    }
+    auto timeCalls = [&](const char* pName, auto&& fn) {
+        float sink = 0;
+        uint64_t startCycles = hostCycles();
+        auto startTime = std::chrono::steady_clock::now();
+        for (int repeatIdx = 0; repeatIdx < NUM_REPEATS; repeatIdx++)
+            for (int ptIdx = 0; ptIdx < NUM_PTS; ptIdx++)
+                sink += fn(ptIdx);
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - startTime).count() /
+                    (NUM_REPEATS * NUM_PTS);
+        double cycles = double(hostCycles() - startCycles) / (NUM_REPEATS * NUM_PTS);
+        char msg[120];
+        benchSink = sink;
+        snprintf(msg, sizeof(msg), "%-22s %6.1f ns/call %6.1f cycles/call", pName, ns, cycles);
+        TEST_MESSAGE(msg);
+        return ns;
+    };
+    AxisPosition curPos;
+    double cachedPtNs = timeCalls("ptToActuator cached", [&](int ptIdx) {
+        AxisFloats actuator;
+        helper.cachedPtToActuator(pts[ptIdx], actuator, curPos);
+        return actuator.getVal(1);
+    });
+    double runtimePtNs = timeCalls("ptToActuator runtime", [&](int ptIdx) {
+        AxisFloats actuator;
+        helper.runtimePtToActuator(pts[ptIdx], actuator, curPos);
+        return actuator.getVal(1);
+    });
+    double cachedStepsNs = timeCalls("actuatorToPt cached", [&](int ptIdx) {
+        AxisFloats pt;
+        helper.cachedActuatorToPt(stepsList[ptIdx], pt);
+        return pt.getVal(0);
+    });
+    double runtimeStepsNs = timeCalls("actuatorToPt runtime", [&](int ptIdx) {
+        AxisFloats pt;
+        helper.runtimeActuatorToPt(stepsList[ptIdx], pt);
+        return pt.getVal(0);
+    });
+    timeCalls("libm cartesian->polar", [&](int ptIdx) {
+        double x = pts[ptIdx].getVal(0), y = pts[ptIdx].getVal(1);
+        return float(atan2(y, x) + sqrt(x * x + y * y));
+    });
+    TEST_ASSERT_LESS_THAN(runtimePtNs * 1.1, cachedPtNs);
+    TEST_ASSERT_LESS_THAN(runtimeStepsNs * 1.1, cachedStepsNs);
+}
+
+// Points which wind several rotations each way (so step overflow is corrected part way through
+// batches), cross theta +/-180 on each point, go out of bounds and pass close to the origin
+static void makeBatchPoints(std::vector<AxisFloats>& pts)
+{
+    for (int ptIdx = 0; ptIdx < 1500; ptIdx++)
+    {
+        float theta = ptIdx * 0.07f;
+        float rho = 5 + 135.0f * ptIdx / 1500;
+        pts.push_back(AxisFloats(rho * cosf(theta), rho * sinf(theta)));
+    }
+    for (int ptIdx = 0; ptIdx < 1500; ptIdx++)
+    {
+        float theta = -ptIdx * 0.09f;
+        float rho = 140 - 135.0f * ptIdx / 1500;
+        pts.push_back(AxisFloats(rho * cosf(theta), rho * sinf(theta)));
+    }
+    for (int ptIdx = 0; ptIdx < 200; ptIdx++)
+        pts.push_back(AxisFloats(-100 + ptIdx * 0.2f, (ptIdx & 1) ? 0.5f : -0.5f));
+    for (int ptIdx = 0; ptIdx < 300; ptIdx++)
+    {
+        float theta = ptIdx * 1.3f;
+        float rho = (ptIdx % 3 == 0) ? 160.0f : ((ptIdx % 3 == 1) ? 0.5f : 120.0f);
+        pts.push_back(AxisFloats(rho * cosf(theta), rho * sinf(theta)));
+    }
+}
+
+// Per-point conversion with the step overflow corrected after each point (as addToPlanner)
+static void perPointToActuator(TestMotionHelper& helper, std::vector<AxisFloats>& pts,
+            std::vector<AxisFloats>& actuator, std::vector<bool>& valid, AxisPosition& curPos)
+{
+    for (size_t ptIdx = 0; ptIdx < pts.size(); ptIdx++)
+    {
+        valid[ptIdx] = helper.cachedPtToActuator(pts[ptIdx], actuator[ptIdx], curPos);
+        if (!valid[ptIdx])
+            continue;
+        curPos._stepsFromHome.setVal(0, int32_t(actuator[ptIdx].getVal(0)));
+        curPos._stepsFromHome.setVal(1, int32_t(actuator[ptIdx].getVal(1)));
+        helper.cachedCorrectStepOverflow(curPos);
+    }
+}
+
+// Batch conversion - each batch is relative to the position at its start so the overflow
+// corrected since then is added to the later points (as blocksToAddProcess)
+static void batchToActuator(TestMotionHelper& helper, std::vector<AxisFloats>& pts,
+            std::vector<AxisFloats>& actuator, std::vector<bool>& valid, AxisPosition& curPos)
+{
+    static const int BATCH_MAX = TestMotionHelper::BATCH_MAX;
+    bool batchValid[BATCH_MAX];
+    for (size_t batchStart = 0; batchStart < pts.size(); batchStart += BATCH_MAX)
+    {
+        int numPts = std::min(int(pts.size() - batchStart), BATCH_MAX);
+        helper.cachedPtsToActuatorBatch(&pts[batchStart], &actuator[batchStart], batchValid, numPts, curPos);
+        AxisInt32s overflowCorrection;
+        for (int ptIdx = 0; ptIdx < numPts; ptIdx++)
+        {
+            valid[batchStart + ptIdx] = batchValid[ptIdx];
+            if (!batchValid[ptIdx])
+                continue;
+            AxisFloats& ptActuator = actuator[batchStart + ptIdx];
+            for (int axisIdx = 0; axisIdx < 2; axisIdx++)
+                ptActuator._pt[axisIdx] += overflowCorrection.vals[axisIdx];
+            curPos._stepsFromHome.setVal(0, int32_t(ptActuator.getVal(0)));
+            curPos._stepsFromHome.setVal(1, int32_t(ptActuator.getVal(1)));
+            AxisInt32s stepsBefore = curPos._stepsFromHome;
+            helper.cachedCorrectStepOverflow(curPos);
+            for (int axisIdx = 0; axisIdx < 2; axisIdx++)
+                overflowCorrection.vals[axisIdx] += curPos._stepsFromHome.vals[axisIdx] - stepsBefore.vals[axisIdx];
+        }
+    }
+}
+
+// Batches give the same steps and validity as per-point conversion (across theta wrap-around,
+// step overflow correction within a batch, out of bounds and near-origin points)
+void test_batch_matches_per_point(void)
+{
+    TestMotionHelper helper(ROBOT_CONFIG_FINE);
+    std::vector<AxisFloats> pts;
+    makeBatchPoints(pts);
+    std::vector<AxisFloats> perPointActuator(pts.size()), batchActuator(pts.size());
+    std::vector<bool> perPointValid(pts.size()), batchValid(pts.size());
+    AxisPosition perPointPos, batchPos;
+    perPointToActuator(helper, pts, perPointActuator, perPointValid, perPointPos);
+    batchToActuator(helper, pts, batchActuator, batchValid, batchPos);
+
+    int numInvalid = 0, numWraps = 0;
+    for (size_t ptIdx = 0; ptIdx < pts.size(); ptIdx++)
+    {
+        char msg[80];
+        snprintf(msg, sizeof(msg), "point %d (%.2f, %.2f)", int(ptIdx), pts[ptIdx].getVal(0), pts[ptIdx].getVal(1));
+        TEST_ASSERT_EQUAL_MESSAGE(perPointValid[ptIdx], batchValid[ptIdx], msg);
+        if (!perPointValid[ptIdx])
+        {
+            numInvalid++;
+            continue;
+        }
+        TEST_ASSERT_EQUAL_MESSAGE(int32_t(perPointActuator[ptIdx].getVal(0)), int32_t(batchActuator[ptIdx].getVal(0)), msg);
+        TEST_ASSERT_EQUAL_MESSAGE(int32_t(perPointActuator[ptIdx].getVal(1)), int32_t(batchActuator[ptIdx].getVal(1)), msg);
+        if ((ptIdx > 0) && (pts[ptIdx].getVal(0) < 0) && (pts[ptIdx].getVal(1) * pts[ptIdx - 1].getVal(1) < 0))
+            numWraps++;
+    }
+    TEST_ASSERT_EQUAL(perPointPos._stepsFromHome.getVal(0), batchPos._stepsFromHome.getVal(0));
+    TEST_ASSERT_EQUAL(perPointPos._stepsFromHome.getVal(1), batchPos._stepsFromHome.getVal(1));
+
+    // The points did exercise the cases
+    TEST_ASSERT_GREATER_THAN(50, numInvalid);
+    TEST_ASSERT_GREATER_THAN(100, numWraps);
+    char msg[80];
+    snprintf(msg, sizeof(msg), "%d points, %d out of bounds, %d theta wraps", int(pts.size()), numInvalid, numWraps);
+    TEST_MESSAGE(msg);
+}
+
+// Points per second converted in batches against one at a time (both through the helper's
+// kinematics constants with step overflow corrected after each point)
+void test_batch_throughput(void)
+{
+    TestMotionHelper helper(ROBOT_CONFIG_FINE);
+    std::vector<AxisFloats> pts;
+    makeBatchPoints(pts);
+    std::vector<AxisFloats> actuator(pts.size());
+    std::vector<bool> valid(pts.size());
+    static const int NUM_RUNS = 9;
+    double minNs[2] = {1e30, 1e30}, minCycles[2] = {1e30, 1e30};
+    for (int runIdx = 0; runIdx < NUM_RUNS; runIdx++)
+    {
+        for (int formIdx = 0; formIdx < 2; formIdx++)
+        {
+            AxisPosition curPos;
+            uint64_t startCycles = hostCycles();
+            auto startTime = std::chrono::steady_clock::now();
+            if (formIdx == 0)
+                perPointToActuator(helper, pts, actuator, valid, curPos);
+            else
+                batchToActuator(helper, pts, actuator, valid, curPos);
+            double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - startTime).count();
+            minNs[formIdx] = std::min(minNs[formIdx], ns / pts.size());
+            minCycles[formIdx] = std::min(minCycles[formIdx], double(hostCycles() - startCycles) / pts.size());
+            benchSink = curPos._stepsFromHome.getVal(1);
+        }
+    }
+    const char* formNames[] = {"per-point", "batch"};
+    for (int formIdx = 0; formIdx < 2; formIdx++)
+    {
+        char msg[120];
+        snprintf(msg, sizeof(msg), "%-10s %6.2fM points/s %6.1f ns/point %6.1f cycles/point", formNames[formIdx],
+                 1e3 / minNs[formIdx], minNs[formIdx], minCycles[formIdx]);
+        TEST_MESSAGE(msg);
+    }
+
+    // Only a gross regression fails (host timing is noisy)
+    TEST_ASSERT_LESS_THAN(minNs[0] * 1.25, minNs[1]);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_helpers_independent);
+    RUN_TEST(test_split_matches_direct);
+    RUN_TEST(test_helpers_concurrent);
+    RUN_TEST(test_cached_matches_runtime);
+    RUN_TEST(test_accuracy_sweep);
+    RUN_TEST(test_call_benchmark);
+    RUN_TEST(test_batch_matches_per_point);
+    RUN_TEST(test_batch_throughput);
+    return UNITY_END();
+}
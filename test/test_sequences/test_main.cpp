@@ -0,0 +1,407 @@
+// RBotFirmware
+// Rob Dobson 2016-2018
+
+// Playlists - a 10k line playlist is indexed and played through the work manager in line order
+// and shuffled (every line once) - reports the time per line played
+// A 10 pattern playlist is played through the work manager and the robot with the main loop and
+// the step ISR run in simulated time and the host FileManager's simulated access time blocking
+// the main loop (while the ISR runs on) - the dead time (no motion while patterns remain) is
+// reported with the next pattern queued when the work queue is empty (seqItemsAhead 0 - as
+// before) and queued ahead (the default) for several pipeline lengths and file open times
+// A prefetched pattern is discarded on stop and when a different file is played
+
+#include <Arduino.h>
+#include <unity.h>
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include "RdJson.h"
+#include "ConfigBase.h"
+#include "RobotConfigurations.h"
+#include "RobotMotion/RobotController.h"
+#include "RestAPISystem.h"
+#include "WorkManager/WorkManager.h"
+#include "WorkManager/Evaluators/EvaluatorFiles.h"
+#include "WorkManager/Evaluators/EvaluatorThetaRhoLine.h"
+
+static const char* HOST_ROOT = "/tmp/test_sequences";
+static const int PLAYLIST_LINES = 10000;
+static const int MAX_SERVICES_PER_LINE = 100;
+static const int SEQ_ITEMS_AHEAD_DEFAULT = 10;
+static const int PLAYLIST_PATTERNS = 10;
+static const uint32_t SIM_READ_MS = 20;
+static const int MAX_SIM_MS = 5000000;
+
+// Playlist of patterns which don't exist (they are handled as unknown commands so each line
+// leaves the queue straight away)
+static void writePlaylist(FileManager& fileManager, const char* pFileName, int numLines)
+{
+    String contents;
+    for (int lineIdx = 0; lineIdx < numLines; lineIdx++)
+        contents += "pattern" + String(lineIdx) + ".thr\n";
+    TEST_ASSERT_TRUE(fileManager.setFileContents("", pFileName, contents));
+}
+
+// Play a playlist recording the line index of each line as it becomes the next to play
+static void playPlaylist(const char* pFileName, bool shuffle, std::vector<int>& lineOrder)
+{
+    ConfigBase mainConfig, robotConfig;
+    RobotController robotController;
+    LedStrip ledStrip;
+    WireGuardManager wireGuardManager;
+    RestAPISystem restAPISystem;
+    FileManager fileManager;
+    fileManager.setHostRoot(HOST_ROOT);
+    WorkManager workManager(mainConfig, robotConfig, robotController, ledStrip, wireGuardManager, restAPISystem,
+                            fileManager);
+    String robotConfigStr = RdJson::getString("robotConfig", "", RobotConfigurations::getConfig("TranquilSmall"));
+    TEST_ASSERT_TRUE(robotController.init(robotConfigStr.c_str()));
+    writePlaylist(fileManager, pFileName, PLAYLIST_LINES);
+
+    // Start - shuffle is set while the playlist is indexed
+    String retStr;
+    WorkItem workItem(pFileName);
+    workManager.addWorkItem(workItem, retStr);
+    workManager.service();
+    if (shuffle)
+    {
+        WorkItem shuffleItem("seq_shuffle_on");
+        workManager.addWorkItem(shuffleItem, retStr);
+    }
+
+    // Play
+    lineOrder.clear();
+    auto startTime = std::chrono::steady_clock::now();
+    for (int serviceIdx = 0; serviceIdx < PLAYLIST_LINES * MAX_SERVICES_PER_LINE; serviceIdx++)
+    {
+        workManager.service();
+        String statusStr;
+        workManager.queryStatus(statusStr);
+        if (statusStr.indexOf("\"playlist\"") < 0)
+            break;
+        int lineIdx = RdJson::getLong("playlistIdx", -1, statusStr.c_str());
+        if (lineOrder.empty() || (lineOrder.back() != lineIdx))
+            lineOrder.push_back(lineIdx);
+    }
+    double elapsedUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - startTime).count();
+    TEST_ASSERT_TRUE(workManager.queueIsEmpty());
+    char msg[100];
+    snprintf(msg, sizeof(msg), "%d lines %s %.2fus/line (with status)", PLAYLIST_LINES, shuffle ? "shuffled" : "in order",
+             elapsedUs / PLAYLIST_LINES);
+    TEST_MESSAGE(msg);
+}
+
+// Work manager and robot with the main loop (1ms a pass) and the ISR run in simulated time - file
+// access time is added to the pass as the main loop is blocked for it - dead time is time with the
+// pipeline empty or not ready while work is pending (from the motion stats) once the first pattern
+// has started
+class PlaylistSim
+{
+public:
+    ConfigBase _mainConfig, _robotConfig;
+    RobotController _robotController;
+    LedStrip _ledStrip;
+    WireGuardManager _wireGuardManager;
+    RestAPISystem _restAPISystem;
+    FileManager _fileManager;
+    WorkManager _workManager;
+    uint32_t _simMs;
+    bool _hasMoved;
+    long _lastStalledMs;
+    uint32_t _gapMs;
+    uint32_t _deadMs;
+    uint32_t _maxGapMs;
+    int _numGaps;
+
+    PlaylistSim(int seqItemsAhead, int pipelineLen, uint32_t openMs) :
+            _workManager(_mainConfig, _robotConfig, _robotController, _ledStrip, _wireGuardManager, _restAPISystem,
+                         _fileManager)
+    {
+        _fileManager.setHostRoot(HOST_ROOT);
+        String config = RobotConfigurations::getConfig("TranquilSmall");
+        config.replace("\"evaluators\":{", "\"evaluators\":{\"seqItemsAhead\":" + String(seqItemsAhead) + ",");
+        config.replace("\"robotGeom\":{", "\"robotGeom\":{\"pipelineLen\":" + String(pipelineLen) + ",");
+        _robotConfig.setConfigData(config.c_str());
+        _workManager.reconfigure();
+        TEST_ASSERT_NOT_NULL(hostTimerIsr);
+        _fileManager.setSimAccessMs(openMs, SIM_READ_MS);
+        _simMs = 0;
+        _hasMoved = false;
+        _lastStalledMs = 0;
+        _gapMs = 0;
+        _deadMs = 0;
+        _maxGapMs = 0;
+        _numGaps = 0;
+    }
+
+    // One pass of the main loop then the ISR for the pass (1ms) and the file access made in it
+    void loop()
+    {
+        _workManager.service();
+        _robotController.service();
+        uint32_t passMs = 1 + _fileManager.takeSimAccessMs();
+        for (uint32_t msIdx = 0; msIdx < passMs; msIdx++)
+        {
+            for (uint32_t tickIdx = 0; tickIdx < MotionBlock::NS_IN_A_MS / MotionBlock::TICK_INTERVAL_NS; tickIdx++)
+                hostTimerIsr();
+            if (!_robotController.isMotionComplete())
+                _hasMoved = true;
+
+            // Stalled time (the stats are reset when each pattern's first move starts)
+            String statsJson = _robotController.getMotionStats();
+            long stalledMs = RdJson::getLong("emptyMs", 0, statsJson.c_str()) +
+                             RdJson::getLong("notReadyMs", 0, statsJson.c_str());
+            long newStalledMs = (stalledMs >= _lastStalledMs) ? stalledMs - _lastStalledMs : stalledMs;
+            _lastStalledMs = stalledMs;
+            if (_hasMoved && (newStalledMs > 0))
+            {
+                _gapMs += newStalledMs;
+                _deadMs += newStalledMs;
+            }
+            else if (_gapMs > 0)
+            {
+                _numGaps++;
+                _maxGapMs = std::max(_maxGapMs, _gapMs);
+                _gapMs = 0;
+            }
+        }
+        _simMs += passMs;
+    }
+
+    bool isWorkRemaining()
+    {
+        String statusStr;
+        _workManager.queryStatus(statusStr);
+        return (statusStr.indexOf("\"playlist\"") >= 0) || (statusStr.indexOf("\"file\"") >= 0) ||
+               !_workManager.queueIsEmpty();
+    }
+};
+
+// Pattern of a playlist - starts and ends at different radii so each is joined by a move
+static String makePattern(int patternIdx)
+{
+    String contents = "# Made with love by Sandify\n";
+    char lineBuf[40];
+    for (int ptIdx = 0; ptIdx < 40; ptIdx++)
+    {
+        double theta = ptIdx * 0.1 + patternIdx;
+        double rho = 0.5 + 0.4 * sin(ptIdx * 0.1 * (2 + patternIdx % 3) + patternIdx);
+        snprintf(lineBuf, sizeof(lineBuf), "%.5f %.5f\n", theta, rho);
+        contents += lineBuf;
+    }
+    return contents;
+}
+
+static void writeFile(FileManager& fileManager, const char* pFileName, const String& contents)
+{
+    String fileContents = contents;
+    TEST_ASSERT_TRUE(fileManager.setFileContents("", pFileName, fileContents));
+}
+
+struct DeadTimeResult
+{
+    double _simTimeS;
+    uint32_t _deadMs;
+    uint32_t _maxGapMs;
+    int _numGaps;
+};
+
+// Play the 10 pattern playlist
+static DeadTimeResult playPatterns(int seqItemsAhead, int pipelineLen, uint32_t openMs)
+{
+    PlaylistSim sim(seqItemsAhead, pipelineLen, openMs);
+    String playlist;
+    for (int patternIdx = 0; patternIdx < PLAYLIST_PATTERNS; patternIdx++)
+    {
+        String fileName = "pattern" + String(patternIdx) + ".thr";
+        writeFile(sim._fileManager, fileName.c_str(), makePattern(patternIdx));
+        playlist += fileName + "\n";
+    }
+    writeFile(sim._fileManager, "patterns.seq", playlist);
+    sim._fileManager.takeSimAccessMs();
+    String retStr;
+    WorkItem workItem("patterns.seq");
+    sim._workManager.addWorkItem(workItem, retStr);
+    while ((sim._simMs < MAX_SIM_MS) && !(sim._hasMoved && !sim.isWorkRemaining() && sim._robotController.isMotionComplete()))
+        sim.loop();
+    TEST_ASSERT_LESS_THAN(MAX_SIM_MS, sim._simMs);
+    return {sim._simMs / 1000.0, sim._deadMs, sim._maxGapMs, sim._numGaps};
+}
+
+// File evaluator with access to the prefetched file
+class TestEvaluatorFiles : public EvaluatorFiles
+{
+public:
+    TestEvaluatorFiles(FileManager& fileManager, WorkManager& workManager, EvaluatorThetaRhoLine& thrEvaluator) :
+            EvaluatorFiles(fileManager, workManager, thrEvaluator)
+    {
+    }
+    String prefetchFileName()
+    {
+        return _prefetchFileName;
+    }
+    // Check the read buffer holds the start of a file
+    bool readBufStartsWith(const String& contents)
+    {
+        return (_thrReadBufLen > 0) && (strncmp(_thrReadBuf, contents.c_str(), _thrReadBufLen) == 0);
+    }
+};
+
+// Stop as the work manager does (the theta-rho evaluator has points of the file)
+static void stopFiles(TestEvaluatorFiles& files, EvaluatorThetaRhoLine& thrEvaluator)
+{
+    files.stop();
+    thrEvaluator.stop();
+}
+
+// Start a file - returns the stat calls made
+static int startFile(TestEvaluatorFiles& files, FileManager& fileManager, const char* pFileName)
+{
+    int statCalls = fileManager.getNumStatCalls();
+    WorkItem workItem(pFileName);
+    TEST_ASSERT_TRUE(files.execWorkItem(workItem));
+    return fileManager.getNumStatCalls() - statCalls;
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_large_playlist(void)
+{
+    std::vector<int> lineOrder;
+    playPlaylist("large.seq", false, lineOrder);
+
+    // The index goes back to 0 when the last line is queued
+    TEST_ASSERT_EQUAL(PLAYLIST_LINES + 1, lineOrder.size());
+    for (int pos = 0; pos < PLAYLIST_LINES; pos++)
+        TEST_ASSERT_EQUAL(pos, lineOrder[pos]);
+}
+
+void test_shuffle_permutation(void)
+{
+    std::vector<int> lineOrder;
+    playPlaylist("shuffle.seq", true, lineOrder);
+
+    // Every line once - the index is also 0 while the playlist is indexed and after the last
+    // line is queued
+    std::vector<int> timesPlayed(PLAYLIST_LINES, 0);
+    int numInOrder = 0;
+    for (int pos = 0; pos < int(lineOrder.size()); pos++)
+    {
+        TEST_ASSERT_TRUE((lineOrder[pos] >= 0) && (lineOrder[pos] < PLAYLIST_LINES));
+        timesPlayed[lineOrder[pos]]++;
+        if (lineOrder[pos] == pos)
+            numInOrder++;
+    }
+    TEST_ASSERT_TRUE((timesPlayed[0] >= 1) && (timesPlayed[0] <= 3));
+    for (int lineIdx = 1; lineIdx < PLAYLIST_LINES; lineIdx++)
+        TEST_ASSERT_EQUAL(1, timesPlayed[lineIdx]);
+    TEST_ASSERT_TRUE(numInOrder < PLAYLIST_LINES / 100);
+}
+
+// Dead time between the patterns of a playlist with the next pattern queued when the queue is
+// empty and queued ahead (so it is opened and prefetched behind the final moves of the one before)
+// - there is none while the planned pipeline outlasts opening a file, when it drains faster the
+// file system (which blocks the main loop) can't be hidden by either and only a gross difference
+// fails
+void test_playlist_dead_time(void)
+{
+    struct
+    {
+        int _pipelineLen;
+        uint32_t _openMs;
+        bool _pipelineOutlastsOpen;
+    } cases[] = {{100, 150, true}, {10, 300, true}, {5, 500, false}};
+    for (auto& simCase : cases)
+    {
+        DeadTimeResult results[2] = {playPatterns(0, simCase._pipelineLen, simCase._openMs),
+                                     playPatterns(SEQ_ITEMS_AHEAD_DEFAULT, simCase._pipelineLen, simCase._openMs)};
+        char msg[200];
+        snprintf(msg, sizeof(msg),
+                 "pipelineLen %3d open %3ums: queue empty %6.1fs %5ums dead (%d gaps, max %ums), "
+                 "ahead %6.1fs %5ums dead (%d gaps, max %ums)",
+                 simCase._pipelineLen, simCase._openMs, results[0]._simTimeS, results[0]._deadMs, results[0]._numGaps,
+                 results[0]._maxGapMs, results[1]._simTimeS, results[1]._deadMs, results[1]._numGaps,
+                 results[1]._maxGapMs);
+        TEST_MESSAGE(msg);
+        if (simCase._pipelineOutlastsOpen)
+        {
+            TEST_ASSERT_EQUAL(0, results[0]._deadMs);
+            TEST_ASSERT_EQUAL(0, results[1]._deadMs);
+        }
+        TEST_ASSERT_LESS_OR_EQUAL(results[0]._deadMs * 1.25, results[1]._deadMs);
+    }
+}
+
+// A prefetched file is used when it is the next played and is otherwise discarded (its status is
+// looked up again and its first block read from the file)
+void test_prefetch_discarded(void)
+{
+    ConfigBase mainConfig, robotConfig;
+    RobotController robotController;
+    LedStrip ledStrip;
+    WireGuardManager wireGuardManager;
+    RestAPISystem restAPISystem;
+    FileManager fileManager;
+    fileManager.setHostRoot(HOST_ROOT);
+    WorkManager workManager(mainConfig, robotConfig, robotController, ledStrip, wireGuardManager, restAPISystem,
+                            fileManager);
+    EvaluatorThetaRhoLine thrEvaluator(workManager);
+    TestEvaluatorFiles files(fileManager, workManager, thrEvaluator);
+    String contentsA = "0 0\n1 0.5\n2 1\n", contentsB = "0 1\n-1 0.5\n";
+    writeFile(fileManager, "a.thr", contentsA);
+    writeFile(fileManager, "b.thr", contentsB);
+    WorkItem itemA("a.thr");
+
+    // Prefetched file played
+    files.prefetch(itemA);
+    TEST_ASSERT_EQUAL_STRING("a.thr", files.prefetchFileName().c_str());
+    TEST_ASSERT_EQUAL(0, startFile(files, fileManager, "a.thr"));
+    TEST_ASSERT_EQUAL(contentsA.length(), files.getTotalFileLength());
+    TEST_ASSERT_TRUE(files.readBufStartsWith(contentsA));
+    TEST_ASSERT_EQUAL_STRING("", files.prefetchFileName().c_str());
+    stopFiles(files, thrEvaluator);
+
+    // Stop discards the prefetch
+    files.prefetch(itemA);
+    stopFiles(files, thrEvaluator);
+    TEST_ASSERT_EQUAL_STRING("", files.prefetchFileName().c_str());
+    TEST_ASSERT_EQUAL(1, startFile(files, fileManager, "a.thr"));
+    files.service();
+    TEST_ASSERT_TRUE(files.readBufStartsWith(contentsA));
+    stopFiles(files, thrEvaluator);
+
+    // A different file is read from the file system and the prefetch is discarded
+    files.prefetch(itemA);
+    TEST_ASSERT_EQUAL(1, startFile(files, fileManager, "b.thr"));
+    TEST_ASSERT_EQUAL(contentsB.length(), files.getTotalFileLength());
+    TEST_ASSERT_EQUAL_STRING("", files.prefetchFileName().c_str());
+    files.service();
+    TEST_ASSERT_TRUE(files.readBufStartsWith(contentsB));
+    stopFiles(files, thrEvaluator);
+    TEST_ASSERT_EQUAL(1, startFile(files, fileManager, "a.thr"));
+    stopFiles(files, thrEvaluator);
+
+    // Nothing is prefetched while a file is being read
+    startFile(files, fileManager, "a.thr");
+    WorkItem itemB("b.thr");
+    files.prefetch(itemB);
+    TEST_ASSERT_EQUAL_STRING("", files.prefetchFileName().c_str());
+    stopFiles(files, thrEvaluator);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_large_playlist);
+    RUN_TEST(test_shuffle_permutation);
+    RUN_TEST(test_playlist_dead_time);
+    RUN_TEST(test_prefetch_discarded);
+    return UNITY_END();
+}
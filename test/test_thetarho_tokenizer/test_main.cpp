@@ -0,0 +1,218 @@
+// RBotFirmware
+// Rob Dobson 2016-2018
+
+// ThetaRhoTokenizer - decimal parsing against strtod, line parsing and random input
+
+#include <unity.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include "WorkManager/Evaluators/ThetaRhoTokenizer.h"
+
+static std::mt19937_64 rng(1);
+
+static bool parse(const char* pStr, double& val, const char** ppAfter = NULL, bool allowExponent = true)
+{
+    const char* p = pStr;
+    bool isOk = ThetaRhoTokenizer::parseDecimal(p, pStr + strlen(pStr), val, allowExponent);
+    if (ppAfter)
+        *ppAfter = p;
+    return isOk;
+}
+
+static bool parseLine(const char* pLine, bool& interpolate, double& theta, double& rho)
+{
+    return ThetaRhoTokenizer::parseLine(pLine, pLine + strlen(pLine), interpolate, theta, rho);
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+// Fixed-point values as written by pattern generators are parsed exactly as strtod does
+void test_fixed_format_matches_strtod(void)
+{
+    char buf[64];
+    for (int trial = 0; trial < 200000; trial++)
+    {
+        double val = 0;
+        if (trial & 1)
+            val = double(int64_t(rng() % 2000000) - 1000000) / pow(10, rng() % 8);
+        else
+            val = (double(rng() % 1000000000) / 1e9 - 0.5) * 200;
+        snprintf(buf, sizeof(buf), "%.*f", int(rng() % 9), val);
+        double parsed = 0;
+        const char* pAfter = NULL;
+        TEST_ASSERT_TRUE(parse(buf, parsed, &pAfter));
+        TEST_ASSERT_TRUE(pAfter == buf + strlen(buf));
+        if (parsed != strtod(buf, NULL))
+            TEST_FAIL_MESSAGE(buf);
+    }
+}
+
+// Any finite double printed in full (or with an exponent) is within an ulp or so of strtod
+void test_full_precision_close_to_strtod(void)
+{
+    char buf[64];
+    for (int trial = 0; trial < 200000; trial++)
+    {
+        uint64_t bits = rng();
+        double val = 0;
+        memcpy(&val, &bits, sizeof(val));
+        if (!std::isfinite(val) || (fabs(val) < 1e-300) || (fabs(val) > 1e300))
+            continue;
+        snprintf(buf, sizeof(buf), (trial & 1) ? "%.17g" : "%.12e", val);
+        double parsed = 0;
+        TEST_ASSERT_TRUE(parse(buf, parsed));
+        double expected = strtod(buf, NULL);
+        TEST_ASSERT_DOUBLE_WITHIN_MESSAGE(fabs(expected) * 1e-15, expected, parsed, buf);
+    }
+}
+
+void test_decimal_forms(void)
+{
+    double val = 0;
+    const char* pAfter = NULL;
+    TEST_ASSERT_TRUE(parse("  -.5", val));
+    TEST_ASSERT_EQUAL_DOUBLE(-0.5, val);
+    TEST_ASSERT_TRUE(parse("+7.", val));
+    TEST_ASSERT_EQUAL_DOUBLE(7.0, val);
+    TEST_ASSERT_TRUE(parse("0.000", val));
+    TEST_ASSERT_EQUAL_DOUBLE(0.0, val);
+    TEST_ASSERT_TRUE(parse("1.25e2", val));
+    TEST_ASSERT_EQUAL_DOUBLE(125.0, val);
+    TEST_ASSERT_TRUE(parse("1.25E-2", val));
+    TEST_ASSERT_EQUAL_DOUBLE(0.0125, val);
+    TEST_ASSERT_TRUE(parse("123456789012345678901234567890", val));
+    TEST_ASSERT_DOUBLE_WITHIN(1e15, 1.2345678901234568e29, val);
+
+    // Left after the number
+    TEST_ASSERT_TRUE(parse("3.5 0.25", val, &pAfter));
+    TEST_ASSERT_EQUAL_STRING(" 0.25", pAfter);
+    TEST_ASSERT_TRUE(parse("2e", val, &pAfter));
+    TEST_ASSERT_EQUAL_DOUBLE(2.0, val);
+    TEST_ASSERT_EQUAL_STRING("e", pAfter);
+    TEST_ASSERT_TRUE(parse("2E5", val, &pAfter, false));
+    TEST_ASSERT_EQUAL_DOUBLE(2.0, val);
+    TEST_ASSERT_EQUAL_STRING("E5", pAfter);
+
+    // No digits
+    TEST_ASSERT_FALSE(parse("", val));
+    TEST_ASSERT_FALSE(parse("-", val));
+    TEST_ASSERT_FALSE(parse(".", val));
+    TEST_ASSERT_FALSE(parse("e5", val));
+    TEST_ASSERT_FALSE(parse("nan", val));
+}
+
+void test_lines(void)
+{
+    bool interpolate = true;
+    double theta = 0, rho = 0;
+    TEST_ASSERT_TRUE(parseLine("1.5 0.25", interpolate, theta, rho));
+    TEST_ASSERT_EQUAL_DOUBLE(1.5, theta);
+    TEST_ASSERT_EQUAL_DOUBLE(0.25, rho);
+    TEST_ASSERT_TRUE(parseLine("  -3.25\t1\r", interpolate, theta, rho));
+    TEST_ASSERT_EQUAL_DOUBLE(-3.25, theta);
+    TEST_ASSERT_EQUAL_DOUBLE(1.0, rho);
+    TEST_ASSERT_TRUE(interpolate);
+
+    // Not points
+    TEST_ASSERT_FALSE(parseLine("", interpolate, theta, rho));
+    TEST_ASSERT_FALSE(parseLine("1.5", interpolate, theta, rho));
+    TEST_ASSERT_FALSE(parseLine("1.5,0.25", interpolate, theta, rho));
+    TEST_ASSERT_FALSE(parseLine("# 1 2", interpolate, theta, rho));
+
+    // Flags
+    TEST_ASSERT_FALSE(parseLine("# Made with Sandify", interpolate, theta, rho));
+    TEST_ASSERT_FALSE(interpolate);
+    TEST_ASSERT_FALSE(parseLine("#_INTERPOLATE_", interpolate, theta, rho));
+    TEST_ASSERT_TRUE(interpolate);
+    TEST_ASSERT_FALSE(parseLine("_NO_INTERPOLATE_", interpolate, theta, rho));
+    TEST_ASSERT_FALSE(interpolate);
+}
+
+// Random bytes (including bytes with the top bit set) in exactly sized buffers
+void test_random_input(void)
+{
+    const char chars[] = "0123456789.-+eE #\t\r\n_INTERPOLATE_Sandify";
+    for (int trial = 0; trial < 200000; trial++)
+    {
+        int len = rng() % 40;
+        std::vector<char> buf(len + 1);
+        for (int idx = 0; idx < len; idx++)
+            buf[idx] = (rng() % 4 == 0) ? char(rng()) : chars[rng() % (sizeof(chars) - 1)];
+        bool interpolate = true;
+        double theta = 0, rho = 0;
+        if (ThetaRhoTokenizer::parseLine(buf.data(), buf.data() + len, interpolate, theta, rho))
+        {
+            TEST_ASSERT_FALSE(std::isnan(theta));
+            TEST_ASSERT_FALSE(std::isnan(rho));
+        }
+    }
+}
+
+// Tokenizer against strtod on typical lines - reports throughput
+void test_throughput(void)
+{
+    std::string lines;
+    char buf[64];
+    for (int line = 0; line < 100000; line++)
+    {
+        snprintf(buf, sizeof(buf), "%.5f %.5f\n", double(rng() % 100000) / 100.0, double(rng() % 100000) / 100000.0);
+        lines += buf;
+    }
+    const char* pStart = lines.c_str();
+    const char* pEnd = pStart + lines.size();
+    double sum = 0;
+    int numPoints = 0;
+    auto startTime = std::chrono::steady_clock::now();
+    bool interpolate = true;
+    for (const char* p = pStart; p < pEnd;)
+    {
+        const char* pLineEnd = (const char*)memchr(p, '\n', pEnd - p);
+        double theta = 0, rho = 0;
+        if (ThetaRhoTokenizer::parseLine(p, pLineEnd, interpolate, theta, rho))
+        {
+            sum += theta + rho;
+            numPoints++;
+        }
+        p = pLineEnd + 1;
+    }
+    double tokenizerS = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    startTime = std::chrono::steady_clock::now();
+    double strtodSum = 0;
+    for (const char* p = pStart; p < pEnd;)
+    {
+        const char* pLineEnd = (const char*)memchr(p, '\n', pEnd - p);
+        char* pAfter = NULL;
+        double theta = strtod(p, &pAfter);
+        strtodSum += theta + strtod(pAfter, NULL);
+        p = pLineEnd + 1;
+    }
+    double strtodS = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    TEST_ASSERT_EQUAL(100000, numPoints);
+    TEST_ASSERT_DOUBLE_WITHIN(1e-6, strtodSum, sum);
+    char msg[100];
+    snprintf(msg, sizeof(msg), "tokenizer %.1f Mlines/s, strtod %.1f Mlines/s", numPoints / tokenizerS / 1e6,
+             numPoints / strtodS / 1e6);
+    TEST_MESSAGE(msg);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_fixed_format_matches_strtod);
+    RUN_TEST(test_full_precision_close_to_strtod);
+    RUN_TEST(test_decimal_forms);
+    RUN_TEST(test_lines);
+    RUN_TEST(test_random_input);
+    RUN_TEST(test_throughput);
+    return UNITY_END();
+}
@@ -0,0 +1,317 @@
+// RBotFirmware
+// Rob Dobson 2016-2018
+
+// Theta-rho feeding - dense (Sandify style) patterns are played through the work manager and the
+// robot with the main loop and the step ISR run in simulated time (the ISR is called for each
+// tick of each loop period) - the average speed, pipeline underruns and time with the pipeline
+// empty from the motion stats are reported with lines fed only when the work queue is empty
+// (thrItemsAhead 0 - as before) and fed ahead (the default) for several main loop periods
+// The file position reported from the last completed numbered move is checked as the motion
+// reaches each line of a file, across a switch to the next file and across the wrap of the
+// numbered command index
+
+#include <Arduino.h>
+#include <unity.h>
+#include <stdio.h>
+#include <algorithm>
+#include <vector>
+#include "RdJson.h"
+#include "ConfigBase.h"
+#include "RobotConfigurations.h"
+#include "RobotMotion/RobotController.h"
+#include "RestAPISystem.h"
+#include "WorkManager/WorkManager.h"
+#include "WorkManager/Evaluators/EvaluatorFiles.h"
+#include "WorkManager/Evaluators/EvaluatorThetaRhoLine.h"
+
+static const char* HOST_ROOT = "/tmp/test_thr_feed";
+static const int THR_ITEMS_AHEAD_DEFAULT = 10;
+static const int MAX_LOOPS = 5000000;
+
+// Work manager and robot with the main loop and the ISR run in simulated time
+class FeedSim
+{
+public:
+    ConfigBase _mainConfig, _robotConfig;
+    RobotController _robotController;
+    LedStrip _ledStrip;
+    WireGuardManager _wireGuardManager;
+    RestAPISystem _restAPISystem;
+    FileManager _fileManager;
+    WorkManager _workManager;
+    uint32_t _loopPeriodUs;
+    double _simTimeS;
+
+    FeedSim(int thrItemsAhead, uint32_t loopPeriodUs) :
+            _workManager(_mainConfig, _robotConfig, _robotController, _ledStrip, _wireGuardManager, _restAPISystem,
+                         _fileManager)
+    {
+        _fileManager.setHostRoot(HOST_ROOT);
+        String config = RobotConfigurations::getConfig("TranquilSmall");
+        config.replace("\"evaluators\":{", "\"evaluators\":{\"thrItemsAhead\":" + String(thrItemsAhead) + ",");
+        _robotConfig.setConfigData(config.c_str());
+        _workManager.reconfigure();
+        TEST_ASSERT_NOT_NULL(hostTimerIsr);
+        _loopPeriodUs = loopPeriodUs;
+        _simTimeS = 0;
+    }
+
+    // One pass of the main loop then the ISR ticks of the loop period
+    void loop()
+    {
+        _workManager.service();
+        _robotController.service();
+        for (uint32_t tickIdx = 0; tickIdx < _loopPeriodUs * 1000 / MotionBlock::TICK_INTERVAL_NS; tickIdx++)
+            hostTimerIsr();
+        _simTimeS += _loopPeriodUs / 1e6;
+    }
+
+    bool isIdle()
+    {
+        String statusStr;
+        _workManager.queryStatus(statusStr);
+        return (statusStr.indexOf("\"file\"") < 0) && _workManager.queueIsEmpty() && _robotController.isMotionComplete();
+    }
+};
+
+// File evaluator with access to the numbered command index base
+class TestEvaluatorFiles : public EvaluatorFiles
+{
+public:
+    TestEvaluatorFiles(FileManager& fileManager, WorkManager& workManager, EvaluatorThetaRhoLine& thrEvaluator) :
+            EvaluatorFiles(fileManager, workManager, thrEvaluator)
+    {
+    }
+    // Next file numbered so that it ends at the maximum index (so the one after wraps)
+    void setNextFileAtIdxMax(int fileLen)
+    {
+        _thrNextCmdIdxBase = THR_CMD_IDX_MAX - fileLen;
+    }
+    static int cmdIdxFirst()
+    {
+        return THR_CMD_IDX_FIRST;
+    }
+    static int cmdIdxMax()
+    {
+        return THR_CMD_IDX_MAX;
+    }
+};
+
+// Sandify style pattern - header comments then a point every few degrees
+static String makeDensePattern(int numPoints, bool spirograph)
+{
+    String contents = "# Made with love by Sandify\n# https://sandify.org\n#\n";
+    char lineBuf[40];
+    for (int ptIdx = 0; ptIdx < numPoints; ptIdx++)
+    {
+        double theta = ptIdx * (spirograph ? 0.02 : 0.03);
+        double rho = spirograph ? 0.55 + 0.4 * sin(theta * 3.7) : double(ptIdx) / numPoints;
+        snprintf(lineBuf, sizeof(lineBuf), "%.5f %.5f\n", theta, rho);
+        contents += lineBuf;
+    }
+    return contents;
+}
+
+// File positions after each point line (as numbered by the file evaluator)
+static std::vector<int> getLineEnds(const String& contents)
+{
+    std::vector<int> lineEnds;
+    int lineStart = 0;
+    while (lineStart < int(contents.length()))
+    {
+        int lineEnd = contents.indexOf('\n', lineStart);
+        if (lineEnd < 0)
+            lineEnd = contents.length();
+        if (contents[lineStart] != '#')
+            lineEnds.push_back(lineEnd);
+        lineStart = lineEnd + 1;
+    }
+    return lineEnds;
+}
+
+static void writeFile(FileManager& fileManager, const char* pFileName, const String& contents)
+{
+    String fileContents = contents;
+    TEST_ASSERT_TRUE(fileManager.setFileContents("", pFileName, fileContents));
+}
+
+struct FeedResult
+{
+    double _simTimeS;
+    double _achievedMMps;
+    long _underruns;
+    long _emptyMs;
+};
+
+// Play a pattern - the motion stats cover the pattern's numbered moves
+static FeedResult playPattern(const char* pFileName, const String& contents, int thrItemsAhead, uint32_t loopPeriodUs)
+{
+    FeedSim sim(thrItemsAhead, loopPeriodUs);
+    writeFile(sim._fileManager, pFileName, contents);
+    String retStr;
+    WorkItem workItem(pFileName);
+    sim._workManager.addWorkItem(workItem, retStr);
+    int loopIdx = 0;
+    for (loopIdx = 0; loopIdx < MAX_LOOPS; loopIdx++)
+    {
+        sim.loop();
+        if ((loopIdx > 0) && sim.isIdle())
+            break;
+    }
+    TEST_ASSERT_LESS_THAN(MAX_LOOPS, loopIdx);
+    String statsJson = sim._robotController.getMotionStats();
+    TEST_ASSERT_GREATER_THAN(0, RdJson::getLong("blocks", 0, statsJson.c_str()));
+    return {sim._simTimeS, RdJson::getDouble("achievedMMps", 0, statsJson.c_str()),
+            RdJson::getLong("underruns", 0, statsJson.c_str()), RdJson::getLong("emptyMs", 0, statsJson.c_str())};
+}
+
+// Play two files one after the other through a file evaluator (the second started once the
+// first is read, as a sequence would) recording the file position of the motion on each loop -
+// checks the positions are those after a line of the file in progress, increase, stay 0 while
+// the first file's moves complete after the switch and reach the last line of each file
+static void checkFileSwitch(bool wrapCmdIdx)
+{
+    FeedSim sim(THR_ITEMS_AHEAD_DEFAULT, 1000);
+    String contents[2] = {makeDensePattern(300, true), makeDensePattern(200, false)};
+    const char* fileNames[2] = {"first.thr", "second.thr"};
+    for (int fileIdx = 0; fileIdx < 2; fileIdx++)
+        writeFile(sim._fileManager, fileNames[fileIdx], contents[fileIdx]);
+
+    String robotConfigStr = RdJson::getString("robotConfig", "", RobotConfigurations::getConfig("TranquilSmall"));
+    String robotAttributes;
+    sim._robotController.getRobotAttributes(robotAttributes);
+    EvaluatorThetaRhoLine thrEvaluator(sim._workManager);
+    String evaluatorConfig = RdJson::getString("evaluators", "{}", robotConfigStr.c_str());
+    thrEvaluator.setConfig(evaluatorConfig.c_str(), robotAttributes.c_str());
+    TestEvaluatorFiles files(sim._fileManager, sim._workManager, thrEvaluator);
+
+    int cmdIdxRanges[2][2] = {{0, 0}, {0, 0}};
+    int maxFilePos[2] = {0, 0};
+    int maxFirstCmdIdx = 0;
+    int numZeroAfterSwitch = 0;
+    int curFile = -1;
+    int lastFilePos = 0;
+    for (int loopIdx = 0; loopIdx < MAX_LOOPS; loopIdx++)
+    {
+        // Start each file once the one before is read
+        if (!files.isBusy() && (curFile < 1))
+        {
+            curFile++;
+            if ((curFile == 0) && wrapCmdIdx)
+                files.setNextFileAtIdxMax(contents[0].length());
+            WorkItem workItem(fileNames[curFile]);
+            TEST_ASSERT_TRUE(files.isValid(workItem));
+            TEST_ASSERT_TRUE(files.execWorkItem(workItem));
+            TEST_ASSERT_TRUE(files.getNumberedCmdIdxRange(cmdIdxRanges[curFile][0], cmdIdxRanges[curFile][1]));
+            lastFilePos = 0;
+        }
+        thrEvaluator.service();
+        if (!thrEvaluator.isBusy())
+            files.service();
+        sim.loop();
+
+        // Position in the file in progress
+        int lastCmdIdx = sim._robotController.getLastCompletedNumberedCmdIdx();
+        int filePos = files.getMotionFilePosition(lastCmdIdx);
+        if (filePos != 0)
+        {
+            std::vector<int> lineEnds = getLineEnds(contents[curFile]);
+            TEST_ASSERT_TRUE(std::find(lineEnds.begin(), lineEnds.end(), filePos) != lineEnds.end());
+            TEST_ASSERT_TRUE((lastCmdIdx >= cmdIdxRanges[curFile][0]) && (lastCmdIdx <= cmdIdxRanges[curFile][1]));
+        }
+        else if ((curFile == 1) && (lastCmdIdx >= cmdIdxRanges[0][0]) && (lastCmdIdx <= cmdIdxRanges[0][1]))
+        {
+            numZeroAfterSwitch++;
+        }
+        TEST_ASSERT_GREATER_OR_EQUAL(lastFilePos, filePos);
+        lastFilePos = filePos;
+        maxFilePos[curFile] = std::max(maxFilePos[curFile], filePos);
+        if ((lastCmdIdx >= cmdIdxRanges[0][0]) && (lastCmdIdx <= cmdIdxRanges[0][1]))
+            maxFirstCmdIdx = std::max(maxFirstCmdIdx, lastCmdIdx);
+        if ((curFile == 1) && !files.isBusy() && !thrEvaluator.isBusy() && sim._workManager.queueIsEmpty() &&
+            sim._robotController.isMotionComplete())
+            break;
+    }
+
+    // Numbering of the second file wraps if the first ends at the maximum
+    if (wrapCmdIdx)
+    {
+        TEST_ASSERT_EQUAL(TestEvaluatorFiles::cmdIdxMax(), cmdIdxRanges[0][1]);
+        TEST_ASSERT_EQUAL(TestEvaluatorFiles::cmdIdxFirst(), cmdIdxRanges[1][0]);
+    }
+    else
+    {
+        TEST_ASSERT_EQUAL(cmdIdxRanges[0][1] + 1, cmdIdxRanges[1][0]);
+    }
+
+    // The first file's moves were still running after the switch (so its last lines are only seen
+    // as command indices) and each file's last line was reached
+    TEST_ASSERT_GREATER_THAN(0, numZeroAfterSwitch);
+    TEST_ASSERT_GREATER_THAN(0, maxFilePos[0]);
+    TEST_ASSERT_EQUAL(cmdIdxRanges[0][0] + getLineEnds(contents[0]).back(), maxFirstCmdIdx);
+    TEST_ASSERT_EQUAL(getLineEnds(contents[1]).back(), maxFilePos[1]);
+    char msg[100];
+    snprintf(msg, sizeof(msg), "%s: second file at %d, %d loops at 0 after the switch", wrapCmdIdx ? "wrapped" : "in order",
+             cmdIdxRanges[1][0], numZeroAfterSwitch);
+    TEST_MESSAGE(msg);
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_file_switch_positions(void)
+{
+    checkFileSwitch(false);
+}
+
+void test_cmd_idx_wrap_positions(void)
+{
+    checkFileSwitch(true);
+}
+
+// Average speed of dense patterns fed only when the queue is empty and fed ahead - in simulated
+// time the motion pipeline never empties with either (the main loop period changes the speed of
+// both alike) so feeding ahead is only checked not to be slower
+void test_average_speed(void)
+{
+    struct
+    {
+        const char* _name;
+        String _contents;
+    } patterns[] = {{"spirograph.thr", makeDensePattern(1500, true)}, {"spiral.thr", makeDensePattern(1500, false)}};
+    const uint32_t loopPeriodsUs[] = {1000, 5000, 20000};
+    for (auto& pattern : patterns)
+    {
+        for (uint32_t loopPeriodUs : loopPeriodsUs)
+        {
+            FeedResult results[2] = {playPattern(pattern._name, pattern._contents, 0, loopPeriodUs),
+                                     playPattern(pattern._name, pattern._contents, THR_ITEMS_AHEAD_DEFAULT, loopPeriodUs)};
+            char msg[200];
+            snprintf(msg, sizeof(msg),
+                     "%-15s loop %5.1fms: queue empty %6.1fs %5.2fmm/s %4ld underruns %6ldms empty, "
+                     "ahead %6.1fs %5.2fmm/s %4ld underruns %6ldms empty",
+                     pattern._name, loopPeriodUs / 1000.0, results[0]._simTimeS, results[0]._achievedMMps,
+                     results[0]._underruns, results[0]._emptyMs, results[1]._simTimeS, results[1]._achievedMMps,
+                     results[1]._underruns, results[1]._emptyMs);
+            TEST_MESSAGE(msg);
+
+            // Feeding ahead is never slower
+            TEST_ASSERT_LESS_OR_EQUAL(results[0]._underruns, results[1]._underruns);
+            TEST_ASSERT_GREATER_OR_EQUAL(results[0]._achievedMMps * 0.99, results[1]._achievedMMps);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_file_switch_positions);
+    RUN_TEST(test_cmd_idx_wrap_positions);
+    RUN_TEST(test_average_speed);
+    return UNITY_END();
+}
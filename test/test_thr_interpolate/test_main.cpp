@@ -0,0 +1,416 @@
+// RBotFirmware
+// Rob Dobson 2016-2018
+
+// Theta-rho line interpolation - points of long lines stepped by the rotation kernel (unit
+// vector advanced by a float rotation and renormalised every RENORMALISE_STEPS steps, rho linear
+// in the step number, mirroring, theta offset and bed radius applied by the 2x2 transform) are
+// compared with libm sin and cos of each step's theta in double precision for mirrored and
+// offset tables with the centre away from the origin - the drift of the same recurrence without
+// renormalisation is reported alongside - and cycles per point of the kernel and of libm are
+// reported
+// Patterns stepped with fixed step angles and by curvature (thrChordTolMM) are compared with the
+// ideal pattern - points per pattern, the distance of the ideal pattern from the moves and the
+// distance of each line's last point from its end are reported
+
+#include <Arduino.h>
+#include <unity.h>
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include "ConfigBase.h"
+#include "RobotMotion/RobotController.h"
+#include "RestAPISystem.h"
+#include "WorkManager/WorkManager.h"
+#include "WorkManager/Evaluators/EvaluatorThetaRhoLine.h"
+
+static const char* ROBOT_ATTRIBUTES = "{\"sizeX\":400,\"sizeY\":400,\"originX\":-25,\"originY\":40}";
+static const double BED_RADIUS_MM = 200;
+static const double CENTRE_X = 225;
+static const double CENTRE_Y = 160;
+static const double STEP_DEGS = 2.8125;
+static const int NUM_RUNS = 7;
+
+static volatile float benchSink = 0;
+
+static uint64_t hostCycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// Evaluator with no continuation offset - steps are fixed angles (so the step thetas are known)
+// unless step settings are given
+struct Interpolator
+{
+    ConfigBase _mainConfig, _robotConfig;
+    RobotController _robotController;
+    LedStrip _ledStrip;
+    WireGuardManager _wireGuardManager;
+    RestAPISystem _restAPISystem;
+    FileManager _fileManager;
+    WorkManager _workManager;
+    EvaluatorThetaRhoLine _evaluator;
+    double _mirror;
+    double _offsetRad;
+
+    Interpolator(bool mirrored, int offsetDegs, const char* pStepConfig = NULL)
+        : _workManager(_mainConfig, _robotConfig, _robotController, _ledStrip, _wireGuardManager, _restAPISystem,
+                       _fileManager),
+          _evaluator(_workManager)
+    {
+        char fixedStepConfig[100];
+        snprintf(fixedStepConfig, sizeof(fixedStepConfig), "\"thrStepDegs\":%g,\"thrStepAdaptation\":0", STEP_DEGS);
+        char config[200];
+        snprintf(config, sizeof(config), "{%s,\"thrContinue\":0,\"thrThetaMirrored\":%d,\"thrThetaOffsetAngle\":%d}",
+                 pStepConfig ? pStepConfig : fixedStepConfig, mirrored ? 1 : 0, offsetDegs);
+        _evaluator.setConfig(config, ROBOT_ATTRIBUTES);
+        _mirror = mirrored ? -1 : 1;
+        _offsetRad = offsetDegs * M_PI / 180;
+    }
+
+    // Start a line from (theta0, rho0) to (theta1, rho1)
+    void startLine(double theta0, double rho0, double theta1, double rho1)
+    {
+        _evaluator.addPolarPoint(theta0, rho0, true, true);
+        _evaluator.addPolarPoint(theta1, rho1, true, false);
+    }
+
+    // Table coords of a file theta and rho with libm in double precision
+    void libmXY(double theta, double rho, double& x, double& y)
+    {
+        double tableTheta = _mirror * theta + _offsetRad;
+        x = sin(tableTheta) * rho * BED_RADIUS_MM + CENTRE_X;
+        y = cos(tableTheta) * rho * BED_RADIUS_MM + CENTRE_Y;
+    }
+};
+
+// Max distance of the kernel's points from libm over a line and of the same recurrence
+// without renormalisation
+struct DriftResult
+{
+    int _numPoints;
+    double _maxErrMM;
+    double _maxErrNoRenormMM;
+    double _maxLenErr;
+    double _maxLenErrNoRenorm;
+};
+
+static DriftResult checkLine(bool mirrored, int offsetDegs, double theta0, double rho0, double theta1, double rho1)
+{
+    Interpolator interp(mirrored, offsetDegs);
+    interp.startLine(theta0, rho0, theta1, rho1);
+    double stepAngle = STEP_DEGS * M_PI / 180;
+    double deltaTheta = theta1 - theta0;
+    int numSteps = int(floor(fabs(deltaTheta) / stepAngle));
+    double thetaInc = deltaTheta >= 0 ? stepAngle : -stepAngle;
+    double rhoInc = (rho1 - rho0) * stepAngle / fabs(deltaTheta);
+
+    // Recurrence without renormalisation
+    float unitSin = sin(theta0), unitCos = cos(theta0);
+    float rotSin = sin(thetaInc), rotCos = cos(thetaInc);
+
+    DriftResult result = {0, 0, 0, 0, 0};
+    double x = 0, y = 0;
+    while (interp._evaluator.getNextPoint(x, y))
+    {
+        result._numPoints++;
+        double theta = theta0 + thetaInc * result._numPoints;
+        double rho = rho0 + rhoInc * result._numPoints;
+        double refX = 0, refY = 0;
+        interp.libmXY(theta, rho, refX, refY);
+        result._maxErrMM = std::max(result._maxErrMM, hypot(x - refX, y - refY));
+        double unitLen = hypot(x - CENTRE_X, y - CENTRE_Y) / (fabs(rho) * BED_RADIUS_MM);
+        if (fabs(rho) > 0.1)
+            result._maxLenErr = std::max(result._maxLenErr, fabs(unitLen - 1));
+
+        float nextSin = unitSin * rotCos + unitCos * rotSin;
+        unitCos = unitCos * rotCos - unitSin * rotSin;
+        unitSin = nextSin;
+        double tableSin = interp._mirror * cos(interp._offsetRad) * unitSin + sin(interp._offsetRad) * unitCos;
+        double tableCos = -interp._mirror * sin(interp._offsetRad) * unitSin + cos(interp._offsetRad) * unitCos;
+        double noRenormX = tableSin * rho * BED_RADIUS_MM + CENTRE_X;
+        double noRenormY = tableCos * rho * BED_RADIUS_MM + CENTRE_Y;
+        result._maxErrNoRenormMM = std::max(result._maxErrNoRenormMM, hypot(noRenormX - refX, noRenormY - refY));
+        result._maxLenErrNoRenorm =
+            std::max(result._maxLenErrNoRenorm, fabs(hypot(double(unitSin), double(unitCos)) - 1));
+    }
+    TEST_ASSERT_EQUAL(numSteps, result._numPoints);
+    return result;
+}
+
+// A theta-rho pattern - file theta and rho of each line end
+struct ThrPoint
+{
+    double _theta;
+    double _rho;
+};
+
+static void addSpiral(std::vector<ThrPoint>& pts, double theta0, double rho0, double theta1, double rho1, int numLines)
+{
+    for (int lineIdx = (pts.empty() ? 0 : 1); lineIdx <= numLines; lineIdx++)
+        pts.push_back({theta0 + (theta1 - theta0) * lineIdx / numLines, rho0 + (rho1 - rho0) * lineIdx / numLines});
+}
+
+// Rays out from the centre and back joined by arcs at the edge and (no movement) at the centre
+static void addStar(std::vector<ThrPoint>& pts, int numRays)
+{
+    double arcAngle = M_PI / numRays;
+    pts.push_back({0, 0});
+    for (int rayIdx = 0; rayIdx < numRays; rayIdx++)
+    {
+        double theta = rayIdx * 2 * arcAngle;
+        pts.push_back({theta, 1});
+        pts.push_back({theta + arcAngle, 1});
+        pts.push_back({theta + arcAngle, 0});
+        pts.push_back({theta + 2 * arcAngle, 0});
+    }
+}
+
+// Distance of a point from a straight move
+static double distToMove(double x, double y, double startX, double startY, double endX, double endY)
+{
+    double dx = endX - startX, dy = endY - startY;
+    double lenSq = dx * dx + dy * dy;
+    double t = lenSq > 0 ? ((x - startX) * dx + (y - startY) * dy) / lenSq : 0;
+    t = std::min(1.0, std::max(0.0, t));
+    return hypot(x - startX - dx * t, y - startY - dy * t);
+}
+
+// Points of a pattern, max distance of the ideal pattern (each line a spiral with rho linear in
+// theta - or a ray if theta is unchanged) from the moves (straight between points), max
+// distance of the last point of each line from its end and cycles to step the pattern
+struct PatternResult
+{
+    int _numPoints;
+    int _maxRayPoints;
+    double _maxErrMM;
+    double _maxEndErrMM;
+    double _cycles;
+};
+
+static PatternResult stepPattern(const std::vector<ThrPoint>& pts, const char* pStepConfig)
+{
+    static const int CURVE_SAMPLES = 16;
+    Interpolator interp(false, 0, pStepConfig);
+    PatternResult result = {0, 0, 0, 0, 1e30};
+    double lastX = 0, lastY = 0;
+    interp.libmXY(pts[0]._theta, pts[0]._rho, lastX, lastY);
+    double lastTheta = pts[0]._theta;
+    for (size_t ptIdx = 0; ptIdx < pts.size(); ptIdx++)
+    {
+        interp._evaluator.addPolarPoint(pts[ptIdx]._theta, pts[ptIdx]._rho, true, ptIdx == 0);
+        if (ptIdx == 0)
+            continue;
+        const ThrPoint& lineStart = pts[ptIdx - 1];
+        const ThrPoint& lineEnd = pts[ptIdx];
+        bool isRay = lineEnd._theta == lineStart._theta;
+        int linePoints = 0;
+        double x = 0, y = 0;
+        while (interp._evaluator.getNextPoint(x, y))
+        {
+            linePoints++;
+
+            // Theta of the point (unwrapped from the last - the line end's at the centre)
+            double theta = lineEnd._theta;
+            if (hypot(x - CENTRE_X, y - CENTRE_Y) > 1e-6)
+                theta = lastTheta + remainder(atan2(x - CENTRE_X, y - CENTRE_Y) - lastTheta, 2 * M_PI);
+
+            // Distance of the move from the ray or of the spiral between the points from the move
+            for (int sampleIdx = 1; sampleIdx <= CURVE_SAMPLES; sampleIdx++)
+            {
+                double t = double(sampleIdx) / CURVE_SAMPLES;
+                double err = 0;
+                if (isRay)
+                {
+                    double sampleX = lastX + (x - lastX) * t - CENTRE_X;
+                    double sampleY = lastY + (y - lastY) * t - CENTRE_Y;
+                    err = fabs(sampleX * cos(lineEnd._theta) - sampleY * sin(lineEnd._theta));
+                }
+                else
+                {
+                    double sampleTheta = lastTheta + (theta - lastTheta) * t;
+                    double rho = lineStart._rho + (lineEnd._rho - lineStart._rho) * (sampleTheta - lineStart._theta) /
+                                                      (lineEnd._theta - lineStart._theta);
+                    double sampleX = 0, sampleY = 0;
+                    interp.libmXY(sampleTheta, rho, sampleX, sampleY);
+                    err = distToMove(sampleX, sampleY, lastX, lastY, x, y);
+                }
+                result._maxErrMM = std::max(result._maxErrMM, err);
+            }
+            lastX = x;
+            lastY = y;
+            lastTheta = theta;
+        }
+        double endX = 0, endY = 0;
+        interp.libmXY(lineEnd._theta, lineEnd._rho, endX, endY);
+        result._maxEndErrMM = std::max(result._maxEndErrMM, hypot(lastX - endX, lastY - endY));
+        result._numPoints += linePoints;
+        if (isRay)
+            result._maxRayPoints = std::max(result._maxRayPoints, linePoints);
+    }
+
+    // Cycles to step the pattern (best of several runs)
+    for (int runIdx = 0; runIdx < NUM_RUNS; runIdx++)
+    {
+        double sum = 0;
+        uint64_t startCycles = hostCycles();
+        for (size_t ptIdx = 0; ptIdx < pts.size(); ptIdx++)
+        {
+            interp._evaluator.addPolarPoint(pts[ptIdx]._theta, pts[ptIdx]._rho, true, ptIdx == 0);
+            double x = 0, y = 0;
+            while (interp._evaluator.getNextPoint(x, y))
+                sum += x + y;
+        }
+        result._cycles = std::min(result._cycles, double(hostCycles() - startCycles));
+        benchSink = sum;
+    }
+    return result;
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+// Lines of up to 100k steps (inward and outward spirals, both directions, circles) on plain,
+// mirrored and offset tables
+void test_drift_against_libm(void)
+{
+    struct
+    {
+        bool _mirrored;
+        int _offsetDegs;
+    } tables[] = {{false, 0}, {true, 0}, {true, 90}, {false, 37}, {true, 217}};
+    struct
+    {
+        const char* _name;
+        double _theta0, _rho0, _theta1, _rho1;
+    } lines[] = {
+        {"1k steps out", 0.3, 0.05, 0.3 + 1000 * STEP_DEGS * M_PI / 180, 1},
+        {"10k steps in", -2, 1, -2 - 10000 * STEP_DEGS * M_PI / 180, 0},
+        {"100k steps circle", 1, 0.9, 1 + 100000 * STEP_DEGS * M_PI / 180, 0.9},
+        {"100k steps in", 5, 1, 5 - 100000 * STEP_DEGS * M_PI / 180, 0.2},
+    };
+    for (auto& table : tables)
+    {
+        for (auto& line : lines)
+        {
+            DriftResult result = checkLine(table._mirrored, table._offsetDegs, line._theta0, line._rho0, line._theta1,
+                                           line._rho1);
+            char msg[200];
+            snprintf(msg, sizeof(msg),
+                     "%s offset %3d %-18s %6d pts: max err %.4fmm (unit len %.1e), "
+                     "no renormalisation %.4fmm (unit len %.1e)",
+                     table._mirrored ? "mirrored" : "plain   ", table._offsetDegs, line._name, result._numPoints,
+                     result._maxErrMM, result._maxLenErr, result._maxErrNoRenormMM, result._maxLenErrNoRenorm);
+            TEST_MESSAGE(msg);
+            TEST_ASSERT_LESS_THAN(2e-6, result._maxLenErr);
+            TEST_ASSERT_LESS_THAN(0.01, result._maxErrMM);
+        }
+    }
+}
+
+// Cycles per point of the kernel and of libm sin and cos (double) for each point with the same
+// transform - run alternately and the best of each taken
+void test_throughput(void)
+{
+    static const int NUM_STEPS = 200000;
+    Interpolator interp(true, 37);
+    double thetaInc = STEP_DEGS * M_PI / 180;
+    double minCycles[2] = {1e30, 1e30};
+    for (int runIdx = 0; runIdx < NUM_RUNS; runIdx++)
+    {
+        interp.startLine(0.5, 0.1, 0.5 + NUM_STEPS * thetaInc, 0.95);
+        double x = 0, y = 0, sum = 0;
+        int numPoints = 0;
+        uint64_t startCycles = hostCycles();
+        while (interp._evaluator.getNextPoint(x, y))
+        {
+            sum += x + y;
+            numPoints++;
+        }
+        minCycles[0] = std::min(minCycles[0], double(hostCycles() - startCycles));
+        TEST_ASSERT_EQUAL(NUM_STEPS, numPoints);
+
+        double rhoInc = (0.95 - 0.1) / NUM_STEPS;
+        startCycles = hostCycles();
+        for (int stepIdx = 1; stepIdx <= NUM_STEPS; stepIdx++)
+        {
+            interp.libmXY(0.5 + thetaInc * stepIdx, 0.1 + rhoInc * stepIdx, x, y);
+            sum -= x + y;
+        }
+        minCycles[1] = std::min(minCycles[1], double(hostCycles() - startCycles));
+        benchSink = sum;
+    }
+    char msg[120];
+    snprintf(msg, sizeof(msg), "kernel %5.1f cycles/point, libm %5.1f cycles/point", minCycles[0] / NUM_STEPS,
+             minCycles[1] / NUM_STEPS);
+    TEST_MESSAGE(msg);
+
+    // Only a gross regression fails (host timing is noisy)
+    if (hostCycles() != 0)
+        TEST_ASSERT_LESS_THAN(minCycles[1] * 1.25, minCycles[0]);
+}
+
+// Points per pattern, distance of the moves from the ideal pattern and cycles per pattern with
+// fixed step angles (adapted to rho) and with steps chosen by curvature for a chord tolerance -
+// patterns include rays (radial-only lines are a single move) and spirals and circles at rho
+// near 0 (where the step is limited by MAX_CHORD_STEP_ANGLE)
+void test_curvature_stepping(void)
+{
+    struct
+    {
+        const char* _name;
+        std::vector<ThrPoint> _pts;
+    } patterns[] = {{"spiral 0.1rad lines", {}}, {"spiral 1 line", {}}, {"circle", {}},
+                    {"centre spiral", {}},       {"tiny circle", {}},   {"star", {}}};
+    addSpiral(patterns[0]._pts, 0, 1, 64 * M_PI, 0, 2011);
+    addSpiral(patterns[1]._pts, 0, 0, 100 * M_PI, 1, 1);
+    addSpiral(patterns[2]._pts, 0, 0.9, 20 * M_PI, 0.9, 1);
+    addSpiral(patterns[3]._pts, 0, 0, 10 * M_PI, 0.02, 314);
+    addSpiral(patterns[4]._pts, 0, 0.0005, 4 * M_PI, 0.0005, 1);
+    addStar(patterns[5]._pts, 20);
+    struct
+    {
+        const char* _name;
+        const char* _stepConfig;
+        float _chordTolMM;
+    } steppings[] = {{"fixed", "\"thrStepAdaptation\":1", 0},
+                     {"tol 0.02mm", "\"thrChordTolMM\":0.02", 0.02f},
+                     {"tol 0.1mm", "\"thrChordTolMM\":0.1", 0.1f}};
+    for (auto& pattern : patterns)
+    {
+        for (auto& stepping : steppings)
+        {
+            PatternResult result = stepPattern(pattern._pts, stepping._stepConfig);
+            char msg[200];
+            snprintf(msg, sizeof(msg), "%-19s %-10s %6d pts: max err %.4fmm, end err %.4fmm, %6.1f cycles/pt",
+                     pattern._name, stepping._name, result._numPoints, result._maxErrMM, result._maxEndErrMM,
+                     result._cycles / result._numPoints);
+            TEST_MESSAGE(msg);
+            if (stepping._chordTolMM <= 0)
+                continue;
+
+            // Moves are within the tolerance, lines end at their end points and rays are one move
+            TEST_ASSERT_LESS_OR_EQUAL(stepping._chordTolMM * 1.05, result._maxErrMM);
+            TEST_ASSERT_LESS_THAN(1e-3, result._maxEndErrMM);
+            TEST_ASSERT_LESS_OR_EQUAL(1, result._maxRayPoints);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_drift_against_libm);
+    RUN_TEST(test_throughput);
+    RUN_TEST(test_curvature_stepping);
+    return UNITY_END();
+}
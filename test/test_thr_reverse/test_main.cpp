@@ -0,0 +1,229 @@
+// RBotFirmware
+// Rob Dobson 2016-2018
+
+// Reversed theta-rho files - file name options (R<degrees> and REV in either order), points
+// played from the last to the first through the file evaluator's reverse block reader (files
+// with headers, CRLF, blank lines, no final newline and lines across read blocks, with and
+// without a prefetch), interpolation from the flags before the first point and file positions
+// which increase as a reversed file is read
+
+#include <Arduino.h>
+#include <unity.h>
+#include <stdio.h>
+#include <vector>
+#include "RdJson.h"
+#include "ConfigBase.h"
+#include "RobotConfigurations.h"
+#include "RobotMotion/RobotController.h"
+#include "RestAPISystem.h"
+#include "WorkManager/WorkManager.h"
+#include "WorkManager/Evaluators/EvaluatorFiles.h"
+#include "WorkManager/Evaluators/EvaluatorThetaRhoLine.h"
+
+static const char* HOST_ROOT = "/tmp/test_thr_reverse";
+
+struct PlayedPoint
+{
+    double _x;
+    double _y;
+    int _filePos;
+    int _lineLen;
+};
+
+static void writeFile(FileManager& fileManager, const char* pFileName, const String& contents)
+{
+    String fileContents = contents;
+    TEST_ASSERT_TRUE(fileManager.setFileContents("", pFileName, fileContents));
+}
+
+// Play a file through the file evaluator - points are taken from the theta-rho evaluator as
+// they are passed to it (so nothing is queued)
+static void playFile(FileManager& fileManager, const char* pWorkItemStr, bool prefetch, std::vector<PlayedPoint>& points,
+                     int& fileLen)
+{
+    ConfigBase mainConfig, robotConfig;
+    RobotController robotController;
+    LedStrip ledStrip;
+    WireGuardManager wireGuardManager;
+    RestAPISystem restAPISystem;
+    WorkManager workManager(mainConfig, robotConfig, robotController, ledStrip, wireGuardManager, restAPISystem,
+                            fileManager);
+    String robotConfigStr = RdJson::getString("robotConfig", "", RobotConfigurations::getConfig("TranquilSmall"));
+    MotionHelper* pHelper = RobotController::createDryRunMotionHelper(robotConfigStr.c_str());
+    TEST_ASSERT_NOT_NULL(pHelper);
+    String robotAttributes;
+    pHelper->getRobotAttributes(robotAttributes);
+    delete pHelper;
+    EvaluatorThetaRhoLine thrEvaluator(workManager);
+    String evaluatorConfig = RdJson::getString("evaluators", "{}", robotConfigStr.c_str());
+    thrEvaluator.setConfig(evaluatorConfig.c_str(), robotAttributes.c_str());
+    EvaluatorFiles files(fileManager, workManager, thrEvaluator);
+
+    points.clear();
+    WorkItem workItem(pWorkItemStr);
+    TEST_ASSERT_TRUE(files.isValid(workItem));
+    if (prefetch)
+        files.prefetch(workItem);
+    TEST_ASSERT_TRUE(files.execWorkItem(workItem));
+    for (int serviceIdx = 0; (serviceIdx < 100000) && files.isBusy(); serviceIdx++)
+    {
+        files.service();
+        double x, y;
+        while (thrEvaluator.getNextPoint(x, y))
+            points.push_back({x, y, files.getCurrentFilePosition(), files.getCurrentLineLength()});
+        thrEvaluator.service();
+    }
+    TEST_ASSERT_FALSE(files.isBusy());
+    TEST_ASSERT_TRUE(workManager.queueIsEmpty());
+    fileLen = files.getTotalFileLength();
+}
+
+// Reversed points are the forward points in reverse order with positions from the end of the file
+static void checkReversed(const std::vector<PlayedPoint>& fwd, const std::vector<PlayedPoint>& rev, int fileLen)
+{
+    TEST_ASSERT_EQUAL(fwd.size(), rev.size());
+    for (size_t idx = 0; idx < rev.size(); idx++)
+    {
+        const PlayedPoint& fwdPoint = fwd[fwd.size() - 1 - idx];
+        TEST_ASSERT_EQUAL_DOUBLE(fwdPoint._x, rev[idx]._x);
+        TEST_ASSERT_EQUAL_DOUBLE(fwdPoint._y, rev[idx]._y);
+        TEST_ASSERT_EQUAL(fwdPoint._lineLen, rev[idx]._lineLen);
+        TEST_ASSERT_EQUAL(fileLen - fwdPoint._filePos - fwdPoint._lineLen, rev[idx]._filePos);
+        if (idx > 0)
+            TEST_ASSERT_GREATER_THAN(rev[idx - 1]._filePos, rev[idx]._filePos);
+    }
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_file_name_options(void)
+{
+    struct
+    {
+        const char* _workItemStr;
+        const char* _fileName;
+        double _rotationDegs;
+        bool _reversed;
+    } cases[] = {
+        {"a.thr", "a.thr", 0, false},
+        {"a.thr REV", "a.thr", 0, true},
+        {"a.thr rev", "a.thr", 0, true},
+        {"a.thr R90", "a.thr", 90, false},
+        {"a.thr REV R-45.5", "a.thr", -45.5, true},
+        {"a.thr R12  REV", "a.thr", 12, true},
+        {"my REV.thr", "my REV.thr", 0, false},
+        {"a.thr REV REV", "a.thr REV", 0, true},
+        {"a.thr R1 R2", "a.thr R1", 2, false},
+        {"a.thr REVERSE", "a.thr REVERSE", 0, false},
+        {"a.thr R", "a.thr R", 0, false},
+    };
+    for (auto& testCase : cases)
+    {
+        String fileName;
+        double rotationDegs = 1;
+        bool reversed = false;
+        EvaluatorFiles::getFileNameAndOptions(testCase._workItemStr, fileName, rotationDegs, reversed);
+        TEST_ASSERT_EQUAL_STRING_MESSAGE(testCase._fileName, fileName.c_str(), testCase._workItemStr);
+        TEST_ASSERT_EQUAL_DOUBLE_MESSAGE(testCase._rotationDegs, rotationDegs, testCase._workItemStr);
+        TEST_ASSERT_EQUAL_MESSAGE(testCase._reversed, reversed, testCase._workItemStr);
+    }
+}
+
+// Uninterpolated points (set by the Sandify header) are played in exactly the reverse order
+void test_reverse_points(void)
+{
+    FileManager fileManager;
+    fileManager.setHostRoot(HOST_ROOT);
+    String header;
+    for (int line = 0; line < 8; line++)
+        header += "# Sandify header line with enough text to span more than one read block\r\n";
+    String points;
+    for (int line = 0; line < 400; line++)
+    {
+        char buf[60];
+        snprintf(buf, sizeof(buf), "%0.5f %0.5f\r\n", line * 0.05, (line % 37) / 37.0);
+        points += buf;
+        if (line % 50 == 0)
+            points += "\r\n# comment\n\n";
+    }
+    struct
+    {
+        const char* _fileName;
+        String _contents;
+    } files[] = {
+        {"long.thr", header + points + "# trailer\n"},
+        {"nofinal.thr", "#Sandify\n" + points + "20 1"},
+        {"single.thr", "#Sandify\n3 0.5"},
+        {"nopoints.thr", "# nothing\n"},
+    };
+    for (auto& file : files)
+    {
+        writeFile(fileManager, file._fileName, file._contents);
+        std::vector<PlayedPoint> fwd, rev;
+        int fileLen = 0;
+        playFile(fileManager, file._fileName, false, fwd, fileLen);
+        TEST_ASSERT_EQUAL(file._contents.length(), fileLen);
+        for (int prefetch = 0; prefetch < 2; prefetch++)
+        {
+            String workItemStr = String(file._fileName) + " REV";
+            playFile(fileManager, workItemStr.c_str(), prefetch, rev, fileLen);
+            TEST_ASSERT_EQUAL_MESSAGE(file._contents.length(), fileLen, file._fileName);
+            checkReversed(fwd, rev, fileLen);
+        }
+    }
+
+    // Rotation is applied to the reversed points
+    std::vector<PlayedPoint> fwd, rev;
+    int fileLen = 0;
+    playFile(fileManager, "long.thr R90", false, fwd, fileLen);
+    playFile(fileManager, "long.thr REV R90", true, rev, fileLen);
+    checkReversed(fwd, rev, fileLen);
+}
+
+// Interpolation is set by the flags before the first point - later flags are ignored when
+// reversed (they would apply to the wrong lines)
+void test_reverse_interpolation(void)
+{
+    FileManager fileManager;
+    fileManager.setHostRoot(HOST_ROOT);
+    writeFile(fileManager, "flags.thr", "#Sandify\n0 0\n# _INTERPOLATE_\n6 1\n12 0\n");
+    std::vector<PlayedPoint> fwd, rev;
+    int fileLen = 0;
+    playFile(fileManager, "flags.thr", false, fwd, fileLen);
+    TEST_ASSERT_GREATER_THAN(3, fwd.size());
+    playFile(fileManager, "flags.thr REV", false, rev, fileLen);
+    TEST_ASSERT_EQUAL(3, rev.size());
+
+    // Interpolated throughout - the first point only sets the start so the reversed moves end
+    // (within a step, as fixed step angles don't reach the end of a line exactly) at the point
+    // the file starts from
+    writeFile(fileManager, "interp.thr", "# header\n0 0.5\n6 1\n12 0.25\n");
+    writeFile(fileManager, "start.thr", "#Sandify\n0 0.5\n");
+    std::vector<PlayedPoint> start;
+    playFile(fileManager, "start.thr", false, start, fileLen);
+    TEST_ASSERT_EQUAL(1, start.size());
+    for (int prefetch = 0; prefetch < 2; prefetch++)
+    {
+        playFile(fileManager, "interp.thr REV", prefetch, rev, fileLen);
+        TEST_ASSERT_GREATER_THAN(3, rev.size());
+        const PlayedPoint& last = rev[rev.size() - 1];
+        const PlayedPoint& prev = rev[rev.size() - 2];
+        double stepLen = hypot(last._x - prev._x, last._y - prev._y);
+        TEST_ASSERT_LESS_OR_EQUAL(stepLen * 1.01, hypot(last._x - start[0]._x, last._y - start[0]._y));
+    }
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_file_name_options);
+    RUN_TEST(test_reverse_points);
+    RUN_TEST(test_reverse_interpolation);
+    return UNITY_END();
+}
@@ -0,0 +1,203 @@
+// RBotFirmware
+// Rob Dobson 2016-2018
+
+// Transit planner - every candidate (straight, rho-first, theta-first and spiral) for a set of
+// transits is run through the dry-run motion helper (block splitting, kinematics, planner and
+// block times from the acceleration profiles) - the chosen plan is never slower than the
+// straight line, transits from the centre to another angle are faster than the straight line
+// and the estimates are reported against the dry-run times
+
+#include <Arduino.h>
+#include <unity.h>
+#include <stdio.h>
+#include <random>
+#include <vector>
+#include "RdJson.h"
+#include "RobotConfigurations.h"
+#include "RobotMotion/RobotController.h"
+#include "WorkManager/TransitPlanner.h"
+#include "MoveCmd.h"
+
+typedef TransitPlanner::Plan Plan;
+
+// Dry-run motion helper and the planner limits from its robot attributes (as the theta-rho
+// evaluator sets them)
+struct TransitRig
+{
+    MotionHelper* _pHelper;
+    TransitPlanner _planner;
+    float _centreX;
+    float _centreY;
+    float _bedRadiusMM;
+
+    TransitRig(const char* pRobotType)
+    {
+        String robotConfigStr = RdJson::getString("robotConfig", "", RobotConfigurations::getConfig(pRobotType));
+        _pHelper = RobotController::createDryRunMotionHelper(robotConfigStr.c_str());
+        TEST_ASSERT_NOT_NULL(_pHelper);
+        String robotAttributes;
+        _pHelper->getRobotAttributes(robotAttributes);
+        const char* pAttrs = robotAttributes.c_str();
+        double sizeX = RdJson::getDouble("sizeX", 0, pAttrs);
+        double sizeY = RdJson::getDouble("sizeY", 0, pAttrs);
+        _bedRadiusMM = float(std::min(sizeX, sizeY) / 2);
+        _centreX = float(sizeX / 2 - RdJson::getDouble("originX", 0, pAttrs));
+        _centreY = float(sizeY / 2 - RdJson::getDouble("originY", 0, pAttrs));
+        TransitPlanner::Limits limits;
+        limits._bedRadiusMM = _bedRadiusMM;
+        limits._maxSpeedMMps = float(RdJson::getDouble("maxSpeedMMps", 0, pAttrs));
+        limits._maxAccMMps2 = float(RdJson::getDouble("maxAccMMps2", 0, pAttrs));
+        limits._thetaMaxDegps = float(RdJson::getDouble("thetaMaxDegps", 0, pAttrs));
+        limits._rhoMaxMMps = float(RdJson::getDouble("rhoMaxMMps", 0, pAttrs));
+        limits._rhoMMPerDegTheta = float(RdJson::getDouble("rhoMMPerDegTheta", 0, pAttrs));
+        TEST_ASSERT_TRUE(_planner.setLimits(limits, 0));
+    }
+    ~TransitRig()
+    {
+        delete _pHelper;
+    }
+
+    // Move (mm from the centre) - returns the time of blocks completed
+    float moveTo(float x, float y, bool direct)
+    {
+        float durationS = 0;
+        while (!_pHelper->canAccept())
+            durationS += _pHelper->dryRunService(false);
+        MoveCmd moveCmd;
+        moveCmd.clear();
+        moveCmd.setAxisValMM(0, x + _centreX);
+        moveCmd.setAxisValMM(1, y + _centreY);
+        moveCmd.setFlag(MoveCmd::FLAG_DONT_SPLIT, direct);
+        TEST_ASSERT_TRUE(_pHelper->moveTo(moveCmd));
+        return durationS;
+    }
+
+    float finish()
+    {
+        float durationS = 0;
+        for (int serviceIdx = 0; (serviceIdx < 100000) && !(_pHelper->canAccept() && _pHelper->isIdle()); serviceIdx++)
+            durationS += _pHelper->dryRunService(true);
+        TEST_ASSERT_TRUE(_pHelper->isIdle());
+        return durationS;
+    }
+
+    // Put the ball at a point (theta is kept at the centre so the centre is reached from an angle)
+    void startAt(float x, float y, float theta)
+    {
+        if (TransitPlanner::isNearCentre(x, y))
+            moveTo(_bedRadiusMM * 0.5f * cosf(theta), _bedRadiusMM * 0.5f * sinf(theta), false);
+        moveTo(x, y, false);
+        finish();
+    }
+
+    // Time to run a plan from a point
+    float runPlan(float fromX, float fromY, float fromTheta, const Plan& plan)
+    {
+        startAt(fromX, fromY, fromTheta);
+        float durationS = 0;
+        for (int wpIdx = 0; wpIdx < plan._numWaypoints; wpIdx++)
+            durationS += moveTo(plan._waypoints[wpIdx]._x, plan._waypoints[wpIdx]._y, plan._waypoints[wpIdx]._direct);
+        return durationS + finish();
+    }
+};
+
+struct Transit
+{
+    float _fromX;
+    float _fromY;
+    float _fromTheta;
+    float _toX;
+    float _toY;
+};
+
+// Edge to edge, edge to centre and centre to edge at several angles plus random transits
+static void makeTransits(float radiusMM, std::vector<Transit>& transits)
+{
+    float edge = radiusMM * 0.95f;
+    for (float angle : {0.3f, 1.2f, 2.0f, 3.0f})
+    {
+        transits.push_back({edge, 0, 0, edge * cosf(angle), edge * sinf(angle)});
+        transits.push_back({edge * 0.5f, 0, 0, edge * cosf(angle), edge * sinf(angle)});
+        transits.push_back({edge * cosf(angle), edge * sinf(angle), 0, 0, 0});
+        transits.push_back({0, 0, 0, edge * cosf(angle), edge * sinf(angle)});
+    }
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> unit(0, 1);
+    for (int idx = 0; idx < 12; idx++)
+    {
+        float fromAngle = unit(rng) * 2 * float(M_PI), fromRho = unit(rng) * edge;
+        float toAngle = unit(rng) * 2 * float(M_PI), toRho = unit(rng) * edge;
+        transits.push_back({fromRho * cosf(fromAngle), fromRho * sinf(fromAngle), fromAngle, toRho * cosf(toAngle),
+                            toRho * sinf(toAngle)});
+    }
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+// The chosen plan (run through the dry-run planner) is never slower than the straight line and
+// transits from the centre to another angle are faster - reports the estimate error
+void test_chosen_plan_not_slower(void)
+{
+    for (const char* pRobotType : {"TranquilSmall", "TranquilLarge"})
+    {
+        TransitRig rig(pRobotType);
+        std::vector<Transit> transits;
+        makeTransits(rig._bedRadiusMM, transits);
+        double errSum = 0, errMax = 0, straightSum = 0, chosenSum = 0;
+        int numRuns = 0, numNotStraight = 0;
+        for (const Transit& transit : transits)
+        {
+            Plan straight, chosen;
+            rig._planner.buildPlan(TransitPlanner::TRANSIT_STRAIGHT, transit._fromX, transit._fromY, transit._fromTheta,
+                                   transit._toX, transit._toY, straight);
+            float straightS = rig.runPlan(transit._fromX, transit._fromY, transit._fromTheta, straight);
+            rig._planner.plan(transit._fromX, transit._fromY, transit._fromTheta, transit._toX, transit._toY, chosen);
+            float chosenS = rig.runPlan(transit._fromX, transit._fromY, transit._fromTheta, chosen);
+            char msg[200];
+            snprintf(msg, sizeof(msg), "%s (%.0f,%.0f)->(%.0f,%.0f) %s %.2fs straight %.2fs", pRobotType, transit._fromX,
+                     transit._fromY, transit._toX, transit._toY, TransitPlanner::getTypeName(chosen._type), chosenS,
+                     straightS);
+            TEST_ASSERT_LESS_OR_EQUAL_MESSAGE(straightS * 1.01f + 0.01f, chosenS, msg);
+            if (TransitPlanner::isNearCentre(transit._fromX, transit._fromY) &&
+                        (fabsf(atan2f(transit._toY, transit._toX) - transit._fromTheta) > 1))
+                TEST_ASSERT_LESS_THAN_MESSAGE(straightS * 0.9f, chosenS, msg);
+            straightSum += straightS;
+            chosenSum += chosenS;
+            numNotStraight += chosen._type != TransitPlanner::TRANSIT_STRAIGHT;
+
+            // Estimates of every candidate
+            for (int typeIdx = 0; typeIdx < TransitPlanner::TRANSIT_NUM_TYPES; typeIdx++)
+            {
+                Plan candidate;
+                rig._planner.buildPlan(TransitPlanner::TransitType(typeIdx), transit._fromX, transit._fromY,
+                                       transit._fromTheta, transit._toX, transit._toY, candidate);
+                float candidateS = rig.runPlan(transit._fromX, transit._fromY, transit._fromTheta, candidate);
+                if (candidateS < 0.05f)
+                    continue;
+                double err = fabs(candidate._timeS - candidateS) / candidateS;
+                errSum += err;
+                errMax = std::max(errMax, err);
+                numRuns++;
+            }
+        }
+        char msg[200];
+        snprintf(msg, sizeof(msg), "%s %d transits (%d not straight) %.1fs -> %.1fs, estimate error mean %.1f%% max %.1f%%",
+                 pRobotType, int(transits.size()), numNotStraight, straightSum, chosenSum, errSum / numRuns * 100,
+                 errMax * 100);
+        TEST_MESSAGE(msg);
+        TEST_ASSERT_LESS_THAN(straightSum, chosenSum);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_chosen_plan_not_slower);
+    return UNITY_END();
+}
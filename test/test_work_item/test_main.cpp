@@ -0,0 +1,158 @@
+// RBotFirmware
+// Rob Dobson 2016-2018
+
+// WorkItem - strings up to INLINE_STR_MAXLEN are held in the item (no new[]), longer strings
+// reuse the item's heap string once it is long enough, types from the string (including bytes
+// above 0x7f) and items per second and new[] allocations per 10k items set directly and through
+// the work item queue
+
+#include <Arduino.h>
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <new>
+#include "WorkManager/WorkItemQueue.h"
+
+// Allocations made with new[] (work item heap strings)
+static int numArrayAllocs = 0;
+
+void* operator new(size_t size)
+{
+    void* pMem = malloc(size ? size : 1);
+    if (!pMem)
+        throw std::bad_alloc();
+    return pMem;
+}
+void* operator new[](size_t size)
+{
+    numArrayAllocs++;
+    return operator new(size);
+}
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+void operator delete[](void* p) noexcept
+{
+    free(p);
+}
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+void operator delete[](void* p, size_t) noexcept
+{
+    free(p);
+}
+
+static const int NUM_ITEMS = 10000;
+
+struct SetBench
+{
+    const char* _name;
+    const char* _strs[2];
+};
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_types(void)
+{
+    TEST_ASSERT_EQUAL(WorkItem::TYPE_GCODE, WorkItem::getTypeFromStr("  g1 X1"));
+    TEST_ASSERT_EQUAL(WorkItem::TYPE_GCODE, WorkItem::getTypeFromStr("M17"));
+    TEST_ASSERT_EQUAL(WorkItem::TYPE_POLAR_MOVE, WorkItem::getTypeFromStr("\t_THRLINE0/1"));
+    TEST_ASSERT_EQUAL(WorkItem::TYPE_UNKNOWN, WorkItem::getTypeFromStr("Gx"));
+    TEST_ASSERT_EQUAL(WorkItem::TYPE_UNKNOWN, WorkItem::getTypeFromStr("pattern.thr"));
+
+    // Bytes above 0x7f (e.g. UTF-8 file names) are not whitespace, letters or digits
+    TEST_ASSERT_EQUAL(WorkItem::TYPE_UNKNOWN, WorkItem::getTypeFromStr("\xc3\xa9t\xc3\xa9.thr"));
+    TEST_ASSERT_EQUAL(WorkItem::TYPE_UNKNOWN, WorkItem::getTypeFromStr("G\xd9"));
+    TEST_ASSERT_EQUAL(WorkItem::TYPE_UNKNOWN, WorkItem::getTypeFromStr("\xa0G1"));
+    WorkItem workItem("\xa0 G1 X1");
+    TEST_ASSERT_FALSE(workItem.startsWith("G1"));
+    workItem.set(" G1 X1", 6);
+    TEST_ASSERT_TRUE(workItem.startsWith("G1"));
+}
+
+// Items per second and new[] per 10k items set in place - inline strings never allocate and
+// long strings only allocate when longer than any set before (or after an inline string, which
+// frees the heap string so items held in the queue don't keep it)
+void test_set_benchmark(void)
+{
+    String longStr, longerStr;
+    while (longStr.length() <= WorkItem::INLINE_STR_MAXLEN)
+        longStr += "G1 X1 Y1;";
+    longerStr = longStr + "G1 X2 Y2";
+    SetBench benches[] = {
+        {"inline", {"G1 X10.5 Y-3.25 F3000", "_THRLINE0/1.2345/0.5"}},
+        {"long", {longStr.c_str(), longStr.c_str()}},
+        {"long and longer", {longStr.c_str(), longerStr.c_str()}},
+        {"long and inline", {longStr.c_str(), "G1 X1"}},
+    };
+    unsigned int strLens[2];
+    int allocs[4];
+    for (int benchIdx = 0; benchIdx < 4; benchIdx++)
+    {
+        SetBench& bench = benches[benchIdx];
+        for (int strIdx = 0; strIdx < 2; strIdx++)
+            strLens[strIdx] = strlen(bench._strs[strIdx]);
+        WorkItem workItem;
+        int allocsAtStart = numArrayAllocs;
+        auto startTime = std::chrono::steady_clock::now();
+        for (int itemIdx = 0; itemIdx < NUM_ITEMS; itemIdx++)
+            workItem.set(bench._strs[itemIdx & 1], strLens[itemIdx & 1]);
+        double elapsedS = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+        allocs[benchIdx] = numArrayAllocs - allocsAtStart;
+        TEST_ASSERT_EQUAL_STRING(bench._strs[(NUM_ITEMS - 1) & 1], workItem.getCString());
+        char msg[120];
+        snprintf(msg, sizeof(msg), "set %-16s %6.1fM items/s, %5d new[] per %d items", bench._name,
+                 NUM_ITEMS / elapsedS / 1e6, allocs[benchIdx], NUM_ITEMS);
+        TEST_MESSAGE(msg);
+    }
+    TEST_ASSERT_EQUAL(0, allocs[0]);
+    TEST_ASSERT_EQUAL(1, allocs[1]);
+    TEST_ASSERT_EQUAL(2, allocs[2]);
+    TEST_ASSERT_EQUAL(NUM_ITEMS / 2, allocs[3]);
+}
+
+// Items added to and got from the work item queue (set in place and moved out)
+void test_queue_benchmark(void)
+{
+    WorkItemQueue queue;
+    const char* pCmdStr = "_THRLINE0/1.2345/0.5";
+    unsigned int cmdLen = strlen(pCmdStr);
+    WorkItem workItem;
+    int allocsAtStart = numArrayAllocs;
+    auto startTime = std::chrono::steady_clock::now();
+    for (int itemIdx = 0; itemIdx < NUM_ITEMS; itemIdx++)
+    {
+        TEST_ASSERT_NOT_NULL(queue.add(pCmdStr, cmdLen));
+        if (queue.size() > 10)
+            TEST_ASSERT_TRUE(queue.get(workItem));
+    }
+    while (queue.get(workItem))
+        ;
+    double elapsedS = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    int allocs = numArrayAllocs - allocsAtStart;
+    char msg[120];
+    snprintf(msg, sizeof(msg), "queue add/get %6.1fM items/s, %d new[] per %d items", NUM_ITEMS / elapsedS / 1e6, allocs,
+             NUM_ITEMS);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_EQUAL(0, allocs);
+    TEST_ASSERT_EQUAL(WorkItem::TYPE_POLAR_MOVE, workItem.getType());
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_types);
+    RUN_TEST(test_set_benchmark);
+    RUN_TEST(test_queue_benchmark);
+    return UNITY_END();
+}
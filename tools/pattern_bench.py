@@ -0,0 +1,137 @@
+#!/usr/bin/env python3
+# RBotFirmware
+# Pattern corpus benchmark - plays each pattern on a table and records the per-pattern motion
+# and planner stats from the status JSON (motionStats and plannerStats) as JSON lines so that
+# planner changes and settings (pipelineLen, blockDistanceMM, junctionDeviation) can be compared
+#
+#   python3 tools/pattern_bench.py run <table-ip> <patterns...> -o before.jsonl --label before
+#   python3 tools/pattern_bench.py compare before.jsonl after.jsonl
+#
+# Host results from the replay benchmark (test/test_pattern_bench) are in the same format and
+# have replayUs (replay time per block) and peakHeap in place of the table-only stats
+
+import argparse
+import json
+import os
+import sys
+import time
+import urllib.parse
+import urllib.request
+
+POLL_INTERVAL_S = 1.0
+# Pattern files are on the table's SD card
+PATTERN_EXTENSIONS = (".thr", ".gcode")
+
+
+def get_json(host, path):
+    with urllib.request.urlopen("http://%s/%s" % (host, path), timeout=10) as resp:
+        return json.loads(resp.read().decode("utf-8"))
+
+
+def is_busy(status):
+    return ("file" in status) or ("playlist" in status) or status.get("Qd", 0) > 0
+
+
+def run_pattern(host, name, timeout_s):
+    # Wait for any previous motion to finish
+    while is_busy(get_json(host, "status")):
+        time.sleep(POLL_INTERVAL_S)
+    # The playFile endpoint takes ~ in place of /
+    get_json(host, "playFile/" + urllib.parse.quote(name.replace("/", "~")))
+    start = time.time()
+    started = False
+    status = {}
+    while time.time() - start < timeout_s:
+        time.sleep(POLL_INTERVAL_S)
+        status = get_json(host, "status")
+        if is_busy(status):
+            started = True
+        elif started or time.time() - start > 5:
+            break
+    return {
+        "pattern": name,
+        "wallS": round(time.time() - start, 1),
+        "motion": status.get("motionStats", {}),
+        "planner": status.get("plannerStats", {}),
+    }
+
+
+def expand_patterns(patterns):
+    # Local directories are expanded to the pattern files they contain (names as on the table)
+    names = []
+    for pattern in patterns:
+        if os.path.isdir(pattern):
+            names += sorted(f for f in os.listdir(pattern) if f.lower().endswith(PATTERN_EXTENSIONS))
+        else:
+            names.append(pattern)
+    return names
+
+
+def cmd_run(args):
+    robot_type = get_json(args.host, "settings/robot").get("robotType", "")
+    with open(args.out, "a") as f:
+        for name in expand_patterns(args.patterns):
+            result = run_pattern(args.host, name, args.timeout)
+            result["label"] = args.label
+            result["robotType"] = robot_type
+            f.write(json.dumps(result) + "\n")
+            f.flush()
+            motion = result["motion"]
+            planner = result["planner"]
+            print("%-30s blocks %6s plan %6sus (max %s) draw %6.1fs speed %s/%s mm/s underruns %s minHeap %s" %
+                  (name, planner.get("blocks"), planner.get("avgUs"), planner.get("maxUs"),
+                   motion.get("distMM", 0) / motion["achievedMMps"] if motion.get("achievedMMps") else 0,
+                   motion.get("achievedMMps"), motion.get("plannedMMps"), motion.get("underruns"),
+                   planner.get("minFreeHeap")))
+    return 0
+
+
+def load_results(file_name):
+    results = {}
+    with open(file_name) as f:
+        for line in f:
+            if line.strip():
+                rec = json.loads(line)
+                # Host runs have results for several robot types
+                name = rec["pattern"]
+                if rec.get("robotType"):
+                    name += " " + rec["robotType"]
+                results[name] = rec
+    return results
+
+
+def cmd_compare(args):
+    base = load_results(args.base)
+    other = load_results(args.other)
+    fields = (("planner", "avgUs"), ("planner", "blocks"), ("motion", "achievedMMps"),
+              ("motion", "belowNominalMs"), ("motion", "underruns"), ("planner", "minFreeHeap"),
+              ("planner", "replayUs"), ("planner", "peakHeap"))
+    print("%-40s " % "pattern" + " ".join("%22s" % f[1] for f in fields))
+    for name in sorted(set(base) & set(other)):
+        cols = []
+        for group, field in fields:
+            a = base[name].get(group, {}).get(field)
+            b = other[name].get(group, {}).get(field)
+            cols.append("%22s" % ("%s -> %s" % (a, b)))
+        print("%-40s " % name + " ".join(cols))
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description="RBotFirmware pattern corpus benchmark")
+    sub = parser.add_subparsers(dest="cmd", required=True)
+    run = sub.add_parser("run", help="play patterns and record stats")
+    run.add_argument("host", help="table IP address")
+    run.add_argument("patterns", nargs="+", help="pattern file names on the table or local directories")
+    run.add_argument("-o", "--out", default="bench.jsonl", help="results file (JSON lines, appended)")
+    run.add_argument("--label", default="", help="label for this run (e.g. settings under test)")
+    run.add_argument("--timeout", type=float, default=3600, help="max seconds per pattern")
+    compare = sub.add_parser("compare", help="compare two results files")
+    compare.add_argument("base")
+    compare.add_argument("other")
+    args = parser.parse_args()
+    return cmd_run(args) if args.cmd == "run" else cmd_compare(args)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,108 @@
+#!/usr/bin/env python3
+# RBotFirmware
+# Plot the motion planner's velocity lookahead from a pipeline snapshot (/motion/pipeline)
+# Shows the entry, exit and max-entry (junction) speeds and feedrate of each block against
+# distance so that junctionDeviation, pipelineLen and blockDistanceMM can be tuned
+
+import argparse
+import json
+import sys
+import urllib.request
+
+
+def load_snapshot(source):
+    if source.startswith("http://") or source.startswith("https://"):
+        with urllib.request.urlopen(source, timeout=10) as resp:
+            data = json.loads(resp.read().decode("utf-8"))
+    elif "/" not in source and not source.endswith(".json"):
+        with urllib.request.urlopen("http://%s/motion/pipeline" % source, timeout=10) as resp:
+            data = json.loads(resp.read().decode("utf-8"))
+    else:
+        with open(source) as f:
+            data = json.load(f)
+    # The REST response wraps the snapshot
+    return data.get("pipeline", data)
+
+
+def block_dicts(snapshot):
+    fields = snapshot["fields"]
+    return [dict(zip(fields, vals)) for vals in snapshot["blocks"]]
+
+
+def step_rate_to_mmps(snapshot, rate, step_dist_mm):
+    return rate * snapshot["ticksPerSec"] / snapshot["tticks"] * step_dist_mm
+
+
+def summarise(snapshot, blocks):
+    print("pipelineLen %d blockDistMM %.3f jnDev %.4f - %d blocks" %
+          (snapshot["pipelineLen"], snapshot["blockDistMM"], snapshot["jnDev"], len(blocks)))
+    print("%3s %9s %9s %9s %9s %8s %9s %5s" %
+          ("idx", "entry", "exit", "maxEntry", "feedrate", "distMM", "cruise", "flags"))
+    for idx, blk in enumerate(blocks):
+        cruise = step_rate_to_mmps(snapshot, blk["maxRate"], blk["stepDistMM"])
+        print("%3d %9.2f %9.2f %9.2f %9.2f %8.3f %9.2f %5d" %
+              (idx, blk["entry"], blk["exit"], blk["maxEntry"], blk["feedrate"],
+               blk["distMM"], cruise, blk["flags"]))
+
+
+def plot(snapshot, blocks, out_file):
+    try:
+        import matplotlib
+    except ImportError:
+        print("matplotlib is needed for plotting (pip install matplotlib)")
+        return
+    if out_file:
+        matplotlib.use("Agg")
+    import matplotlib.pyplot as plt
+    dist = 0
+    xs, entry, exit_, max_entry, feed, cruise = [], [], [], [], [], []
+    for blk in blocks:
+        xs.append(dist)
+        entry.append(blk["entry"])
+        max_entry.append(blk["maxEntry"])
+        feed.append(blk["feedrate"])
+        cruise.append(step_rate_to_mmps(snapshot, blk["maxRate"], blk["stepDistMM"]))
+        dist += blk["distMM"]
+        exit_.append(blk["exit"])
+    ends = xs[1:] + [dist]
+    fig, ax = plt.subplots(figsize=(12, 5))
+    # Speed profile through each block (entry -> exit)
+    for x0, x1, v0, v1 in zip(xs, ends, entry, exit_):
+        ax.plot([x0, x1], [v0, v1], color="tab:blue")
+    ax.step(xs, cruise, where="post", color="tab:green", label="cruise")
+    ax.step(xs, feed, where="post", color="tab:gray", linestyle="--", label="feedrate")
+    ax.plot(xs, max_entry, "o", color="tab:red", markersize=3, label="max entry (junction)")
+    ax.plot([], [], color="tab:blue", label="entry to exit")
+    ax.set_xlabel("distance along pipeline (mm)")
+    ax.set_ylabel("speed (mm/s)")
+    ax.set_title("pipelineLen %d blockDistMM %.3f jnDev %.4f" %
+                 (snapshot["pipelineLen"], snapshot["blockDistMM"], snapshot["jnDev"]))
+    ax.legend()
+    ax.grid(True)
+    if out_file:
+        fig.savefig(out_file, dpi=100)
+        print("written to %s" % out_file)
+    else:
+        plt.show()
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Plot RBotFirmware motion pipeline lookahead")
+    parser.add_argument("source", help="table IP address, snapshot URL or saved JSON file")
+    parser.add_argument("-o", "--out", help="save the plot to a file instead of showing it")
+    parser.add_argument("-s", "--save", help="save the snapshot JSON to a file")
+    parser.add_argument("--no-plot", action="store_true", help="only print the block table")
+    args = parser.parse_args()
+    snapshot = load_snapshot(args.source)
+    if args.save:
+        with open(args.save, "w") as f:
+            json.dump(snapshot, f)
+    blocks = block_dicts(snapshot)
+    summarise(snapshot, blocks)
+    if blocks and not args.no_plot:
+        plot(snapshot, blocks, args.out)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
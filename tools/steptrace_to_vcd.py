@@ -0,0 +1,119 @@
+#!/usr/bin/env python3
+# RBotFirmware
+# Convert a step trace recorded by the firmware (steptrace_start / steptrace_stop commands)
+# to a VCD file for viewing in a waveform viewer (e.g. GTKWave) and print a per-axis summary
+# of step rate, timing jitter and acceleration
+
+import argparse
+import math
+import struct
+import sys
+
+FILE_MAGIC = 0x54534252
+HEADER_FMT = "<IHHIB3x"
+RECORD_FMT = "<IHHBB2x"
+# Width of the step pulse shown in the VCD (the firmware pulse ends on the next ISR tick)
+STEP_PULSE_NS = 20000
+
+
+def read_trace(file_name):
+    with open(file_name, "rb") as f:
+        data = f.read()
+    header_size = struct.calcsize(HEADER_FMT)
+    magic, version, record_size, cycle_hz, num_axes = struct.unpack_from(HEADER_FMT, data, 0)
+    if magic != FILE_MAGIC:
+        raise ValueError("not a step trace file")
+    if record_size != struct.calcsize(RECORD_FMT):
+        raise ValueError("unsupported record size %d (version %d)" % (record_size, version))
+    records = []
+    for pos in range(header_size, len(data) - record_size + 1, record_size):
+        cycles, wraps, block_idx, step_bits, dirn_bits = struct.unpack_from(RECORD_FMT, data, pos)
+        time_ns = ((wraps << 32) + cycles) * 1e9 / cycle_hz
+        records.append((time_ns, block_idx, step_bits, dirn_bits))
+    return cycle_hz, num_axes, records
+
+
+def write_vcd(file_name, num_axes, records):
+    ids = {}
+    with open(file_name, "w") as f:
+        f.write("$timescale 1ns $end\n$scope module rbot $end\n")
+        code = 33
+        for axis_idx in range(num_axes):
+            for sig in ("step", "dirn"):
+                ids[(sig, axis_idx)] = chr(code)
+                f.write("$var wire 1 %s %s%d $end\n" % (chr(code), sig, axis_idx))
+                code += 1
+        ids["block"] = chr(code)
+        f.write("$var integer 16 %s block $end\n" % chr(code))
+        f.write("$upscope $end\n$enddefinitions $end\n")
+        if not records:
+            return
+        t0 = records[0][0]
+        # Events are (time, text) and step pulses fall after the pulse width
+        events = []
+        last_dirn = None
+        last_block = None
+        for time_ns, block_idx, step_bits, dirn_bits in records:
+            t = int(time_ns - t0)
+            if block_idx != last_block:
+                events.append((t, "b{0:b} {1}".format(block_idx, ids["block"])))
+                last_block = block_idx
+            for axis_idx in range(num_axes):
+                dirn = (dirn_bits >> axis_idx) & 1
+                if last_dirn is None or ((last_dirn >> axis_idx) & 1) != dirn:
+                    events.append((t, "%d%s" % (dirn, ids[("dirn", axis_idx)])))
+                if (step_bits >> axis_idx) & 1:
+                    events.append((t, "1" + ids[("step", axis_idx)]))
+                    events.append((t + STEP_PULSE_NS, "0" + ids[("step", axis_idx)]))
+            last_dirn = dirn_bits
+        events.sort(key=lambda e: e[0])
+        cur_time = None
+        for t, text in events:
+            if t != cur_time:
+                f.write("#%d\n" % t)
+                cur_time = t
+            f.write(text + "\n")
+
+
+def summarise(num_axes, records):
+    for axis_idx in range(num_axes):
+        times = [r[0] for r in records if (r[2] >> axis_idx) & 1]
+        print("Axis %d: %d steps" % (axis_idx, len(times)))
+        if len(times) < 3:
+            continue
+        intervals = [b - a for a, b in zip(times, times[1:])]
+        # Ignore pauses between moves when looking at rates
+        moving = [iv for iv in intervals if iv < 100e6]
+        rates = [1e9 / iv for iv in moving if iv > 0]
+        # Jitter is the change between successive intervals (acceleration changes these slowly)
+        deltas = [b - a for a, b in zip(moving, moving[1:])]
+        jitter_rms = math.sqrt(sum(d * d for d in deltas) / len(deltas)) if deltas else 0
+        # Acceleration from successive step rates
+        accels = []
+        for i in range(1, len(moving)):
+            dt = (moving[i] + moving[i - 1]) / 2e9
+            if dt > 0:
+                accels.append((1e9 / moving[i] - 1e9 / moving[i - 1]) / dt)
+        print("  step rate min %.1f max %.1f mean %.1f steps/s" %
+              (min(rates), max(rates), sum(rates) / len(rates)))
+        print("  interval jitter rms %.0fns max %.0fns" %
+              (jitter_rms, max(abs(d) for d in deltas) if deltas else 0))
+        if accels:
+            print("  acceleration max %.0f min %.0f steps/s^2" % (max(accels), min(accels)))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Convert RBotFirmware step trace to VCD")
+    parser.add_argument("trace", help="binary trace file (steptrace.bin)")
+    parser.add_argument("-o", "--out", help="VCD output file (default trace name with .vcd)")
+    args = parser.parse_args()
+    cycle_hz, num_axes, records = read_trace(args.trace)
+    out_name = args.out or (args.trace.rsplit(".", 1)[0] + ".vcd")
+    write_vcd(out_name, num_axes, records)
+    print("%d records at %dMHz written to %s" % (len(records), cycle_hz // 1000000, out_name))
+    summarise(num_axes, records)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())